@@ -0,0 +1,143 @@
+#pragma once
+#include "Config.hpp"
+#include "collision.hpp"
+#include "bsp.hpp"
+#include "polygonmesh.hpp"
+#include <chrono>
+
+// Utilitários partilhados pelos benchmarks (correr a partir de bin/)
+
+#define BENCH_MAP "maps/oa_rpg3dm2.bsp"
+
+// Mapas dos benchmarks que correm em vários (sem mapas na linha de comandos)
+static const char* BENCH_MAPS[] = {
+    "maps/20kdm2.bsp", "maps/Level.bsp", "maps/bubtny2.bsp",
+    "maps/egyptians.bsp", "maps/oa_rpg3dm2.bsp", "maps/tutorial.bsp"
+};
+
+// Mapas da linha de comandos ou, sem nenhum, BENCH_MAPS
+inline s32 BenchMapCount(int argc)
+{
+    return argc > 1 ? argc - 1 : (s32)(sizeof(BENCH_MAPS) / sizeof(BENCH_MAPS[0]));
+}
+
+inline const char* BenchMapName(int argc, char** argv, s32 index)
+{
+    return argc > 1 ? argv[index + 1] : BENCH_MAPS[index];
+}
+
+// O BSP carrega texturas e meshes para a GPU: precisa de contexto GL,
+// por isso abre-se uma janela escondida
+inline void BenchInit(const char* title)
+{
+    SetTraceLogLevel(LOG_WARNING);
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    InitWindow(64, 64, title);
+}
+
+inline void BenchShutdown()
+{
+    CloseWindow();
+}
+
+// Triângulos das superfícies e dos brushes de clip do mapa, com as camadas
+// de colisão da textura, num Selector ou numa PolygonMesh (addTriangle(a, b, c, layers))
+template <typename Target>
+inline void BenchAddSurfaces(const BSP& map, Target& target)
+{
+    for (const std::vector<BSPSurface>* surfaces : { &map.getSurfaces(), &map.getClipSurfaces() })
+    {
+        for (const BSPSurface& surface : *surfaces)
+        {
+            const std::vector<Vector3>& verts = surface.vertices;
+            const std::vector<u16>& indices = surface.indices;
+            u32 layers = map.getCollisionLayers(surface.textureID);
+
+            for (size_t i = 0; i + 2 < indices.size(); i += 3)
+            {
+                target.addTriangle(verts[indices[i + 0]], verts[indices[i + 1]],
+                                   verts[indices[i + 2]], layers);
+            }
+        }
+    }
+}
+
+// Triângulos das superfícies do mapa numa PolygonMesh já construída
+inline void BenchBuildPolygons(const BSP& map, PolygonMesh& mesh)
+{
+    BenchAddSurfaces(map, mesh);
+    mesh.build();
+}
+
+// Mesmo processo que MainScreen: os triângulos das superfícies passam pela
+// PolygonMesh e vão para a octree.
+// graphics = false carrega só a geometria e dispensa BenchInit (sem janela).
+inline bool BenchLoadWorld(BSP& map, Octree& tree, const char* fileName = BENCH_MAP,
+                           bool graphics = true)
+{
+    if (!map.loadFromFile(fileName, graphics))
+    {
+        LogError("Não foi possível carregar %s", fileName);
+        return false;
+    }
+
+    tree.setWorldBounds(map.getBounds());
+
+    PolygonMesh mesh;
+    BenchBuildPolygons(map, mesh);
+    mesh.addTo(tree);
+
+    tree.rebuild();
+    return true;
+}
+
+inline double BenchNow()
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Gerador fixo para os resultados serem repetíveis entre corridas
+inline float BenchRandom(u32& state)
+{
+    state = state * 1664525u + 1013904223u;
+    return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+inline Vector3 BenchRandomPoint(const BoundingBox& box, u32& state)
+{
+    return { box.min.x + (box.max.x - box.min.x) * BenchRandom(state),
+             box.min.y + (box.max.y - box.min.y) * BenchRandom(state),
+             box.min.z + (box.max.z - box.min.z) * BenchRandom(state) };
+}
+
+inline Vector3 BenchRandomDirection(u32& state)
+{
+    Vector3 dir;
+    do
+    {
+        dir = { BenchRandom(state) * 2.0f - 1.0f, BenchRandom(state) * 2.0f - 1.0f,
+                BenchRandom(state) * 2.0f - 1.0f };
+    } while (Vector3LengthSqr(dir) < 0.01f || Vector3LengthSqr(dir) > 1.0f);
+    return Vector3Normalize(dir);
+}
+
+// Média por frame dos contadores de colisão desde ResetCollisionStats
+// (só com -DCOLLISION_STATS=ON; sem a opção não escreve nada)
+inline void BenchLogCollisionStats(const char* label)
+{
+#ifdef COLLISION_STATS
+    const CollisionCounters& total = GetCollisionTotalStats();
+    double frames = GetCollisionFrameCount() > 0 ? (double)GetCollisionFrameCount() : 1.0;
+    printf("%-10s per frame: moves %.1f  slides %.1f  depth %u  queries %.1f  nodes %.1f  "
+           "candidates %.1f  dup %.1f  tests %.1f  polygons %.1f  cache %.1f/%.1f  ground %.1f/%.1f  query %.3f ms  move %.3f ms\n",
+           label, total.moves / frames, total.collideCalls / frames, total.maxRecursion,
+           total.queries / frames, total.nodesVisited / frames, total.candidates / frames,
+           total.duplicates / frames, total.triangleTests / frames, total.polygonTests / frames,
+           total.cacheHits / frames, total.cacheMisses / frames,
+           total.groundProbes / frames, total.gravitySweeps / frames,
+           total.queryTime / frames, total.moveTime / frames);
+#else
+    (void)label;
+#endif
+}
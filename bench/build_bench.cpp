@@ -0,0 +1,89 @@
+#include "bench.hpp"
+#include "threadpool.hpp"
+
+// Construção da octree em cada mapa: rebuild() numa thread contra
+// rebuild(&pool) com 2, 4 e todas as threads. As árvores têm de dar as
+// mesmas queries (mesmos triângulos, pela mesma ordem).
+
+static const s32 RUNS = 5;
+static const s32 QUERY_COUNT = 2000;
+
+// Melhor de RUNS (a máquina pode estar ocupada)
+static double TimeBuild(Octree& tree, ThreadPool* pool)
+{
+    double best = 1e30;
+    for (s32 run = 0; run < RUNS; run++)
+    {
+        double start = BenchNow();
+        tree.rebuild(pool);
+        double elapsed = BenchNow() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+static s32 CountMismatches(const BSP& map, const Octree& a, const Octree& b)
+{
+    u32 seed = 1234;
+    s32 mismatches = 0;
+    for (s32 i = 0; i < QUERY_COUNT; i++)
+    {
+        Vector3 center = BenchRandomPoint(map.getBounds(), seed);
+        float size = 1.0f + BenchRandom(seed) * 8.0f;
+        BoundingBox area = { Vector3Subtract(center, { size, size, size }), Vector3Add(center, { size, size, size }) };
+
+        std::vector<const Triangle*> x = a.getCandidates(area);
+        std::vector<const Triangle*> y = b.getCandidates(area);
+        bool same = x.size() == y.size();
+        for (size_t k = 0; same && k < x.size(); k++)
+        {
+            same = x[k]->id == y[k]->id;
+        }
+        if (!same) mismatches++;
+    }
+    return mismatches;
+}
+
+int main(int argc, char** argv)
+{
+    BenchInit("build_bench");
+
+    u32 hardware = std::thread::hardware_concurrency();
+    u32 counts[] = { 2, 4, hardware > 0 ? hardware : 1 };
+
+    s32 mapCount = BenchMapCount(argc);
+    for (s32 m = 0; m < mapCount; m++)
+    {
+        const char* fileName = BenchMapName(argc, argv, m);
+
+        BSP map;
+        if (!map.loadFromFile(fileName))
+        {
+            LogError("Não foi possível carregar %s", fileName);
+            continue;
+        }
+
+        Octree serial;
+        serial.setWorldBounds(map.getBounds());
+        BenchAddSurfaces(map, serial);
+        double serialMs = TimeBuild(serial, nullptr);
+        printf("%-22s %6d triangles  serial     threads=1   %7.2f ms\n",
+               fileName, serial.getTriangleCount(), serialMs);
+
+        for (u32 threads : counts)
+        {
+            ThreadPool pool(threads);
+            Octree parallel;
+            parallel.setWorldBounds(map.getBounds());
+            BenchAddSurfaces(map, parallel);
+            double parallelMs = TimeBuild(parallel, &pool);
+
+            printf("%-22s %6s            pool       threads=%-2u  %7.2f ms  speedup %.2fx  mismatches %d\n",
+                   fileName, "", pool.getThreadCount(), parallelMs, serialMs / parallelMs,
+                   CountMismatches(map, serial, parallel));
+        }
+    }
+
+    BenchShutdown();
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include "bench.hpp"
+#include "characters.hpp"
+
+// Colisão entre personagens. Primeiro sem mapa: N cápsulas a andar numa
+// caixa (mesma densidade para todo o N), pares do sweep-and-prune contra o
+// teste de todos os pares (têm de ser os mesmos) e tempo de cada um. Depois
+// no mapa: bots a correr para o mesmo sítio com o Collider, separados pelo
+// CharacterSet, com as sobreposições que ficam depois do resolve.
+
+static const s32 COUNTS[] = { 64, 256, 1024, 4096 };
+static const s32 FRAME_COUNT = 200;
+static const float FRAME_TIME = 1.0f / 60.0f;
+static const float RADIUS = 1.6f;
+static const float HALF_HEIGHT = 2.8f;
+static const float SPEED = 15.0f;
+
+static bool CapsulesOverlap(const CharacterCapsule& a, const CharacterCapsule& b)
+{
+    float gap = fmaxf(0.0f, fabsf(a.position.y - b.position.y) - (a.halfHeight - a.radius) - (b.halfHeight - b.radius));
+    float dx = a.position.x - b.position.x, dz = a.position.z - b.position.z;
+    float reach = a.radius + b.radius - 0.01f;
+    return dx * dx + dz * dz + gap * gap < reach * reach;
+}
+
+static u32 CountOverlaps(const CharacterSet& set)
+{
+    u32 overlaps = 0;
+    for (u32 i = 0; i < set.getCount(); i++)
+        for (u32 j = i + 1; j < set.getCount(); j++)
+        {
+            if (CapsulesOverlap(set.getCapsule(i), set.getCapsule(j))) overlaps++;
+        }
+    return overlaps;
+}
+
+static void BruteForcePairs(const CharacterSet& set, std::vector<CharacterPair>& out)
+{
+    out.clear();
+    for (u32 i = 0; i < set.getCount(); i++)
+        for (u32 j = i + 1; j < set.getCount(); j++)
+        {
+            const CharacterCapsule& a = set.getCapsule(i);
+            const CharacterCapsule& b = set.getCapsule(j);
+            float extentA = a.radius * (1.0f + CHARACTER_PAIR_MARGIN);
+            float extentB = b.radius * (1.0f + CHARACTER_PAIR_MARGIN);
+            // Como o sweep compara as pontas (mesmo arredondamento)
+            if (b.position.x - extentB > a.position.x + extentA) continue;
+            if (a.position.x - extentA > b.position.x + extentB) continue;
+            if (fabsf(a.position.z - b.position.z) > extentA + extentB) continue;
+            if (fabsf(a.position.y - b.position.y) > a.halfHeight + b.halfHeight) continue;
+            out.push_back({ i, j });
+        }
+}
+
+static void RunOpenArea()
+{
+    for (s32 count : COUNTS)
+    {
+        // ~ 40 unidades quadradas por personagem
+        float side = sqrtf((float)count * 40.0f);
+        u32 seed = 1234;
+        CharacterSet set;
+        std::vector<Vector3> velocities(count);
+        for (s32 i = 0; i < count; i++)
+        {
+            set.add({ BenchRandom(seed) * side, 0.0f, BenchRandom(seed) * side }, RADIUS, HALF_HEIGHT);
+            float angle = BenchRandom(seed) * 2.0f * PI;
+            velocities[i] = { cosf(angle) * SPEED, 0.0f, sinf(angle) * SPEED };
+        }
+
+        std::vector<CharacterPair> sapPairs, brutePairs;
+        double sapMs = 0.0, bruteMs = 0.0, resolveMs = 0.0;
+        u64 pairs = 0, overlaps = 0, resolved = 0, swaps = 0;
+        s32 mismatches = 0;
+        for (s32 frame = 0; frame < FRAME_COUNT; frame++)
+        {
+            for (s32 i = 0; i < count; i++)
+            {
+                Vector3 position = Vector3Add(set.getPosition(i), Vector3Scale(velocities[i], FRAME_TIME));
+                if (position.x < 0.0f || position.x > side) velocities[i].x = -velocities[i].x;
+                if (position.z < 0.0f || position.z > side) velocities[i].z = -velocities[i].z;
+                set.setPosition(i, position);
+            }
+
+            double start = BenchNow();
+            set.findPairs(sapPairs);
+            sapMs += BenchNow() - start;
+            swaps += set.getStats().swaps;
+
+            start = BenchNow();
+            BruteForcePairs(set, brutePairs);
+            bruteMs += BenchNow() - start;
+
+            std::sort(sapPairs.begin(), sapPairs.end(), [](const CharacterPair& a, const CharacterPair& b)
+                      { return a.a != b.a ? a.a < b.a : a.b < b.b; });
+            bool same = sapPairs.size() == brutePairs.size();
+            for (size_t i = 0; same && i < sapPairs.size(); i++)
+            {
+                same = sapPairs[i].a == brutePairs[i].a && sapPairs[i].b == brutePairs[i].b;
+            }
+            if (!same) mismatches++;
+
+            start = BenchNow();
+            set.resolve(nullptr);
+            resolveMs += BenchNow() - start;
+            const CharacterStats& stats = set.getStats();
+            pairs += stats.pairs;
+            overlaps += stats.overlaps;
+            resolved += stats.resolved;
+        }
+
+        printf("%5d characters  sweep %7.3f ms  all pairs %8.3f ms  resolve %7.3f ms  pairs %7.1f  "
+               "overlaps %6.1f  resolved %6.1f  swaps %7.1f  mismatches %d\n",
+               count, sapMs / FRAME_COUNT, bruteMs / FRAME_COUNT, resolveMs / FRAME_COUNT,
+               (double)pairs / FRAME_COUNT, (double)overlaps / FRAME_COUNT, (double)resolved / FRAME_COUNT,
+               (double)swaps / FRAME_COUNT, mismatches);
+    }
+}
+
+static void RunCrowd(const char* fileName)
+{
+    BSP map;
+    Octree tree;
+    if (!BenchLoadWorld(map, tree, fileName, false)) return;
+
+    Collider world;
+    world.setCollisionSelector(&tree);
+
+    // Nascem em cima de chãos a menos de 40 unidades de um ponto e cada um
+    // anda para outro desses chãos: cruzam-se todos na mesma zona
+    std::vector<Vector3> floors;
+    for (const Triangle* tri : tree.getCandidates(map.getBounds(), MASK_MOVEMENT))
+    {
+        if (CalculateTriangleNormal(tri->pointA, tri->pointB, tri->pointC).y < 0.9f) continue;
+        Vector3 center = Vector3Scale(Vector3Add(Vector3Add(tri->pointA, tri->pointB), tri->pointC), 1.0f / 3.0f);
+        floors.push_back(Vector3Add(center, { 0.0f, HALF_HEIGHT + 0.1f, 0.0f }));
+    }
+    if (floors.empty()) return;
+
+    u32 seed = 99;
+    Vector3 center = floors[(u32)(BenchRandom(seed) * floors.size()) % floors.size()];
+    std::vector<Vector3> nearby;
+    for (const Vector3& floor : floors)
+    {
+        if (Vector3Distance(floor, center) < 40.0f) nearby.push_back(floor);
+    }
+
+    CharacterSet set;
+    std::vector<Vector3> goals;
+    for (u32 i = 0; i < nearby.size() && i < 128; i++)
+    {
+        set.add(nearby[i], RADIUS, HALF_HEIGHT);
+        goals.push_back(nearby[(u32)(BenchRandom(seed) * nearby.size()) % nearby.size()]);
+    }
+
+    std::vector<MoveRequest> requests(set.getCount());
+    std::vector<MoveResult> results(set.getCount());
+    double moveMs = 0.0, resolveMs = 0.0;
+    u64 overlaps = 0, resolved = 0, pairs = 0, left = 0;
+    for (s32 frame = 0; frame < FRAME_COUNT; frame++)
+    {
+        for (u32 i = 0; i < set.getCount(); i++)
+        {
+            Vector3 toGoal = Vector3Subtract(goals[i], set.getPosition(i));
+            toGoal.y = 0.0f;
+            Vector3 velocity = Vector3LengthSqr(toGoal) > 1.0f ? Vector3Scale(Vector3Normalize(toGoal), SPEED * FRAME_TIME)
+                                                               : Vector3{ 0.0f, 0.0f, 0.0f };
+            requests[i] = { set.getPosition(i), { RADIUS, HALF_HEIGHT, RADIUS }, velocity, { 0.0f, -0.15f, 0.0f }, 0.00001f };
+        }
+
+        double start = BenchNow();
+        world.collideEllipsoidBatch(requests.data(), results.data(), set.getCount());
+        moveMs += BenchNow() - start;
+        for (u32 i = 0; i < set.getCount(); i++) set.setPosition(i, results[i].position);
+
+        start = BenchNow();
+        set.resolve(&world);
+        resolveMs += BenchNow() - start;
+
+        const CharacterStats& stats = set.getStats();
+        pairs += stats.pairs;
+        overlaps += stats.overlaps;
+        resolved += stats.resolved;
+        left += CountOverlaps(set);
+    }
+
+    printf("%-22s %u bots  move %7.3f ms  resolve %7.3f ms  pairs %6.1f  overlaps %6.1f  resolved %6.1f  "
+           "overlapping after resolve %5.1f\n",
+           fileName, set.getCount(), moveMs / FRAME_COUNT, resolveMs / FRAME_COUNT, (double)pairs / FRAME_COUNT,
+           (double)overlaps / FRAME_COUNT, (double)resolved / FRAME_COUNT, (double)left / FRAME_COUNT);
+}
+
+int main(int argc, char** argv)
+{
+    RunOpenArea();
+    RunCrowd(argc > 1 ? argv[1] : BENCH_MAP);
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include "bench.hpp"
+
+// Camadas de colisão em cada mapa: triângulos por camada e, para cada
+// máscara, candidatos por caixa e tempo de raycast. O raycast com máscara
+// tem de dar os mesmos hits que o raycast com um RayFilter equivalente
+// (que percorre a árvore toda), na octree normal, na compacta e na HashGrid.
+
+static const char* LAYER_NAMES[] = { "solid", "grate", "playerclip", "sky", "liquid", "nonsolid" };
+
+struct MaskInfo
+{
+    const char* name;
+    u32 mask;
+};
+
+static const MaskInfo MASKS[] = {
+    { "all", MASK_ALL }, { "movement", MASK_MOVEMENT }, { "shot", MASK_SHOT }, { "particle", MASK_PARTICLE }
+};
+
+static const s32 QUERY_COUNT = 20000;
+static const s32 RAY_COUNT = 20000;
+
+// Hits diferentes entre a máscara e o filtro com as mesmas camadas
+static s32 CountMismatches(const Selector& selector, const std::vector<Ray>& rays, u32 mask)
+{
+    RayFilter filter = [mask](const Triangle& tri) { return (tri.layers & mask) != 0; };
+    s32 mismatches = 0;
+    for (const Ray& ray : rays)
+    {
+        // Numa octree compacta o triângulo do hit só vale até ao próximo raycast
+        RayHit masked = selector.raycast(ray, 1000.0f, nullptr, mask);
+        u32 id = masked.hit ? masked.triangle->id : 0;
+        RayHit filtered = selector.raycast(ray, 1000.0f, filter);
+
+        if (masked.hit != filtered.hit) mismatches++;
+        else if (masked.hit && (masked.distance != filtered.distance || id != filtered.triangle->id)) mismatches++;
+    }
+    return mismatches;
+}
+
+int main(int argc, char** argv)
+{
+    s32 mapCount = BenchMapCount(argc);
+    for (s32 m = 0; m < mapCount; m++)
+    {
+        const char* fileName = BenchMapName(argc, argv, m);
+
+        BSP map;
+        Octree tree;
+        if (!BenchLoadWorld(map, tree, fileName, false)) continue;
+
+        std::vector<const Triangle*> all = tree.getCandidates(map.getBounds());
+        u32 counts[6] = { 0, 0, 0, 0, 0, 0 };
+        HashGrid grid(8.0f);
+        for (const Triangle* tri : all)
+        {
+            for (s32 bit = 0; bit < 6; bit++)
+            {
+                if (tri->layers & (1u << bit)) counts[bit]++;
+            }
+        }
+        // Pela ordem dos ids, para os ids da grelha baterem com os da octree
+        std::vector<const Triangle*> ordered = all;
+        std::sort(ordered.begin(), ordered.end(), [](const Triangle* a, const Triangle* b) { return a->id < b->id; });
+        for (const Triangle* tri : ordered)
+        {
+            grid.addTriangle(tri->pointA, tri->pointB, tri->pointC, tri->layers);
+        }
+
+        printf("%-22s %6u triangles:", fileName, (u32)all.size());
+        for (s32 bit = 0; bit < 6; bit++)
+        {
+            if (counts[bit]) printf(" %s %u", LAYER_NAMES[bit], counts[bit]);
+        }
+        printf("\n");
+
+        u32 seed = 4321;
+        std::vector<BoundingBox> boxes(QUERY_COUNT);
+        for (BoundingBox& box : boxes)
+        {
+            Vector3 center = BenchRandomPoint(map.getBounds(), seed);
+            float size = 2.0f + BenchRandom(seed) * 2.0f;
+            box = { Vector3Subtract(center, { size, size, size }), Vector3Add(center, { size, size, size }) };
+        }
+        std::vector<Ray> rays(RAY_COUNT);
+        for (Ray& ray : rays)
+        {
+            ray.position = BenchRandomPoint(map.getBounds(), seed);
+            ray.direction = Vector3Normalize(Vector3Subtract(BenchRandomPoint(map.getBounds(), seed), ray.position));
+        }
+
+        Octree compact;
+        compact.setWorldBounds(map.getBounds());
+        for (const Triangle* tri : ordered)
+        {
+            compact.addTriangle(tri->pointA, tri->pointB, tri->pointC, tri->layers);
+        }
+        compact.rebuild();
+        compact.setCompact(true);
+
+        for (const MaskInfo& info : MASKS)
+        {
+            size_t candidates = 0;
+            double start = BenchNow();
+            for (const BoundingBox& box : boxes)
+            {
+                candidates += tree.getCandidates(box, info.mask).size();
+            }
+            double queryMs = BenchNow() - start;
+
+            s32 hits = 0;
+            start = BenchNow();
+            for (const Ray& ray : rays)
+            {
+                if (tree.raycast(ray, 1000.0f, nullptr, info.mask).hit) hits++;
+            }
+            double rayMs = BenchNow() - start;
+
+            s32 mismatches = CountMismatches(tree, rays, info.mask) + CountMismatches(compact, rays, info.mask)
+                           + CountMismatches(grid, rays, info.mask);
+
+            printf("  %-9s candidates/query %6.1f  query %7.2f ms  rays hit %5d  raycast %7.2f ms  mismatches %d\n",
+                   info.name, (double)candidates / QUERY_COUNT, queryMs, hits, rayMs, mismatches);
+        }
+    }
+    return 0;
+}
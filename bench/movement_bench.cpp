@@ -0,0 +1,121 @@
+#include "bench.hpp"
+#include "threadpool.hpp"
+
+// Movimento de 256 bots por tick: collideEllipsoidBatch em série contra o
+// mesmo lote repartido pelo ThreadPool. As posições têm de ser iguais.
+// No fim, em série com um GroundContact por bot: gravidades resolvidas
+// sem varrimento e testes de triângulos (as posições podem separar-se da
+// corrida sem ele, um bot que fica a centésimos de uma aresta segue outro
+// caminho).
+
+static Octree tree;
+static BSP map;
+static Collider world;
+
+static const u32 BOT_COUNT = 256;
+static const s32 TICKS = 300;
+
+struct Bot
+{
+    Vector3 position;
+    float heading;
+};
+
+static void Spawn(std::vector<Bot>& bots)
+{
+    u32 seed = 99;
+    bots.resize(BOT_COUNT);
+    for (Bot& bot : bots)
+    {
+        bot.position = BenchRandomPoint(map.getBounds(), seed);
+        bot.heading = BenchRandom(seed) * 2.0f * PI;
+    }
+}
+
+// Corre TICKS ticks e devolve o tempo; pool = nullptr corre em série
+static double Simulate(std::vector<Bot>& bots, ThreadPool* pool, GroundContact* grounds = nullptr)
+{
+    std::vector<MoveRequest> requests(bots.size());
+    std::vector<MoveResult> results(bots.size());
+
+    ResetCollisionStats();
+    double start = BenchNow();
+    for (s32 tick = 0; tick < TICKS; tick++)
+    {
+        for (size_t i = 0; i < bots.size(); i++)
+        {
+            // Muda de direção de vez em quando, sempre da mesma forma
+            if ((tick + (s32)i) % 60 == 0) bots[i].heading += 1.3f;
+
+            MoveRequest& request = requests[i];
+            request.position = bots[i].position;
+            request.radius = { 1.6f, 2.8f, 1.6f };
+            request.velocity = { cosf(bots[i].heading) * 0.5f, 0.0f, sinf(bots[i].heading) * 0.5f };
+            request.gravity = { 0.0f, -0.4f, 0.0f };
+            request.slidingSpeed = 0.005f;
+        }
+
+        world.collideEllipsoidBatch(requests.data(), results.data(), (u32)requests.size(), pool, nullptr, grounds);
+
+        for (size_t i = 0; i < bots.size(); i++)
+        {
+            bots[i].position = results[i].position;
+        }
+        CollisionStatsEndFrame();
+    }
+    return BenchNow() - start;
+}
+
+int main()
+{
+    BenchInit("movement_bench");
+    if (!BenchLoadWorld(map, tree)) return 1;
+    world.setCollisionSelector(&tree);
+
+    std::vector<Bot> serial;
+    Spawn(serial);
+    double serialMs = Simulate(serial, nullptr);
+    printf("serial     threads=1  %d bots x %d ticks  %.2f ms  (%.3f ms/tick)\n",
+           BOT_COUNT, TICKS, serialMs, serialMs / TICKS);
+    BenchLogCollisionStats("serial");
+
+    u32 hardware = std::thread::hardware_concurrency();
+    u32 counts[] = { 2, 4, hardware > 0 ? hardware : 1 };
+    for (u32 threads : counts)
+    {
+        ThreadPool pool(threads);
+        std::vector<Bot> parallel;
+        Spawn(parallel);
+        double parallelMs = Simulate(parallel, &pool);
+
+        s32 mismatches = 0;
+        for (u32 i = 0; i < BOT_COUNT; i++)
+        {
+            if (memcmp(&serial[i].position, &parallel[i].position, sizeof(Vector3)) != 0) mismatches++;
+        }
+
+        printf("pool       threads=%-2u %d bots x %d ticks  %.2f ms  (%.3f ms/tick)  speedup %.2fx  mismatches %d\n",
+               pool.getThreadCount(), BOT_COUNT, TICKS, parallelMs, parallelMs / TICKS,
+               serialMs / parallelMs, mismatches);
+        BenchLogCollisionStats("pool");
+    }
+
+    std::vector<Bot> grounded;
+    std::vector<GroundContact> grounds(BOT_COUNT);
+    Spawn(grounded);
+    double groundMs = Simulate(grounded, nullptr, grounds.data());
+
+    u32 hits = 0, misses = 0;
+    for (u32 i = 0; i < BOT_COUNT; i++)
+    {
+        hits += grounds[i].hits;
+        misses += grounds[i].misses;
+    }
+    printf("ground     threads=1  %d bots x %d ticks  %.2f ms  (%.3f ms/tick)  speedup %.2fx  ground hits %.1f%%\n",
+           BOT_COUNT, TICKS, groundMs, groundMs / TICKS, serialMs / groundMs,
+           hits + misses ? hits * 100.0 / (hits + misses) : 0.0);
+    BenchLogCollisionStats("ground");
+
+    BenchShutdown();
+    return 0;
+}
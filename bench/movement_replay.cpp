@@ -0,0 +1,310 @@
+#include "bench.hpp"
+#include "movetrace.hpp"
+#include <algorithm>
+
+// Repete movimentos gravados no jogo (F9, CameraFPS::Update) em
+// collideEllipsoidWithWorld contra a octree do mapa, sem janela. Dá
+// movimentos por segundo, percentis da latência de cada movimento e um
+// checksum das posições; os movimentos cujo resultado já não é o gravado
+// contam como divergentes (e o processo sai com 1). Corre duas vezes: sem
+// e com CandidateCache, que tem de dar exatamente as mesmas posições.
+// Depois com GroundContact (não conta para os divergentes: a gravidade
+// varrida ainda pode escorregar uns centésimos numa aresta ao lado), com a
+// diferença máxima para o varrimento da posição e do ponto de contacto; os
+// movimentos em que falling ou collide mudam também fazem sair com 1.
+// No fim compara os dois SlideSolver nos mesmos pedidos: quanto se avança
+// na direção pedida, movimentos presos, para trás ou mais longos do que o
+// pedido e, com COLLISION_STATS,
+// passos e testes de triângulos por movimento. Por fim, o mesmo percurso
+// na octree compacta: as mesmas posições, o tempo e a memória das duas.
+//
+// movement_replay [trace] [mapa]
+//
+// Sem ficheiro de gravação, grava um percurso fixo (andar, virar, saltar)
+// com as mesmas contas de CameraFPS::Update e guarda-o para as próximas corridas.
+
+static const s32 RUNS = 5;
+static const s32 SCRIPT_FRAMES = 3600;   // um minuto a 60 fps
+
+static Octree tree;
+static BSP map;
+static Collider world;
+
+// Percurso fixo a 60 fps: velocidade de andar, gravidade e salto de CameraFPS
+static void RecordScript(MoveTrace& trace)
+{
+    const float dt = 1.0f / 60.0f;
+    const float walkSpeed = 25.0f;
+    const float jumpForce = 2.0f;
+    const Vector3 gravity = { 0.0f, -9.0f, 0.0f };
+
+    Vector3 position = { 5.0f, 30.0f, -5.0f };
+    Vector3 fallingVelocity = { 0.0f, 0.0f, 0.0f };
+    float heading = 0.0f;
+    bool falling = false;
+
+    trace.clear();
+    for (s32 frame = 0; frame < SCRIPT_FRAMES; frame++)
+    {
+        if (frame % 90 == 0) heading += 2.1f;
+        if (frame % 150 == 75 && !falling) fallingVelocity.y = jumpForce;
+        fallingVelocity = Vector3Add(fallingVelocity, Vector3Scale(gravity, dt));
+
+        MoveRequest request;
+        request.position = position;
+        request.radius = { 1.6f, 2.8f, 1.6f };
+        request.velocity = { cosf(heading) * walkSpeed * dt, 0.0f, sinf(heading) * walkSpeed * dt };
+        request.gravity = fallingVelocity;
+        request.slidingSpeed = 0.00001f;
+
+        Triangle triangle;
+        Vector3 hitPosition;
+        bool collide;
+        position = world.collideEllipsoidWithWorld(request.position, request.radius, request.velocity,
+                                                   request.slidingSpeed, request.gravity, triangle,
+                                                   hitPosition, falling, collide);
+        if (!falling) fallingVelocity = { 0.0f, 0.0f, 0.0f };
+
+        trace.add(request, position);
+    }
+}
+
+static double Percentile(const std::vector<double>& sorted, double p)
+{
+    size_t index = (size_t)(p * (double)(sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+// Melhor de RUNS; com cache, cada corrida começa com ela vazia
+static double Replay(const std::vector<MoveRecord>& records, CandidateCache* cache,
+                     std::vector<Vector3>& results, std::vector<double>& latencies)
+{
+    const size_t count = records.size();
+    results.resize(count);
+    latencies.clear();
+    latencies.reserve(count * RUNS);
+    double best = 1e30;
+
+    for (s32 run = 0; run < RUNS; run++)
+    {
+        if (cache) cache->invalidate();
+
+        double start = BenchNow();
+        for (size_t i = 0; i < count; i++)
+        {
+            const MoveRequest& request = records[i].request;
+            Triangle triangle;
+            Vector3 hitPosition;
+            bool falling, collide;
+
+            double moveStart = BenchNow();
+            results[i] = world.collideEllipsoidWithWorld(request.position, request.radius, request.velocity,
+                                                         request.slidingSpeed, request.gravity, triangle,
+                                                         hitPosition, falling, collide, cache);
+            latencies.push_back(BenchNow() - moveStart);
+        }
+        best = std::min(best, BenchNow() - start);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    return best;
+}
+
+// Cada pedido pela ordem gravada, com ground = nullptr ou com o chão em
+// cache; devolve o tempo e escreve os resultados
+static double ReplayGround(const std::vector<MoveRecord>& records, GroundContact* ground,
+                           std::vector<MoveResult>& results, u64& tests)
+{
+    results.resize(records.size());
+    ResetCollisionStats();
+
+    double start = BenchNow();
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const MoveRequest& request = records[i].request;
+        MoveResult& result = results[i];
+        result.position = world.collideEllipsoidWithWorld(request.position, request.radius, request.velocity,
+                                                          request.slidingSpeed, request.gravity, result.triangle,
+                                                          result.hitPosition, result.falling, result.collide,
+                                                          nullptr, MASK_MOVEMENT, ground);
+    }
+    double time = BenchNow() - start;
+
+    CollisionStatsEndFrame();
+#ifdef COLLISION_STATS
+    // Os polígonos da PolygonMesh contam à parte
+    tests = GetCollisionTotalStats().triangleTests + GetCollisionTotalStats().polygonTests;
+#else
+    tests = 0;
+#endif
+    return time;
+}
+
+// falling e collide têm de ser iguais aos do varrimento; a posição, o
+// ponto de contacto e o plano do triângulo só até uma tolerância (ver
+// GroundContact). Devolve os movimentos com falling ou collide diferentes.
+static s32 CompareGround(const std::vector<MoveRecord>& records)
+{
+    std::vector<MoveResult> sweepResults, groundResults;
+    u64 sweepTests, groundTests;
+    GroundContact ground;
+    double sweepMs = ReplayGround(records, nullptr, sweepResults, sweepTests);
+    double groundMs = ReplayGround(records, &ground, groundResults, groundTests);
+
+    float maxError = 0.0f;
+    float maxHitError = 0.0f;
+    s32 fallingMismatches = 0;
+    s32 collideMismatches = 0;
+    s32 planeMismatches = 0;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const MoveResult& sweep = sweepResults[i];
+        const MoveResult& probe = groundResults[i];
+        maxError = fmaxf(maxError, Vector3Distance(sweep.position, probe.position));
+        if (sweep.falling != probe.falling) fallingMismatches++;
+        if (sweep.collide != probe.collide) collideMismatches++;
+        if (!sweep.collide || !probe.collide) continue;
+
+        maxHitError = fmaxf(maxHitError, Vector3Distance(sweep.hitPosition, probe.hitPosition));
+        Vector3 sweepNormal = CalculateTriangleNormal(sweep.triangle.pointA, sweep.triangle.pointB, sweep.triangle.pointC);
+        Vector3 probeNormal = CalculateTriangleNormal(probe.triangle.pointA, probe.triangle.pointB, probe.triangle.pointC);
+        if (Vector3DotProduct(sweepNormal, probeNormal) < 0.999f) planeMismatches++;
+    }
+
+    printf("GroundContact: hit rate %.1f%% (%u hits, %u misses)  sweep %.2f ms  ground %.2f ms  "
+           "max error %.4f  hit max error %.4f  falling mismatches %d  collide mismatches %d  plane mismatches %d",
+           ground.getHitRate() * 100.0f, ground.hits, ground.misses, sweepMs, groundMs, maxError,
+           maxHitError, fallingMismatches, collideMismatches, planeMismatches);
+#ifdef COLLISION_STATS
+    printf("  tests/move %.1f -> %.1f", (double)sweepTests / records.size(), (double)groundTests / records.size());
+#endif
+    printf("\n");
+    return fallingMismatches + collideMismatches;
+}
+
+// Escreve os resultados de uma repetição e devolve os movimentos divergentes
+static s32 Report(const char* label, const std::vector<MoveRecord>& records, double best,
+                  const std::vector<Vector3>& results, const std::vector<double>& latencies)
+{
+    const size_t count = records.size();
+    double checksum = 0.0;
+    u64 hash = HashFNV1a(results.data(), count * sizeof(Vector3));
+    s32 diverged = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        checksum += results[i].x + results[i].y + results[i].z;
+        if (memcmp(&results[i], &records[i].position, sizeof(Vector3)) != 0) diverged++;
+    }
+
+    printf("%s: %u moves x %d runs  best %.2f ms  %.0f moves/s\n",
+           label, (u32)count, RUNS, best, (double)count / (best * 0.001));
+    printf("latency us  p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+           Percentile(latencies, 0.5) * 1000.0, Percentile(latencies, 0.9) * 1000.0,
+           Percentile(latencies, 0.99) * 1000.0, Percentile(latencies, 0.999) * 1000.0,
+           latencies.back() * 1000.0);
+    printf("checksum %.3f  hash %016llx  diverged %d\n", checksum, (unsigned long long)hash, diverged);
+    return diverged;
+}
+
+// Cada pedido da gravação com o solver dado (a partir da posição gravada)
+static void CompareSolver(const char* label, SlideSolver solver, const std::vector<MoveRecord>& records)
+{
+    world.setSlideSolver(solver);
+    ResetCollisionStats();
+
+    double requested = 0.0, progress = 0.0;
+    s32 blocked = 0, backwards = 0, overshoot = 0;
+    for (const MoveRecord& record : records)
+    {
+        const MoveRequest& request = record.request;
+        Triangle triangle;
+        Vector3 hitPosition;
+        bool falling, collide;
+        Vector3 result = world.collideEllipsoidWithWorld(request.position, request.radius, request.velocity,
+                                                         request.slidingSpeed, request.gravity, triangle,
+                                                         hitPosition, falling, collide);
+
+        // Só o plano horizontal (o que o jogador pediu com as teclas) e só o
+        // que avança na direção pedida: ir e voltar num canto não conta, e
+        // andar mais do que o pedido também não
+        float want = sqrtf(request.velocity.x * request.velocity.x + request.velocity.z * request.velocity.z);
+        if (want <= 0.0f) continue;
+        float along = ((result.x - request.position.x) * request.velocity.x +
+                       (result.z - request.position.z) * request.velocity.z) / want;
+        requested += want;
+        progress += fminf(along, want);
+        if (along > want * 1.01f) overshoot++;
+        if (along < want * 0.25f) blocked++;
+        if (along < -want * 0.01f) backwards++;
+    }
+    CollisionStatsEndFrame();
+
+    printf("%-10s progress %.1f%% of the requested distance  blocked %d  backwards %d  overshoot %d", label,
+           requested > 0.0 ? progress * 100.0 / requested : 0.0, blocked, backwards, overshoot);
+#ifdef COLLISION_STATS
+    const CollisionCounters& total = GetCollisionTotalStats();
+    double moves = total.moves > 0 ? (double)total.moves : 1.0;
+    printf("  steps/move %.2f  max %u  tests/move %.1f", total.collideCalls / moves,
+           total.maxRecursion, (total.triangleTests + total.polygonTests) / moves);
+#endif
+    printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+    // Sem trace, o que o jogo grava ao lado do mapa
+    const char* mapFile = argc > 2 ? argv[2] : BENCH_MAP;
+    std::string defaultTrace = ChangeFileExtension(mapFile, ".trace");
+    const char* traceFile = argc > 1 ? argv[1] : defaultTrace.c_str();
+
+    if (!BenchLoadWorld(map, tree, mapFile, false)) return 1;
+    world.setCollisionSelector(&tree);
+
+    MoveTrace trace;
+    u64 mapHash = 0;
+    if (!trace.load(traceFile, &mapHash))
+    {
+        LogWarning("Sem gravação em %s: a gravar um percurso fixo", traceFile);
+        RecordScript(trace);
+        mapHash = map.getContentHash();
+        trace.save(traceFile, mapHash);
+    }
+    if (mapHash != map.getContentHash())
+    {
+        LogWarning("%s foi gravado noutro mapa", traceFile);
+    }
+
+    const std::vector<MoveRecord>& records = trace.getRecords();
+    if (records.empty()) return 1;
+
+    std::vector<Vector3> results;
+    std::vector<double> latencies;
+
+    double best = Replay(records, nullptr, results, latencies);
+    s32 diverged = Report(traceFile, records, best, results, latencies);
+    double normalBest = best;
+
+    // O mesmo percurso com a cache de candidatos de CameraFPS
+    CandidateCache cache;
+    best = Replay(records, &cache, results, latencies);
+    diverged += Report("with CandidateCache", records, best, results, latencies);
+    printf("cache hit rate %.1f%% (%u hits, %u misses, margin %.1f)\n",
+           cache.getHitRate() * 100.0f, cache.hits, cache.misses, cache.margin);
+
+    s32 groundMismatches = CompareGround(records);
+
+    SlideSolver solver = world.getSlideSolver();
+    CompareSolver("recursive", SlideSolver::Recursive, records);
+    CompareSolver("iterative", SlideSolver::Iterative, records);
+    world.setSlideSolver(solver);
+
+    // Por último: setCompact(false) deixaria os nós com as caixas quantizadas
+    size_t memory = tree.getMemory();
+    tree.setCompact(true);
+    double compactBest = Replay(records, nullptr, results, latencies);
+    diverged += Report("compact octree", records, compactBest, results, latencies);
+    printf("compact vs normal: %.2f ms vs %.2f ms (%.2fx)  memory %.0f KB vs %.0f KB (%.1fx less)\n",
+           compactBest, normalBest, compactBest / normalBest, tree.getMemory() / 1024.0, memory / 1024.0,
+           (double)memory / (double)tree.getMemory());
+
+    return (diverged || groundMismatches) ? 1 : 0;
+}
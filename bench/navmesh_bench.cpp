@@ -0,0 +1,122 @@
+#include "bench.hpp"
+#include "navmesh.hpp"
+#include "threadpool.hpp"
+
+// Malha de navegação em cada mapa: tempo de construção, polígonos, portais e
+// regiões; depois caminhos entre centros de polígonos ao acaso, com o A*
+// hierárquico e com o A* em todos os polígonos (caminhos por segundo e nós
+// abertos), em lote no ThreadPool e ida e volta pela cache em disco.
+
+static const s32 PATH_COUNT = 5000;
+
+struct PathRun
+{
+    double ms;
+    s32 found;
+    u64 expanded;
+    double length;
+};
+
+static double PathLength(const NavPath& path)
+{
+    double length = 0.0;
+    for (size_t i = 0; i + 1 < path.points.size(); i++)
+    {
+        length += Vector3Distance(path.points[i], path.points[i + 1]);
+    }
+    return length;
+}
+
+static PathRun RunPaths(const NavMesh& nav, const std::vector<NavPathRequest>& requests, bool hierarchical)
+{
+    PathRun run = { 0.0, 0, 0, 0.0 };
+    NavPath path;
+    double start = BenchNow();
+    for (const NavPathRequest& request : requests)
+    {
+        if (!nav.findPath(request.start, request.goal, path, hierarchical)) continue;
+        run.found++;
+        run.expanded += path.expanded;
+        run.length += PathLength(path);
+    }
+    run.ms = BenchNow() - start;
+    return run;
+}
+
+int main(int argc, char** argv)
+{
+    ThreadPool pool;
+    s32 mapCount = BenchMapCount(argc);
+    for (s32 m = 0; m < mapCount; m++)
+    {
+        const char* fileName = BenchMapName(argc, argv, m);
+
+        BSP map;
+        if (!map.loadFromFile(fileName, false)) continue;
+
+        PolygonMesh mesh;
+        BenchBuildPolygons(map, mesh);
+        Octree tree;
+        tree.setWorldBounds(map.getBounds());
+        mesh.addTo(tree);
+        tree.rebuild();
+
+        NavMesh nav;
+        double start = BenchNow();
+        nav.build(mesh, &tree);
+        double buildMs = BenchNow() - start;
+
+        printf("%-22s build %7.2f ms  polygons %5u (of %5u)  portals %5u  regions %4u\n",
+               fileName, buildMs, nav.getPolygonCount(), mesh.getPolygonCount(),
+               (u32)nav.getLinks().size() / 2, nav.getRegionCount());
+        if (nav.getPolygonCount() < 2) continue;
+
+        // Um pouco acima do centro de um polígono, como os pés de um agente
+        u32 seed = 9876;
+        std::vector<NavPathRequest> requests(PATH_COUNT);
+        const std::vector<NavPolygon>& polygons = nav.getPolygons();
+        for (NavPathRequest& request : requests)
+        {
+            request.start = polygons[(u32)(BenchRandom(seed) * polygons.size()) % polygons.size()].center;
+            request.goal = polygons[(u32)(BenchRandom(seed) * polygons.size()) % polygons.size()].center;
+            request.start.y += 0.1f;
+            request.goal.y += 0.1f;
+        }
+
+        PathRun flat = RunPaths(nav, requests, false);
+        PathRun hier = RunPaths(nav, requests, true);
+        for (const PathRun* run : { &flat, &hier })
+        {
+            s32 found = run->found > 0 ? run->found : 1;
+            printf("  %-12s found %5d  paths/s %9.0f  expanded/path %7.1f  length/path %7.1f\n",
+                   run == &flat ? "flat" : "hierarchical", run->found, PATH_COUNT / (run->ms / 1000.0),
+                   (double)run->expanded / found, run->length / found);
+        }
+
+        std::vector<NavPath> results(PATH_COUNT);
+        std::unique_ptr<bool[]> found(new bool[PATH_COUNT]);
+        start = BenchNow();
+        nav.findPaths(requests.data(), results.data(), found.get(), PATH_COUNT, &pool);
+        double batchMs = BenchNow() - start;
+        s32 batchFound = 0;
+        for (s32 i = 0; i < PATH_COUNT; i++) batchFound += found[i] ? 1 : 0;
+        printf("  %-12s found %5d  paths/s %9.0f  (%u threads)\n", "batch", batchFound,
+               PATH_COUNT / (batchMs / 1000.0), pool.getThreadCount());
+
+        // Ida e volta pela cache: os mesmos caminhos
+        u64 key = nav.getCacheKey(PolygonMesh::getCacheKey(map.getCollisionHash()));
+        NavMesh loaded;
+        bool roundTrip = nav.saveCache("navmesh_bench.nav", key) && loaded.loadCache("navmesh_bench.nav", key);
+        s32 mismatches = 0;
+        NavPath a, b;
+        for (s32 i = 0; roundTrip && i < 500; i++)
+        {
+            bool foundA = nav.findPath(requests[i].start, requests[i].goal, a);
+            bool foundB = loaded.findPath(requests[i].start, requests[i].goal, b);
+            if (foundA != foundB || a.polygons != b.polygons || a.points.size() != b.points.size()) mismatches++;
+        }
+        remove("navmesh_bench.nav");
+        printf("  cache %s  mismatches %d\n", roundTrip ? "ok" : "FAILED", mismatches);
+    }
+    return 0;
+}
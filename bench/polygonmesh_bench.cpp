@@ -0,0 +1,137 @@
+#include "bench.hpp"
+#include "polygonmesh.hpp"
+
+// PolygonMesh em cada mapa: quantos triângulos entram, em quantos
+// polígonos ficam e quantos triângulos vão para a octree (os leques, para os
+// raycasts). Depois as mesmas caixas de movimento nas duas octrees, contadas
+// em primitivas do Collider (getCollisionCandidates: triângulos soltos mais
+// polígonos), e bots a andar nos dois mundos: tempo e, com COLLISION_STATS,
+// testes elipse-triângulo e elipse-polígono por movimento.
+
+static const s32 QUERY_COUNT = 20000;
+static const u32 BOT_COUNT = 256;
+static const s32 TICKS = 100;
+
+struct Primitives
+{
+    double triangles;
+    double polygons;
+};
+
+// Primitivas médias do Collider por caixa do tamanho de um movimento de jogador
+static Primitives AveragePrimitives(const BSP& map, const Octree& tree)
+{
+    u32 seed = 1234;
+    size_t triangles = 0, polygons = 0;
+    CollisionCandidates candidates;
+    for (s32 i = 0; i < QUERY_COUNT; i++)
+    {
+        Vector3 center = BenchRandomPoint(map.getBounds(), seed);
+        float size = 2.0f + BenchRandom(seed) * 2.0f;
+        BoundingBox box = { Vector3Subtract(center, { size, size, size }), Vector3Add(center, { size, size, size }) };
+        candidates.clear();
+        tree.getCollisionCandidates(box, { 1.6f, 2.8f, 1.6f }, MASK_ALL, candidates);
+        triangles += candidates.triangles.size();
+        polygons += candidates.polygons.size();
+    }
+    return { (double)triangles / QUERY_COUNT, (double)polygons / QUERY_COUNT };
+}
+
+struct WalkResult
+{
+    double ms;
+    double triangleTests;   // por movimento (só com COLLISION_STATS)
+    double polygonTests;
+};
+
+// Bots a andar e a cair, como no movement_bench
+static WalkResult Walk(const BSP& map, Octree& tree)
+{
+    Collider world;
+    world.setCollisionSelector(&tree);
+
+    u32 seed = 99;
+    std::vector<Vector3> positions(BOT_COUNT);
+    std::vector<float> headings(BOT_COUNT);
+    for (u32 i = 0; i < BOT_COUNT; i++)
+    {
+        positions[i] = BenchRandomPoint(map.getBounds(), seed);
+        headings[i] = BenchRandom(seed) * 2.0f * PI;
+    }
+
+    CollisionCounters before = GetCollisionCounters();
+    double start = BenchNow();
+    for (s32 tick = 0; tick < TICKS; tick++)
+    {
+        for (u32 i = 0; i < BOT_COUNT; i++)
+        {
+            if ((tick + (s32)i) % 60 == 0) headings[i] += 1.3f;
+
+            Triangle triangle;
+            Vector3 hitPosition;
+            bool falling, collide;
+            Vector3 velocity = { cosf(headings[i]) * 0.5f, 0.0f, sinf(headings[i]) * 0.5f };
+            positions[i] = world.collideEllipsoidWithWorld(positions[i], { 1.6f, 2.8f, 1.6f }, velocity, 0.005f,
+                                                           { 0.0f, -0.4f, 0.0f }, triangle, hitPosition,
+                                                           falling, collide);
+        }
+    }
+    WalkResult result;
+    result.ms = BenchNow() - start;
+
+    const CollisionCounters& after = GetCollisionCounters();
+    double moves = (double)BOT_COUNT * TICKS;
+    result.triangleTests = (after.triangleTests - before.triangleTests) / moves;
+    result.polygonTests = (after.polygonTests - before.polygonTests) / moves;
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    s32 mapCount = BenchMapCount(argc);
+    for (s32 m = 0; m < mapCount; m++)
+    {
+        const char* fileName = BenchMapName(argc, argv, m);
+
+        BSP map;
+        if (!map.loadFromFile(fileName, false))
+        {
+            LogError("Não foi possível carregar %s", fileName);
+            continue;
+        }
+
+        Octree original(map.getBounds());
+        BenchAddSurfaces(map, original);
+        original.rebuild();
+
+        PolygonMesh mesh;
+        BenchAddSurfaces(map, mesh);
+        double start = BenchNow();
+        mesh.build();
+        double buildMs = BenchNow() - start;
+
+        Octree merged(map.getBounds());
+        mesh.addTo(merged);
+        merged.rebuild();
+
+        u32 inputCount = mesh.getInputCount();
+        printf("%-22s %6u triangles -> %6u polygons -> %6u triangles (%.1f%% fewer)  build %.2f ms\n",
+               fileName, inputCount, mesh.getPolygonCount(), mesh.getTriangleCount(),
+               inputCount ? (1.0 - (double)mesh.getTriangleCount() / inputCount) * 100.0 : 0.0, buildMs);
+
+        Primitives before = AveragePrimitives(map, original);
+        Primitives after = AveragePrimitives(map, merged);
+        printf("%-22s primitives/query %.1f triangles -> %.1f triangles + %.1f polygons\n", "",
+               before.triangles, after.triangles, after.polygons);
+
+        WalkResult originalWalk = Walk(map, original);
+        WalkResult mergedWalk = Walk(map, merged);
+        printf("%-22s walk %.2f -> %.2f ms", "", originalWalk.ms, mergedWalk.ms);
+#ifdef COLLISION_STATS
+        printf("  tests/move %.1f triangles -> %.1f triangles + %.1f polygons",
+               originalWalk.triangleTests, mergedWalk.triangleTests, mergedWalk.polygonTests);
+#endif
+        printf("\n");
+    }
+    return 0;
+}
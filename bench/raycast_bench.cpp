@@ -0,0 +1,116 @@
+#include "bench.hpp"
+
+// Raycast em lote contra N raycasts separados, com N = 8, 64 e 1024.
+// "cone": raios da mesma origem num cone de 4 graus (caçadeira, rajada)
+// "random": origens e direções aleatórias (pior caso para o lote)
+// O lote com um alcance por raio (linhas de visão) também tem de dar os
+// mesmos hits que os raycasts separados com esse alcance.
+
+static Octree tree;
+static BSP map;
+
+static void MakeCone(const BoundingBox& bounds, s32 count, u32& seed, std::vector<Ray>& rays)
+{
+    Vector3 origin = BenchRandomPoint(bounds, seed);
+    Vector3 forward = BenchRandomDirection(seed);
+    const float spread = tanf(4.0f * DEG2RAD);
+
+    for (s32 i = 0; i < count; i++)
+    {
+        Vector3 jitter = Vector3Scale(BenchRandomDirection(seed), spread * BenchRandom(seed));
+        rays.push_back({ origin, Vector3Normalize(Vector3Add(forward, jitter)) });
+    }
+}
+
+static void MakeRandom(const BoundingBox& bounds, s32 count, u32& seed, std::vector<Ray>& rays)
+{
+    for (s32 i = 0; i < count; i++)
+    {
+        rays.push_back({ BenchRandomPoint(bounds, seed), BenchRandomDirection(seed) });
+    }
+}
+
+static bool SameHit(const RayHit& a, const RayHit& b)
+{
+    return a.hit == b.hit && a.triangle == b.triangle && a.distance == b.distance
+        && a.normal.x == b.normal.x && a.normal.y == b.normal.y && a.normal.z == b.normal.z;
+}
+
+static void Run(const char* name, s32 batchSize,
+                void (*make)(const BoundingBox&, s32, u32&, std::vector<Ray>&))
+{
+    const s32 totalRays = 65536;
+    const s32 batches = totalRays / batchSize;
+    const float maxDistance = 1000.0f;
+
+    u32 seed = 1234;
+    std::vector<Ray> rays;
+    rays.reserve(totalRays);
+    for (s32 b = 0; b < batches; b++)
+    {
+        make(map.getBounds(), batchSize, seed, rays);
+    }
+
+    std::vector<RayHit> single(rays.size());
+    std::vector<RayHit> batched(rays.size());
+
+    // Melhor de 5 corridas, para tirar ruído da máquina
+    double singleMs = 1e30;
+    double batchMs = 1e30;
+    for (s32 run = 0; run < 5; run++)
+    {
+        double start = BenchNow();
+        for (size_t i = 0; i < rays.size(); i++)
+        {
+            single[i] = tree.raycast(rays[i], maxDistance);
+        }
+        singleMs = fmin(singleMs, BenchNow() - start);
+
+        start = BenchNow();
+        for (s32 b = 0; b < batches; b++)
+        {
+            tree.raycast(&rays[b * batchSize], batchSize, maxDistance, &batched[b * batchSize]);
+        }
+        batchMs = fmin(batchMs, BenchNow() - start);
+    }
+
+    s32 mismatches = 0;
+    s32 hits = 0;
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        if (!SameHit(single[i], batched[i])) mismatches++;
+        if (single[i].hit) hits++;
+    }
+
+    // Alcance próprio de cada raio
+    std::vector<float> limits(rays.size());
+    for (float& limit : limits) limit = BenchRandom(seed) * 50.0f;
+    for (s32 b = 0; b < batches; b++)
+    {
+        tree.raycast(&rays[b * batchSize], batchSize, maxDistance, &batched[b * batchSize], nullptr, MASK_ALL,
+                     &limits[b * batchSize]);
+    }
+    s32 limitedMismatches = 0;
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        if (!SameHit(tree.raycast(rays[i], limits[i]), batched[i])) limitedMismatches++;
+    }
+
+    printf("%-7s N=%-5d rays=%d hits=%d  single %.2f ms  batch %.2f ms  speedup %.2fx  mismatches %d  "
+           "per-ray limit mismatches %d\n",
+           name, batchSize, (int)rays.size(), hits, singleMs, batchMs, singleMs / batchMs,
+           mismatches, limitedMismatches);
+}
+
+int main()
+{
+    BenchInit("raycast_bench");
+    if (!BenchLoadWorld(map, tree)) return 1;
+
+    const s32 sizes[] = { 8, 64, 1024 };
+    for (s32 n : sizes) Run("cone", n, MakeCone);
+    for (s32 n : sizes) Run("random", n, MakeRandom);
+
+    BenchShutdown();
+    return 0;
+}
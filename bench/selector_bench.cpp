@@ -0,0 +1,200 @@
+#include "bench.hpp"
+
+// Octree (normal e compacta), Quadtree e HashGrid (com vários tamanhos de
+// célula) no mesmo mapa:
+// construção, queries de caixa e de esfera, os candidatos do Collider
+// (getCollisionCandidates, já em espaço da elipse: é aqui que a octree
+// compacta se compara com a normal) e raycasts. Os raycasts têm de
+// dar os mesmos hits que a octree. No fim, o custo de tirar e voltar a pôr
+// triângulos na grelha contra um rebuild da octree.
+
+static const s32 RUNS = 5;
+static const s32 QUERY_COUNT = 20000;
+static const s32 RAY_COUNT = 20000;
+static const s32 CHURN_COUNT = 1000;
+static const Vector3 ELLIPSOID = { 1.6f, 2.8f, 1.6f };
+
+struct Queries
+{
+    std::vector<BoundingBox> boxes;
+    std::vector<Vector3> centers;
+    std::vector<float> radii;
+    std::vector<Ray> rays;
+};
+
+static void MakeQueries(const BoundingBox& bounds, Queries& queries)
+{
+    u32 seed = 1234;
+    for (s32 i = 0; i < QUERY_COUNT; i++)
+    {
+        // Do tamanho de um jogador a andar (o que o Collider pede)
+        Vector3 center = BenchRandomPoint(bounds, seed);
+        float size = 1.0f + BenchRandom(seed) * 4.0f;
+        queries.boxes.push_back({ Vector3Subtract(center, { size, size, size }),
+                                  Vector3Add(center, { size, size, size }) });
+        queries.centers.push_back(center);
+        queries.radii.push_back(size);
+    }
+    for (s32 i = 0; i < RAY_COUNT; i++)
+    {
+        queries.rays.push_back({ BenchRandomPoint(bounds, seed), BenchRandomDirection(seed) });
+    }
+}
+
+// Os selectors guardam cópias diferentes dos triângulos (e a octree compacta
+// reutiliza a sua a cada raycast): guarda-se o id logo a seguir ao raycast
+struct HitRecord
+{
+    bool hit;
+    u32 id;
+    float distance;
+};
+
+static bool SameHit(const HitRecord& a, const HitRecord& b)
+{
+    if (a.hit != b.hit) return false;
+    return !a.hit || (a.id == b.id && a.distance == b.distance);
+}
+
+// Melhor de RUNS para cada teste; hits recebe os raycasts da última corrida
+static void Run(const char* name, Selector& selector, double buildMs, const Queries& queries,
+                std::vector<HitRecord>& hits)
+{
+    double boxMs = 1e30, sphereMs = 1e30, collideMs = 1e30, rayMs = 1e30;
+    size_t candidates = 0;
+    hits.resize(queries.rays.size());
+    CollisionCandidates collision;
+
+    for (s32 run = 0; run < RUNS; run++)
+    {
+        candidates = 0;
+        double start = BenchNow();
+        for (const BoundingBox& box : queries.boxes)
+        {
+            candidates += selector.getCandidates(box).size();
+        }
+        boxMs = fmin(boxMs, BenchNow() - start);
+
+        start = BenchNow();
+        for (size_t i = 0; i < queries.centers.size(); i++)
+        {
+            selector.getCandidates(queries.centers[i], queries.radii[i]);
+        }
+        sphereMs = fmin(sphereMs, BenchNow() - start);
+
+        start = BenchNow();
+        for (const BoundingBox& box : queries.boxes)
+        {
+            collision.clear();
+            selector.getCollisionCandidates(box, ELLIPSOID, MASK_ALL, collision);
+        }
+        collideMs = fmin(collideMs, BenchNow() - start);
+
+        start = BenchNow();
+        for (size_t i = 0; i < queries.rays.size(); i++)
+        {
+            RayHit hit = selector.raycast(queries.rays[i], 1000.0f);
+            hits[i] = { hit.hit, hit.hit ? hit.triangle->id : 0, hit.distance };
+        }
+        rayMs = fmin(rayMs, BenchNow() - start);
+    }
+
+    printf("%-16s build %7.2f ms  box %6.2f ms (%.1f cand)  sphere %6.2f ms  collide %6.2f ms  ray %6.2f ms",
+           name, buildMs, boxMs, (double)candidates / queries.boxes.size(), sphereMs, collideMs, rayMs);
+}
+
+int main(int argc, char** argv)
+{
+    const char* fileName = argc > 1 ? argv[1] : BENCH_MAP;
+
+    BSP map;
+    if (!map.loadFromFile(fileName, false))
+    {
+        LogError("Não foi possível carregar %s", fileName);
+        return 1;
+    }
+
+    Queries queries;
+    MakeQueries(map.getBounds(), queries);
+
+    std::vector<HitRecord> reference;
+    std::vector<HitRecord> hits;
+
+    Octree octree(map.getBounds());
+    BenchAddSurfaces(map, octree);
+    double start = BenchNow();
+    octree.rebuild();
+    double octreeBuildMs = BenchNow() - start;
+    Run("octree", octree, octreeBuildMs, queries, reference);
+    printf("  memory %.0f KB\n", octree.getMemory() / 1024.0);
+
+    // Mesma árvore com os triângulos em CompactTriangles
+    Octree compact(map.getBounds());
+    compact.setCompact(true);
+    BenchAddSurfaces(map, compact);
+    start = BenchNow();
+    compact.rebuild();
+    Run("octree compact", compact, BenchNow() - start, queries, hits);
+    s32 compactMismatches = 0;
+    for (size_t i = 0; i < hits.size(); i++)
+    {
+        if (!SameHit(reference[i], hits[i])) compactMismatches++;
+    }
+    printf("  memory %.0f KB  mismatches %d\n", compact.getMemory() / 1024.0, compactMismatches);
+
+    Quadtree quadtree(map.getBounds());
+    BenchAddSurfaces(map, quadtree);
+    start = BenchNow();
+    quadtree.rebuild();
+    Run("quadtree", quadtree, BenchNow() - start, queries, hits);
+    printf("\n");
+
+    const float sizes[] = { 2.0f, 4.0f, 8.0f, 16.0f, 32.0f };
+    for (float size : sizes)
+    {
+        HashGrid grid(size);
+        start = BenchNow();
+        BenchAddSurfaces(map, grid);
+        double buildMs = BenchNow() - start;
+
+        char name[32];
+        snprintf(name, sizeof(name), "hashgrid %.0f", size);
+        Run(name, grid, buildMs, queries, hits);
+
+        s32 mismatches = 0;
+        for (size_t i = 0; i < hits.size(); i++)
+        {
+            if (!SameHit(reference[i], hits[i])) mismatches++;
+        }
+        printf("  cells %u  mismatches %d\n", grid.getCellCount(), mismatches);
+    }
+
+    // Geometria dinâmica: CHURN_COUNT triângulos saem e voltam a entrar
+    HashGrid grid(8.0f);
+    std::vector<u32> handles;
+    for (const BSPSurface& surface : map.getSurfaces())
+    {
+        u32 layers = map.getCollisionLayers(surface.textureID);
+        for (size_t i = 0; i + 2 < surface.indices.size(); i += 3)
+        {
+            handles.push_back(grid.insertTriangle(surface.vertices[surface.indices[i + 0]],
+                                                  surface.vertices[surface.indices[i + 1]],
+                                                  surface.vertices[surface.indices[i + 2]], layers));
+        }
+    }
+
+    u32 seed = 4321;
+    start = BenchNow();
+    for (s32 i = 0; i < CHURN_COUNT && !handles.empty(); i++)
+    {
+        u32 slot = (u32)(BenchRandom(seed) * handles.size()) % handles.size();
+        Triangle tri = grid.getTriangle(handles[slot]);
+        grid.removeTriangle(handles[slot]);
+        handles[slot] = grid.insertTriangle(tri.pointA, tri.pointB, tri.pointC, tri.layers);
+    }
+    double churnMs = BenchNow() - start;
+
+    printf("churn: %d remove+insert on hashgrid 8 %.3f ms (%.2f us each), octree rebuild %.2f ms\n",
+           CHURN_COUNT, churnMs, churnMs * 1000.0 / CHURN_COUNT, octreeBuildMs);
+    return 0;
+}
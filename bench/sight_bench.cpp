@@ -0,0 +1,178 @@
+#include "bench.hpp"
+#include "sight.hpp"
+
+// Linhas de visão para muitos bots: cada bot pergunta a cada frame se vê
+// todos os outros. Compara um raycast por par e por frame com o
+// SightService (com e sem PVS), em ms por frame (média e pior), raios por
+// frame e quantos resultados da cache diferem de um raio feito na hora.
+
+static const s32 BOT_COUNT = 128;
+static const s32 FRAME_COUNT = 300;
+static const float FRAME_TIME = 1.0f / 60.0f;
+static const float EYE_HEIGHT = 5.0f;
+static const float BOT_SPEED = 3.0f;
+
+struct Bot
+{
+    Vector3 eye;
+    Vector3 forward;
+    Vector3 velocity;
+};
+
+// Em cima de chãos ao acaso, a olhar para um lado qualquer
+static std::vector<Bot> SpawnBots(const PolygonMesh& mesh, u32 seed)
+{
+    std::vector<const CollisionPolygon*> floors;
+    for (const CollisionPolygon& polygon : mesh.getPolygons())
+    {
+        if (polygon.normal.y > 0.9f && (polygon.layers & LAYER_SOLID)) floors.push_back(&polygon);
+    }
+
+    std::vector<Bot> bots(BOT_COUNT);
+    for (Bot& bot : bots)
+    {
+        const CollisionPolygon& floor = *floors[(u32)(BenchRandom(seed) * floors.size()) % floors.size()];
+        const Vector3* points = mesh.getPoints(floor);
+        Vector3 center = { 0.0f, 0.0f, 0.0f };
+        for (u32 i = 0; i < floor.pointCount; i++) center = Vector3Add(center, points[i]);
+        bot.eye = Vector3Scale(center, 1.0f / (float)floor.pointCount);
+        bot.eye.y += EYE_HEIGHT;
+
+        Vector3 direction = BenchRandomDirection(seed);
+        direction.y = 0.0f;
+        bot.forward = Vector3Normalize(Vector3Add(direction, { 0.001f, 0.0f, 0.0f }));
+        bot.velocity = Vector3Scale(bot.forward, BOT_SPEED);
+    }
+    return bots;
+}
+
+static void MoveBots(std::vector<Bot>& bots, float dt)
+{
+    for (Bot& bot : bots) bot.eye = Vector3Add(bot.eye, Vector3Scale(bot.velocity, dt));
+}
+
+static bool SeesNow(const Selector& world, const SightConfig& config, const Bot& observer, const Bot& target)
+{
+    Vector3 delta = Vector3Subtract(target.eye, observer.eye);
+    float distance = Vector3Length(delta);
+    if (distance > config.maxDistance) return false;
+    Vector3 direction = Vector3Scale(delta, 1.0f / distance);
+    if (Vector3DotProduct(direction, observer.forward) < cosf(config.fieldOfView * 0.5f * DEG2RAD)) return false;
+
+    RayHit hit = world.raycast({ observer.eye, direction }, distance, nullptr, config.mask);
+    return !hit.hit || hit.distance >= distance - 0.01f;
+}
+
+struct SightRun
+{
+    double total;
+    double worst;
+    u64 rays;
+    u64 rejected;
+    u64 deferred;
+    u64 mismatches;
+    u64 checked;
+};
+
+static SightRun RunService(const Octree& tree, const BSP* map, const PolygonMesh& mesh)
+{
+    SightRun run = { 0.0, 0.0, 0, 0, 0, 0, 0 };
+    std::vector<Bot> bots = SpawnBots(mesh, 777);
+
+    SightService sight;
+    sight.setWorld(&tree, map);
+    for (s32 frame = 0; frame < FRAME_COUNT; frame++)
+    {
+        MoveBots(bots, FRAME_TIME);
+
+        double start = BenchNow();
+        for (s32 i = 0; i < BOT_COUNT; i++) sight.setAgent(i, bots[i].eye, bots[i].forward);
+        for (s32 i = 0; i < BOT_COUNT; i++)
+            for (s32 j = 0; j < BOT_COUNT; j++)
+            {
+                if (i != j) sight.query(i, j);
+            }
+        sight.update(FRAME_TIME);
+        double ms = BenchNow() - start;
+
+        // Os primeiros frames enchem a cache
+        if (frame < 30) continue;
+        run.total += ms;
+        run.worst = fmax(run.worst, ms);
+        const SightStats& stats = sight.getStats();
+        run.rays += stats.rays;
+        run.rejected += stats.rejectedDistance + stats.rejectedView + stats.rejectedPVS;
+        run.deferred += stats.deferred;
+
+        // Amostra de pares contra um raio feito agora
+        if (frame % 10 == 0)
+        {
+            for (s32 i = 0; i < BOT_COUNT; i += 4)
+                for (s32 j = 1; j < BOT_COUNT; j += 3)
+                {
+                    if (i == j) continue;
+                    SightResult result = sight.query(i, j);
+                    if (result.age == FLT_MAX) continue;
+                    run.checked++;
+                    if (result.visible != SeesNow(tree, sight.getConfig(), bots[i], bots[j])) run.mismatches++;
+                }
+        }
+    }
+    return run;
+}
+
+int main(int argc, char** argv)
+{
+    s32 mapCount = BenchMapCount(argc);
+    for (s32 m = 0; m < mapCount; m++)
+    {
+        const char* fileName = BenchMapName(argc, argv, m);
+
+        BSP map;
+        if (!map.loadFromFile(fileName, false)) continue;
+        PolygonMesh mesh;
+        BenchBuildPolygons(map, mesh);
+        Octree tree;
+        tree.setWorldBounds(map.getBounds());
+        mesh.addTo(tree);
+        tree.rebuild();
+
+        printf("%-22s %d bots, %d pairs, PVS %s\n", fileName, BOT_COUNT, BOT_COUNT * (BOT_COUNT - 1),
+               map.hasVisibility() ? "yes" : "no");
+
+        // Um raio por par e por frame
+        SightConfig config;
+        std::vector<Bot> bots = SpawnBots(mesh, 777);
+        double total = 0.0, worst = 0.0;
+        u64 visible = 0;
+        for (s32 frame = 0; frame < FRAME_COUNT; frame++)
+        {
+            MoveBots(bots, FRAME_TIME);
+            double start = BenchNow();
+            for (s32 i = 0; i < BOT_COUNT; i++)
+                for (s32 j = 0; j < BOT_COUNT; j++)
+                {
+                    if (i != j && SeesNow(tree, config, bots[i], bots[j])) visible++;
+                }
+            double ms = BenchNow() - start;
+            if (frame < 30) continue;
+            total += ms;
+            worst = fmax(worst, ms);
+        }
+        s32 frames = FRAME_COUNT - 30;
+        printf("  %-12s ms/frame %7.3f  worst %7.3f  visible/frame %7.1f\n", "every frame",
+               total / frames, worst, (double)visible / FRAME_COUNT);
+
+        SightRun runs[2] = { RunService(tree, nullptr, mesh), RunService(tree, &map, mesh) };
+        for (s32 r = 0; r < 2; r++)
+        {
+            const SightRun& run = runs[r];
+            printf("  %-12s ms/frame %7.3f  worst %7.3f  rays/frame %7.1f  rejected/frame %7.1f  "
+                   "deferred/frame %6.1f  stale mismatches %.2f%%\n",
+                   r == 0 ? "service" : "service+PVS", run.total / frames, run.worst,
+                   (double)run.rays / frames, (double)run.rejected / frames, (double)run.deferred / frames,
+                   run.checked ? 100.0 * run.mismatches / run.checked : 0.0);
+        }
+    }
+    return 0;
+}
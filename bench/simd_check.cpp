@@ -0,0 +1,295 @@
+#include "bench.hpp"
+
+// Os kernels SSE2 contra as versões escalares nos mesmos candidatos:
+// TestTriangleIntersection4 com esferas a varrer perto dos triângulos do
+// mapa (os candidatos da caixa do varrimento, de 4 em 4 como em
+// gatherCandidates), IntersectRayTriangle4 e IntersectRayBox4 com pacotes de
+// 4 raios apontados a um triângulo. Os resultados têm de ser iguais bit a bit;
+// sai com 1 se algum for diferente. Mede também o empacotamento dos
+// candidatos por query contra o tempo do kernel.
+// Compilado com COLLISION_SCALAR os dois lados são a versão escalar.
+
+static const s32 SWEEP_COUNT = 20000;
+static const s32 RAY_PACKET_COUNT = 20000;
+static const Vector3 RADIUS = { 1.6f, 2.8f, 1.6f };
+
+// Um varrimento em espaço da elipse e os seus candidatos em triangles
+struct Sweep
+{
+    Vector3 basePoint;
+    Vector3 velocity;
+    u32 first;
+    u32 count;
+};
+
+// 4 raios apontados a um triângulo, com a caixa desse triângulo
+struct RayCase
+{
+    RayPacket rays;
+    float maxDistance[4];
+    const Triangle* triangle;
+    BoundingBox box;
+};
+
+static void ResetSweep(CollisionData& colData, const Sweep& sweep)
+{
+    colData.basePoint = sweep.basePoint;
+    colData.velocity = sweep.velocity;
+    colData.normalizedVelocity = Vector3Normalize(sweep.velocity);
+    colData.foundCollision = false;
+    colData.nearestDistance = FLT_MAX;
+    colData.intersectionPoint = { 0.0f, 0.0f, 0.0f };
+    colData.triangleHits = 0;
+}
+
+static bool SameSweep(const CollisionData& a, const CollisionData& b)
+{
+    return a.foundCollision == b.foundCollision && a.triangleHits == b.triangleHits
+        && a.nearestDistance == b.nearestDistance && a.intersectionPoint.x == b.intersectionPoint.x
+        && a.intersectionPoint.y == b.intersectionPoint.y && a.intersectionPoint.z == b.intersectionPoint.z;
+}
+
+// O mesmo empacotamento que gatherCandidates faz a cada query
+static void Pack(const CollisionTriangle* triangles, u32 count, TrianglePacket* packets)
+{
+    for (u32 i = 0; i < count; i++)
+    {
+        TrianglePacket& packet = packets[i / TRIANGLE_PACKET_SIZE];
+        s32 lane = i % TRIANGLE_PACKET_SIZE;
+        packet.set(lane, triangles[i]);
+        packet.count = lane + 1;
+    }
+}
+
+static u32 PacketCount(u32 triangleCount)
+{
+    return (triangleCount + TRIANGLE_PACKET_SIZE - 1) / TRIANGLE_PACKET_SIZE;
+}
+
+static Vector3 PointOnTriangle(const Triangle& tri, u32& seed)
+{
+    float u = BenchRandom(seed);
+    float v = BenchRandom(seed);
+    if (u + v > 1.0f)
+    {
+        u = 1.0f - u;
+        v = 1.0f - v;
+    }
+    return Vector3Add(tri.pointA, Vector3Add(Vector3Scale(Vector3Subtract(tri.pointB, tri.pointA), u),
+                                             Vector3Scale(Vector3Subtract(tri.pointC, tri.pointA), v)));
+}
+
+static void MakeSweeps(const Octree& tree, const std::vector<const Triangle*>& all, u32& seed,
+                       std::vector<CollisionTriangle>& triangles, std::vector<Sweep>& sweeps)
+{
+    sweeps.resize(SWEEP_COUNT);
+    for (Sweep& sweep : sweeps)
+    {
+        // Perto de um triângulo ao acaso, para haver contactos
+        const Triangle& tri = *all[(u32)(BenchRandom(seed) * all.size()) % all.size()];
+        Vector3 start = Vector3Add(PointOnTriangle(tri, seed), Vector3Scale(tri.normal, BenchRandom(seed) * 4.0f));
+        start = Vector3Add(start, Vector3Scale(BenchRandomDirection(seed), 2.0f));
+        Vector3 velocity = Vector3Scale(BenchRandomDirection(seed), 0.5f + BenchRandom(seed) * 4.0f);
+        Vector3 end = Vector3Add(start, velocity);
+
+        BoundingBox area = { Vector3Subtract(Vector3Min(start, end), RADIUS), Vector3Add(Vector3Max(start, end), RADIUS) };
+        std::vector<const Triangle*> found = tree.getCandidates(area);
+
+        sweep.basePoint = Vector3Divide(start, RADIUS);
+        sweep.velocity = Vector3Divide(velocity, RADIUS);
+        sweep.first = (u32)triangles.size();
+        sweep.count = (u32)found.size();
+        triangles.resize(triangles.size() + found.size());
+        for (size_t i = 0; i < found.size(); i++)
+        {
+            BuildCollisionTriangle(*found[i], RADIUS, triangles[sweep.first + i]);
+        }
+    }
+}
+
+static void MakeRays(const std::vector<const Triangle*>& all, u32& seed, std::vector<RayCase>& cases)
+{
+    cases.resize(RAY_PACKET_COUNT);
+    for (RayCase& ray : cases)
+    {
+        const Triangle& tri = *all[(u32)(BenchRandom(seed) * all.size()) % all.size()];
+        Vector3 origin = Vector3Add(PointOnTriangle(tri, seed), Vector3Scale(tri.normal, 0.5f + BenchRandom(seed) * 20.0f));
+
+        for (s32 lane = 0; lane < 4; lane++)
+        {
+            Vector3 position = Vector3Add(origin, Vector3Scale(BenchRandomDirection(seed), BenchRandom(seed) * 3.0f));
+            Vector3 direction = Vector3Subtract(PointOnTriangle(tri, seed), position);
+            // Lane 2 com um eixo paralelo (inverso a 0), lane 3 ao acaso
+            if (lane == 2) direction.x = 0.0f;
+            if (lane == 3 || Vector3LengthSqr(direction) < 1e-6f) direction = BenchRandomDirection(seed);
+            ray.rays.set(lane, { position, Vector3Normalize(direction) });
+            ray.maxDistance[lane] = BenchRandom(seed) * 40.0f;
+        }
+
+        float grow = BenchRandom(seed) * 2.0f;
+        ray.triangle = &tri;
+        ray.box = { Vector3Subtract(tri.bounds.min, { grow, grow, grow }), Vector3Add(tri.bounds.max, { grow, grow, grow }) };
+    }
+}
+
+// Pacotes com resultados diferentes; depois de uma diferença o escalar
+// continua do estado do SIMD, para não a contar outra vez nos seguintes
+static s32 CheckSweeps(const std::vector<CollisionTriangle>& triangles, const std::vector<Sweep>& sweeps, s32& hits)
+{
+    s32 mismatches = 0;
+    std::vector<TrianglePacket> packets;
+    for (const Sweep& sweep : sweeps)
+    {
+        packets.assign(PacketCount(sweep.count), TrianglePacket());
+        Pack(&triangles[sweep.first], sweep.count, packets.data());
+
+        CollisionData simd;
+        CollisionData scalar;
+        ResetSweep(simd, sweep);
+        ResetSweep(scalar, sweep);
+        for (const TrianglePacket& packet : packets)
+        {
+            s32 simdLane = TestTriangleIntersection4(&simd, packet);
+            s32 scalarLane = TestTriangleIntersection4Scalar(&scalar, packet);
+            if (simdLane != scalarLane || !SameSweep(simd, scalar))
+            {
+                mismatches++;
+                scalar = simd;
+            }
+        }
+        if (simd.foundCollision) hits++;
+    }
+    return mismatches;
+}
+
+static s32 CheckRayTriangles(const std::vector<RayCase>& cases, s32& hits)
+{
+    s32 mismatches = 0;
+    for (const RayCase& ray : cases)
+    {
+        float simdDistance[4];
+        float scalarDistance[4];
+        s32 simd = IntersectRayTriangle4(ray.rays, *ray.triangle, simdDistance);
+        s32 scalar = IntersectRayTriangle4Scalar(ray.rays, *ray.triangle, scalarDistance);
+
+        bool same = simd == scalar;
+        for (s32 lane = 0; lane < 4 && same; lane++)
+        {
+            if ((simd & (1 << lane)) && simdDistance[lane] != scalarDistance[lane]) same = false;
+        }
+        if (!same) mismatches++;
+        for (s32 lane = 0; lane < 4; lane++) hits += (simd >> lane) & 1;
+    }
+    return mismatches;
+}
+
+static s32 CheckRayBoxes(const std::vector<RayCase>& cases, s32& hits)
+{
+    s32 mismatches = 0;
+    for (const RayCase& ray : cases)
+    {
+        float simdEntry[4];
+        float scalarEntry[4];
+        s32 simd = IntersectRayBox4(ray.rays, ray.box, ray.maxDistance, simdEntry);
+        s32 scalar = IntersectRayBox4Scalar(ray.rays, ray.box, ray.maxDistance, scalarEntry);
+
+        bool same = simd == scalar;
+        for (s32 lane = 0; lane < 4 && same; lane++)
+        {
+            if ((simd & (1 << lane)) && simdEntry[lane] != scalarEntry[lane]) same = false;
+        }
+        if (!same) mismatches++;
+        for (s32 lane = 0; lane < 4; lane++) hits += (simd >> lane) & 1;
+    }
+    return mismatches;
+}
+
+// Melhor de 5 corridas de todos os varrimentos com os pacotes já feitos
+static double TimeSweeps(const std::vector<TrianglePacket>& packets, const std::vector<u32>& firstPacket,
+                         const std::vector<Sweep>& sweeps, s32 (*test)(CollisionData*, const TrianglePacket&))
+{
+    double best = 1e30;
+    for (s32 run = 0; run < 5; run++)
+    {
+        double start = BenchNow();
+        for (size_t s = 0; s < sweeps.size(); s++)
+        {
+            CollisionData colData;
+            ResetSweep(colData, sweeps[s]);
+            for (u32 p = firstPacket[s]; p < firstPacket[s + 1]; p++)
+            {
+                test(&colData, packets[p]);
+            }
+        }
+        best = fmin(best, BenchNow() - start);
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    bool failed = false;
+    s32 mapCount = BenchMapCount(argc);
+    for (s32 m = 0; m < mapCount; m++)
+    {
+        const char* fileName = BenchMapName(argc, argv, m);
+
+        BSP map;
+        Octree tree;
+        if (!BenchLoadWorld(map, tree, fileName, false)) continue;
+
+        std::vector<const Triangle*> all = tree.getCandidates(map.getBounds());
+        if (all.empty()) continue;
+
+        u32 seed = 2468;
+        std::vector<CollisionTriangle> triangles;
+        std::vector<Sweep> sweeps;
+        std::vector<RayCase> rays;
+        MakeSweeps(tree, all, seed, triangles, sweeps);
+        MakeRays(all, seed, rays);
+
+        s32 sweepHits = 0;
+        s32 triangleHits = 0;
+        s32 boxHits = 0;
+        s32 sweepMismatches = CheckSweeps(triangles, sweeps, sweepHits);
+        s32 triangleMismatches = CheckRayTriangles(rays, triangleHits);
+        s32 boxMismatches = CheckRayBoxes(rays, boxHits);
+        failed |= sweepMismatches + triangleMismatches + boxMismatches > 0;
+
+        // Empacotamento por query (num buffer reutilizado, como o thread_local
+        // de gatherCandidates) contra os kernels sobre os pacotes já feitos
+        std::vector<u32> firstPacket(sweeps.size() + 1, 0);
+        for (size_t s = 0; s < sweeps.size(); s++)
+        {
+            firstPacket[s + 1] = firstPacket[s] + PacketCount(sweeps[s].count);
+        }
+        std::vector<TrianglePacket> packets(firstPacket.back());
+        std::vector<TrianglePacket> scratch;
+        double packMs = 1e30;
+        for (s32 run = 0; run < 5; run++)
+        {
+            double start = BenchNow();
+            for (size_t s = 0; s < sweeps.size(); s++)
+            {
+                scratch.resize(PacketCount(sweeps[s].count));
+                Pack(&triangles[sweeps[s].first], sweeps[s].count, scratch.data());
+            }
+            packMs = fmin(packMs, BenchNow() - start);
+        }
+        for (size_t s = 0; s < sweeps.size(); s++)
+        {
+            Pack(&triangles[sweeps[s].first], sweeps[s].count, &packets[firstPacket[s]]);
+        }
+        double simdMs = TimeSweeps(packets, firstPacket, sweeps, TestTriangleIntersection4);
+        double scalarMs = TimeSweeps(packets, firstPacket, sweeps, TestTriangleIntersection4Scalar);
+
+        double perQuery = 1000.0 / SWEEP_COUNT;
+        printf("%-22s sweeps %d (%.1f candidates, %d hits)  pack %.3f us  simd %.3f us  scalar %.3f us per query  "
+               "mismatches %d\n",
+               fileName, SWEEP_COUNT, (double)triangles.size() / SWEEP_COUNT, sweepHits,
+               packMs * perQuery, simdMs * perQuery, scalarMs * perQuery, sweepMismatches);
+        printf("%-22s rays %d  triangle hits %d  mismatches %d  box hits %d  mismatches %d\n",
+               "", RAY_PACKET_COUNT * 4, triangleHits, triangleMismatches, boxHits, boxMismatches);
+    }
+    return failed ? 1 : 0;
+}
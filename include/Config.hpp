@@ -20,3 +20,10 @@ typedef uint64_t u64;
 void LogError( const char *msg, ... );
 void LogInfo( const char *msg, ... );
 void LogWarning( const char *msg, ... );
+
+// FNV-1a de 64 bits; hash permite encadear vários blocos
+u64 HashFNV1a( const void *data, size_t size, u64 hash = 14695981039346656037ULL );
+
+// fileName com a extensão trocada ("maps/a.bsp", ".oct" -> "maps/a.oct");
+// sem extensão, junta-a no fim
+std::string ChangeFileExtension( const char *fileName, const char *extension );
@@ -0,0 +1,222 @@
+#pragma once
+#include "Config.hpp"
+#include <raylib.h>
+#include <vector>
+
+// Árvore dinâmica de AABBs (broadphase) para objetos da cena.
+// Cada proxy guarda uma caixa "gorda" (com margem), assim pequenos
+// movimentos não obrigam a reinserir. A inserção escolhe o irmão pelo
+// custo de área de superfície e rotações AVL mantêm a altura baixa.
+class AABBTree
+{
+public:
+    static constexpr s32 NULL_NODE = -1;
+
+    explicit AABBTree(float margin = 0.1f);
+
+    s32 insert(const BoundingBox& box, void* userData);
+    void remove(s32 proxy);
+    // Devolve true se a proxy foi reinserida (saiu da caixa gorda)
+    bool move(s32 proxy, const BoundingBox& box, const Vector3& displacement);
+    void clear();
+
+    void* getUserData(s32 proxy) const { return nodes[proxy].userData; }
+    const BoundingBox& getFatBounds(s32 proxy) const { return nodes[proxy].box; }
+
+    s32 getHeight() const { return root == NULL_NODE ? 0 : nodes[root].height; }
+    s32 getProxyCount() const { return proxyCount; }
+    s32 getNodeCount() const { return nodeCount; }
+    // Soma das áreas dos nós / área da raiz (qualidade da árvore)
+    float getAreaRatio() const;
+
+    // test(box) decide se desce; callback(proxy) devolve false para parar
+    template <typename Test, typename Callback>
+    void query(const Test& test, const Callback& callback) const;
+
+    template <typename Callback>
+    void query(const BoundingBox& area, const Callback& callback) const;
+
+    template <typename Callback>
+    void query(const Vector3& center, float radius, const Callback& callback) const;
+
+    // Percorre as proxies por ordem de entrada no raio.
+    // callback(proxy, maxDistance) devolve a nova distância máxima
+    // (menor para cortar o resto, <= 0 para parar)
+    template <typename Callback>
+    void raycast(const Ray& ray, float maxDistance, const Callback& callback) const;
+
+private:
+    struct Node
+    {
+        BoundingBox box;
+        void* userData;
+        s32 parent;     // ou next, na lista livre
+        s32 child1;
+        s32 child2;
+        s32 height;     // 0 folha, -1 livre
+
+        bool isLeaf() const { return child1 == NULL_NODE; }
+    };
+
+    struct Entry
+    {
+        s32 node;
+        float distance;
+    };
+
+    std::vector<Node> nodes;
+    s32 root = NULL_NODE;
+    s32 freeList = NULL_NODE;
+    s32 nodeCount = 0;
+    s32 proxyCount = 0;
+    float margin;
+
+    s32 allocateNode();
+    void freeNode(s32 node);
+    void insertLeaf(s32 leaf);
+    void removeLeaf(s32 leaf);
+    s32 balance(s32 node);
+
+    static bool intersectRay(const Ray& ray, const Vector3& invDir,
+                             const BoundingBox& box, float maxDistance, float* entry);
+};
+
+inline bool AABBTree::intersectRay(const Ray& ray, const Vector3& invDir,
+                                   const BoundingBox& box, float maxDistance, float* entry)
+{
+    // Slab test; eixos paralelos (invDir 0) só passam com a origem dentro
+    const float o[3] = { ray.position.x, ray.position.y, ray.position.z };
+    const float d[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+    const float inv[3] = { invDir.x, invDir.y, invDir.z };
+    const float lo[3] = { box.min.x, box.min.y, box.min.z };
+    const float hi[3] = { box.max.x, box.max.y, box.max.z };
+
+    float tmin = 0.0f;
+    float tmax = maxDistance;
+    for (int i = 0; i < 3; i++)
+    {
+        if (d[i] == 0.0f)
+        {
+            if (o[i] < lo[i] || o[i] > hi[i]) return false;
+            continue;
+        }
+        float t0 = (lo[i] - o[i]) * inv[i];
+        float t1 = (hi[i] - o[i]) * inv[i];
+        if (t0 > t1) { float t = t0; t0 = t1; t1 = t; }
+        if (t0 > tmin) tmin = t0;
+        if (t1 < tmax) tmax = t1;
+        if (tmin > tmax) return false;
+    }
+    *entry = tmin;
+    return true;
+}
+
+template <typename Test, typename Callback>
+void AABBTree::query(const Test& test, const Callback& callback) const
+{
+    if (root == NULL_NODE) return;
+
+    std::vector<s32> stack;
+    stack.reserve(64);
+    stack.push_back(root);
+
+    while (!stack.empty())
+    {
+        s32 index = stack.back();
+        stack.pop_back();
+
+        const Node& node = nodes[index];
+        if (!test(node.box)) continue;
+
+        if (node.isLeaf())
+        {
+            if (!callback(index)) return;
+            continue;
+        }
+
+        stack.push_back(node.child1);
+        stack.push_back(node.child2);
+    }
+}
+
+template <typename Callback>
+void AABBTree::query(const BoundingBox& area, const Callback& callback) const
+{
+    query([&](const BoundingBox& box)
+    {
+        return box.min.x <= area.max.x && box.max.x >= area.min.x &&
+               box.min.y <= area.max.y && box.max.y >= area.min.y &&
+               box.min.z <= area.max.z && box.max.z >= area.min.z;
+    }, callback);
+}
+
+template <typename Callback>
+void AABBTree::query(const Vector3& center, float radius, const Callback& callback) const
+{
+    const float radiusSq = radius * radius;
+    query([&](const BoundingBox& box)
+    {
+        // distância do centro ao ponto mais próximo da caixa
+        float dx = (center.x < box.min.x) ? box.min.x - center.x : (center.x > box.max.x ? center.x - box.max.x : 0.0f);
+        float dy = (center.y < box.min.y) ? box.min.y - center.y : (center.y > box.max.y ? center.y - box.max.y : 0.0f);
+        float dz = (center.z < box.min.z) ? box.min.z - center.z : (center.z > box.max.z ? center.z - box.max.z : 0.0f);
+        return dx * dx + dy * dy + dz * dz <= radiusSq;
+    }, callback);
+}
+
+template <typename Callback>
+void AABBTree::raycast(const Ray& ray, float maxDistance, const Callback& callback) const
+{
+    if (root == NULL_NODE) return;
+
+    Vector3 invDir = {
+        ray.direction.x != 0.0f ? 1.0f / ray.direction.x : 0.0f,
+        ray.direction.y != 0.0f ? 1.0f / ray.direction.y : 0.0f,
+        ray.direction.z != 0.0f ? 1.0f / ray.direction.z : 0.0f
+    };
+
+    float entry;
+    if (!intersectRay(ray, invDir, nodes[root].box, maxDistance, &entry)) return;
+
+    std::vector<Entry> stack;
+    stack.reserve(64);
+    stack.push_back({ root, entry });
+
+    while (!stack.empty())
+    {
+        Entry top = stack.back();
+        stack.pop_back();
+
+        // o máximo pode ter encolhido desde que entrou na pilha
+        if (top.distance > maxDistance) continue;
+
+        const Node& node = nodes[top.node];
+        if (node.isLeaf())
+        {
+            maxDistance = callback(top.node, maxDistance);
+            if (maxDistance <= 0.0f) return;
+            continue;
+        }
+
+        float entry1, entry2;
+        bool hit1 = intersectRay(ray, invDir, nodes[node.child1].box, maxDistance, &entry1);
+        bool hit2 = intersectRay(ray, invDir, nodes[node.child2].box, maxDistance, &entry2);
+
+        // o mais próximo fica no topo
+        if (hit1 && hit2)
+        {
+            if (entry1 <= entry2)
+            {
+                stack.push_back({ node.child2, entry2 });
+                stack.push_back({ node.child1, entry1 });
+            }
+            else
+            {
+                stack.push_back({ node.child1, entry1 });
+                stack.push_back({ node.child2, entry2 });
+            }
+        }
+        else if (hit1) stack.push_back({ node.child1, entry1 });
+        else if (hit2) stack.push_back({ node.child2, entry2 });
+    }
+}
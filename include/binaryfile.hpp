@@ -19,6 +19,7 @@ public:
 
     u32 getFileSize();
     u32 ftell();
+    const void* getData() const { return data; }
 
     u32 seek(u32 offset, u32 origin);
     u32 readBytes(void* buffer, u32 size);
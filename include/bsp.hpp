@@ -21,10 +21,24 @@ struct BSPHeader
 struct BSPTexture
 {
     c8 strName[64]; // The name of the texture w/o the extension
-    u32 flags; // The surface flags (unknown)
-    u32 contents; // The content flags (unknown)
+    u32 flags; // The surface flags (SURF_*)
+    u32 contents; // The content flags (CONTENTS_*)
 };
 
+// Bits de BSPTexture::contents e BSPTexture::flags (Quake 3) que contam para a colisão
+#define CONTENTS_SOLID        0x1
+#define CONTENTS_LAVA         0x8
+#define CONTENTS_SLIME        0x10
+#define CONTENTS_WATER        0x20
+#define CONTENTS_PLAYERCLIP   0x10000
+#define CONTENTS_MONSTERCLIP  0x20000
+#define CONTENTS_BOTCLIP      0x400000
+#define CONTENTS_TRANSLUCENT  0x20000000
+
+#define SURF_SKY              0x4
+#define SURF_NONSOLID         0x4000
+#define SURF_ALPHASHADOW      0x10000
+
 struct BSPLightmap
 {
     u8 imageBits[128][128][3]; // The RGB data in a 128x128 image
@@ -204,13 +218,17 @@ private:
     s32 NumModels;
 
     BSPPlane* Planes{ nullptr };
-    s32 NumPlanes;
+    s32 NumPlanes{ 0 };
 
     BSPNode* Nodes{ nullptr };
-    s32 NumNodes;
+    s32 NumNodes{ 0 };
 
     BSPLeaf* Leafs{ nullptr };
-    s32 NumLeafs;
+    s32 NumLeafs{ 0 };
+
+    std::vector<u8> visBits;
+    s32 numClusters{ 0 };
+    s32 bytesPerCluster{ 0 };
 
     s32* Indices{ nullptr };
     s32 NumIndices;
@@ -222,15 +240,20 @@ private:
     s32 NumMeshVerts;
 
     BSPBrush* Brushes{ nullptr };
-    s32 NumBrushes;
+    s32 NumBrushes{ 0 };
+
+    BSPBrushSide* BrushSides{ nullptr };
+    s32 NumBrushSides{ 0 };
 
     s32 NumEntities;
     std::vector<u8> Entities;
 
     float lmgamma = { 1.0f };
+    bool graphics = { true };
 
     std::vector<BSPSurface> Surfaces;
     std::vector<BSPSurface> mergedSurfaces;
+    std::vector<BSPSurface> clipSurfaces;  // um por brush de clip, só colisão
     //  std::vector<Image> images;
     std::vector<Mesh> meshes;
 
@@ -241,8 +264,12 @@ private:
     void loadIndex(BinaryFile& file);
     void LoadEntities(BinaryFile& file);
     void loadModels(BinaryFile& file);
+    void loadVisibility(BinaryFile& file);
+    void loadBrushes(BinaryFile& file);
 
     void BuildSurfaces();
+    void BuildClipSurfaces();
+    bool HasSamePlane(const BSPBrush& brush, s32 side) const;
     void MergeSurfacesByMaterial();
     void CreateMeshesFromMergedSurfaces();
  
@@ -255,6 +282,7 @@ private:
  
     float scale = {0.1f};
     Matrix transform;
+    u64 contentHash = 0;
     
     std::vector<Texture2D> textures;
     std::vector<Texture2D> lightmaps;
@@ -335,7 +363,9 @@ private:
   
 
 public:
-    bool loadFromFile(const std::string& filePath);
+    // graphics = false só carrega a geometria (colisão): sem texturas nem
+    // buffers na GPU, por isso funciona sem janela. Um mapa assim não se desenha.
+    bool loadFromFile(const std::string& filePath, bool graphics = true);
     void drawDebugSurfaces();
     void clear();
     void render(ViewFrustum& frustum,Shader &shader);
@@ -343,9 +373,31 @@ public:
     
 
     const std::vector<BSPSurface>& getSurfaces() const { return mergedSurfaces; }
+    // Brushes de clip (só bloqueiam quem anda) não têm faces desenhadas: os
+    // lados de cada um, em triângulos, com a textura do brush
+    const std::vector<BSPSurface>& getClipSurfaces() const { return clipSurfaces; }
+    // Nome e flags da textura de BSPSurface::textureID (nullptr se não existe)
+    const BSPTexture* getTexture(s32 id) const
+    {
+        return (id >= 0 && id < NumTextures) ? &Textures[id] : nullptr;
+    }
+    // CollisionLayer dos triângulos de uma superfície com esta textura
+    u32 getCollisionLayers(s32 textureID) const;
+
+    // PVS do q3map: um cluster só vê os clusters marcados no seu bitset.
+    // Sem vis no .bsp (ou fora das folhas) isClusterVisible diz sempre que sim.
+    bool hasVisibility() const { return !visBits.empty(); }
+    // Cluster da folha onde está point (-1 se não há árvore ou é sólido)
+    s32 findCluster(const Vector3& point) const;
+    bool isClusterVisible(s32 from, s32 to) const;
 
     u32 getViewCount() const { return  view_count; }
     BoundingBox getBounds() const { return bounds; }
+    // Hash do ficheiro .bsp (chave das caches em disco)
+    u64 getContentHash() const { return contentHash; }
+    // O mesmo com a versão da geometria de colisão (getSurfaces e
+    // getClipSurfaces): chave das caches da octree e da navmesh
+    u64 getCollisionHash() const;
 
     BSP();
     ~BSP();
@@ -2,6 +2,7 @@
 #include "Config.hpp"
 #include "collision.hpp"
 
+class MoveTrace;
 
 class CameraFPS {
 public:
@@ -14,8 +15,21 @@ public:
     void Stats();
     bool IsMoving() { return isMoving; }
 
+    // Centro da elipse; SetPosition leva a câmara junto (empurrões de CharacterSet)
+    Vector3 GetPosition() const { return translation; }
+    void SetPosition(const Vector3& position);
+
     void StartShake(float duration, float intensity);
 
+    // Com trace, cada Update grava o movimento (entradas e resultado)
+    void SetTrace(MoveTrace* trace) { this->trace = trace; }
+    MoveTrace* GetTrace() const { return trace; }
+
+    // Candidatos de colisão reaproveitados entre frames (taxa de acertos)
+    const CandidateCache& GetCollisionCache() const { return collisionCache; }
+    // Chão do último frame (gravidade sem varrimento enquanto apoiado)
+    const GroundContact& GetGroundContact() const { return groundContact; }
+
 private:
     float mouseSensitivity = 0.003f;
     float walkSpeed = 25.0f;
@@ -44,6 +58,9 @@ private:
     Vector3 hitPosition;
 
     bool useFreeCamera = false;
+    MoveTrace* trace = nullptr;
+    CandidateCache collisionCache;
+    GroundContact groundContact;
 
 
       bool isShaking = false;
@@ -0,0 +1,73 @@
+#pragma once
+#include "Config.hpp"
+#include "collision.hpp"
+
+// Folga das caixas da broadphase, em fração do raio: os empurrões de um
+// resolve podem levar um personagem contra um vizinho que ainda não tocava
+#define CHARACTER_PAIR_MARGIN 0.5f
+
+// Cápsula vertical de um personagem, centrada em position como a elipse do
+// Collider: o segmento vai de position.y - (halfHeight - radius) até
+// position.y + (halfHeight - radius)
+struct CharacterCapsule
+{
+    Vector3 position;
+    float radius;
+    float halfHeight;    // do centro ao topo (>= radius)
+    float mass;          // 0 = não se mexe (empurra mas não é empurrado)
+    bool active;
+};
+
+struct CharacterPair
+{
+    u32 a;
+    u32 b;
+};
+
+// Contadores do último resolve (ou findPairs)
+struct CharacterStats
+{
+    u32 characters{0};
+    u32 swaps{0};         // trocas do insertion sort (quanto a ordem mudou)
+    u32 pairs{0};         // pares com caixas (com folga) sobrepostas (broadphase)
+    u32 overlaps{0};      // pares com as cápsulas sobrepostas
+    u32 resolved{0};      // personagens empurrados
+    u32 iterations{0};
+    double time{0.0};     // ms
+};
+
+// Colisão entre personagens. Broadphase sweep-and-prune em x: as cápsulas
+// ficam ordenadas pela ponta mínima e a ordem do frame anterior só precisa
+// de um insertion sort (quase linear, porque quase não muda). Só os pares
+// sobrepostos em x, y e z chegam ao teste das cápsulas.
+//
+// resolve() afasta as cápsulas sobrepostas na horizontal (ninguém é
+// empurrado para cima da cabeça do outro), repartindo pela massa, e aplica
+// o empurrão pelo collide-and-slide do Collider para não entrar nas paredes.
+// Chama-se depois de mover os personagens no frame.
+class CharacterSet
+{
+public:
+    u32 add(const Vector3& position, float radius, float halfHeight, float mass = 1.0f);
+    void remove(u32 id);
+    void clear();
+
+    void setPosition(u32 id, const Vector3& position) { capsules[id].position = position; }
+    const Vector3& getPosition(u32 id) const { return capsules[id].position; }
+    const CharacterCapsule& getCapsule(u32 id) const { return capsules[id]; }
+    u32 getCount() const { return activeCount; }
+
+    void findPairs(std::vector<CharacterPair>& out);
+    // world pode ser nullptr (empurra sem testar o mundo)
+    void resolve(const Collider* world, u32 iterations = 4, u32 mask = MASK_MOVEMENT);
+
+    const CharacterStats& getStats() const { return stats; }
+
+private:
+    std::vector<CharacterCapsule> capsules;
+    std::vector<u32> order;       // ativos, pela ponta mínima da caixa em x
+    std::vector<CharacterPair> pairs;
+    std::vector<Vector3> pushes;
+    u32 activeCount{0};
+    CharacterStats stats;
+};
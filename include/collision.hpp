@@ -1,11 +1,33 @@
 #pragma once
 #include "Config.hpp"
+#include "collisionstats.hpp"
+#include <unordered_map>
 
 class BSPSurface;
 class Scene;
+class ThreadPool;
 
 #define MAX_RECURSION 5
 
+// Camadas de colisão de um triângulo (bits de Triangle::layers), tiradas dos
+// contents/flags da textura no BSP (BSP::getCollisionLayers). As queries e os
+// raycasts recebem uma máscara e ignoram os triângulos sem nenhum bit em comum.
+// CompactTriangles guarda-as em 8 bits.
+enum CollisionLayer : u32
+{
+    LAYER_SOLID      = 1 << 0, // paredes e chão
+    LAYER_GRATE      = 1 << 1, // sólido mas recortado: grelhas, redes, bandeiras
+    LAYER_PLAYERCLIP = 1 << 2, // só para quem anda (clip de jogador/monstro/bot)
+    LAYER_SKY        = 1 << 3,
+    LAYER_LIQUID     = 1 << 4, // água, lava, slime
+    LAYER_NONSOLID   = 1 << 5  // nevoeiro, chamas, decoração sem colisão
+};
+
+#define MASK_ALL      0xFFFFFFFFu
+#define MASK_MOVEMENT (LAYER_SOLID | LAYER_GRATE | LAYER_PLAYERCLIP | LAYER_SKY)
+#define MASK_SHOT     (LAYER_SOLID | LAYER_SKY)   // tiros passam grelhas e clips
+#define MASK_PARTICLE (LAYER_SOLID | LAYER_GRATE | LAYER_LIQUID)
+
 
 struct Triangle
 {
@@ -14,6 +36,12 @@ struct Triangle
     Vector3 pointC;
     BoundingBox bounds;
     Vector3 normal; 
+    float planeD;   // plano: dot(normal, p) + planeD = 0
+    Vector3 edgeAB;
+    Vector3 edgeBC;
+    Vector3 edgeCA;
+    u32 id{0}; // índice no Selector que o guarda (usado para marcar visitas)
+    u32 layers{LAYER_SOLID}; // CollisionLayer
 
     void updateBounds()
     {
@@ -26,12 +54,94 @@ struct Triangle
         bounds.max = Vector3Add(bounds.max, {EPSILON, EPSILON, EPSILON});
         
 
-        Vector3 edge1 = Vector3Subtract(pointB, pointA);
-        Vector3 edge2 = Vector3Subtract(pointC, pointA);
-        normal = Vector3Normalize(Vector3CrossProduct(edge1, edge2));
+        edgeAB = Vector3Subtract(pointB, pointA);
+        edgeBC = Vector3Subtract(pointC, pointB);
+        edgeCA = Vector3Subtract(pointA, pointC);
+        normal = Vector3Normalize(Vector3CrossProduct(edgeAB, Vector3Negate(edgeCA)));
+        planeD = -Vector3DotProduct(normal, pointA);
     }
 };
 
+// Triângulo em espaço da elipse com tudo o que o teste esfera-triângulo
+// precisa já calculado: plano, arestas, comprimentos e os produtos internos
+// do teste baricêntrico. Construído uma vez por candidato, não por teste.
+struct CollisionTriangle
+{
+    Vector3 pointA;
+    Vector3 pointB;
+    Vector3 pointC;
+    Vector3 normal;
+    float planeD;
+    Vector3 edgeAB;
+    Vector3 edgeBC;
+    Vector3 edgeCA;
+    float edgeABSq;
+    float edgeBCSq;
+    float edgeCASq;
+    float dot01;    // (C-A).(B-A)
+    float invDenom; // 1 / (|C-A|^2 |B-A|^2 - dot01^2)
+};
+
+// Passa um triângulo do mundo para espaço da elipse (divide por eRadius)
+void BuildCollisionTriangle(const Triangle& triangle, const Vector3& eRadius,
+                            CollisionTriangle& out);
+
+// Polígono convexo feito de triângulos complanares vizinhos (PolygonMesh).
+// O Collider testa-o como uma só primitiva: o plano e, por aresta, o plano
+// que a contém virado para dentro. Num Selector é também um leque de
+// pointCount - 2 triângulos seguidos a partir de firstTriangle.
+// O contorno e os planos das arestas não estão no polígono: são pointCount
+// entradas seguidas a partir de firstPoint nos arrays de quem o guarda
+// (PolygonMesh::getPoints/getEdgePlanes, Octree), como os índices de um TreeNode.
+struct CollisionPolygon
+{
+    Vector3 normal;
+    float planeD;                 // plano: dot(normal, p) + planeD = 0
+    u32 firstPoint;               // contorno, no sentido dos triângulos de origem
+    u32 pointCount;
+    BoundingBox bounds;
+    u32 sourceTriangles;          // triângulos que juntou
+    u32 layers;                   // CollisionLayer (só se juntam triângulos com as mesmas)
+    u32 firstTriangle{0};         // id do primeiro triângulo do leque no Selector
+};
+
+// Planos das arestas do contorno points (aresta i: dot(xyz, p) + w >= 0 do
+// lado de dentro) em edgePlanes e a caixa do polígono
+void BuildPolygonPlanes(CollisionPolygon& polygon, const Vector3* points, Vector4* edgePlanes);
+
+// Vértice de um EllipsoidPolygon: o ponto, a aresta até ao seguinte e o
+// plano dessa aresta, já em espaço da elipse
+struct PolygonCorner
+{
+    Vector3 point;
+    Vector3 edge;
+    float edgeSq;
+    Vector3 edgeNormal;     // não normalizada: só conta o sinal
+    float edgeD;
+};
+
+// CollisionPolygon em espaço da elipse; os vértices ficam num array à parte
+// (CollisionCandidates::corners) a partir de firstCorner
+struct EllipsoidPolygon
+{
+    Vector3 normal;
+    float planeD;
+    u32 firstCorner;
+    u32 cornerCount;
+};
+
+void BuildEllipsoidPolygon(const CollisionPolygon& polygon, const Vector3* points,
+                           const Vector4* edgePlanes, const Vector3& eRadius,
+                           EllipsoidPolygon& out, std::vector<PolygonCorner>& corners);
+
+// Polígono candidato do Collider: a caixa (a CandidateCache filtra por ela)
+// e o primeiro triângulo do leque (Selector::getTriangleCopy dá o do contacto)
+struct PolygonCandidate
+{
+    BoundingBox bounds;
+    u32 firstTriangle;
+};
+
 
 struct CollisionData
 {
@@ -50,167 +160,570 @@ struct CollisionData
 
     Triangle intersectionTriangle;
     s32 triangleIndex;
+    s32 polygonFan;     // triangleIndex é um polígono: triângulo (0, k, k + 1) do contacto
     s32 triangleHits;
 
     float slidingSpeed;
 };
-class QuadtreeNode {
-private:
-    BoundingBox bounds;
+
+// Pacote SoA com até 4 CollisionTriangle, testados de uma vez
+// pelo kernel SIMD (TestTriangleIntersection4).
+#define TRIANGLE_PACKET_SIZE 4
+
+struct alignas(16) TrianglePacket
+{
+    float ax[TRIANGLE_PACKET_SIZE], ay[TRIANGLE_PACKET_SIZE], az[TRIANGLE_PACKET_SIZE];
+    float bx[TRIANGLE_PACKET_SIZE], by[TRIANGLE_PACKET_SIZE], bz[TRIANGLE_PACKET_SIZE];
+    float cx[TRIANGLE_PACKET_SIZE], cy[TRIANGLE_PACKET_SIZE], cz[TRIANGLE_PACKET_SIZE];
+    float nx[TRIANGLE_PACKET_SIZE], ny[TRIANGLE_PACKET_SIZE], nz[TRIANGLE_PACKET_SIZE];
+    float d[TRIANGLE_PACKET_SIZE];
+    float abx[TRIANGLE_PACKET_SIZE], aby[TRIANGLE_PACKET_SIZE], abz[TRIANGLE_PACKET_SIZE];
+    float bcx[TRIANGLE_PACKET_SIZE], bcy[TRIANGLE_PACKET_SIZE], bcz[TRIANGLE_PACKET_SIZE];
+    float cax[TRIANGLE_PACKET_SIZE], cay[TRIANGLE_PACKET_SIZE], caz[TRIANGLE_PACKET_SIZE];
+    float abSq[TRIANGLE_PACKET_SIZE], bcSq[TRIANGLE_PACKET_SIZE], caSq[TRIANGLE_PACKET_SIZE];
+    float dot01[TRIANGLE_PACKET_SIZE], invDenom[TRIANGLE_PACKET_SIZE];
+    s32 count{0};
+
+    void set(s32 lane, const CollisionTriangle& tri)
+    {
+        ax[lane] = tri.pointA.x; ay[lane] = tri.pointA.y; az[lane] = tri.pointA.z;
+        bx[lane] = tri.pointB.x; by[lane] = tri.pointB.y; bz[lane] = tri.pointB.z;
+        cx[lane] = tri.pointC.x; cy[lane] = tri.pointC.y; cz[lane] = tri.pointC.z;
+        nx[lane] = tri.normal.x; ny[lane] = tri.normal.y; nz[lane] = tri.normal.z;
+        d[lane] = tri.planeD;
+        abx[lane] = tri.edgeAB.x; aby[lane] = tri.edgeAB.y; abz[lane] = tri.edgeAB.z;
+        bcx[lane] = tri.edgeBC.x; bcy[lane] = tri.edgeBC.y; bcz[lane] = tri.edgeBC.z;
+        cax[lane] = tri.edgeCA.x; cay[lane] = tri.edgeCA.y; caz[lane] = tri.edgeCA.z;
+        abSq[lane] = tri.edgeABSq; bcSq[lane] = tri.edgeBCSq; caSq[lane] = tri.edgeCASq;
+        dot01[lane] = tri.dot01; invDenom[lane] = tri.invDenom;
+    }
+
+    Triangle get(s32 lane) const
+    {
+        Triangle tri;
+        tri.pointA = { ax[lane], ay[lane], az[lane] };
+        tri.pointB = { bx[lane], by[lane], bz[lane] };
+        tri.pointC = { cx[lane], cy[lane], cz[lane] };
+        tri.normal = { nx[lane], ny[lane], nz[lane] };
+        tri.planeD = d[lane];
+        return tri;
+    }
+
+    CollisionTriangle getCollision(s32 lane) const
+    {
+        CollisionTriangle tri;
+        tri.pointA = { ax[lane], ay[lane], az[lane] };
+        tri.pointB = { bx[lane], by[lane], bz[lane] };
+        tri.pointC = { cx[lane], cy[lane], cz[lane] };
+        tri.normal = { nx[lane], ny[lane], nz[lane] };
+        tri.planeD = d[lane];
+        tri.edgeAB = { abx[lane], aby[lane], abz[lane] };
+        tri.edgeBC = { bcx[lane], bcy[lane], bcz[lane] };
+        tri.edgeCA = { cax[lane], cay[lane], caz[lane] };
+        tri.edgeABSq = abSq[lane]; tri.edgeBCSq = bcSq[lane]; tri.edgeCASq = caSq[lane];
+        tri.dot01 = dot01[lane]; tri.invDenom = invDenom[lane];
+        return tri;
+    }
+};
+
+// Candidatos de um movimento: recolhidos e passados para espaço da elipse
+// uma vez por collideEllipsoidWithWorld, depois reutilizados por todos os
+// slides e pela passagem da gravidade. Os triângulos vão em pacotes para o
+// kernel SIMD; os polígonos do selector são testados um a um, depois.
+struct CollisionCandidates
+{
     std::vector<const Triangle*> triangles;
-    QuadtreeNode* children[4];
-    bool divided;
+    std::vector<CollisionTriangle> eSpace;  // de triangles, se não vêm da cache
+    std::vector<Triangle> instanced;    // cópias mundo dos nós da cena
+    std::vector<TrianglePacket> packets;
+    std::vector<PolygonCandidate> polygons;
+    std::vector<EllipsoidPolygon> ePolygons;        // de polygons, pela mesma ordem
+    std::vector<PolygonCorner> corners;
+
+    void clear()
+    {
+        triangles.clear();
+        eSpace.clear();
+        instanced.clear();
+        packets.clear();
+        polygons.clear();
+        ePolygons.clear();
+        corners.clear();
+    }
 
-    static constexpr int MAX_TRIANGLES = 16;
-    static constexpr float MIN_SIZE = 0.5f;
+    u32 getTriangleCount() const { return (u32)(instanced.size() + triangles.size()); }
 
-public:
-    QuadtreeNode(const BoundingBox& bounds);
-    ~QuadtreeNode();
+    // Triângulo mundo do índice usado nos pacotes (cena primeiro, depois selector)
+    const Triangle& get(u32 index) const
+    {
+        return (index < instanced.size()) ? instanced[index] : *triangles[index - instanced.size()];
+    }
+};
 
-    void insert(const Triangle* tri, int maxDepth = 8, int depth = 0);
-    void subdivide();
+// Uma instância por thread (os vectors mantêm a capacidade entre movimentos)
+CollisionCandidates& GetCollisionCandidates();
 
+// Marcas por query: um triângulo que atravessa vários nós só é emitido uma vez.
+// Cada query abre uma nova geração; um triângulo já marcado com ela é duplicado.
+struct QueryMarks
+{
+    std::vector<u32> stamps;
+    u32 generation{0};
+    u32 duplicates{0};
 
-    void collectTriangles(const BoundingBox& area,
-                          std::vector<const Triangle*>& out) const;
-    void collectTriangles(const Vector3& point, float radius,
-                          std::vector<const Triangle*>& out) const;
-    void collectTriangles(const Ray& ray, float maxDistance,
-                          std::vector<const Triangle*>& out) const;
+    void begin(size_t count);
 
+    bool visit(u32 id)
+    {
+        if (stamps[id] == generation)
+        {
+            duplicates++;
+            return false;
+        }
+        stamps[id] = generation;
+        return true;
+    }
 
-    inline void collectAll(std::vector<const Triangle*>& out) const;
+    bool visit(const Triangle* tri) { return visit(tri->id); }
 
-    void clear();
-    void debug(Color color = BLUE) const;
+    // Raycast em lote: bits dos raios (até 64) que já testaram cada triângulo
+    std::vector<u64> rayMasks;
 
+    void beginRays(size_t count);
 
-    int getTriangleCount() const
+    // Devolve os raios de rays que ainda não testaram tri, e marca-os
+    u64 visitRays(u32 id, u64 rays)
     {
-        return triangles.size()
-            + (divided ? children[0]->getTriangleCount()
-                       + children[1]->getTriangleCount()
-                       + children[2]->getTriangleCount()
-                       + children[3]->getTriangleCount()
-                       : 0);
+        if (stamps[id] != generation)
+        {
+            stamps[id] = generation;
+            rayMasks[id] = rays;
+            return rays;
+        }
+
+        u64 pending = rays & ~rayMasks[id];
+        if (pending != rays) duplicates++;
+        rayMasks[id] |= rays;
+        return pending;
     }
+
+    u64 visitRays(const Triangle* tri, u64 rays) { return visitRays(tri->id, rays); }
 };
 
+// Uma instância por thread, partilhada por todos os selectors
+QueryMarks& GetQueryMarks();
 
-class OctreeNode {
-private:
+// Resultado de Selector::raycast. A normal vem sempre virada contra o raio.
+struct RayHit
+{
+    bool hit{false};
+    float distance{0.0f};
+    Vector3 point{0.0f, 0.0f, 0.0f};
+    Vector3 normal{0.0f, 0.0f, 0.0f};
+    const Triangle* triangle{nullptr};
+};
+
+// Filtro opcional do raycast: devolve false para ignorar o triângulo
+typedef std::function<bool(const Triangle&)> RayFilter;
+
+// 4 raios em SoA para os testes SIMD do raycast
+struct alignas(16) RayPacket
+{
+    float ox[4], oy[4], oz[4];
+    float dx[4], dy[4], dz[4];
+    float ix[4], iy[4], iz[4]; // 1/direção (0 nos eixos paralelos)
+
+    void set(s32 lane, const Ray& ray)
+    {
+        ox[lane] = ray.position.x; oy[lane] = ray.position.y; oz[lane] = ray.position.z;
+        dx[lane] = ray.direction.x; dy[lane] = ray.direction.y; dz[lane] = ray.direction.z;
+        ix[lane] = ray.direction.x != 0.0f ? 1.0f / ray.direction.x : 0.0f;
+        iy[lane] = ray.direction.y != 0.0f ? 1.0f / ray.direction.y : 0.0f;
+        iz[lane] = ray.direction.z != 0.0f ? 1.0f / ray.direction.z : 0.0f;
+    }
+};
+
+// Bits das lanes que entram na caixa até maxDistance[lane]; entry recebe a
+// distância de entrada (0 se a origem já está dentro)
+s32 IntersectRayBox4(const RayPacket& rays, const BoundingBox& box,
+                     const float* maxDistance, float* entry);
+
+// Bits das lanes que atingem o triângulo, com as mesmas contas que
+// GetRayCollisionTriangle (Möller-Trumbore); distance recebe o t de cada lane
+s32 IntersectRayTriangle4(const RayPacket& rays, const Triangle& tri, float* distance);
+
+// Versões escalares das duas (referência para os kernels SSE2, ver COLLISION_SCALAR)
+s32 IntersectRayBox4Scalar(const RayPacket& rays, const BoundingBox& box,
+                           const float* maxDistance, float* entry);
+s32 IntersectRayTriangle4Scalar(const RayPacket& rays, const Triangle& tri, float* distance);
+
+
+// Nó de Quadtree/Octree dentro de um NodePool. Os filhos de um nó dividido
+// são CHILD_COUNT nós seguidos a partir de firstChild e os triângulos são um
+// intervalo [firstIndex, firstIndex + indexCount) de NodePool::indices.
+struct TreeNode
+{
     BoundingBox bounds;
-    std::vector<const Triangle*> triangles;
-    OctreeNode* children[8];
-    bool divided;
+    u32 firstChild;     // 0 = folha (o nó 0 é a raiz, nunca é filho)
+    u32 firstIndex;
+    u32 indexCount;
+    u32 layers;         // OR das camadas dos triângulos da subárvore
 
-    static constexpr int MAX_TRIANGLES = 16; 
+    static constexpr int MAX_TRIANGLES = 16;
     static constexpr float MIN_SIZE = 0.5f;
+    static constexpr int MAX_DEPTH = 8;
 
-public:
-    OctreeNode(const BoundingBox& bounds);
-    ~OctreeNode();
+    bool isDivided() const { return firstChild != 0; }
+};
 
-    void insert(const Triangle* tri, int maxDepth = 8, int depth = 0);
-    void subdivide();
+// Arena dos nós e dos índices de triângulos (em triangleStorage) de uma
+// árvore. clear() só esvazia os vectors: não há delete nó a nó e a memória
+// fica reservada para o próximo rebuild.
+struct NodePool
+{
+    std::vector<TreeNode> nodes;
+    std::vector<u32> indices;
 
+    void clear()
+    {
+        nodes.clear();
+        indices.clear();
+    }
 
-    void collectTriangles(const BoundingBox& area,
-                          std::vector<const Triangle*>& out) const;
-    void collectTriangles(const Vector3& point, float radius,
-                          std::vector<const Triangle*>& out) const;
-    void collectTriangles(const Ray& ray, float maxDistance,
-                          std::vector<const Triangle*>& out) const;
+    // Reserva count nós seguidos (folhas vazias) e devolve o primeiro
+    u32 allocate(u32 count, const BoundingBox* bounds);
 
+    size_t getMemory() const
+    {
+        return nodes.capacity() * sizeof(TreeNode) + indices.capacity() * sizeof(u32);
+    }
 
-    inline void collectAll(std::vector<const Triangle*>& out) const;
+    // Nós, bytes por nó e histograma de profundidades
+    void stats(s32 childCount) const;
+};
 
-    void clear();
-    void debug(Color color = BLUE) const;
+// Triângulos sem os dados derivados: posições únicas partilhadas e 3 índices
+// por triângulo (12 bytes, contra os ~116 de um Triangle mais os vértices
+// repetidos). decode refaz o Triangle com updateBounds a partir dos mesmos
+// pontos, por isso as queries dão exatamente os mesmos resultados.
+struct CompactTriangles
+{
+    std::vector<Vector3> positions;
+    std::vector<u32> corners;   // 3 por triângulo, índices em positions
+    std::vector<u8> layers;     // 1 por triângulo
 
-    int getTriangleCount() const;
+    void clear()
+    {
+        positions.clear();
+        corners.clear();
+        layers.clear();
+    }
+
+    bool empty() const { return corners.empty(); }
+    u32 getCount() const { return (u32)(corners.size() / 3); }
+
+    void build(const std::vector<Triangle>& triangles);
+
+    void decode(u32 id, Triangle& out) const
+    {
+        const u32* corner = &corners[id * 3];
+        out.pointA = positions[corner[0]];
+        out.pointB = positions[corner[1]];
+        out.pointC = positions[corner[2]];
+        out.updateBounds();
+        out.id = id;
+        out.layers = layers[id];
+    }
+
+    // Só os pontos e as arestas (o que o teste raio-triângulo usa)
+    void decodeEdges(u32 id, Triangle& out) const
+    {
+        const u32* corner = &corners[id * 3];
+        out.pointA = positions[corner[0]];
+        out.pointB = positions[corner[1]];
+        out.pointC = positions[corner[2]];
+        out.edgeAB = Vector3Subtract(out.pointB, out.pointA);
+        out.edgeBC = Vector3Subtract(out.pointC, out.pointB);
+        out.edgeCA = Vector3Subtract(out.pointA, out.pointC);
+        out.id = id;
+        out.layers = layers[id];
+    }
+
+    // Pontos, arestas e normal (o que BuildCollisionTriangle lê), sem bounds
+    // nem planeD; a normal sai com as mesmas contas de updateBounds
+    void decodeShape(u32 id, Triangle& out) const
+    {
+        decodeEdges(id, out);
+        out.normal = Vector3Normalize(Vector3CrossProduct(out.edgeAB, Vector3Negate(out.edgeCA)));
+    }
+
+    size_t getMemory() const
+    {
+        return positions.capacity() * sizeof(Vector3) + corners.capacity() * sizeof(u32) + layers.capacity();
+    }
 };
 
+// Nó da octree compacta: a caixa em 16 bits por eixo dentro da caixa da
+// raiz, arredondada para fora (nunca fica mais pequena que a do TreeNode),
+// e o intervalo de índices e as camadas juntos em 32 bits. 24 bytes.
+struct CompactNode
+{
+    u16 min[3];
+    u16 max[3];
+    u32 firstChild;
+    u32 firstIndex;
+    u32 indexCount : 24;
+    u32 layers : 8;
+};
+
+// NodePool em CompactNode, com os índices em 16 bits quando os triângulos
+// cabem. As caixas maiores só fazem visitar mais nós: os triângulos de cada
+// nó são os mesmos e as queries dão os mesmos hits.
+struct CompactNodes
+{
+    BoundingBox bounds;     // da raiz, exata
+    Vector3 step;           // tamanho de uma unidade em cada eixo
+    std::vector<CompactNode> nodes;
+    std::vector<u16> shortIndices;
+    std::vector<u32> indices;   // só se houver mais de 65536 triângulos
+
+    void clear()
+    {
+        nodes.clear();
+        shortIndices.clear();
+        indices.clear();
+    }
+
+    bool empty() const { return nodes.empty(); }
+
+    // false (e fica vazio) se algum nó não cabe num CompactNode
+    bool build(const NodePool& pool, u32 triangleCount);
+    // De volta a TreeNode, com as caixas quantizadas (a raiz fica exata)
+    void expand(NodePool& pool) const;
+
+    float dequantize(u16 value, s32 axis) const
+    {
+        return (&bounds.min.x)[axis] + (float)value * (&step.x)[axis];
+    }
+
+    // Menor valor com posição >= value (0x10000 se nenhum) e maior valor com
+    // posição <= value (-1 se nenhum)
+    s32 firstAtOrAbove(float value, s32 axis) const;
+    s32 lastAtOrBelow(float value, s32 axis) const;
+
+    TreeNode get(u32 index) const
+    {
+        const CompactNode& node = nodes[index];
+        TreeNode out;
+        out.bounds.min = { dequantize(node.min[0], 0), dequantize(node.min[1], 1), dequantize(node.min[2], 2) };
+        out.bounds.max = { dequantize(node.max[0], 0), dequantize(node.max[1], 1), dequantize(node.max[2], 2) };
+        out.firstChild = node.firstChild;
+        out.firstIndex = node.firstIndex;
+        out.indexCount = node.indexCount;
+        out.layers = node.layers;
+        return out;
+    }
+
+    u32 index(u32 position) const
+    {
+        return indices.empty() ? shortIndices[position] : indices[position];
+    }
+
+    size_t getMemory() const
+    {
+        return nodes.capacity() * sizeof(CompactNode) + shortIndices.capacity() * sizeof(u16)
+             + indices.capacity() * sizeof(u32);
+    }
+};
+
+// CollisionPolygon da octree compacta: o contorno são índices na pool de
+// posições de CompactTriangles (os mesmos pontos que os leques já usam), em
+// 16 bits quando as posições cabem. Os planos das arestas e a caixa não se
+// guardam: decode refá-los com BuildPolygonPlanes, com as mesmas contas que
+// os da octree normal. 32 bytes por polígono mais 2 ou 4 por ponto.
+struct CompactPolygon
+{
+    Vector3 normal;
+    float planeD;
+    u32 firstPoint;         // em CompactPolygons::shortPoints/points
+    u32 firstTriangle;
+    u32 sourceTriangles;
+    u16 pointCount;
+    u8 layers;
+};
+
+struct CompactPolygons
+{
+    std::vector<CompactPolygon> polygons;
+    std::vector<u16> shortPoints;
+    std::vector<u32> points;    // só se houver mais de 65536 posições
+
+    void clear()
+    {
+        polygons.clear();
+        shortPoints.clear();
+        points.clear();
+    }
+
+    bool empty() const { return polygons.empty(); }
+    u32 getCount() const { return (u32)polygons.size(); }
+
+    // Os índices saem dos cantos dos leques em triangles (ponto 0 e os
+    // seguintes ao longo do leque); false (e fica vazio) se um polígono não
+    // cabe (mais de 65535 pontos ou camadas acima de 8 bits)
+    bool build(const std::vector<CollisionPolygon>& source, const CompactTriangles& triangles);
+
+    u32 pointIndex(u32 position) const { return points.empty() ? shortPoints[position] : points[position]; }
+
+    // Polígono i com o contorno em outline e os planos das arestas em
+    // edgePlanes (pointCount de cada); out.firstPoint fica a 0
+    void decode(u32 i, const CompactTriangles& triangles, CollisionPolygon& out,
+                Vector3* outline, Vector4* edgePlanes) const;
+
+    size_t getMemory() const
+    {
+        return polygons.capacity() * sizeof(CompactPolygon) + shortPoints.capacity() * sizeof(u16)
+             + points.capacity() * sizeof(u32);
+    }
+};
 
 class Selector 
 {
 
 protected:
    std::vector<Triangle> triangleStorage;    
+   u32 version{0};   // muda sempre que os triângulos ou a árvore mudam
 public:
         virtual ~Selector() = default;
 
 
 
-    virtual void addTriangle(const Vector3& a, const Vector3& b, const Vector3& c)=0;
+    virtual void addTriangle(const Vector3& a, const Vector3& b, const Vector3& c,
+                             u32 layers = LAYER_SOLID)=0;
+    // Polígono convexo com o contorno em points (polygon.pointCount pontos):
+    // entra sempre como leque de triângulos (raycasts e getCandidates só veem
+    // triângulos); a Octree guarda também o polígono para o Collider o testar
+    // como uma primitiva
+    virtual void addPolygon(const CollisionPolygon& polygon, const Vector3* points);
     virtual void rebuild() =0;
 
 
-   virtual  std::vector<const Triangle*> getCandidates(const BoundingBox& area) const = 0;
+   // mask: só triângulos com alguma camada em comum (nós sem nenhuma nem são visitados)
+   virtual  std::vector<const Triangle*> getCandidates(const BoundingBox& area,
+                                                       u32 mask = MASK_ALL) const = 0;
    virtual std::vector<const Triangle*> getCandidates(const Vector3& point,
-                                                      float radius) const = 0;
-   virtual std::vector<const Triangle*> getCandidates(const Ray& ray, float maxDistance = 1000.0f) const = 0;
+                                                      float radius, u32 mask = MASK_ALL) const = 0;
+   virtual std::vector<const Triangle*> getCandidates(const Ray& ray, float maxDistance = 1000.0f,
+                                                      u32 mask = MASK_ALL) const = 0;
+
+   // Candidatos do Collider: acrescenta a out.triangles os de
+   // getCandidates(area) por ordem de id, com o CollisionTriangle de cada um
+   // em out.eSpace. Por omissão é getCandidates + BuildCollisionTriangle; a
+   // Octree troca os leques dos polígonos pelo polígono (out.polygons) e a
+   // compacta só descodifica o que BuildCollisionTriangle lê (os Triangle
+   // vêm sem bounds nem planeD).
+   virtual void getCollisionCandidates(const BoundingBox& area, const Vector3& eRadius, u32 mask,
+                                       CollisionCandidates& out) const;
+
+   // Hit mais perto ao longo do raio: percorre os nós de frente para trás e
+   // corta tudo o que começa depois do melhor hit encontrado até ali
+   virtual RayHit raycast(const Ray& ray, float maxDistance = 1000.0f,
+                          const RayFilter& filter = nullptr, u32 mask = MASK_ALL) const = 0;
+
+   // Lote de raios (caçadeira, linhas de visão): percorre a árvore uma vez
+   // e escreve count hits em out, iguais aos de count raycasts separados.
+   // maxDistances, se existir, dá o alcance de cada raio (em vez de maxDistance)
+   virtual void raycast(const Ray* rays, s32 count, float maxDistance, RayHit* out,
+                        const RayFilter& filter = nullptr, u32 mask = MASK_ALL,
+                        const float* maxDistances = nullptr) const = 0;
    
    virtual void debug() const =0;
    
-    int getTriangleCount() const { return triangleStorage.size(); }
+    virtual int getTriangleCount() const { return triangleStorage.size(); }
+    // Cópia do triângulo id (a Octree compacta descodifica-o)
+    virtual Triangle getTriangleCopy(u32 id) const { return triangleStorage[id]; }
+
+    // Para quem guarda resultados de queries (CandidateCache): se mudou, deita fora
+    u32 getVersion() const { return version; }
 };
 
 
 class Quadtree : public Selector
  {
 private:
-    QuadtreeNode* root;
-    std::vector<Triangle> triangleStorage;
+    NodePool pool;
 
 public:
     Quadtree()=default;
     Quadtree(const BoundingBox& worldBounds);
 
-    ~Quadtree();
-
     void setWorldBounds(const BoundingBox& bounds);
 
 
-    void addTriangle(const Vector3& a, const Vector3& b, const Vector3& c);
+    void addTriangle(const Vector3& a, const Vector3& b, const Vector3& c, u32 layers = LAYER_SOLID);
      void rebuild();
 
 
-    std::vector<const Triangle*> getCandidates(const BoundingBox& area) const ;
-    std::vector<const Triangle*> getCandidates(const Vector3& point,float radius) const ;
-    std::vector<const Triangle*> getCandidates(const Ray& ray, float maxDistance = 1000.0f) const ;
+    std::vector<const Triangle*> getCandidates(const BoundingBox& area, u32 mask = MASK_ALL) const ;
+    std::vector<const Triangle*> getCandidates(const Vector3& point,float radius, u32 mask = MASK_ALL) const ;
+    std::vector<const Triangle*> getCandidates(const Ray& ray, float maxDistance = 1000.0f, u32 mask = MASK_ALL) const ;
+    RayHit raycast(const Ray& ray, float maxDistance = 1000.0f,
+                   const RayFilter& filter = nullptr, u32 mask = MASK_ALL) const;
+    void raycast(const Ray* rays, s32 count, float maxDistance, RayHit* out,
+                 const RayFilter& filter = nullptr, u32 mask = MASK_ALL,
+                 const float* maxDistances = nullptr) const;
    
     void debug() const ;
 
-
-
-
-   
-    
+    void stats() const;
 };
 
 
 class Octree :  public Selector
 {
 private:
-    OctreeNode* root;
-
+    NodePool pool;
+    CompactTriangles compactStorage;
+    CompactNodes compactNodes;  // no lugar de pool quando é compacta
+    bool compact{false};
+    std::vector<CollisionPolygon> polygonStorage;
+    std::vector<Vector3> polygonPoints;  // contornos, por firstPoint/pointCount
+    std::vector<Vector4> edgePlanes;     // um por ponto de polygonPoints
+    CompactPolygons compactPolygons;     // no lugar dos três de cima quando é compacta
+    std::vector<u32> polygonOf;  // por triângulo, se houver polígonos: índice ou NO_POLYGON
+
+    static constexpr u32 NO_POLYGON = 0xFFFFFFFF;
+
+    void compress();
+    void expand();
+    // Polígonos, contornos e planos das arestas de compactPolygons
+    void expandPolygons(std::vector<CollisionPolygon>& polygons, std::vector<Vector3>& points,
+                        std::vector<Vector4>& planes) const;
+    bool hasRoot() const { return !pool.nodes.empty() || !compactNodes.empty(); }
 
 public:
     Octree()=default;
     Octree(const BoundingBox& worldBounds);
-    ~Octree();
 
     void setWorldBounds(const BoundingBox& bounds) ;
 
-    void addTriangle(const Vector3& a, const Vector3& b, const Vector3& c);
+    void addTriangle(const Vector3& a, const Vector3& b, const Vector3& c, u32 layers = LAYER_SOLID);
+    void addPolygon(const CollisionPolygon& polygon, const Vector3* points);
     void rebuild();
-
-
-    std::vector<const Triangle*> getCandidates(const BoundingBox& area) const;
-    std::vector<const Triangle*> getCandidates(const Vector3& point,float radius) const;
-    std::vector<const Triangle*> getCandidates(const Ray& ray, float maxDistance = 1000.0f) const;
+    // Subárvores construídas em paralelo no pool; a árvore é igual à de rebuild()
+    void rebuild(ThreadPool* pool);
+
+
+    std::vector<const Triangle*> getCandidates(const BoundingBox& area, u32 mask = MASK_ALL) const;
+    std::vector<const Triangle*> getCandidates(const Vector3& point,float radius, u32 mask = MASK_ALL) const;
+    std::vector<const Triangle*> getCandidates(const Ray& ray, float maxDistance = 1000.0f, u32 mask = MASK_ALL) const;
+    void getCollisionCandidates(const BoundingBox& area, const Vector3& eRadius, u32 mask,
+                                CollisionCandidates& out) const;
+    RayHit raycast(const Ray& ray, float maxDistance = 1000.0f,
+                   const RayFilter& filter = nullptr, u32 mask = MASK_ALL) const;
+    void raycast(const Ray* rays, s32 count, float maxDistance, RayHit* out,
+                 const RayFilter& filter = nullptr, u32 mask = MASK_ALL,
+                 const float* maxDistances = nullptr) const;
     std::vector<const Triangle*> getCandidatesForObject(const Vector3& position, const Vector3& size) const;
  
 
@@ -219,25 +732,265 @@ public:
  
  
 
+    void stats() const;
+
+    // Formato compacto (CompactTriangles + CompactNodes): depois de cada
+    // rebuild/loadCache os triângulos ficam só como índices numa pool de
+    // posições, os nós quantizados, e as queries descodificam-nos à medida.
+    // Os ponteiros de getCandidates e de RayHit::triangle passam a apontar
+    // para uma área da thread, válida até à query seguinte do mesmo tipo
+    // nessa thread. addTriangle volta a expandir (os nós com as caixas
+    // quantizadas até ao próximo rebuild).
+    void setCompact(bool enable);
+    bool isCompact() const { return compact; }
+    int getTriangleCount() const;
+    Triangle getTriangleCopy(u32 id) const;
+    u32 getPolygonCount() const { return (u32)(polygonStorage.size() + compactPolygons.getCount()); }
+    // Bytes dos triângulos e dos nós
+    size_t getMemory() const;
+
+    // Cache em disco da árvore construída (triângulos + nós). A chave junta o
+    // hash da fonte (ex.: BSP::getContentHash) com os parâmetros de construção;
+    // loadCache falha se o ficheiro não existir ou a chave não bater.
+    u64 getCacheKey(u64 sourceHash) const;
+    bool saveCache(const char* filename, u64 key) const;
+    bool loadCache(const char* filename, u64 key);
+};
+
+
+// Grelha uniforme com as células num hash (só existem as que têm triângulos).
+// Inserir e remover mexe só nas células que a caixa do triângulo toca, sem
+// rebuild: serve para geometria que muda (portas, destroços, peças
+// destrutíveis) e para zonas muito densas. Os raios andam célula a célula
+// por 3D-DDA e param na primeira célula que já fecha o melhor hit.
+class HashGrid : public Selector
+{
+private:
+    float cellSize;
+    float invCellSize;
+    // Célula: ids dos triângulos e o OR das camadas deles (só cresce até ao rebuild)
+    struct Cell
+    {
+        std::vector<u32> ids;
+        u32 layers{0};
+    };
+
+    std::unordered_map<u64, Cell> cells;
+    std::vector<u8> alive;       // triangleStorage[i] está na grelha
+    std::vector<u32> freeSlots;  // ids removidos, reaproveitados por insertTriangle
+    BoundingBox bounds;          // só cresce; rebuild() volta a apertar
+    u32 liveCount{0};
+
+    void cellRange(const BoundingBox& box, s32* lo, s32* hi) const;
+    void link(u32 id);
+    void unlink(u32 id);
+
+    template <typename Visit>
+    void traverse(const Ray& ray, float maxDistance, const Visit& visit) const;
+
+public:
+    static constexpr u32 INVALID = 0xFFFFFFFF;
+
+    explicit HashGrid(float cellSize = 8.0f);
+
+    // Muda o tamanho das células e redistribui os triângulos
+    void setCellSize(float size);
+    float getCellSize() const { return cellSize; }
+
+    void addTriangle(const Vector3& a, const Vector3& b, const Vector3& c, u32 layers = LAYER_SOLID);
+    // Como addTriangle, mas devolve o handle (o id do triângulo) para removeTriangle
+    u32 insertTriangle(const Vector3& a, const Vector3& b, const Vector3& c, u32 layers = LAYER_SOLID);
+    void removeTriangle(u32 handle);
+    const Triangle& getTriangle(u32 handle) const { return triangleStorage[handle]; }
+    void clear();
+    // Os triângulos já entram nas células em addTriangle; rebuild só
+    // recalcula as células e os limites (depois de muitas remoções)
+    void rebuild();
+
+    std::vector<const Triangle*> getCandidates(const BoundingBox& area, u32 mask = MASK_ALL) const;
+    std::vector<const Triangle*> getCandidates(const Vector3& point, float radius, u32 mask = MASK_ALL) const;
+    std::vector<const Triangle*> getCandidates(const Ray& ray, float maxDistance = 1000.0f, u32 mask = MASK_ALL) const;
+    RayHit raycast(const Ray& ray, float maxDistance = 1000.0f,
+                   const RayFilter& filter = nullptr, u32 mask = MASK_ALL) const;
+    void raycast(const Ray* rays, s32 count, float maxDistance, RayHit* out,
+                 const RayFilter& filter = nullptr, u32 mask = MASK_ALL,
+                 const float* maxDistances = nullptr) const;
+
+    void debug() const;
+
+    // Triângulos na grelha (getTriangleCount conta também os slots livres)
+    u32 getLiveCount() const { return liveCount; }
+    u32 getCellCount() const { return (u32)cells.size(); }
     void stats() const;
 };
 
 
+// Candidatos de um agente guardados entre frames. A recolha é feita numa
+// caixa alargada por margin; enquanto a caixa dos movimentos seguintes ficar
+// lá dentro e o selector não mudar (getVersion) não há descida na árvore.
+// Guarda cópias dos triângulos, também já em espaço da elipse, por isso
+// serve para octrees compactas e para a HashGrid. Os triângulos da cena
+// (nós que se mexem) são sempre recolhidos de novo.
+struct CandidateCache
+{
+    float margin{2.0f};
+    u32 hits{0};
+    u32 misses{0};
+
+    void invalidate() { valid = false; }
+    void resetStats() { hits = 0; misses = 0; }
+    float getHitRate() const
+    {
+        u32 total = hits + misses;
+        return total ? (float)hits / (float)total : 0.0f;
+    }
+
+    // Preenchido por Collider
+    bool valid{false};
+    const Selector* selector{nullptr};
+    u32 version{0};
+    u32 mask{0};
+    Vector3 eRadius{0.0f, 0.0f, 0.0f};
+    BoundingBox bounds;
+    std::vector<Triangle> triangles;
+    std::vector<CollisionTriangle> eSpace;
+    std::vector<PolygonCandidate> polygons;
+    std::vector<EllipsoidPolygon> ePolygons;
+    std::vector<PolygonCorner> corners;
+};
+
+// Chão de um agente guardado entre frames. Depois de uma gravidade que
+// acabou em cima de um triângulo plano, os movimentos seguintes só testam
+// a distância ao plano e se o ponto de apoio continua dentro do triângulo;
+// o varrimento da gravidade volta quando sai de cima dele, sobe ou desce
+// (degrau, rampa), salta, o selector muda (getVersion) ou algum nó da
+// cena entra, sai, se move ou se esconde (Scene::GetVersion): um adereço
+// pode ser o chão, ou chegar por baixo de um chão do mapa.
+// Sem o varrimento, o resultado de collideEllipsoidWithWorld não é o dele
+// bit a bit: outFalling e outCollide são os mesmos (a gravidade varrida
+// também acabava no chão), mas triout é o triângulo guardado, hitPosition
+// é o ponto do plano por baixo do centro (o varrimento dá o contacto
+// recuado de slidingSpeed) e a posição fica à distância guardada do plano,
+// a menos de GROUND_TOLERANCE (espaço da elipse) da do varrimento.
+// movement_replay compara os dois caminhos.
+struct GroundContact
+{
+    u32 hits{0};
+    u32 misses{0};
+
+    void invalidate() { valid = false; }
+    void resetStats() { hits = 0; misses = 0; }
+    float getHitRate() const
+    {
+        u32 total = hits + misses;
+        return total ? (float)hits / (float)total : 0.0f;
+    }
+
+    // Preenchido por Collider
+    bool valid{false};
+    const Selector* selector{nullptr};
+    u32 version{0};
+    const Scene* scene{nullptr};
+    u32 sceneVersion{0};
+    u32 mask{0};
+    Vector3 eRadius{0.0f, 0.0f, 0.0f};
+    Triangle triangle;   // em espaço mundo
+    float distance{0.0f};   // do centro ao plano em repouso, em espaço da elipse
+};
+
+// Movimento de um agente para Collider::collideEllipsoidBatch
+struct MoveRequest
+{
+    Vector3 position;
+    Vector3 radius;
+    Vector3 velocity;
+    Vector3 gravity;
+    float slidingSpeed;
+    u32 mask{MASK_MOVEMENT};
+};
+
+struct MoveResult
+{
+    Vector3 position;    // posição final
+    Vector3 hitPosition; // último ponto de contacto
+    Triangle triangle;   // último triângulo tocado (se collide)
+    bool falling;        // a gravidade não encontrou chão
+    bool collide;
+};
+
+// Esfera a varrer de from até to, para Collider::sweepSphereBatch
+struct SweepRequest
+{
+    Vector3 from;
+    Vector3 to;
+    float radius;
+    u32 mask{MASK_SHOT};
+};
+
+struct SweepHit
+{
+    bool hit;
+    float time;         // fração de from a to no primeiro contacto (1 sem hit)
+    Vector3 position;   // centro da esfera no contacto (to sem hit)
+    Vector3 point;      // ponto de contacto
+    Vector3 normal;     // do contacto para o centro da esfera
+    Triangle triangle;  // triângulo tocado, em espaço mundo
+};
+
+// Como collideEllipsoidWithWorld resolve o collide-and-slide
+enum class SlideSolver
+{
+    Iterative,  // até 3 planos de contacto por movimento: desliza na aresta entre dois, pára no canto
+    Recursive   // um plano por passo, até 4 níveis, e o resto * 0.95 em cada slide
+};
+
 struct Collider
 {
 private:
    
     Selector* collisionSelector{nullptr}; 
     Scene *scene{nullptr};
+    SlideSolver slideSolver{SlideSolver::Iterative};
+
+    void gatherCandidates(const BoundingBox& area, const Vector3& eRadius, u32 mask,
+                          CollisionCandidates& out, CandidateCache* cache = nullptr) const;
 public:
     void setCollisionSelector(Selector* selector);
     void setScene(Scene* scene);
+    void setSlideSolver(SlideSolver solver) { slideSolver = solver; }
+    SlideSolver getSlideSolver() const { return slideSolver; }
  
-    Vector3 collideWithWorld(s32 recursionDepth, CollisionData& colData,Vector3 pos, Vector3 vel);
+    Vector3 collideWithWorld(s32 recursionDepth, CollisionData& colData,
+                             const CollisionCandidates& candidates, Vector3 pos, Vector3 vel) const;
+    // Em espaço da elipse, como collideWithWorld, mas num ciclo: os planos
+    // tocados no movimento acumulam-se e o resto da velocidade é projetado
+    // em todos eles de uma vez
+    Vector3 slideWithWorld(CollisionData& colData, const CollisionCandidates& candidates,
+                           Vector3 pos, Vector3 vel) const;
     Vector3 collideEllipsoidWithWorld(
         const Vector3& position, const Vector3& radius, const Vector3& velocity,
         float slidingSpeed, const Vector3& gravity, Triangle& triout,
-        Vector3& hitPosition, bool& outFalling, bool& outCollide);
+        Vector3& hitPosition, bool& outFalling, bool& outCollide,
+        CandidateCache* cache = nullptr, u32 mask = MASK_MOVEMENT,
+        GroundContact* ground = nullptr) const;
+
+    // N agentes de uma vez, repartidos pelo pool (nullptr = nesta thread).
+    // O selector e a cena só são lidos; os resultados são iguais aos de N
+    // chamadas a collideEllipsoidWithWorld. caches e grounds, se existirem,
+    // têm uma CandidateCache/GroundContact por pedido.
+    void collideEllipsoidBatch(const MoveRequest* requests, MoveResult* results,
+                               u32 count, ThreadPool* pool = nullptr,
+                               CandidateCache* caches = nullptr,
+                               GroundContact* grounds = nullptr) const;
+
+    // Primeiro contacto de uma esfera que vai de from a to, sem slide
+    // (granadas, rockets). Como no collide-and-slide, só contam as faces
+    // viradas contra o movimento; o segmento inteiro é testado de uma vez,
+    // por isso um projétil rápido não atravessa paredes finas.
+    SweepHit sweepSphere(const Vector3& from, const Vector3& to, float radius,
+                         u32 mask = MASK_SHOT) const;
+    void sweepSphereBatch(const SweepRequest* requests, SweepHit* results,
+                          u32 count, ThreadPool* pool = nullptr) const;
 };
 
 
@@ -245,7 +998,17 @@ Vector3 GetCameraForward(Camera3D camera);
 
 Vector3 GetCameraRight(Camera3D camera);
 
+bool TestTriangleIntersection(CollisionData* colData, const CollisionTriangle& triangle);
 bool TestTriangleIntersection(CollisionData* colData, const Triangle& triangle);
+// O mesmo contra um polígono convexo: plano, planos das arestas e, se o
+// contacto com o plano cair fora, os vértices e as arestas do contorno
+bool TestPolygonIntersection(CollisionData* colData, const EllipsoidPolygon& polygon,
+                             const PolygonCorner* corners);
+// Mesmo resultado que chamar TestTriangleIntersection para cada triângulo do
+// pacote por ordem. Devolve o índice do último que ficou como hit mais próximo, ou -1.
+s32 TestTriangleIntersection4(CollisionData* colData, const TrianglePacket& packet);
+// O mesmo, sempre escalar (TestTriangleIntersection lane a lane)
+s32 TestTriangleIntersection4Scalar(CollisionData* colData, const TrianglePacket& packet);
 Vector3 CalculateTriangleNormal(Vector3 v1, Vector3 v2, Vector3 v3);
 void GetTriangleInfo(Vector3 v1, Vector3 v2, Vector3 v3, Vector3& center,
                      Vector3& normal);
@@ -0,0 +1,73 @@
+#pragma once
+#include "Config.hpp"
+#include <chrono>
+
+// Contadores das queries de colisão (Selector) e do slide do Collider.
+// Só contam com COLLISION_STATS definido (opção CMake COLLISION_STATS);
+// sem isso as macros desaparecem e os contadores ficam a zero.
+//
+// Cada thread soma nos seus contadores (GetCollisionCounters). Para uma
+// query, basta comparar os contadores da thread antes e depois.
+// CollisionStatsEndFrame junta todas as threads no frame que acabou: deve
+// ser chamada quando não há colisões a correr (fim do frame).
+struct CollisionCounters
+{
+    u64 queries{0};            // getCandidates e raios dos selectors
+    u64 nodesVisited{0};       // nós testados pelas queries
+    u64 candidates{0};         // triângulos devolvidos pelas queries
+    u64 duplicates{0};         // triângulos repetidos (QueryMarks)
+    u64 triangleTests{0};      // elipse-triângulo e raio-triângulo
+    u64 polygonTests{0};       // elipse-polígono (polígonos da PolygonMesh na Octree)
+    u64 moves{0};              // collideEllipsoidWithWorld
+    u64 collideCalls{0};       // passos do slide (collideWithWorld/slideWithWorld)
+    u32 maxRecursion{0};       // níveis (ou iterações) do slide (1 = sem slides)
+    u64 cacheHits{0};          // movimentos servidos pela CandidateCache
+    u64 cacheMisses{0};        // recolhas novas da CandidateCache
+    u64 groundProbes{0};       // gravidade resolvida pelo GroundContact (sem varrimento)
+    u64 gravitySweeps{0};      // passagens completas da gravidade
+    double queryTime{0.0};     // ms nas queries
+    double moveTime{0.0};      // ms em collideEllipsoidWithWorld (inclui as queries)
+
+    void add(const CollisionCounters& other);
+};
+
+// Contadores da thread atual
+CollisionCounters& GetCollisionCounters();
+
+// Fecha o frame: soma as threads, zera-as e acumula no total
+void CollisionStatsEndFrame();
+
+// Último frame fechado, soma desde o início (ou do último reset) e nº de frames
+const CollisionCounters& GetCollisionFrameStats();
+const CollisionCounters& GetCollisionTotalStats();
+u64 GetCollisionFrameCount();
+void ResetCollisionStats();
+
+// Soma ms em target até sair do scope
+class CollisionTimer
+{
+public:
+    explicit CollisionTimer(double& target)
+        : target(target), start(std::chrono::steady_clock::now()) {}
+
+    ~CollisionTimer()
+    {
+        target += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    double& target;
+    std::chrono::steady_clock::time_point start;
+};
+
+#ifdef COLLISION_STATS
+#define COLLISION_STAT_ADD(field, value) (GetCollisionCounters().field += (value))
+#define COLLISION_STAT_MAX(field, value) \
+    do { CollisionCounters& counters_ = GetCollisionCounters(); \
+         if ((u32)(value) > counters_.field) counters_.field = (u32)(value); } while (0)
+#define COLLISION_STAT_TIMER(field) CollisionTimer collisionTimer_(GetCollisionCounters().field)
+#else
+#define COLLISION_STAT_ADD(field, value) ((void)0)
+#define COLLISION_STAT_MAX(field, value) ((void)0)
+#define COLLISION_STAT_TIMER(field) ((void)0)
+#endif
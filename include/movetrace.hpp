@@ -0,0 +1,31 @@
+#pragma once
+#include "Config.hpp"
+#include "collision.hpp"
+
+// Um movimento gravado: as entradas de collideEllipsoidWithWorld e a
+// posição que devolveu
+struct MoveRecord
+{
+    MoveRequest request;
+    Vector3 position;
+};
+
+// Sequência de movimentos gravada em CameraFPS::Update, para repetir em
+// benchmarks sem janela. O ficheiro guarda o hash do mapa
+// (BSP::getContentHash) para se saber se a gravação é deste mapa.
+class MoveTrace
+{
+public:
+    void clear() { records.clear(); }
+    void add(const MoveRequest& request, const Vector3& position);
+
+    bool save(const char* filename, u64 mapHash) const;
+    // mapHash recebe o hash gravado (se não for nullptr)
+    bool load(const char* filename, u64* mapHash = nullptr);
+
+    const std::vector<MoveRecord>& getRecords() const { return records; }
+    u32 getCount() const { return (u32)records.size(); }
+
+private:
+    std::vector<MoveRecord> records;
+};
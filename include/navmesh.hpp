@@ -0,0 +1,133 @@
+#pragma once
+#include "Config.hpp"
+#include "collision.hpp"
+#include <unordered_map>
+
+class PolygonMesh;
+class ThreadPool;
+
+// Parâmetros do agente usados para escolher e ligar os polígonos
+struct NavMeshConfig
+{
+    float agentRadius{1.6f};
+    float agentHeight{5.6f};     // espaço livre que tem de haver por cima do chão
+    float maxSlope{45.0f};       // graus
+    float stepHeight{1.8f};      // degrau mais alto que se sobe sem saltar
+    u32 walkableLayers{LAYER_SOLID | LAYER_GRATE};
+    u32 regionSize{32};          // polígonos por região do grafo de cima
+};
+
+// Polígono convexo onde se pode andar; os vértices são
+// [firstVertex, firstVertex + vertexCount) de NavMesh::vertices e as
+// ligações [firstLink, firstLink + linkCount) de NavMesh::links
+struct NavPolygon
+{
+    u32 firstVertex;
+    u32 vertexCount;
+    u32 firstLink;
+    u32 linkCount;
+    u32 region;
+    Vector3 center;
+    Vector3 normal;
+    float planeD;
+    BoundingBox bounds;
+};
+
+// Portal de um polígono para target. left/right como se vêem a atravessar
+// o portal a partir do polígono de origem.
+struct NavLink
+{
+    u32 target;
+    Vector3 left;
+    Vector3 right;
+};
+
+// Região: polígonos ligados juntos por flood fill. O A* de cima corre neste
+// grafo e o de baixo só entra nos polígonos das regiões do corredor.
+struct NavRegion
+{
+    Vector3 center;
+    u32 firstLink;   // em NavMesh::regionLinks
+    u32 linkCount;
+};
+
+struct NavRegionLink
+{
+    u32 target;
+    float cost;
+};
+
+struct NavPath
+{
+    std::vector<Vector3> points;    // start, cantos do funil e goal
+    std::vector<u32> polygons;      // corredor, do polígono de start ao de goal
+    u32 expanded{0};                // nós abertos pelos dois A*
+};
+
+struct NavPathRequest
+{
+    Vector3 start;
+    Vector3 goal;
+};
+
+// Malha de navegação feita a partir dos polígonos da PolygonMesh: ficam os
+// de declive até maxSlope, nas camadas walkableLayers e com agentHeight
+// livre por cima do centro (raycast no Selector). Polígonos vizinhos ligam-se
+// por portais onde as arestas se sobrepõem em planta e a diferença de altura
+// não passa de stepHeight (arestas partilhadas, rampas e degraus).
+class NavMesh
+{
+public:
+    void clear();
+    // world pode ser nullptr (sem teste de espaço livre)
+    void build(const PolygonMesh& mesh, const Selector* world, const NavMeshConfig& config = NavMeshConfig());
+
+    // Polígono por baixo de point (até maxDrop abaixo, ou stepHeight acima); -1 se não há
+    s32 findPolygon(const Vector3& point, float maxDrop = -1.0f) const;
+
+    // A* nas regiões, A* nos polígonos do corredor e funil (string pulling).
+    // hierarchical = false faz o A* em todos os polígonos (para comparar).
+    bool findPath(const Vector3& start, const Vector3& goal, NavPath& out, bool hierarchical = true) const;
+    // Muitos agentes de uma vez, repartidos pelo pool (nullptr = nesta thread)
+    void findPaths(const NavPathRequest* requests, NavPath* results, bool* found, u32 count,
+                   ThreadPool* pool = nullptr) const;
+
+    const std::vector<NavPolygon>& getPolygons() const { return polygons; }
+    const std::vector<Vector3>& getVertices() const { return vertices; }
+    const std::vector<NavLink>& getLinks() const { return links; }
+    const std::vector<NavRegion>& getRegions() const { return regions; }
+    const NavMeshConfig& getConfig() const { return config; }
+    u32 getPolygonCount() const { return (u32)polygons.size(); }
+    u32 getRegionCount() const { return (u32)regions.size(); }
+
+    // Cache em disco, como Octree::saveCache/loadCache. A chave junta o hash
+    // da fonte (ex.: PolygonMesh::getCacheKey) com a configuração.
+    u64 getCacheKey(u64 sourceHash, const NavMeshConfig& config = NavMeshConfig()) const;
+    bool saveCache(const char* filename, u64 key) const;
+    bool loadCache(const char* filename, u64 key);
+
+    void debug() const;
+    void debugPath(const NavPath& path) const;
+    void stats() const;
+
+private:
+    NavMeshConfig config;
+    std::vector<NavPolygon> polygons;
+    std::vector<Vector3> vertices;
+    std::vector<NavLink> links;
+    std::vector<NavRegion> regions;
+    std::vector<NavRegionLink> regionLinks;
+
+    // Polígonos por célula em planta (x/z), para findPolygon
+    float cellSize{8.0f};
+    std::unordered_map<u64, std::vector<u32>> cells;
+
+    void buildRegions();
+    void buildCells();
+    bool searchRegions(u32 from, u32 to, std::vector<u32>& corridor, u32& expanded) const;
+    bool searchPolygons(u32 from, u32 to, const Vector3& start, const Vector3& goal,
+                        const std::vector<u32>* regionsAllowed, std::vector<u32>& out, u32& expanded) const;
+    void pullString(const Vector3& start, const Vector3& goal, const std::vector<u32>& corridor,
+                    std::vector<Vector3>& out) const;
+    const NavLink* findLink(u32 from, u32 to) const;
+};
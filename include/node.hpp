@@ -1,6 +1,7 @@
 #pragma once
 #include "Config.hpp"
 #include "collision.hpp"
+#include <memory>
 // #include <raylib.h>
 // #include <raymath.h>
 // #include <vector>
@@ -76,6 +77,10 @@ public:
 
     u32 GetID() const { return ID; }
 
+protected:
+    // Chamado sempre que a transformação mundial muda
+    virtual void OnTransformChanged() {}
+
 private:
     std::vector<Node3D*> children;
     friend class Scene;
@@ -97,6 +102,25 @@ struct PickData
     Model3D* node;
 };
 
+// Malha de colisão de um Model em espaço local, partilhada por todas as
+// instâncias: cada Model3D leva as queries para o seu espaço com a inversa
+// da matriz mundo em vez de guardar uma cópia transformada da malha.
+class CollisionMesh
+{
+    Octree tree;
+    BoundingBox bounds;
+
+public:
+    explicit CollisionMesh(const Model& model);
+
+    // Uma por Model; libertada quando a última instância desaparece
+    static std::shared_ptr<CollisionMesh> Get(const Model* model);
+
+    const Octree& getTree() const { return tree; }
+    const BoundingBox& getBounds() const { return bounds; }
+    int getTriangleCount() const { return tree.getTriangleCount(); }
+};
+
 class Model3D : public Node3D 
 {
     Model *model{nullptr};
@@ -104,8 +128,18 @@ class Model3D : public Node3D
     BoundingBox bounds;
     BoundingBox world;
     bool m_visible = true;
-    mutable std::vector<Triangle> cachedTriangles;  // Cache dos triângulos
-    mutable bool trianglesCacheValid = false;
+    std::shared_ptr<CollisionMesh> mesh;
+    Matrix worldMatrix;
+    Matrix inverseWorldMatrix;
+    bool worldMatrixValid = false;
+    Scene* scene{nullptr};
+    s32 proxy = -1;     // folha na AABBTree da cena
+    friend class Scene;
+
+    void updateWorldBounds();
+
+protected:
+    void OnTransformChanged() override;
 
 public:
     Model3D(Model* model);
@@ -113,20 +147,18 @@ public:
     void Render();
     void SetTexture(u32 index , Texture2D texture);
 
-    void SetVisible(bool visible) { m_visible = visible; }
+    void SetVisible(bool visible);
+    bool IsVisible() const { return m_visible; }
+    const BoundingBox& GetWorldBounds() const { return world; }
     
     bool collide(const BoundingBox& area, PickData* data) ;
     bool collide(const Vector3& point, float radius, PickData *data) ;
     bool collide(const Ray& ray, float maxDistance, PickData* data) ;
 
-      //std::vector<const Triangle*> triangles;
-
-    bool collectTriangles(const BoundingBox& area, std::vector<const Triangle*>& out) const;
-    bool collectTriangles(const Ray& ray, std::vector<const Triangle*>& out) const;
-    bool collectTriangles(const Vector3& point, float radius, std::vector<const Triangle*>& out) const;
+    // Acrescenta a out cópias em espaço mundo dos triângulos que tocam area
+    bool collectTriangles(const BoundingBox& area, std::vector<Triangle>& out) const;
 
     std::vector<Triangle> GetTriangles(bool transform = false);
 
-    void invalidateTriangleCache() {        trianglesCacheValid = false;}
-    void buildTriangleCache() const;
+    const CollisionMesh* GetCollisionMesh() const { return mesh.get(); }
 };
@@ -0,0 +1,45 @@
+#pragma once
+#include "Config.hpp"
+#include "collision.hpp"
+
+// Malha de colisão simplificada. A triangulação do render parte chãos e
+// paredes em muitos triângulos finos; build() junta os que partilham uma
+// aresta e estão no mesmo plano em polígonos convexos (CollisionPolygon) e
+// tira os vértices a meio de arestas retas. Cada polígono vai para o
+// Selector com addPolygon: a Octree guarda-o e o Collider testa-o como uma
+// primitiva; os raycasts usam o leque de points.size() - 2 triângulos.
+class PolygonMesh
+{
+public:
+    void addTriangle(const Vector3& a, const Vector3& b, const Vector3& c, u32 layers = LAYER_SOLID);
+    void clear();
+    void build();
+
+    // Os polígonos, por ordem (Selector::addPolygon); um Selector vazio fica
+    // com os triângulos do leque do polígono i seguidos (ver getFirstTriangle)
+    void addTo(Selector& selector) const;
+
+    const std::vector<CollisionPolygon>& getPolygons() const { return polygons; }
+    // Contornos e planos das arestas de todos os polígonos (firstPoint/pointCount)
+    const std::vector<Vector3>& getPoints() const { return points; }
+    const std::vector<Vector4>& getEdgePlanes() const { return edgePlanes; }
+    const Vector3* getPoints(const CollisionPolygon& polygon) const { return &points[polygon.firstPoint]; }
+    u32 getInputCount() const { return (u32)input.size() / 3; }
+    u32 getPolygonCount() const { return (u32)polygons.size(); }
+    u32 getTriangleCount() const { return triangleCount; }
+    u32 getFirstTriangle(u32 polygon) const { return firstTriangle[polygon]; }
+
+    // Para caches de árvores feitas com addTo: muda com a versão do algoritmo
+    static u64 getCacheKey(u64 sourceHash);
+
+    void stats() const;
+
+private:
+    std::vector<Vector3> input;       // 3 pontos por triângulo de addTriangle
+    std::vector<u32> inputLayers;     // 1 por triângulo de addTriangle
+    std::vector<CollisionPolygon> polygons;
+    std::vector<Vector3> points;
+    std::vector<Vector4> edgePlanes;
+    std::vector<u32> firstTriangle;
+    u32 triangleCount{0};
+};
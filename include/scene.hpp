@@ -1,6 +1,7 @@
 #pragma once
 #include "Config.hpp"
 #include "collision.hpp"
+#include "aabbtree.hpp"
 #include <raylib.h>
 #include <raymath.h>
 #include <vector>
@@ -9,12 +10,15 @@
 
 class Node3D;
 class Model3D;
+class ViewFrustum;
 struct PickData;
 
 class Scene
 {
     std::vector<Model3D*> nodes;
     std::vector<Model3D*> toRemove;
+    AABBTree tree;  // broadphase dos nós visíveis (colisão e culling)
+    u32 version{0};  // muda sempre que um nó entra, sai, se move ou se esconde
 
 
 public:
@@ -26,8 +30,16 @@ public:
     void RemoveNode(Model3D* node);
     void Update(float dt);
     void Render();
+    void Render(ViewFrustum& frustum);
     void Clear();
 
+    // Sincroniza o nó com a árvore (transformação ou visibilidade mudou);
+    // displacement alarga a caixa gorda no sentido do movimento
+    void UpdateNode(Model3D* node, const Vector3& displacement = { 0.0f, 0.0f, 0.0f });
+    const AABBTree& GetTree() const { return tree; }
+    // Para caches de colisão (GroundContact): diferente = a cena mudou
+    u32 GetVersion() const { return version; }
+
 
 
     Model3D* GetNode(u32 index) { return nodes[index]; }
@@ -36,6 +48,8 @@ public:
     bool collide(const Vector3& point, float radius, PickData *data) ;
     bool collide(const Ray& ray, float maxDistance, PickData* data) ;
 
-    std::vector<const Triangle*> collectTriangles(const BoundingBox& area) const;
+    // Cópias em espaço mundo (as malhas são partilhadas em espaço local);
+    // só lê a cena, pode correr em várias threads
+    void collectTriangles(const BoundingBox& area, std::vector<Triangle>& out) const;
 
 };
\ No newline at end of file
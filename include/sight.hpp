@@ -0,0 +1,104 @@
+#pragma once
+#include "Config.hpp"
+#include "collision.hpp"
+#include <unordered_map>
+
+class BSP;
+
+struct SightConfig
+{
+    float maxDistance{150.0f};   // mais longe que isto não se vê
+    float fieldOfView{120.0f};   // graus, cone à frente dos olhos (0 = vê para todo o lado)
+    float maxAge{0.25f};         // segundos até um resultado precisar de raio novo
+    float dropAfter{1.0f};       // segundos sem query até o par sair da cache
+    float budget{0.5f};          // ms de testes por update
+    u32 mask{MASK_SHOT};
+};
+
+// Resultado em cache de um par (quem olha, quem é visto)
+struct SightResult
+{
+    bool visible;
+    float age;       // segundos desde o último teste (FLT_MAX: ainda não foi testado)
+};
+
+// Contadores do último update
+struct SightStats
+{
+    u32 pairs{0};             // pares em cache
+    u32 stale{0};             // pares com idade >= maxAge no início do update
+    u32 rejectedDistance{0};
+    u32 rejectedView{0};      // fora do cone de visão
+    u32 rejectedPVS{0};       // clusters que não se vêem (BSP::isClusterVisible)
+    u32 rays{0};              // raios lançados
+    u32 deferred{0};          // ainda velhos no fim (orçamento gasto)
+    double time{0.0};         // ms no update
+};
+
+// Linhas de visão para a IA, amortizadas entre frames. Os agentes pedem
+// query(observer, target) e recebem o último resultado em cache; update()
+// refaz só os pares velhos, à roda a partir de onde parou: primeiro os
+// testes baratos (distância, cone, PVS do mapa se o .bsp tiver vis) e os
+// que sobram vão em lotes para o raycast do Selector até gastar o orçamento.
+// O que não couber fica para o frame seguinte, sem picos no frame.
+class SightService
+{
+public:
+    // map pode ser nullptr (sem PVS)
+    void setWorld(const Selector* world, const BSP* map = nullptr);
+    void setConfig(const SightConfig& config) { this->config = config; }
+    const SightConfig& getConfig() const { return config; }
+
+    // Olhos e direção de cada agente; ids pequenos e estáveis (índices)
+    void setAgent(u32 id, const Vector3& eye, const Vector3& forward);
+    void removeAgent(u32 id);
+
+    // Último resultado de observer a ver target. O par fica na cache e os
+    // updates mantêm-no fresco enquanto continuar a ser pedido.
+    SightResult query(u32 observer, u32 target);
+
+    void update(float dt);
+    void clear();
+
+    const SightStats& getStats() const { return stats; }
+    u32 getPairCount() const { return (u32)pairs.size(); }
+
+private:
+    struct Agent
+    {
+        Vector3 eye;
+        Vector3 forward;
+        s32 cluster;
+        bool active;
+    };
+
+    struct Pair
+    {
+        u32 observer;
+        u32 target;
+        bool visible;
+        float age;
+        float idle;     // segundos desde a última query
+    };
+
+    const Selector* world{nullptr};
+    const BSP* map{nullptr};
+    SightConfig config;
+    SightStats stats;
+
+    std::vector<Agent> agents;
+    std::vector<Pair> pairs;
+    std::unordered_map<u64, u32> pairIndex;   // (observer, target) -> pairs
+
+    u32 cursor{0};     // par onde o próximo update começa
+
+    // Scratch de update
+    std::vector<u32> pending;
+    std::vector<Ray> rays;
+    std::vector<float> distances;
+    std::vector<RayHit> hits;
+
+    void removePair(u32 index);
+    // false: nem precisa de raio (e o resultado já ficou escrito)
+    bool needsRay(Pair& pair, Ray& ray, float& distance);
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include "Config.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Pool fixo de threads para trabalho em lote (movimento de bots, raycasts).
+// parallelFor bloqueia até todos os blocos acabarem; a thread que chama
+// também trabalha. Só uma thread deve chamar parallelFor de cada vez.
+class ThreadPool
+{
+public:
+    typedef std::function<void(u32 begin, u32 end)> Job;
+
+    // threadCount = 0: uma thread por núcleo (contando com a que chama)
+    explicit ThreadPool(u32 threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Divide [0, count) em blocos de grain e corre job em todas as threads
+    void parallelFor(u32 count, u32 grain, const Job& job);
+
+    // Workers + a thread que chama parallelFor
+    u32 getThreadCount() const { return (u32)workers.size() + 1; }
+
+private:
+    void workerLoop();
+    void runChunks();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const Job* job{nullptr};
+    std::atomic<u32> next{0};
+    u32 count{0};
+    u32 grain{1};
+    u32 generation{0};
+    u32 busy{0};
+    bool stopping{false};
+};
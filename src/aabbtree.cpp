@@ -0,0 +1,346 @@
+#include "aabbtree.hpp"
+#include <algorithm>
+
+
+static BoundingBox Combine(const BoundingBox& a, const BoundingBox& b)
+{
+    return {
+        { std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z) },
+        { std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z) }
+    };
+}
+
+static float SurfaceArea(const BoundingBox& box)
+{
+    float dx = box.max.x - box.min.x;
+    float dy = box.max.y - box.min.y;
+    float dz = box.max.z - box.min.z;
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static bool Contains(const BoundingBox& outer, const BoundingBox& inner)
+{
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+           outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+}
+
+
+AABBTree::AABBTree(float margin) : margin(margin)
+{
+}
+
+s32 AABBTree::allocateNode()
+{
+    if (freeList == NULL_NODE)
+    {
+        nodes.push_back({});
+        freeList = (s32)nodes.size() - 1;
+        nodes[freeList].parent = NULL_NODE;
+    }
+
+    s32 index = freeList;
+    Node& node = nodes[index];
+    freeList = node.parent;
+    node.parent = NULL_NODE;
+    node.child1 = NULL_NODE;
+    node.child2 = NULL_NODE;
+    node.height = 0;
+    node.userData = nullptr;
+    nodeCount++;
+    return index;
+}
+
+void AABBTree::freeNode(s32 index)
+{
+    nodes[index].parent = freeList;
+    nodes[index].height = -1;
+    freeList = index;
+    nodeCount--;
+}
+
+void AABBTree::clear()
+{
+    nodes.clear();
+    root = NULL_NODE;
+    freeList = NULL_NODE;
+    nodeCount = 0;
+    proxyCount = 0;
+}
+
+s32 AABBTree::insert(const BoundingBox& box, void* userData)
+{
+    s32 proxy = allocateNode();
+    Node& node = nodes[proxy];
+    node.box = {
+        { box.min.x - margin, box.min.y - margin, box.min.z - margin },
+        { box.max.x + margin, box.max.y + margin, box.max.z + margin }
+    };
+    node.userData = userData;
+
+    insertLeaf(proxy);
+    proxyCount++;
+    return proxy;
+}
+
+void AABBTree::remove(s32 proxy)
+{
+    removeLeaf(proxy);
+    freeNode(proxy);
+    proxyCount--;
+}
+
+bool AABBTree::move(s32 proxy, const BoundingBox& box, const Vector3& displacement)
+{
+    if (Contains(nodes[proxy].box, box)) return false;
+
+    removeLeaf(proxy);
+
+    // Margem mais o deslocamento previsto, só no sentido do movimento
+    BoundingBox fat = {
+        { box.min.x - margin, box.min.y - margin, box.min.z - margin },
+        { box.max.x + margin, box.max.y + margin, box.max.z + margin }
+    };
+    const float predict = 2.0f;
+    if (displacement.x < 0.0f) fat.min.x += predict * displacement.x; else fat.max.x += predict * displacement.x;
+    if (displacement.y < 0.0f) fat.min.y += predict * displacement.y; else fat.max.y += predict * displacement.y;
+    if (displacement.z < 0.0f) fat.min.z += predict * displacement.z; else fat.max.z += predict * displacement.z;
+    nodes[proxy].box = fat;
+
+    insertLeaf(proxy);
+    return true;
+}
+
+float AABBTree::getAreaRatio() const
+{
+    if (root == NULL_NODE) return 0.0f;
+
+    float rootArea = SurfaceArea(nodes[root].box);
+    if (rootArea <= 0.0f) return 0.0f;
+
+    float total = 0.0f;
+    for (const Node& node : nodes)
+    {
+        if (node.height < 0) continue;
+        total += SurfaceArea(node.box);
+    }
+    return total / rootArea;
+}
+
+void AABBTree::insertLeaf(s32 leaf)
+{
+    if (root == NULL_NODE)
+    {
+        root = leaf;
+        nodes[root].parent = NULL_NODE;
+        return;
+    }
+
+    // Desce pelo filho que menos aumenta a área total
+    BoundingBox leafBox = nodes[leaf].box;
+    s32 index = root;
+    while (!nodes[index].isLeaf())
+    {
+        const Node& node = nodes[index];
+        s32 child1 = node.child1;
+        s32 child2 = node.child2;
+
+        float area = SurfaceArea(node.box);
+        float combinedArea = SurfaceArea(Combine(node.box, leafBox));
+
+        // custo de criar um pai novo para este nó e a folha
+        float cost = 2.0f * combinedArea;
+        // custo mínimo de empurrar a folha mais para baixo
+        float inheritanceCost = 2.0f * (combinedArea - area);
+
+        float cost1 = SurfaceArea(Combine(leafBox, nodes[child1].box)) + inheritanceCost;
+        if (!nodes[child1].isLeaf()) cost1 -= SurfaceArea(nodes[child1].box);
+
+        float cost2 = SurfaceArea(Combine(leafBox, nodes[child2].box)) + inheritanceCost;
+        if (!nodes[child2].isLeaf()) cost2 -= SurfaceArea(nodes[child2].box);
+
+        if (cost < cost1 && cost < cost2) break;
+
+        index = (cost1 < cost2) ? child1 : child2;
+    }
+
+    s32 sibling = index;
+    s32 oldParent = nodes[sibling].parent;
+    s32 newParent = allocateNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].box = Combine(leafBox, nodes[sibling].box);
+    nodes[newParent].height = nodes[sibling].height + 1;
+    nodes[newParent].child1 = sibling;
+    nodes[newParent].child2 = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+
+    if (oldParent != NULL_NODE)
+    {
+        if (nodes[oldParent].child1 == sibling) nodes[oldParent].child1 = newParent;
+        else nodes[oldParent].child2 = newParent;
+    }
+    else
+    {
+        root = newParent;
+    }
+
+    // Sobe a corrigir caixas e alturas
+    index = nodes[leaf].parent;
+    while (index != NULL_NODE)
+    {
+        index = balance(index);
+
+        Node& node = nodes[index];
+        node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+        node.box = Combine(nodes[node.child1].box, nodes[node.child2].box);
+
+        index = node.parent;
+    }
+}
+
+void AABBTree::removeLeaf(s32 leaf)
+{
+    if (leaf == root)
+    {
+        root = NULL_NODE;
+        return;
+    }
+
+    s32 parent = nodes[leaf].parent;
+    s32 grandParent = nodes[parent].parent;
+    s32 sibling = (nodes[parent].child1 == leaf) ? nodes[parent].child2 : nodes[parent].child1;
+
+    if (grandParent != NULL_NODE)
+    {
+        // O irmão toma o lugar do pai
+        if (nodes[grandParent].child1 == parent) nodes[grandParent].child1 = sibling;
+        else nodes[grandParent].child2 = sibling;
+        nodes[sibling].parent = grandParent;
+        freeNode(parent);
+
+        s32 index = grandParent;
+        while (index != NULL_NODE)
+        {
+            index = balance(index);
+
+            Node& node = nodes[index];
+            node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+            node.box = Combine(nodes[node.child1].box, nodes[node.child2].box);
+
+            index = node.parent;
+        }
+    }
+    else
+    {
+        root = sibling;
+        nodes[sibling].parent = NULL_NODE;
+        freeNode(parent);
+    }
+}
+
+// Rotação AVL: se um filho é mais alto por 2 ou mais, sobe esse filho.
+// Devolve o índice da nova raiz da subárvore.
+s32 AABBTree::balance(s32 iA)
+{
+    Node& A = nodes[iA];
+    if (A.isLeaf() || A.height < 2) return iA;
+
+    s32 iB = A.child1;
+    s32 iC = A.child2;
+    Node& B = nodes[iB];
+    Node& C = nodes[iC];
+
+    s32 delta = C.height - B.height;
+
+    if (delta > 1)
+    {
+        // Sobe C
+        s32 iF = C.child1;
+        s32 iG = C.child2;
+        Node& F = nodes[iF];
+        Node& G = nodes[iG];
+
+        C.child1 = iA;
+        C.parent = A.parent;
+        A.parent = iC;
+
+        if (C.parent != NULL_NODE)
+        {
+            if (nodes[C.parent].child1 == iA) nodes[C.parent].child1 = iC;
+            else nodes[C.parent].child2 = iC;
+        }
+        else
+        {
+            root = iC;
+        }
+
+        if (F.height > G.height)
+        {
+            C.child2 = iF;
+            A.child2 = iG;
+            G.parent = iA;
+            A.box = Combine(B.box, G.box);
+            C.box = Combine(A.box, F.box);
+            A.height = 1 + std::max(B.height, G.height);
+            C.height = 1 + std::max(A.height, F.height);
+        }
+        else
+        {
+            C.child2 = iG;
+            A.child2 = iF;
+            F.parent = iA;
+            A.box = Combine(B.box, F.box);
+            C.box = Combine(A.box, G.box);
+            A.height = 1 + std::max(B.height, F.height);
+            C.height = 1 + std::max(A.height, G.height);
+        }
+        return iC;
+    }
+
+    if (delta < -1)
+    {
+        // Sobe B
+        s32 iD = B.child1;
+        s32 iE = B.child2;
+        Node& D = nodes[iD];
+        Node& E = nodes[iE];
+
+        B.child1 = iA;
+        B.parent = A.parent;
+        A.parent = iB;
+
+        if (B.parent != NULL_NODE)
+        {
+            if (nodes[B.parent].child1 == iA) nodes[B.parent].child1 = iB;
+            else nodes[B.parent].child2 = iB;
+        }
+        else
+        {
+            root = iB;
+        }
+
+        if (D.height > E.height)
+        {
+            B.child2 = iD;
+            A.child1 = iE;
+            E.parent = iA;
+            A.box = Combine(C.box, E.box);
+            B.box = Combine(A.box, D.box);
+            A.height = 1 + std::max(C.height, E.height);
+            B.height = 1 + std::max(A.height, D.height);
+        }
+        else
+        {
+            B.child2 = iE;
+            A.child1 = iD;
+            D.parent = iA;
+            A.box = Combine(C.box, D.box);
+            B.box = Combine(A.box, E.box);
+            A.height = 1 + std::max(C.height, D.height);
+            B.height = 1 + std::max(A.height, E.height);
+        }
+        return iB;
+    }
+
+    return iA;
+}
@@ -1,5 +1,6 @@
  
 #include "bsp.hpp"
+#include "collision.hpp"
 #include "frustum.hpp"
 #include "binaryfile.hpp"
 
@@ -97,6 +98,8 @@ void BSP::loadTexture(BinaryFile& file)
     file.readBytes(&Textures[0], lumps[kTextures].length);
 
 
+    if (!graphics) return;
+
     textures.reserve(NumTextures);
 
     for (int i = 0; i < NumTextures; ++i)
@@ -118,6 +121,8 @@ void BSP::loadLightmap(BinaryFile& file)
 
 
     LogInfo(" %d", NumLightMaps);
+    if (!graphics) return;
+
     lightmaps.reserve(NumLightMaps);
     for (int i = 0; i < NumLightMaps; ++i)
     {
@@ -205,11 +210,65 @@ void BSP::loadModels(BinaryFile& file)
 }
 
 
-bool BSP::loadFromFile(const std::string& filePath)
+// Árvore BSP (planos, nós, folhas) e PVS, só para findCluster/isClusterVisible
+void BSP::loadVisibility(BinaryFile& file)
+{
+    NumPlanes = lumps[kPlanes].length / sizeof(BSPPlane);
+    Planes = new BSPPlane[NumPlanes];
+    file.seek(lumps[kPlanes].offset, SEEK_SET);
+    file.readBytes(&Planes[0], NumPlanes * sizeof(BSPPlane));
+
+    NumNodes = lumps[kNodes].length / sizeof(BSPNode);
+    Nodes = new BSPNode[NumNodes];
+    file.seek(lumps[kNodes].offset, SEEK_SET);
+    file.readBytes(&Nodes[0], NumNodes * sizeof(BSPNode));
+
+    NumLeafs = lumps[kLeafs].length / sizeof(BSPLeaf);
+    Leafs = new BSPLeaf[NumLeafs];
+    file.seek(lumps[kLeafs].offset, SEEK_SET);
+    file.readBytes(&Leafs[0], NumLeafs * sizeof(BSPLeaf));
+
+    // Lump: numOfClusters, bytesPerCluster e os bitsets
+    visBits.clear();
+    numClusters = 0;
+    bytesPerCluster = 0;
+    if (lumps[kVisData].length < 8 || NumNodes == 0) return;
+
+    s32 counts[2];
+    file.seek(lumps[kVisData].offset, SEEK_SET);
+    file.readBytes(counts, sizeof(counts));
+    u64 size = (u64)counts[0] * (u64)counts[1];
+    if (counts[0] <= 0 || counts[1] <= 0 || size + 8 > (u64)lumps[kVisData].length) return;
+
+    numClusters = counts[0];
+    bytesPerCluster = counts[1];
+    visBits.resize(size);
+    file.readBytes(visBits.data(), (u32)size);
+}
+
+// Brushes e lados, só para os brushes de clip (BuildClipSurfaces)
+void BSP::loadBrushes(BinaryFile& file)
+{
+    NumBrushes = lumps[kBrushes].length / sizeof(BSPBrush);
+    Brushes = new BSPBrush[NumBrushes];
+    file.seek(lumps[kBrushes].offset, SEEK_SET);
+    file.readBytes(&Brushes[0], NumBrushes * sizeof(BSPBrush));
+
+    NumBrushSides = lumps[kBrushSides].length / sizeof(BSPBrushSide);
+    BrushSides = new BSPBrushSide[NumBrushSides];
+    file.seek(lumps[kBrushSides].offset, SEEK_SET);
+    file.readBytes(&BrushSides[0], NumBrushSides * sizeof(BSPBrushSide));
+}
+
+bool BSP::loadFromFile(const std::string& filePath, bool graphics)
 {
+    this->graphics = graphics;
+
     BinaryFile file;
     if (!file.open(filePath.c_str())) return false;
 
+    contentHash = HashFNV1a(file.getData(), file.getFileSize());
+
     file.readBytes(&header, sizeof(BSPHeader));
 
     LogInfo("BSP version: %d", header.version);
@@ -225,8 +284,11 @@ bool BSP::loadFromFile(const std::string& filePath)
     loadIndex(file);
     LoadEntities(file);
     loadModels(file);
+    loadVisibility(file);
+    loadBrushes(file);
 
     BuildSurfaces();
+    BuildClipSurfaces();
 
     transform = MatrixIdentity();
     
@@ -243,6 +305,212 @@ BSP::BSP()
 
 BSP::~BSP() {}
 
+u32 BSP::getCollisionLayers(s32 textureID) const
+{
+    const BSPTexture* texture = getTexture(textureID);
+    if (!texture) return LAYER_SOLID;
+
+    const u32 contents = texture->contents;
+    const u32 clip = CONTENTS_PLAYERCLIP | CONTENTS_MONSTERCLIP | CONTENTS_BOTCLIP;
+
+    // Brushes de clip: o shader (common/clip) também é nonsolid, mas isso é
+    // da superfície; o conteúdo bloqueia quem anda
+    if (!(contents & CONTENTS_SOLID) && (contents & clip)) return LAYER_PLAYERCLIP;
+
+    // Sem nada sólido: água/lava/slime ou só decoração (nevoeiro, chamas)
+    if ((texture->flags & SURF_NONSOLID) || !(contents & CONTENTS_SOLID))
+    {
+        return (contents & (CONTENTS_LAVA | CONTENTS_SLIME | CONTENTS_WATER)) ? LAYER_LIQUID : LAYER_NONSOLID;
+    }
+    if (texture->flags & SURF_SKY) return LAYER_SKY;
+    // Translúcido só diz que não tapa a visibilidade: vidro e weapclip também
+    // o são e têm de parar tiros. Grelha é a textura recortada (alphashadow:
+    // grelhas, redes, bandeiras), onde os tiros passam pelos buracos
+    if ((contents & CONTENTS_TRANSLUCENT) && (texture->flags & SURF_ALPHASHADOW)) return LAYER_GRATE;
+    return LAYER_SOLID;
+}
+
+// Sobe quando muda a geometria de colisão que sai do mesmo .bsp
+// (1: brushes de clip, 2: só os translúcidos recortados são grelha)
+#define BSP_COLLISION_VERSION 2
+
+u64 BSP::getCollisionHash() const
+{
+    const s32 version = BSP_COLLISION_VERSION;
+    return HashFNV1a(&version, sizeof(version), contentHash);
+}
+
+// Lado de um brush: um quadrado enorme no plano do lado, cortado pelos
+// planos dos outros lados (fica o que está atrás de todos, dentro do brush).
+// Tudo nas coordenadas do .bsp.
+static void BaseWinding(const BSPPlane& plane, std::vector<Vector3>& winding)
+{
+    const float size = 131072.0f;
+    Vector3 normal = { plane.vNormal[0], plane.vNormal[1], plane.vNormal[2] };
+
+    // Um eixo que não seja quase paralelo à normal
+    Vector3 up = fabsf(normal.z) > 0.7f ? (Vector3){ 1.0f, 0.0f, 0.0f } : (Vector3){ 0.0f, 0.0f, 1.0f };
+    up = Vector3Normalize(Vector3Subtract(up, Vector3Scale(normal, Vector3DotProduct(up, normal))));
+    Vector3 right = Vector3CrossProduct(up, normal);
+    up = Vector3Scale(up, size);
+    right = Vector3Scale(right, size);
+
+    Vector3 origin = Vector3Scale(normal, plane.d);
+    winding.clear();
+    winding.push_back(Vector3Add(Vector3Subtract(origin, right), up));
+    winding.push_back(Vector3Add(Vector3Add(origin, right), up));
+    winding.push_back(Vector3Subtract(Vector3Add(origin, right), up));
+    winding.push_back(Vector3Subtract(Vector3Subtract(origin, right), up));
+}
+
+static void ClipWinding(const BSPPlane& plane, std::vector<Vector3>& winding, std::vector<Vector3>& clipped)
+{
+    const float epsilon = 0.1f;
+    Vector3 normal = { plane.vNormal[0], plane.vNormal[1], plane.vNormal[2] };
+
+    clipped.clear();
+    for (size_t i = 0; i < winding.size(); i++)
+    {
+        const Vector3& a = winding[i];
+        const Vector3& b = winding[(i + 1) % winding.size()];
+        float da = Vector3DotProduct(normal, a) - plane.d;
+        float db = Vector3DotProduct(normal, b) - plane.d;
+
+        if (da <= epsilon) clipped.push_back(a);
+        if ((da < -epsilon && db > epsilon) || (da > epsilon && db < -epsilon))
+        {
+            clipped.push_back(Vector3Lerp(a, b, da / (da - db)));
+        }
+    }
+    winding.swap(clipped);
+}
+
+// O q3map deixa alguns brushes com dois lados quase no mesmo plano: só o
+// primeiro dá faces
+bool BSP::HasSamePlane(const BSPBrush& brush, s32 side) const
+{
+    const BSPPlane& plane = Planes[BrushSides[brush.brushSide + side].plane];
+    for (s32 i = 0; i < side; i++)
+    {
+        s32 other = BrushSides[brush.brushSide + i].plane;
+        if (other < 0 || other >= NumPlanes) continue;
+        const BSPPlane& earlier = Planes[other];
+        float dot = plane.vNormal[0] * earlier.vNormal[0] + plane.vNormal[1] * earlier.vNormal[1]
+                  + plane.vNormal[2] * earlier.vNormal[2];
+        if (dot > 0.9999f && fabsf(plane.d - earlier.d) < 0.1f) return true;
+    }
+    return false;
+}
+
+// Os brushes de clip do mundo (modelo 0) em triângulos: um BSPSurface por
+// brush, virado para fora, nas coordenadas das outras superfícies
+void BSP::BuildClipSurfaces()
+{
+    clipSurfaces.clear();
+    if (NumModels == 0 || !Brushes || !BrushSides) return;
+
+    const BSPModel& world = Models[0];
+    std::vector<Vector3> winding;
+    std::vector<Vector3> clipped;
+    u32 triangles = 0;
+
+    for (s32 b = world.brushIndex; b < world.brushIndex + world.numOfBrushes && b < NumBrushes; b++)
+    {
+        const BSPBrush& brush = Brushes[b];
+        if (getCollisionLayers(brush.textureID) != LAYER_PLAYERCLIP) continue;
+        if (brush.brushSide < 0 || brush.brushSide + brush.numOfBrushSides > NumBrushSides) continue;
+
+        BSPSurface surface;
+        surface.textureID = brush.textureID;
+        surface.lightmapID = -1;
+        for (s32 i = 0; i < brush.numOfBrushSides; i++)
+        {
+            s32 planeIndex = BrushSides[brush.brushSide + i].plane;
+            if (planeIndex < 0 || planeIndex >= NumPlanes) continue;
+            if (HasSamePlane(brush, i)) continue;
+
+            BaseWinding(Planes[planeIndex], winding);
+            for (s32 j = 0; j < brush.numOfBrushSides && winding.size() >= 3; j++)
+            {
+                s32 other = BrushSides[brush.brushSide + j].plane;
+                if (j == i || other == planeIndex || other < 0 || other >= NumPlanes) continue;
+                ClipWinding(Planes[other], winding, clipped);
+            }
+            // Os lados de bevel (axiais) ficam sem área
+            if (winding.size() < 3 || surface.vertices.size() + winding.size() > 0xFFFF) continue;
+
+            // y e z trocados, como os vértices das faces: a ordem do leque
+            // pode ficar ao contrário da normal do lado
+            const BSPPlane& plane = Planes[planeIndex];
+            Vector3 normal = { plane.vNormal[0], plane.vNormal[2], plane.vNormal[1] };
+            u16 first = (u16)surface.vertices.size();
+            for (const Vector3& point : winding)
+            {
+                surface.vertices.push_back({ point.x * scale, point.z * scale, point.y * scale });
+            }
+            const Vector3* points = &surface.vertices[first];
+            Vector3 faceNormal = { 0.0f, 0.0f, 0.0f };
+            for (size_t k = 1; k + 1 < winding.size(); k++)
+            {
+                Vector3 edge1 = Vector3Subtract(points[k], points[0]);
+                Vector3 edge2 = Vector3Subtract(points[k + 1], points[0]);
+                faceNormal = Vector3Add(faceNormal, Vector3CrossProduct(edge1, edge2));
+            }
+            bool flip = Vector3DotProduct(faceNormal, normal) < 0.0f;
+
+            for (u16 k = 1; k + 1 < (u16)winding.size(); k++)
+            {
+                surface.indices.push_back(first);
+                surface.indices.push_back(first + (flip ? k + 1 : k));
+                surface.indices.push_back(first + (flip ? k : k + 1));
+            }
+        }
+
+        if (surface.indices.empty()) continue;
+        surface.vertexCount = (u32)surface.vertices.size();
+        surface.triangleCount = (u32)surface.indices.size() / 3;
+        surface.updateBounds();
+        triangles += surface.triangleCount;
+
+        // O mapa tem de conter a colisão toda (a octree usa getBounds)
+        bounds.min = Vector3Min(bounds.min, surface.bounds.min);
+        bounds.max = Vector3Max(bounds.max, surface.bounds.max);
+        clipSurfaces.push_back(std::move(surface));
+    }
+
+    if (!clipSurfaces.empty())
+    {
+        LogInfo("Clip brushes: %u (%u triangles)", (u32)clipSurfaces.size(), triangles);
+    }
+}
+
+s32 BSP::findCluster(const Vector3& point) const
+{
+    if (NumNodes == 0) return -1;
+
+    // De volta às coordenadas do .bsp (y e z trocados, sem escala)
+    const float p[3] = { point.x / scale, point.z / scale, point.y / scale };
+    s32 index = 0;
+    while (index >= 0)
+    {
+        if (index >= NumNodes) return -1;
+        const BSPNode& node = Nodes[index];
+        const BSPPlane& plane = Planes[node.plane];
+        float distance = plane.vNormal[0] * p[0] + plane.vNormal[1] * p[1] + plane.vNormal[2] * p[2] - plane.d;
+        index = distance >= 0.0f ? node.front : node.back;
+    }
+
+    s32 leaf = -(index + 1);
+    return leaf < NumLeafs ? Leafs[leaf].cluster : -1;
+}
+
+bool BSP::isClusterVisible(s32 from, s32 to) const
+{
+    // Sem PVS, ou algum ponto dentro de uma parede: não se sabe
+    if (visBits.empty() || from < 0 || to < 0 || from >= numClusters || to >= numClusters) return true;
+    return (visBits[(size_t)from * bytesPerCluster + (to >> 3)] & (1 << (to & 7))) != 0;
+}
+
 void BSP::drawDebugSurfaces()
 {
 
@@ -324,12 +592,20 @@ void BSP::clear()
     Nodes = 0;
     delete[] Leafs;
     Leafs = 0;
+    NumPlanes = NumNodes = NumLeafs = 0;
+    visBits.clear();
+    numClusters = 0;
+    bytesPerCluster = 0;
     delete[] LeafFaces;
     LeafFaces = 0;
     delete[] MeshVerts;
     MeshVerts = 0;
     delete[] Brushes;
     Brushes = 0;
+    delete[] BrushSides;
+    BrushSides = 0;
+    NumBrushes = NumBrushSides = 0;
+    clipSurfaces.clear();
     delete[] Indices;
     Indices = 0;
 }
@@ -525,7 +801,9 @@ void BSP::MergeSurfacesByMaterial()
             }
         }
 
-        mergedSurface.init();
+        // init() também calcula as bounds; sem GPU só as bounds
+        if (graphics) mergedSurface.init();
+        else mergedSurface.updateBounds();
         mergedSurfaces.push_back(mergedSurface);
 
         LogInfo("Merged %d surfaces with texture %d, lightmap %d (%d "
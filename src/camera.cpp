@@ -1,5 +1,6 @@
 
 #include "camera.hpp"
+#include "movetrace.hpp"
 
 void CameraFPS::Init(Vector3 startPos)
 {
@@ -16,6 +17,15 @@ void CameraFPS::Init(Vector3 startPos)
     
 }
 
+void CameraFPS::SetPosition(const Vector3& position)
+{
+    Vector3 delta = Vector3Subtract(position, translation);
+    translation = position;
+    lastPosition = position;
+    camera.position = Vector3Add(camera.position, delta);
+    camera.target = Vector3Add(camera.target, delta);
+}
+
 void CameraFPS::Update(float deltaTime, Collider& world)
 {
  
@@ -94,7 +104,16 @@ void CameraFPS::Update(float deltaTime, Collider& world)
         hitTriangle,
         hitPosition,
          outFalling, 
-         collision);
+         collision,
+        &collisionCache,
+        MASK_MOVEMENT,
+        &groundContact);
+
+    if (trace)
+    {
+        MoveRequest request = { lastPosition, ellipsoidRadius, vel, fallingVelocity, slidingSpeed };
+        trace->add(request, result);
+    }
 
     if (outFalling)
     {
@@ -0,0 +1,155 @@
+#include "characters.hpp"
+#include <algorithm>
+#include <chrono>
+
+u32 CharacterSet::add(const Vector3& position, float radius, float halfHeight, float mass)
+{
+    CharacterCapsule capsule = { position, radius, fmaxf(halfHeight, radius), mass, true };
+
+    // Reaproveita um lugar livre
+    u32 id = 0;
+    while (id < capsules.size() && capsules[id].active) id++;
+    if (id == capsules.size()) capsules.push_back(capsule);
+    else capsules[id] = capsule;
+
+    order.push_back(id);
+    activeCount++;
+    return id;
+}
+
+void CharacterSet::remove(u32 id)
+{
+    if (id >= capsules.size() || !capsules[id].active) return;
+    capsules[id].active = false;
+    order.erase(std::find(order.begin(), order.end(), id));
+    activeCount--;
+}
+
+void CharacterSet::clear()
+{
+    capsules.clear();
+    order.clear();
+    activeCount = 0;
+    stats = CharacterStats();
+}
+
+void CharacterSet::findPairs(std::vector<CharacterPair>& out)
+{
+    out.clear();
+    stats.characters = activeCount;
+    stats.swaps = 0;
+
+    for (size_t i = 1; i < order.size(); i++)
+    {
+        u32 id = order[i];
+        float key = capsules[id].position.x - capsules[id].radius * (1.0f + CHARACTER_PAIR_MARGIN);
+        size_t j = i;
+        for (; j > 0; j--)
+        {
+            const CharacterCapsule& previous = capsules[order[j - 1]];
+            if (previous.position.x - previous.radius * (1.0f + CHARACTER_PAIR_MARGIN) <= key) break;
+            order[j] = order[j - 1];
+            stats.swaps++;
+        }
+        order[j] = id;
+    }
+
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const CharacterCapsule& a = capsules[order[i]];
+        float extentA = a.radius * (1.0f + CHARACTER_PAIR_MARGIN);
+        float maxX = a.position.x + extentA;
+        for (size_t j = i + 1; j < order.size(); j++)
+        {
+            const CharacterCapsule& b = capsules[order[j]];
+            float extentB = b.radius * (1.0f + CHARACTER_PAIR_MARGIN);
+            if (b.position.x - extentB > maxX) break;
+            if (fabsf(a.position.z - b.position.z) > extentA + extentB) continue;
+            if (fabsf(a.position.y - b.position.y) > a.halfHeight + b.halfHeight) continue;
+            out.push_back({ std::min(order[i], order[j]), std::max(order[i], order[j]) });
+        }
+    }
+    stats.pairs = (u32)out.size();
+}
+
+void CharacterSet::resolve(const Collider* world, u32 iterations, u32 mask)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    findPairs(pairs);
+    stats.overlaps = 0;
+    stats.resolved = 0;
+    stats.iterations = 0;
+
+    pushes.assign(capsules.size(), { 0.0f, 0.0f, 0.0f });
+    for (u32 iteration = 0; iteration < iterations; iteration++)
+    {
+        bool moved = false;
+        stats.iterations++;
+        for (const CharacterPair& pair : pairs)
+        {
+            const CharacterCapsule& a = capsules[pair.a];
+            const CharacterCapsule& b = capsules[pair.b];
+            Vector3 pa = Vector3Add(a.position, pushes[pair.a]);
+            Vector3 pb = Vector3Add(b.position, pushes[pair.b]);
+
+            // Os segmentos são verticais: a distância é a horizontal mais a
+            // folga vertical entre os dois segmentos (0 se se sobrepõem)
+            float segmentA = a.halfHeight - a.radius;
+            float segmentB = b.halfHeight - b.radius;
+            float gap = fmaxf(0.0f, fabsf(pa.y - pb.y) - segmentA - segmentB);
+            float dx = pa.x - pb.x, dz = pa.z - pb.z;
+            float horizontal = dx * dx + dz * dz;
+            float reach = a.radius + b.radius;
+            if (horizontal + gap * gap >= reach * reach) continue;
+
+            float weightA = a.mass > 0.0f ? 1.0f / a.mass : 0.0f;
+            float weightB = b.mass > 0.0f ? 1.0f / b.mass : 0.0f;
+            if (weightA + weightB <= 0.0f) continue;
+            if (iteration == 0) stats.overlaps++;
+
+            // Afasta na horizontal até deixarem de se tocar
+            float length = sqrtf(horizontal);
+            Vector3 direction;
+            if (length > 1e-4f)
+            {
+                direction = { dx / length, 0.0f, dz / length };
+            }
+            else
+            {
+                // Um em cima do outro: uma direção fixa pelo id, para não tremer
+                float angle = (float)pair.a * 2.399963f;
+                direction = { cosf(angle), 0.0f, sinf(angle) };
+            }
+            float depth = sqrtf(reach * reach - gap * gap) - length;
+            float share = depth / (weightA + weightB);
+            pushes[pair.a] = Vector3Add(pushes[pair.a], Vector3Scale(direction, share * weightA));
+            pushes[pair.b] = Vector3Subtract(pushes[pair.b], Vector3Scale(direction, share * weightB));
+            moved = true;
+        }
+        if (!moved) break;
+    }
+
+    for (u32 id = 0; id < (u32)capsules.size(); id++)
+    {
+        if (!capsules[id].active || Vector3LengthSqr(pushes[id]) < 1e-10f) continue;
+        stats.resolved++;
+
+        CharacterCapsule& capsule = capsules[id];
+        if (!world)
+        {
+            capsule.position = Vector3Add(capsule.position, pushes[id]);
+            continue;
+        }
+
+        // Sem gravidade: o movimento do frame já tratou dela
+        Triangle triangle;
+        Vector3 hitPosition;
+        bool falling = false, collide = false;
+        capsule.position = world->collideEllipsoidWithWorld(
+            capsule.position, { capsule.radius, capsule.halfHeight, capsule.radius }, pushes[id],
+            0.00001f, { 0.0f, 0.0f, 0.0f }, triangle, hitPosition, falling, collide, nullptr, mask);
+    }
+
+    stats.time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
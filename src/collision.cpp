@@ -4,6 +4,8 @@
 #include "node.hpp"
 #include "scene.hpp"
 #include "frustum.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
  
 
 void ExpandBoundingBox(BoundingBox& target, const BoundingBox& source)
@@ -144,13 +146,132 @@ bool GetLowestRoot(float a, float b, float c, float maxR, float* root)
 }
 
 
-// Função principal para testar interseção esfera-triângulo
-bool TestTriangleIntersection(CollisionData* colData, const Triangle& triangle)
+void BuildCollisionTriangle(const Triangle& triangle, const Vector3& eRadius,
+                            CollisionTriangle& out)
+{
+    Vector3 invRadius = { 1.0f / eRadius.x, 1.0f / eRadius.y, 1.0f / eRadius.z };
+
+    out.pointA = Vector3Multiply(triangle.pointA, invRadius);
+    out.pointB = Vector3Multiply(triangle.pointB, invRadius);
+    out.pointC = Vector3Multiply(triangle.pointC, invRadius);
+
+    // As arestas escalam como os pontos; a normal escala pelo inverso
+    out.edgeAB = Vector3Multiply(triangle.edgeAB, invRadius);
+    out.edgeBC = Vector3Multiply(triangle.edgeBC, invRadius);
+    out.edgeCA = Vector3Multiply(triangle.edgeCA, invRadius);
+    out.normal = Vector3Normalize(Vector3Multiply(triangle.normal, eRadius));
+    out.planeD = -Vector3DotProduct(out.normal, out.pointA);
+
+    out.edgeABSq = Vector3DotProduct(out.edgeAB, out.edgeAB);
+    out.edgeBCSq = Vector3DotProduct(out.edgeBC, out.edgeBC);
+    out.edgeCASq = Vector3DotProduct(out.edgeCA, out.edgeCA);
+
+    out.dot01 = -Vector3DotProduct(out.edgeCA, out.edgeAB);
+    out.invDenom = 1.0f / (out.edgeCASq * out.edgeABSq - out.dot01 * out.dot01);
+}
+
+void BuildPolygonPlanes(CollisionPolygon& polygon, const Vector3* points, Vector4* edgePlanes)
+{
+    u32 count = polygon.pointCount;
+    BoundingBox& bounds = polygon.bounds;
+    bounds.min = bounds.max = points[0];
+    for (u32 i = 0; i < count; i++)
+    {
+        // O contorno roda no sentido da normal: normal x aresta aponta para dentro
+        Vector3 edge = Vector3Subtract(points[(i + 1) % count], points[i]);
+        Vector3 inward = Vector3CrossProduct(polygon.normal, edge);
+        edgePlanes[i] = { inward.x, inward.y, inward.z, -Vector3DotProduct(inward, points[i]) };
+        bounds.min = Vector3Min(bounds.min, points[i]);
+        bounds.max = Vector3Max(bounds.max, points[i]);
+    }
+
+    // A mesma folga que Triangle::updateBounds, para os leques não saírem da caixa
+    bounds.min = Vector3Subtract(bounds.min, {EPSILON, EPSILON, EPSILON});
+    bounds.max = Vector3Add(bounds.max, {EPSILON, EPSILON, EPSILON});
+}
+
+void BuildEllipsoidPolygon(const CollisionPolygon& polygon, const Vector3* points,
+                           const Vector4* edgePlanes, const Vector3& eRadius,
+                           EllipsoidPolygon& out, std::vector<PolygonCorner>& corners)
+{
+    Vector3 invRadius = { 1.0f / eRadius.x, 1.0f / eRadius.y, 1.0f / eRadius.z };
+    u32 count = polygon.pointCount;
+
+    out.firstCorner = (u32)corners.size();
+    out.cornerCount = count;
+    corners.resize(out.firstCorner + count);
+
+    PolygonCorner* corner = &corners[out.firstCorner];
+    for (u32 i = 0; i < count; i++)
+    {
+        corner[i].point = Vector3Multiply(points[i], invRadius);
+    }
+
+    out.normal = Vector3Normalize(Vector3Multiply(polygon.normal, eRadius));
+    out.planeD = -Vector3DotProduct(out.normal, corner[0].point);
+
+    for (u32 i = 0; i < count; i++)
+    {
+        corner[i].edge = Vector3Subtract(corner[(i + 1) % count].point, corner[i].point);
+        corner[i].edgeSq = Vector3DotProduct(corner[i].edge, corner[i].edge);
+
+        // dot(m, p) + w com p = eRadius * q: a normal escala por eRadius e w fica
+        const Vector4& plane = edgePlanes[i];
+        corner[i].edgeNormal = Vector3Multiply({ plane.x, plane.y, plane.z }, eRadius);
+        corner[i].edgeD = plane.w;
+    }
+}
+
+// Varre a esfera contra uma aresta (from + edge * f, f em [0,1])
+static bool SweepEdge(const Vector3& from, const Vector3& edge, float edgeSquaredLength,
+                      const Vector3& base, const Vector3& velocity,
+                      float velocitySquaredLength, float& t, Vector3& collisionPoint)
+{
+    Vector3 baseToVertex = Vector3Subtract(from, base);
+    float edgeDotVelocity = Vector3DotProduct(edge, velocity);
+    float edgeDotBaseToVertex = Vector3DotProduct(edge, baseToVertex);
+
+    float a = edgeSquaredLength * -velocitySquaredLength
+        + edgeDotVelocity * edgeDotVelocity;
+    float b = edgeSquaredLength
+            * (2.0f * Vector3DotProduct(velocity, baseToVertex))
+        - 2.0f * edgeDotVelocity * edgeDotBaseToVertex;
+    float c = edgeSquaredLength
+            * (1.0f - Vector3DotProduct(baseToVertex, baseToVertex))
+        + edgeDotBaseToVertex * edgeDotBaseToVertex;
+
+    float newT;
+    if (!GetLowestRoot(a, b, c, t, &newT)) return false;
+
+    float f = (edgeDotVelocity * newT - edgeDotBaseToVertex) / edgeSquaredLength;
+    if (f < 0.0f || f > 1.0f) return false;
+
+    t = newT;
+    collisionPoint = Vector3Add(from, Vector3Scale(edge, f));
+    return true;
+}
+
+// Varre a esfera contra um vértice
+static bool SweepVertex(const Vector3& vertex, const Vector3& base, const Vector3& velocity,
+                        float velocitySquaredLength, float& t, Vector3& collisionPoint)
 {
-    Vector4 trianglePlane = GetTrianglePlane(triangle);
+    Vector3 baseToPoint = Vector3Subtract(base, vertex);
+    float b = 2.0f * Vector3DotProduct(velocity, baseToPoint);
+    float c = Vector3DotProduct(baseToPoint, baseToPoint) - 1.0f;
+
+    float newT;
+    if (!GetLowestRoot(velocitySquaredLength, b, c, t, &newT)) return false;
+
+    t = newT;
+    collisionPoint = vertex;
+    return true;
+}
 
+// Função principal para testar interseção esfera-triângulo
+bool TestTriangleIntersection(CollisionData* colData, const CollisionTriangle& triangle)
+{
     // Verifica apenas polígonos voltados para frente
-    if (!IsFrontFacing(trianglePlane, colData->normalizedVelocity))
+    if (Vector3DotProduct(triangle.normal, colData->normalizedVelocity) > 0.0f)
     {
         return false;
     }
@@ -161,10 +282,9 @@ bool TestTriangleIntersection(CollisionData* colData, const Triangle& triangle)
 
     // Calcula distância com sinal da posição da esfera ao plano do triângulo
     float signedDistToTrianglePlane =
-        GetDistanceToPlane(trianglePlane, colData->basePoint);
+        Vector3DotProduct(triangle.normal, colData->basePoint) + triangle.planeD;
 
-    Vector3 planeNormal = { trianglePlane.x, trianglePlane.y, trianglePlane.z };
-    float normalDotVelocity = Vector3DotProduct(planeNormal, colData->velocity);
+    float normalDotVelocity = Vector3DotProduct(triangle.normal, colData->velocity);
 
     if (fabsf(normalDotVelocity) < 0.0001f)
     {
@@ -173,13 +293,11 @@ bool TestTriangleIntersection(CollisionData* colData, const Triangle& triangle)
         {
             return false; // Sem colisão possível
         }
-        else
-        {
-            // Esfera está incorporada no plano
-            embeddedInPlane = true;
-            t0 = 0.0f;
-            t1 = 1.0f;
-        }
+
+        // Esfera está incorporada no plano
+        embeddedInPlane = true;
+        t0 = 0.0f;
+        t1 = 1.0f;
     }
     else
     {
@@ -197,32 +315,35 @@ bool TestTriangleIntersection(CollisionData* colData, const Triangle& triangle)
             t0 = temp;
         }
 
-        // Verifica se pelo menos um valor está dentro do intervalo
+        // Ambos os valores t estão fora de [0,1], sem colisão possível
         if (t0 > 1.0f || t1 < 0.0f)
         {
-            return false; // Ambos os valores t estão fora de [0,1], sem colisão
-                          // possível
+            return false;
         }
 
-        // Limita a 0 e 1
         t0 = Clamp(t0, 0.0f, 1.0f);
-        t1 = Clamp(t1, 0.0f, 1.0f);
     }
 
-    // Neste ponto temos t0 e t1, se há alguma interseção,
-    // está entre este intervalo
     Vector3 collisionPoint = { 0 };
     bool foundCollision = false;
     float t = 1.0f;
 
-    // Primeiro verifica o caso fácil: Colisão dentro do triângulo
+    // Primeiro o caso fácil: colisão dentro do triângulo (baricêntricas com
+    // os produtos internos pré-calculados)
     if (!embeddedInPlane)
     {
         Vector3 planeIntersectionPoint =
-            Vector3Add(Vector3Subtract(colData->basePoint, planeNormal),
+            Vector3Add(Vector3Subtract(colData->basePoint, triangle.normal),
                        Vector3Scale(colData->velocity, t0));
 
-        if (IsPointInsideTriangle(triangle, planeIntersectionPoint))
+        Vector3 toPoint = Vector3Subtract(planeIntersectionPoint, triangle.pointA);
+        float dot02 = -Vector3DotProduct(triangle.edgeCA, toPoint);
+        float dot12 = Vector3DotProduct(triangle.edgeAB, toPoint);
+
+        float u = (triangle.edgeABSq * dot02 - triangle.dot01 * dot12) * triangle.invDenom;
+        float v = (triangle.edgeCASq * dot12 - triangle.dot01 * dot02) * triangle.invDenom;
+
+        if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f)
         {
             foundCollision = true;
             t = t0;
@@ -230,162 +351,160 @@ bool TestTriangleIntersection(CollisionData* colData, const Triangle& triangle)
         }
     }
 
-    // Se não encontramos colisão, precisamos varrer a esfera
-    // contra pontos e arestas do triângulo
+    // Se não encontramos colisão, varre a esfera contra pontos e arestas
     if (!foundCollision)
     {
-        Vector3 velocity = colData->velocity;
-        Vector3 base = colData->basePoint;
-
+        const Vector3& velocity = colData->velocity;
+        const Vector3& base = colData->basePoint;
         float velocitySquaredLength = Vector3DotProduct(velocity, velocity);
-        float a, b, c;
-        float newT;
 
-        // Para cada aresta ou vértice, uma equação quadrática deve ser
-        // resolvida: a*t^2 + b*t + c = 0
+        foundCollision = SweepVertex(triangle.pointA, base, velocity, velocitySquaredLength, t, collisionPoint);
+        if (!foundCollision)
+            foundCollision = SweepVertex(triangle.pointB, base, velocity, velocitySquaredLength, t, collisionPoint);
+        if (!foundCollision)
+            foundCollision = SweepVertex(triangle.pointC, base, velocity, velocitySquaredLength, t, collisionPoint);
 
-        // Verifica contra pontos
-        a = velocitySquaredLength;
+        if (SweepEdge(triangle.pointA, triangle.edgeAB, triangle.edgeABSq, base, velocity, velocitySquaredLength, t, collisionPoint))
+            foundCollision = true;
+        if (SweepEdge(triangle.pointB, triangle.edgeBC, triangle.edgeBCSq, base, velocity, velocitySquaredLength, t, collisionPoint))
+            foundCollision = true;
+        if (SweepEdge(triangle.pointC, triangle.edgeCA, triangle.edgeCASq, base, velocity, velocitySquaredLength, t, collisionPoint))
+            foundCollision = true;
+    }
+
+    // Define resultado:
+    if (foundCollision)
+    {
+        // Distância para colisão é t
+        float distToCollision = t * Vector3Length(colData->velocity);
 
-        // Ponto A
-        Vector3 baseToPointA = Vector3Subtract(base, triangle.pointA);
-        b = 2.0f * Vector3DotProduct(velocity, baseToPointA);
-        Vector3 distToA = Vector3Subtract(triangle.pointA, base);
-        c = Vector3DotProduct(distToA, distToA) - 1.0f;
-        if (GetLowestRoot(a, b, c, t, &newT))
+        // Este triângulo qualifica para o hit mais próximo?
+        if (!colData->foundCollision
+            || distToCollision < colData->nearestDistance)
         {
-            t = newT;
-            foundCollision = true;
-            collisionPoint = triangle.pointA;
+            colData->nearestDistance = distToCollision;
+            colData->intersectionPoint = collisionPoint;
+            colData->foundCollision = true;
+            colData->triangleHits++;
+            return true;
         }
+    }
 
-        // Ponto B
-        if (!foundCollision)
+    return false;
+}
+
+// Versão para um triângulo que já está em espaço da elipse
+bool TestTriangleIntersection(CollisionData* colData, const Triangle& triangle)
+{
+    Triangle eSpace = triangle;
+    eSpace.updateBounds();
+
+    CollisionTriangle collisionTriangle;
+    BuildCollisionTriangle(eSpace, { 1.0f, 1.0f, 1.0f }, collisionTriangle);
+    return TestTriangleIntersection(colData, collisionTriangle);
+}
+
+// O mesmo teste que TestTriangleIntersection, com o contorno do polígono no
+// lugar das três arestas: um polígono de n lados custa um plano e n arestas,
+// o leque equivalente custa n - 2 planos e 3(n - 2) arestas
+bool TestPolygonIntersection(CollisionData* colData, const EllipsoidPolygon& polygon,
+                             const PolygonCorner* corners)
+{
+    // Verifica apenas polígonos voltados para frente
+    if (Vector3DotProduct(polygon.normal, colData->normalizedVelocity) > 0.0f)
+    {
+        return false;
+    }
+
+    float t1, t0;
+    bool embeddedInPlane = false;
+
+    float signedDistToPlane = Vector3DotProduct(polygon.normal, colData->basePoint) + polygon.planeD;
+    float normalDotVelocity = Vector3DotProduct(polygon.normal, colData->velocity);
+
+    if (fabsf(normalDotVelocity) < 0.0001f)
+    {
+        // Esfera viajando paralela ao plano
+        if (fabsf(signedDistToPlane) >= 1.0f)
         {
-            Vector3 baseToPointB = Vector3Subtract(base, triangle.pointB);
-            b = 2.0f * Vector3DotProduct(velocity, baseToPointB);
-            Vector3 distToB = Vector3Subtract(triangle.pointB, base);
-            c = Vector3DotProduct(distToB, distToB) - 1.0f;
-            if (GetLowestRoot(a, b, c, t, &newT))
-            {
-                t = newT;
-                foundCollision = true;
-                collisionPoint = triangle.pointB;
-            }
+            return false;
         }
 
-        // Ponto C
-        if (!foundCollision)
+        embeddedInPlane = true;
+        t0 = 0.0f;
+        t1 = 1.0f;
+    }
+    else
+    {
+        float invNormalDotVelocity = 1.0f / normalDotVelocity;
+
+        t0 = (-1.0f - signedDistToPlane) * invNormalDotVelocity;
+        t1 = (1.0f - signedDistToPlane) * invNormalDotVelocity;
+
+        if (t0 > t1)
         {
-            Vector3 baseToPointC = Vector3Subtract(base, triangle.pointC);
-            b = 2.0f * Vector3DotProduct(velocity, baseToPointC);
-            Vector3 distToC = Vector3Subtract(triangle.pointC, base);
-            c = Vector3DotProduct(distToC, distToC) - 1.0f;
-            if (GetLowestRoot(a, b, c, t, &newT))
-            {
-                t = newT;
-                foundCollision = true;
-                collisionPoint = triangle.pointC;
-            }
+            float temp = t1;
+            t1 = t0;
+            t0 = temp;
         }
 
-        // Verifica contra arestas:
-
-        // Aresta A-B
-        Vector3 edge = Vector3Subtract(triangle.pointB, triangle.pointA);
-        Vector3 baseToVertex = Vector3Subtract(triangle.pointA, base);
-        float edgeSquaredLength = Vector3DotProduct(edge, edge);
-        float edgeDotVelocity = Vector3DotProduct(edge, velocity);
-        float edgeDotBaseToVertex = Vector3DotProduct(edge, baseToVertex);
-
-        a = edgeSquaredLength * -velocitySquaredLength
-            + edgeDotVelocity * edgeDotVelocity;
-        b = edgeSquaredLength
-                * (2.0f * Vector3DotProduct(velocity, baseToVertex))
-            - 2.0f * edgeDotVelocity * edgeDotBaseToVertex;
-        c = edgeSquaredLength
-                * (1.0f - Vector3DotProduct(baseToVertex, baseToVertex))
-            + edgeDotBaseToVertex * edgeDotBaseToVertex;
-
-        if (GetLowestRoot(a, b, c, t, &newT))
+        if (t0 > 1.0f || t1 < 0.0f)
         {
-            float f = (edgeDotVelocity * newT - edgeDotBaseToVertex)
-                / edgeSquaredLength;
-            if (f >= 0.0f && f <= 1.0f)
-            {
-                t = newT;
-                foundCollision = true;
-                collisionPoint =
-                    Vector3Add(triangle.pointA, Vector3Scale(edge, f));
-            }
+            return false;
         }
 
-        // Aresta B-C
-        edge = Vector3Subtract(triangle.pointC, triangle.pointB);
-        baseToVertex = Vector3Subtract(triangle.pointB, base);
-        edgeSquaredLength = Vector3DotProduct(edge, edge);
-        edgeDotVelocity = Vector3DotProduct(edge, velocity);
-        edgeDotBaseToVertex = Vector3DotProduct(edge, baseToVertex);
-
-        a = edgeSquaredLength * -velocitySquaredLength
-            + edgeDotVelocity * edgeDotVelocity;
-        b = edgeSquaredLength
-                * (2.0f * Vector3DotProduct(velocity, baseToVertex))
-            - 2.0f * edgeDotVelocity * edgeDotBaseToVertex;
-        c = edgeSquaredLength
-                * (1.0f - Vector3DotProduct(baseToVertex, baseToVertex))
-            + edgeDotBaseToVertex * edgeDotBaseToVertex;
-
-        if (GetLowestRoot(a, b, c, t, &newT))
+        t0 = Clamp(t0, 0.0f, 1.0f);
+    }
+
+    Vector3 collisionPoint = { 0 };
+    bool foundCollision = false;
+    float t = 1.0f;
+
+    // Dentro do polígono: do lado de dentro de todos os planos das arestas
+    if (!embeddedInPlane)
+    {
+        Vector3 planeIntersectionPoint =
+            Vector3Add(Vector3Subtract(colData->basePoint, polygon.normal),
+                       Vector3Scale(colData->velocity, t0));
+
+        bool inside = true;
+        for (u32 i = 0; i < polygon.cornerCount && inside; i++)
         {
-            float f = (edgeDotVelocity * newT - edgeDotBaseToVertex)
-                / edgeSquaredLength;
-            if (f >= 0.0f && f <= 1.0f)
-            {
-                t = newT;
-                foundCollision = true;
-                collisionPoint =
-                    Vector3Add(triangle.pointB, Vector3Scale(edge, f));
-            }
+            inside = Vector3DotProduct(corners[i].edgeNormal, planeIntersectionPoint) + corners[i].edgeD >= 0.0f;
         }
 
-        // Aresta C-A
-        edge = Vector3Subtract(triangle.pointA, triangle.pointC);
-        baseToVertex = Vector3Subtract(triangle.pointC, base);
-        edgeSquaredLength = Vector3DotProduct(edge, edge);
-        edgeDotVelocity = Vector3DotProduct(edge, velocity);
-        edgeDotBaseToVertex = Vector3DotProduct(edge, baseToVertex);
-
-        a = edgeSquaredLength * -velocitySquaredLength
-            + edgeDotVelocity * edgeDotVelocity;
-        b = edgeSquaredLength
-                * (2.0f * Vector3DotProduct(velocity, baseToVertex))
-            - 2.0f * edgeDotVelocity * edgeDotBaseToVertex;
-        c = edgeSquaredLength
-                * (1.0f - Vector3DotProduct(baseToVertex, baseToVertex))
-            + edgeDotBaseToVertex * edgeDotBaseToVertex;
-
-        if (GetLowestRoot(a, b, c, t, &newT))
+        if (inside)
         {
-            float f = (edgeDotVelocity * newT - edgeDotBaseToVertex)
-                / edgeSquaredLength;
-            if (f >= 0.0f && f <= 1.0f)
-            {
-                t = newT;
+            foundCollision = true;
+            t = t0;
+            collisionPoint = planeIntersectionPoint;
+        }
+    }
+
+    // Senão os vértices e as arestas do contorno; cada um só pode baixar t
+    if (!foundCollision)
+    {
+        const Vector3& velocity = colData->velocity;
+        const Vector3& base = colData->basePoint;
+        float velocitySquaredLength = Vector3DotProduct(velocity, velocity);
+
+        for (u32 i = 0; i < polygon.cornerCount; i++)
+        {
+            if (SweepVertex(corners[i].point, base, velocity, velocitySquaredLength, t, collisionPoint))
+                foundCollision = true;
+        }
+        for (u32 i = 0; i < polygon.cornerCount; i++)
+        {
+            if (SweepEdge(corners[i].point, corners[i].edge, corners[i].edgeSq, base, velocity,
+                          velocitySquaredLength, t, collisionPoint))
                 foundCollision = true;
-                collisionPoint =
-                    Vector3Add(triangle.pointC, Vector3Scale(edge, f));
-            }
         }
     }
 
-    // Define resultado:
     if (foundCollision)
     {
-        // Distância para colisão é t
         float distToCollision = t * Vector3Length(colData->velocity);
 
-        // Este triângulo qualifica para o hit mais próximo?
         if (!colData->foundCollision
             || distToCollision < colData->nearestDistance)
         {
@@ -418,106 +537,234 @@ void Collider::setScene(Scene* scene)
 }
 
 
-Vector3 Collider::collideWithWorld(s32 recursionDepth, CollisionData& colData,Vector3 pos, Vector3 vel)
+CollisionCandidates& GetCollisionCandidates()
 {
-    float veryCloseDistance = colData.slidingSpeed;
+    static thread_local CollisionCandidates candidates;
+    return candidates;
+}
 
-    if (recursionDepth > 3) return pos;
+// Os candidatos do selector vão para o kernel por id e não pela ordem da
+// árvore: em empates exatos ganha o primeiro, e assim o resultado não depende
+// do selector, do percurso nem da CandidateCache
+static bool CandidateOrder(const Triangle* a, const Triangle* b)
+{
+    return a->id < b->id;
+}
 
-    colData.velocity = vel;
-    colData.normalizedVelocity = vel;
-    colData.normalizedVelocity = Vector3Normalize(colData.normalizedVelocity);
-    colData.basePoint = pos;
-    colData.foundCollision = false;
-    colData.nearestDistance = FLT_MAX;
+void Selector::addPolygon(const CollisionPolygon& polygon, const Vector3* points)
+{
+    for (u32 i = 1; i + 1 < polygon.pointCount; i++)
+    {
+        addTriangle(points[0], points[i], points[i + 1], polygon.layers);
+    }
+}
 
-    Matrix scale = MatrixScale(1.0f / colData.eRadius.x, 1.0f / colData.eRadius.y,1.0f / colData.eRadius.z);
+void Selector::getCollisionCandidates(const BoundingBox& area, const Vector3& eRadius, u32 mask,
+                                      CollisionCandidates& out) const
+{
+    std::vector<const Triangle*> found = getCandidates(area, mask);
+    std::sort(found.begin(), found.end(), CandidateOrder);
 
-    if(!collisionSelector && !scene) return Vector3Add(pos, vel);
+    size_t first = out.triangles.size();
+    out.triangles.insert(out.triangles.end(), found.begin(), found.end());
+    out.eSpace.resize(first + found.size());
+    for (size_t i = 0; i < found.size(); i++)
+    {
+        BuildCollisionTriangle(*found[i], eRadius, out.eSpace[first + i]);
+    }
+}
 
+// Volta a recolher os triângulos do selector numa caixa maior que area,
+// se a anterior já não a cobre ou se o selector/elipse/máscara mudaram
+static void RefreshCandidateCache(const Selector* selector, const BoundingBox& area,
+                                  const Vector3& eRadius, u32 mask, CandidateCache& cache)
+{
+    bool inside = cache.bounds.min.x <= area.min.x && cache.bounds.min.y <= area.min.y &&
+                  cache.bounds.min.z <= area.min.z && cache.bounds.max.x >= area.max.x &&
+                  cache.bounds.max.y >= area.max.y && cache.bounds.max.z >= area.max.z;
 
-    Vector3 currentPos = colData.R3Position;
-    Vector3 targetPos = Vector3Add(colData.R3Position, colData.R3Velocity);
-    
-    BoundingBox queryBox;
+    bool sameRadius = cache.eRadius.x == eRadius.x && cache.eRadius.y == eRadius.y &&
+                      cache.eRadius.z == eRadius.z;
 
-    queryBox.min = Vector3Min(currentPos, targetPos);
-    queryBox.max = Vector3Max(currentPos, targetPos);
-    
- 
-    
- 
-    Vector3 maxRadius = 
+    if (cache.valid && inside && sameRadius && cache.selector == selector &&
+        cache.version == selector->getVersion() && cache.mask == mask)
     {
-        fmaxf(fmaxf(colData.eRadius.x, colData.eRadius.y), colData.eRadius.z),// * 2.0f,
-        fmaxf(fmaxf(colData.eRadius.x, colData.eRadius.y), colData.eRadius.z),// * 2.0f,
-        fmaxf(fmaxf(colData.eRadius.x, colData.eRadius.y), colData.eRadius.z)// * 2.0f
-    };
-    
-    queryBox.min = Vector3Subtract(queryBox.min, maxRadius);
-    queryBox.max = Vector3Add(queryBox.max, maxRadius);
+        cache.hits++;
+        COLLISION_STAT_ADD(cacheHits, 1);
+        return;
+    }
 
- 
-  //  std::vector<const Triangle*> triangles = collisionSelector->getCandidates(queryBox);
+    cache.misses++;
+    COLLISION_STAT_ADD(cacheMisses, 1);
+
+    Vector3 margin = { cache.margin, cache.margin, cache.margin };
+    cache.bounds.min = Vector3Subtract(area.min, margin);
+    cache.bounds.max = Vector3Add(area.max, margin);
+    cache.selector = selector;
+    cache.version = selector->getVersion();
+    cache.eRadius = eRadius;
+    cache.mask = mask;
+    cache.valid = true;
+
+    static thread_local CollisionCandidates found;
+    found.clear();
+    selector->getCollisionCandidates(cache.bounds, eRadius, mask, found);
+
+    // Cópias dos triângulos: os ponteiros do selector podem não sobreviver à
+    // próxima query (a octree compacta descodifica para um buffer, sem bounds)
+    cache.triangles.resize(found.triangles.size());
+    for (size_t i = 0; i < found.triangles.size(); i++)
+    {
+        cache.triangles[i] = *found.triangles[i];
+        cache.triangles[i].updateBounds();
+    }
+    cache.eSpace.swap(found.eSpace);
+    cache.polygons.swap(found.polygons);
+    cache.ePolygons.swap(found.ePolygons);
+    cache.corners.swap(found.corners);
+}
 
-    std::vector<const Triangle*> triangles;
- 
-    
-    
-    if (scene) 
+void Collider::gatherCandidates(const BoundingBox& area, const Vector3& eRadius, u32 mask,
+                                CollisionCandidates& out, CandidateCache* cache) const
+{
+    out.clear();
+
+    // Os nós da cena não têm camadas: contam como sólidos
+    if (scene && (mask & LAYER_SOLID)) 
     {
-        auto sceneTriangles = scene->collectTriangles(queryBox);
-        triangles.insert(triangles.end(), sceneTriangles.begin(), sceneTriangles.end());
-        
-       
+        scene->collectTriangles(area, out.instanced);
     }
     
     // Da octree (se disponível)
-    if (collisionSelector) 
+    if (collisionSelector && cache)
     {
-        auto octreeTriangles = collisionSelector->getCandidates(queryBox);
-        triangles.insert(triangles.end(), octreeTriangles.begin(), octreeTriangles.end());
+        // Só os da cache que tocam a caixa deste movimento
+        RefreshCandidateCache(collisionSelector, area, eRadius, mask, *cache);
+        for (const Triangle& tri : cache->triangles)
+        {
+            if (CheckCollisionBoxes(tri.bounds, area)) out.triangles.push_back(&tri);
+        }
+        for (size_t i = 0; i < cache->polygons.size(); i++)
+        {
+            if (!CheckCollisionBoxes(cache->polygons[i].bounds, area)) continue;
+
+            const EllipsoidPolygon& polygon = cache->ePolygons[i];
+            const PolygonCorner* corners = &cache->corners[polygon.firstCorner];
+            out.polygons.push_back(cache->polygons[i]);
+            out.ePolygons.push_back(polygon);
+            out.ePolygons.back().firstCorner = (u32)out.corners.size();
+            out.corners.insert(out.corners.end(), corners, corners + polygon.cornerCount);
+        }
+    }
+    else if (collisionSelector) 
+    {
+        collisionSelector->getCollisionCandidates(area, eRadius, mask, out);
     }
 
+    // Passa tudo para espaço da elipse e empacota de 4 em 4 para o kernel SIMD
+    // (primeiro os da cena, depois os do selector). Os pacotes refazem-se a
+    // cada query: dependem do raio e de que triângulos da cache tocam a caixa,
+    // e pacotes guardados nas folhas (em espaço do mundo) não poupavam a
+    // passagem para espaço da elipse. Custa ~60% do kernel (simd_check).
+    u32 instancedCnt = out.instanced.size();
+    u32 triangleCnt = instancedCnt + out.triangles.size();
+    out.packets.resize((triangleCnt + TRIANGLE_PACKET_SIZE - 1) / TRIANGLE_PACKET_SIZE);
+
+    CollisionTriangle eSpaceTriangle;
+    for (u32 i = 0; i < triangleCnt; ++i)
+    {
+        TrianglePacket& packet = out.packets[i / TRIANGLE_PACKET_SIZE];
+        s32 lane = i % TRIANGLE_PACKET_SIZE;
 
- 
-    u32 triangleCnt = triangles.size();
-    
-	for (u32 i=0; i<triangleCnt; ++i)
-  //  for (const Triangle* tri : triangles) 
+        if (cache && i >= instancedCnt)
+        {
+            // Já está em espaço da elipse na cache
+            packet.set(lane, cache->eSpace[out.triangles[i - instancedCnt] - cache->triangles.data()]);
+        }
+        else if (i >= instancedCnt)
+        {
+            packet.set(lane, out.eSpace[i - instancedCnt]);
+        }
+        else
+        {
+            BuildCollisionTriangle(out.get(i), eRadius, eSpaceTriangle);
+            packet.set(lane, eSpaceTriangle);
+        }
+        packet.count = lane + 1;
+    }
+}
+
+// Triângulo (0, k, k + 1) do leque que contém o contacto: a diagonal 0 -> k + 1
+// separa o k do seguinte
+static u32 PolygonFan(const EllipsoidPolygon& polygon, const PolygonCorner* corners, const Vector3& point)
+{
+    const Vector3& origin = corners[0].point;
+    Vector3 toPoint = Vector3Subtract(point, origin);
+    for (u32 k = 1; k + 2 < polygon.cornerCount; k++)
     {
-        Triangle t = *triangles[i];
-        t.pointA = Vector3Transform(t.pointA, scale);
-        t.pointB = Vector3Transform(t.pointB, scale);
-        t.pointC = Vector3Transform(t.pointC, scale);
-        
-        
-        if (TestTriangleIntersection(&colData, t))
+        Vector3 diagonal = Vector3Subtract(corners[k + 1].point, origin);
+        if (Vector3DotProduct(Vector3CrossProduct(diagonal, toPoint), polygon.normal) <= 0.0f) return k;
+    }
+    return polygon.cornerCount - 2;
+}
+
+// Os candidatos já estão em espaço da elipse (gatherCandidates). Os índices
+// dos polígonos vêm depois dos triângulos (getTriangleCount)
+static void TestCandidates(CollisionData& colData, const CollisionCandidates& candidates)
+{
+    COLLISION_STAT_ADD(triangleTests, candidates.getTriangleCount());
+    COLLISION_STAT_ADD(polygonTests, candidates.ePolygons.size());
+
+    u32 packetCnt = candidates.packets.size();
+    for (u32 i = 0; i < packetCnt; ++i)
+    {
+        const TrianglePacket& packet = candidates.packets[i];
+        s32 lane = TestTriangleIntersection4(&colData, packet);
+        if (lane >= 0)
         {
-            colData.triangleIndex = i;
+            colData.triangleIndex = i * TRIANGLE_PACKET_SIZE + lane;
+            colData.intersectionTriangle = packet.get(lane);
+        }
+    }
+
+    u32 triangleCnt = candidates.getTriangleCount();
+    u32 polygonCnt = candidates.ePolygons.size();
+    for (u32 i = 0; i < polygonCnt; ++i)
+    {
+        const EllipsoidPolygon& polygon = candidates.ePolygons[i];
+        const PolygonCorner* corners = &candidates.corners[polygon.firstCorner];
+        if (TestPolygonIntersection(&colData, polygon, corners))
+        {
+            u32 fan = PolygonFan(polygon, corners, colData.intersectionPoint);
+            colData.triangleIndex = triangleCnt + i;
+            colData.polygonFan = fan;
+            colData.intersectionTriangle.pointA = corners[0].point;
+            colData.intersectionTriangle.pointB = corners[fan].point;
+            colData.intersectionTriangle.pointC = corners[fan + 1].point;
+            colData.intersectionTriangle.normal = polygon.normal;
+            colData.intersectionTriangle.planeD = polygon.planeD;
         }
-        
-       
     }
+}
 
+Vector3 Collider::collideWithWorld(s32 recursionDepth, CollisionData& colData,
+                                   const CollisionCandidates& candidates, Vector3 pos, Vector3 vel) const
+{
+    float veryCloseDistance = colData.slidingSpeed;
 
-     // DrawBoundingBox(queryBox, LIME);
-    
-//     // Desenhar posição atual
-//   //  DrawSphere(colData.R3Position, 0.5f, BLUE);
-    
-//     // Desenhar triângulos candidatos
-//     for (const Triangle* tri : triangles) 
-//     {
-//       //  DrawTriangle3D(tri->pointA, tri->pointB, tri->pointC, RED);
-//         DrawBoundingBox(tri->bounds, ORANGE);
-//     }
-    
-//     // Se houve colisão, desenhar ponto de interseção
-//     // if (colData.foundCollision)
-//     // {
-//     //     DrawSphere(colData.intersectionPoint, 0.3f, YELLOW);
-//     // }
+    if (recursionDepth > 3) return pos;
+
+    COLLISION_STAT_ADD(collideCalls, 1);
+    COLLISION_STAT_MAX(maxRecursion, recursionDepth + 1);
+
+    colData.velocity = vel;
+    colData.normalizedVelocity = vel;
+    colData.normalizedVelocity = Vector3Normalize(colData.normalizedVelocity);
+    colData.basePoint = pos;
+    colData.foundCollision = false;
+    colData.nearestDistance = FLT_MAX;
+
+    TestCandidates(colData, candidates);
 
 
     if (!colData.foundCollision) return Vector3Add(pos, vel); // pos + vel;
@@ -581,19 +828,235 @@ Vector3 Collider::collideWithWorld(s32 recursionDepth, CollisionData& colData,Ve
     newVelocityVector = Vector3Scale(newVelocityVector, 0.95f);
 
 
-    return collideWithWorld(recursionDepth + 1, colData, newBasePoint,newVelocityVector);
+    return collideWithWorld(recursionDepth + 1, colData, candidates, newBasePoint,newVelocityVector);
+}
+
+
+static const s32 SLIDE_MAX_ITERATIONS = 5;
+static const s32 SLIDE_MAX_PLANES = 3;
+// Folga (espaço da elipse) entre a esfera e o plano tocado. Maior que o erro
+// dos varrimentos contra arestas compridas, que chegam a ver contacto a 1e-4
+static const float SLIDE_SKIN = 0.001f;
+
+// Tira a componente que entra no plano (a que sai fica)
+static Vector3 ClipToPlane(const Vector3& vel, const Vector3& normal)
+{
+    float into = Vector3DotProduct(vel, normal);
+    if (into >= 0.0f) return vel;
+    return Vector3Subtract(vel, Vector3Scale(normal, into));
+}
+
+static bool LeavesPlanes(const Vector3& vel, const Vector3* planes, s32 count, s32 skipA, s32 skipB)
+{
+    for (s32 i = 0; i < count; i++)
+    {
+        if (i == skipA || i == skipB) continue;
+        if (Vector3DotProduct(vel, planes[i]) < -1e-6f) return false;
+    }
+    return true;
+}
+
+// Resto do movimento que não entra em nenhum dos planos: projeção num só
+// plano, senão ao longo da aresta entre dois; false se ficar preso num canto
+static bool ProjectOnPlanes(const Vector3& remaining, const Vector3* planes, s32 count, Vector3& out)
+{
+    for (s32 i = 0; i < count; i++)
+    {
+        Vector3 clipped = ClipToPlane(remaining, planes[i]);
+        if (LeavesPlanes(clipped, planes, count, i, -1))
+        {
+            out = clipped;
+            return true;
+        }
+    }
+
+    for (s32 i = 0; i < count; i++)
+    {
+        for (s32 j = i + 1; j < count; j++)
+        {
+            Vector3 crease = Vector3CrossProduct(planes[i], planes[j]);
+            float length = Vector3Length(crease);
+            if (length < 1e-4f) continue;   // planos paralelos
+
+            crease = Vector3Scale(crease, 1.0f / length);
+            Vector3 along = Vector3Scale(crease, Vector3DotProduct(crease, remaining));
+            if (LeavesPlanes(along, planes, count, i, j))
+            {
+                out = along;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+Vector3 Collider::slideWithWorld(CollisionData& colData, const CollisionCandidates& candidates,
+                                 Vector3 pos, Vector3 vel) const
+{
+    const float veryCloseDistance = colData.slidingSpeed;
+    const Vector3 originalVelocity = vel;
+    Vector3 planes[SLIDE_MAX_PLANES];
+    s32 planeCount = 0;
+
+    for (s32 iteration = 0; iteration < SLIDE_MAX_ITERATIONS; iteration++)
+    {
+        COLLISION_STAT_ADD(collideCalls, 1);
+        COLLISION_STAT_MAX(maxRecursion, iteration + 1);
+
+        colData.velocity = vel;
+        colData.normalizedVelocity = Vector3Normalize(vel);
+        colData.basePoint = pos;
+        colData.foundCollision = false;
+        colData.nearestDistance = FLT_MAX;
+
+        TestCandidates(colData, candidates);
+
+        if (!colData.foundCollision) return Vector3Add(pos, vel);
+
+        const Vector3 destinationPoint = Vector3Add(pos, vel);
+        const Vector3 direction = colData.normalizedVelocity;
+
+        // Normal do plano de slide: do ponto de contacto para o centro da
+        // esfera no momento do contacto
+        Vector3 contactCenter = Vector3Add(pos, Vector3Scale(direction, colData.nearestDistance));
+        Vector3 normal = Vector3Subtract(contactCenter, colData.intersectionPoint);
+        float normalLength = Vector3Length(normal);
+
+        // Pára um pouco antes do contacto
+        float moveDistance = colData.nearestDistance - veryCloseDistance;
+        if (moveDistance > 0.0f)
+        {
+            pos = Vector3Add(pos, Vector3Scale(direction, moveDistance));
+            colData.intersectionPoint = Vector3Subtract(colData.intersectionPoint,
+                                                        Vector3Scale(direction, veryCloseDistance));
+        }
+
+        if (normalLength < 1e-4f) return pos;
+        normal = Vector3Scale(normal, 1.0f / normalLength);
+
+        // Recuar só na direção do movimento deixa a esfera encostada ao plano
+        // quando chega de lado, e o slide seguinte voltava a tocá-lo logo
+        pos = Vector3Add(pos, Vector3Scale(normal, SLIDE_SKIN));
+
+        // O mesmo plano outra vez (arredondamentos) não conta como novo
+        bool known = false;
+        for (s32 i = 0; i < planeCount && !known; i++)
+        {
+            known = Vector3DotProduct(planes[i], normal) > 0.999f;
+        }
+        if (!known)
+        {
+            if (planeCount == SLIDE_MAX_PLANES) return pos;
+            planes[planeCount++] = normal;
+        }
+
+        Vector3 remaining = Vector3Subtract(destinationPoint, pos);
+        if (!ProjectOnPlanes(remaining, planes, planeCount, vel)) return pos;
+
+        // Nunca contra o movimento pedido: em cantos agudos isso faz tremer
+        if (Vector3DotProduct(vel, originalVelocity) <= 0.0f) return pos;
+        if (Vector3Length(vel) < veryCloseDistance) return pos;
+    }
+
+    return pos;
 }
 
+// GroundContact: só chãos quase planos (numa rampa a gravidade faz
+// deslizar e isso continua a ser varrido) e folga, em espaço da elipse,
+// da distância ao plano em relação à de repouso guardada
+static const float GROUND_MIN_NORMAL_Y = 0.999f;
+static const float GROUND_TOLERANCE = 0.01f;
+
+// Plano do triângulo em espaço da elipse, com a normal virada para pos
+static float GroundPlane(const Triangle& triangle, const Vector3& eRadius, const Vector3& pos,
+                         Vector3& a, Vector3& b, Vector3& c, Vector3& normal)
+{
+    a = Vector3Divide(triangle.pointA, eRadius);
+    b = Vector3Divide(triangle.pointB, eRadius);
+    c = Vector3Divide(triangle.pointC, eRadius);
+    normal = Vector3Normalize(Vector3CrossProduct(Vector3Subtract(b, a), Vector3Subtract(c, a)));
+    float distance = Vector3DotProduct(normal, Vector3Subtract(pos, a));
+    if (distance < 0.0f)
+    {
+        normal = Vector3Negate(normal);
+        distance = -distance;
+    }
+    return distance;
+}
+
+// Continua apoiado no chão guardado? pos e gravity em espaço da elipse;
+// pos desce até à distância de repouso (onde a gravidade o deixaria) e
+// contact recebe o ponto de apoio
+static bool ProbeGround(const GroundContact& ground, const Selector* selector, const Scene* scene,
+                        const Vector3& eRadius, u32 mask, Vector3& pos, const Vector3& gravity, Vector3& contact)
+{
+    if (!ground.valid || ground.selector != selector || ground.scene != scene || ground.mask != mask) return false;
+    if (selector && ground.version != selector->getVersion()) return false;
+    if (scene && ground.sceneVersion != scene->GetVersion()) return false;
+    if (ground.eRadius.x != eRadius.x || ground.eRadius.y != eRadius.y || ground.eRadius.z != eRadius.z)
+    {
+        return false;
+    }
+
+    Vector3 a, b, c, normal;
+    float distance = GroundPlane(ground.triangle, eRadius, pos, a, b, c, normal);
+
+    // A gravidade tem de empurrar contra o chão, e o chão tem de estar à
+    // distância a que a gravidade o deixou
+    float gravityDown = -Vector3DotProduct(gravity, normal);
+    if (gravityDown <= 0.0f) return false;
+    float gap = distance - ground.distance;
+    if (fabsf(gap) > GROUND_TOLERANCE || gap > gravityDown) return false;
+
+    // Ponto de apoio dentro do triângulo (as três arestas do mesmo lado)
+    contact = Vector3Subtract(pos, Vector3Scale(normal, distance));
+    float e0 = Vector3DotProduct(Vector3CrossProduct(Vector3Subtract(b, a), Vector3Subtract(contact, a)), normal);
+    float e1 = Vector3DotProduct(Vector3CrossProduct(Vector3Subtract(c, b), Vector3Subtract(contact, b)), normal);
+    float e2 = Vector3DotProduct(Vector3CrossProduct(Vector3Subtract(a, c), Vector3Subtract(contact, c)), normal);
+    bool inside = (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f) || (e0 <= 0.0f && e1 <= 0.0f && e2 <= 0.0f);
+    if (!inside) return false;
+
+    if (gap > 0.0f) pos = Vector3Subtract(pos, Vector3Scale(normal, gap));
+    return true;
+}
+
+// Guarda o chão onde a gravidade acabou (triangle em espaço mundo, pos em
+// espaço da elipse)
+static void StoreGround(GroundContact& ground, const Selector* selector, const Scene* scene,
+                        const Vector3& eRadius, u32 mask, const Triangle& triangle, const Vector3& pos, bool landed)
+{
+    ground.valid = false;
+    if (!landed) return;
+    if (fabsf(CalculateTriangleNormal(triangle.pointA, triangle.pointB, triangle.pointC).y) < GROUND_MIN_NORMAL_Y)
+    {
+        return;
+    }
+
+    Vector3 a, b, c, normal;
+    ground.distance = GroundPlane(triangle, eRadius, pos, a, b, c, normal);
+    ground.valid = true;
+    ground.selector = selector;
+    ground.version = selector ? selector->getVersion() : 0;
+    ground.scene = scene;
+    ground.sceneVersion = scene ? scene->GetVersion() : 0;
+    ground.mask = mask;
+    ground.eRadius = eRadius;
+    ground.triangle = triangle;
+}
 
 Vector3 Collider::collideEllipsoidWithWorld(
     const Vector3& position, const Vector3& radius, const Vector3& velocity,
     float slidingSpeed, const Vector3& gravity, Triangle& triout,
-    Vector3& hitPosition, bool& outFalling, bool& outCollide)
+    Vector3& hitPosition, bool& outFalling, bool& outCollide, CandidateCache* cache, u32 mask,
+    GroundContact* ground) const
 {
 
     if (radius.x == 0.0f || radius.y == 0.0f || radius.z == 0.0f)
         return position;
 
+    COLLISION_STAT_TIMER(moveTime);
+    COLLISION_STAT_ADD(moves, 1);
+
     // This code is based on the paper "Improved Collision detection
     // andResponse" by Kasper Fauerby, but some parts are modified.
 
@@ -605,30 +1068,63 @@ Vector3 Collider::collideEllipsoidWithWorld(
     colData.slidingSpeed = slidingSpeed;
     colData.triangleHits = 0;
     colData.triangleIndex = -1;
+    colData.polygonFan = -1;
 
     Vector3 eSpacePosition = Vector3Divide(colData.R3Position, colData.eRadius);
     Vector3 eSpaceVelocity = Vector3Divide(colData.R3Velocity, colData.eRadius);
 
+    // Uma só recolha por movimento. Os slides ficam dentro de |velocity| da
+    // posição inicial (cada um é a projeção do resto do anterior) e a gravidade
+    // parte daí, por isso a caixa cobre |velocity| + |gravity| + raio à volta
+    // (mais a folga que slideWithWorld deixa em cada contacto).
+    float maxRadius = fmaxf(fmaxf(radius.x, radius.y), radius.z);
+    float skin = 2.0f * SLIDE_MAX_ITERATIONS * SLIDE_SKIN * maxRadius;
+    float reach = Vector3Length(velocity) + Vector3Length(gravity) + maxRadius + slidingSpeed + skin;
+    Vector3 extent = { reach, reach, reach };
+
+    BoundingBox queryBox;
+    queryBox.min = Vector3Subtract(position, extent);
+    queryBox.max = Vector3Add(position, extent);
+
+    CollisionCandidates& candidates = GetCollisionCandidates();
+    gatherCandidates(queryBox, colData.eRadius, mask, candidates, cache);
 
     // iterate until we have our final position
 
-    Vector3 finalPos =
-        collideWithWorld(0, colData, eSpacePosition, eSpaceVelocity);
+    bool iterative = slideSolver == SlideSolver::Iterative;
+    Vector3 finalPos = iterative ? slideWithWorld(colData, candidates, eSpacePosition, eSpaceVelocity)
+                                 : collideWithWorld(0, colData, candidates, eSpacePosition, eSpaceVelocity);
 
 
     outFalling = false;
 
     // add gravity
 
-    if (gravity.x != 0.0f || gravity.y != 0.0f || gravity.z != 0.0f)
+    bool hasGravity = gravity.x != 0.0f || gravity.y != 0.0f || gravity.z != 0.0f;
+    if (hasGravity)
     {
+        eSpaceVelocity = Vector3Divide(gravity, colData.eRadius);
+
+        // Ainda em cima do chão do último movimento: nada a varrer
+        Vector3 contact;
+        if (ground && ProbeGround(*ground, collisionSelector, scene, colData.eRadius, mask, finalPos, eSpaceVelocity, contact))
+        {
+            ground->hits++;
+            COLLISION_STAT_ADD(groundProbes, 1);
+
+            triout = ground->triangle;
+            hitPosition = Vector3Multiply(contact, colData.eRadius);
+            outCollide = true;
+            return Vector3Multiply(finalPos, colData.eRadius);
+        }
+
+        COLLISION_STAT_ADD(gravitySweeps, 1);
         colData.R3Position = Vector3Multiply(finalPos, colData.eRadius);
         colData.R3Velocity = gravity;
         colData.triangleHits = 0;
 
-        eSpaceVelocity = Vector3Divide(gravity, colData.eRadius);
-
-        finalPos = collideWithWorld(0, colData, finalPos, eSpaceVelocity);
+        finalPos = iterative ? slideWithWorld(colData, candidates, finalPos, eSpaceVelocity)
+                             : collideWithWorld(0, colData, candidates, finalPos, eSpaceVelocity);
 
         outFalling = (colData.triangleHits == 0);
     }
@@ -649,6 +1145,12 @@ Vector3 Collider::collideEllipsoidWithWorld(
 
     outCollide = (colData.triangleHits > 0);
 
+    if (ground && hasGravity)
+    {
+        ground->misses++;
+        StoreGround(*ground, collisionSelector, scene, colData.eRadius, mask, triout, finalPos, !outFalling);
+    }
+
     finalPos.x *= colData.eRadius.x;
     finalPos.y *= colData.eRadius.y;
     finalPos.z *= colData.eRadius.z;
@@ -656,6 +1158,119 @@ Vector3 Collider::collideEllipsoidWithWorld(
     return finalPos;
 }
 
+void Collider::collideEllipsoidBatch(const MoveRequest* requests, MoveResult* results,
+                                     u32 count, ThreadPool* pool, CandidateCache* caches,
+                                     GroundContact* grounds) const
+{
+    auto move = [&](u32 begin, u32 end)
+    {
+        for (u32 i = begin; i < end; i++)
+        {
+            const MoveRequest& request = requests[i];
+            MoveResult& result = results[i];
+
+            result.position = collideEllipsoidWithWorld(
+                request.position, request.radius, request.velocity,
+                request.slidingSpeed, request.gravity, result.triangle,
+                result.hitPosition, result.falling, result.collide,
+                caches ? &caches[i] : nullptr, request.mask, grounds ? &grounds[i] : nullptr);
+        }
+    };
+
+    if (pool)
+    {
+        pool->parallelFor(count, 8, move);
+    }
+    else
+    {
+        move(0, count);
+    }
+}
+
+SweepHit Collider::sweepSphere(const Vector3& from, const Vector3& to, float radius, u32 mask) const
+{
+    SweepHit result;
+    result.hit = false;
+    result.time = 1.0f;
+    result.position = to;
+    result.point = to;
+    result.normal = { 0.0f, 0.0f, 0.0f };
+
+    Vector3 delta = Vector3Subtract(to, from);
+    if (radius <= 0.0f || Vector3LengthSqr(delta) == 0.0f) return result;
+
+    // Caixa do segmento inteiro, alargada pelo raio
+    Vector3 extent = { radius, radius, radius };
+    BoundingBox sweptBox;
+    sweptBox.min = Vector3Subtract(Vector3Min(from, to), extent);
+    sweptBox.max = Vector3Add(Vector3Max(from, to), extent);
+
+    CollisionData colData;
+    colData.eRadius = { radius, radius, radius };
+    colData.basePoint = Vector3Scale(from, 1.0f / radius);
+    colData.velocity = Vector3Scale(delta, 1.0f / radius);
+    colData.normalizedVelocity = Vector3Normalize(colData.velocity);
+    colData.foundCollision = false;
+    colData.nearestDistance = FLT_MAX;
+    colData.triangleIndex = -1;
+    colData.polygonFan = -1;
+    colData.triangleHits = 0;
+
+    CollisionCandidates& candidates = GetCollisionCandidates();
+    gatherCandidates(sweptBox, colData.eRadius, mask, candidates);
+    TestCandidates(colData, candidates);
+
+    if (!colData.foundCollision) return result;
+
+    // nearestDistance é t * |velocity| em espaço da esfera
+    float t = colData.nearestDistance / Vector3Length(colData.velocity);
+
+    result.hit = true;
+    result.time = t;
+    result.position = Vector3Add(from, Vector3Scale(delta, t));
+    result.point = Vector3Scale(colData.intersectionPoint, radius);
+    u32 triangleCnt = candidates.getTriangleCount();
+    if ((u32)colData.triangleIndex < triangleCnt)
+    {
+        result.triangle = candidates.get(colData.triangleIndex);
+        result.triangle.updateBounds();   // os da octree compacta vêm sem bounds
+    }
+    else
+    {
+        // Triângulo (0, fan, fan + 1) do leque, com o id que tem no selector
+        const PolygonCandidate& polygon = candidates.polygons[colData.triangleIndex - triangleCnt];
+        result.triangle = collisionSelector->getTriangleCopy(polygon.firstTriangle + colData.polygonFan - 1);
+        result.triangle.updateBounds();
+    }
+
+    // Começou encaixada na face: o centro pode estar sobre o ponto
+    Vector3 normal = Vector3Subtract(result.position, result.point);
+    float length = Vector3Length(normal);
+    result.normal = (length > 1e-6f) ? Vector3Scale(normal, 1.0f / length) : result.triangle.normal;
+    return result;
+}
+
+void Collider::sweepSphereBatch(const SweepRequest* requests, SweepHit* results,
+                                u32 count, ThreadPool* pool) const
+{
+    auto sweep = [&](u32 begin, u32 end)
+    {
+        for (u32 i = begin; i < end; i++)
+        {
+            results[i] = sweepSphere(requests[i].from, requests[i].to, requests[i].radius, requests[i].mask);
+        }
+    };
+
+    if (pool)
+    {
+        pool->parallelFor(count, 16, sweep);
+    }
+    else
+    {
+        sweep(0, count);
+    }
+}
+
   
 bool intersects(const BoundingBox& a, const BoundingBox& b)
 {
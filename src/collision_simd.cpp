@@ -0,0 +1,462 @@
+#include "collision.hpp"
+
+// Kernels SSE2: esfera-triângulo (Fauerby) para 4 CollisionTriangle de uma
+// vez em SoA, e raio-caixa / raio-triângulo para 4 raios de uma vez.
+//
+// Cada lane faz exatamente as mesmas operações, pela mesma ordem, que a
+// versão escalar (TestTriangleIntersection, GetRayCollisionTriangle), por
+// isso os resultados são iguais bit a bit. A aplicação dos resultados é
+// escalar, lane a lane, para manter a ordem do loop original.
+
+// COLLISION_SCALAR força a versão escalar mesmo com SSE2 (para comparar
+// resultados e tempos); as versões ...Scalar compilam-se sempre.
+
+#if defined(__SSE2__) && !defined(COLLISION_SCALAR)
+#define COLLISION_SIMD 1
+#endif
+
+#ifdef COLLISION_SIMD
+
+#include <emmintrin.h>
+
+namespace
+{
+
+struct Vec4x3
+{
+    __m128 x, y, z;
+};
+
+inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+{
+    // mask ? a : b
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline Vec4x3 Select(__m128 mask, const Vec4x3& a, const Vec4x3& b)
+{
+    return { Select(mask, a.x, b.x), Select(mask, a.y, b.y), Select(mask, a.z, b.z) };
+}
+
+inline Vec4x3 Sub(const Vec4x3& a, const Vec4x3& b)
+{
+    return { _mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z) };
+}
+
+inline Vec4x3 Add(const Vec4x3& a, const Vec4x3& b)
+{
+    return { _mm_add_ps(a.x, b.x), _mm_add_ps(a.y, b.y), _mm_add_ps(a.z, b.z) };
+}
+
+inline Vec4x3 Scale(const Vec4x3& a, __m128 s)
+{
+    return { _mm_mul_ps(a.x, s), _mm_mul_ps(a.y, s), _mm_mul_ps(a.z, s) };
+}
+
+inline __m128 Dot(const Vec4x3& a, const Vec4x3& b)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)),
+                      _mm_mul_ps(a.z, b.z));
+}
+
+inline Vec4x3 Cross(const Vec4x3& a, const Vec4x3& b)
+{
+    return { _mm_sub_ps(_mm_mul_ps(a.y, b.z), _mm_mul_ps(a.z, b.y)),
+             _mm_sub_ps(_mm_mul_ps(a.z, b.x), _mm_mul_ps(a.x, b.z)),
+             _mm_sub_ps(_mm_mul_ps(a.x, b.y), _mm_mul_ps(a.y, b.x)) };
+}
+
+inline Vec4x3 Splat(const Vector3& v)
+{
+    return { _mm_set1_ps(v.x), _mm_set1_ps(v.y), _mm_set1_ps(v.z) };
+}
+
+inline __m128 Abs(__m128 v)
+{
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+
+inline __m128 Negate(__m128 v)
+{
+    return _mm_xor_ps(v, _mm_set1_ps(-0.0f));
+}
+
+// GetLowestRoot para 4 equações; devolve a máscara das lanes com raiz válida
+inline __m128 LowestRoot4(__m128 a, __m128 b, __m128 c, __m128 maxR, __m128* root)
+{
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128 determinant = _mm_sub_ps(_mm_mul_ps(b, b),
+                                    _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(4.0f), a), c));
+    __m128 valid = _mm_cmpnlt_ps(determinant, zero);
+
+    __m128 sqrtD = _mm_sqrt_ps(determinant);
+    __m128 twoA = _mm_mul_ps(_mm_set1_ps(2.0f), a);
+    __m128 minusB = Negate(b);
+    __m128 r1 = _mm_div_ps(_mm_sub_ps(minusB, sqrtD), twoA);
+    __m128 r2 = _mm_div_ps(_mm_add_ps(minusB, sqrtD), twoA);
+
+    __m128 swap = _mm_cmpgt_ps(r1, r2);
+    __m128 lo = Select(swap, r2, r1);
+    __m128 hi = Select(swap, r1, r2);
+
+    __m128 loOk = _mm_and_ps(_mm_cmpgt_ps(lo, zero), _mm_cmplt_ps(lo, maxR));
+    __m128 hiOk = _mm_and_ps(_mm_cmpgt_ps(hi, zero), _mm_cmplt_ps(hi, maxR));
+
+    *root = Select(loOk, lo, hi);
+    return _mm_and_ps(valid, _mm_or_ps(loOk, hiOk));
+}
+
+// Aresta from + edge * f: atualiza t e o ponto de colisão nas lanes com hit
+inline void SweepEdge4(const Vec4x3& from, const Vec4x3& edge, __m128 edgeSquaredLength,
+                       const Vec4x3& base, const Vec4x3& velocity,
+                       __m128 velocitySquaredLength, __m128 active, __m128& t,
+                       __m128& found, Vec4x3& point)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+
+    Vec4x3 baseToVertex = Sub(from, base);
+    __m128 edgeDotVelocity = Dot(edge, velocity);
+    __m128 edgeDotBaseToVertex = Dot(edge, baseToVertex);
+
+    __m128 a = _mm_add_ps(_mm_mul_ps(edgeSquaredLength, Negate(velocitySquaredLength)),
+                          _mm_mul_ps(edgeDotVelocity, edgeDotVelocity));
+    __m128 b = _mm_sub_ps(
+        _mm_mul_ps(edgeSquaredLength, _mm_mul_ps(two, Dot(velocity, baseToVertex))),
+        _mm_mul_ps(_mm_mul_ps(two, edgeDotVelocity), edgeDotBaseToVertex));
+    __m128 c = _mm_add_ps(
+        _mm_mul_ps(edgeSquaredLength, _mm_sub_ps(one, Dot(baseToVertex, baseToVertex))),
+        _mm_mul_ps(edgeDotBaseToVertex, edgeDotBaseToVertex));
+
+    __m128 newT;
+    __m128 hit = _mm_and_ps(active, LowestRoot4(a, b, c, t, &newT));
+
+    __m128 f = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(edgeDotVelocity, newT), edgeDotBaseToVertex),
+                          edgeSquaredLength);
+    hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(f, zero), _mm_cmple_ps(f, one)));
+
+    t = Select(hit, newT, t);
+    found = _mm_or_ps(found, hit);
+    point = Select(hit, Add(from, Scale(edge, f)), point);
+}
+
+// Vértice: só testado nas lanes que ainda não têm colisão (como no escalar)
+inline void SweepVertex4(const Vec4x3& vertex, const Vec4x3& base, const Vec4x3& velocity,
+                         __m128 a, __m128 active, __m128& t, __m128& found, Vec4x3& point)
+{
+    Vec4x3 baseToPoint = Sub(base, vertex);
+    __m128 b = _mm_mul_ps(_mm_set1_ps(2.0f), Dot(velocity, baseToPoint));
+    __m128 c = _mm_sub_ps(Dot(baseToPoint, baseToPoint), _mm_set1_ps(1.0f));
+
+    __m128 newT;
+    __m128 hit = _mm_and_ps(_mm_andnot_ps(found, active), LowestRoot4(a, b, c, t, &newT));
+
+    t = Select(hit, newT, t);
+    found = _mm_or_ps(found, hit);
+    point = Select(hit, vertex, point);
+}
+
+} // namespace
+
+
+s32 TestTriangleIntersection4(CollisionData* colData, const TrianglePacket& packet)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    Vec4x3 A = { _mm_load_ps(packet.ax), _mm_load_ps(packet.ay), _mm_load_ps(packet.az) };
+    Vec4x3 normal = { _mm_load_ps(packet.nx), _mm_load_ps(packet.ny), _mm_load_ps(packet.nz) };
+    __m128 planeD = _mm_load_ps(packet.d);
+
+    Vec4x3 base = Splat(colData->basePoint);
+    Vec4x3 velocity = Splat(colData->velocity);
+    Vec4x3 normalizedVelocity = Splat(colData->normalizedVelocity);
+
+    // Lanes vazias do último pacote ficam de fora
+    alignas(16) float laneMask[4];
+    for (s32 i = 0; i < 4; i++)
+    {
+        laneMask[i] = (i < packet.count) ? -1.0f : 0.0f;
+    }
+    __m128 active = _mm_cmplt_ps(_mm_load_ps(laneMask), zero);
+
+    // Só polígonos virados para a frente
+    active = _mm_and_ps(active, _mm_cmple_ps(Dot(normal, normalizedVelocity), zero));
+
+    __m128 signedDistToTrianglePlane = _mm_add_ps(Dot(normal, base), planeD);
+    __m128 normalDotVelocity = Dot(normal, velocity);
+
+    // Esfera paralela ao plano: ou está incorporada nele ou não há colisão
+    __m128 parallel = _mm_cmplt_ps(Abs(normalDotVelocity), _mm_set1_ps(0.0001f));
+    __m128 embedded = _mm_and_ps(parallel, _mm_cmplt_ps(Abs(signedDistToTrianglePlane), one));
+    active = _mm_and_ps(active, _mm_or_ps(_mm_andnot_ps(parallel, _mm_cmpeq_ps(zero, zero)), embedded));
+
+    __m128 invNormalDotVelocity = _mm_div_ps(one, normalDotVelocity);
+    __m128 t0 = _mm_mul_ps(_mm_sub_ps(Negate(one), signedDistToTrianglePlane), invNormalDotVelocity);
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(one, signedDistToTrianglePlane), invNormalDotVelocity);
+
+    __m128 swap = _mm_cmpgt_ps(t0, t1);
+    __m128 lo = Select(swap, t1, t0);
+    __m128 hi = Select(swap, t0, t1);
+
+    __m128 outside = _mm_or_ps(_mm_cmpgt_ps(lo, one), _mm_cmplt_ps(hi, zero));
+    active = _mm_andnot_ps(_mm_andnot_ps(parallel, outside), active);
+
+    // Clamp(t0, 0, 1)
+    lo = Select(_mm_cmplt_ps(lo, zero), zero, lo);
+    lo = Select(_mm_cmpgt_ps(lo, one), one, lo);
+    t0 = Select(parallel, zero, lo);
+
+    if (_mm_movemask_ps(active) == 0) return -1;
+
+    __m128 t = one;
+    __m128 found = zero;
+    Vec4x3 collisionPoint = { zero, zero, zero };
+
+    Vec4x3 edgeAB = { _mm_load_ps(packet.abx), _mm_load_ps(packet.aby), _mm_load_ps(packet.abz) };
+    Vec4x3 edgeCA = { _mm_load_ps(packet.cax), _mm_load_ps(packet.cay), _mm_load_ps(packet.caz) };
+    __m128 edgeABSq = _mm_load_ps(packet.abSq);
+    __m128 edgeCASq = _mm_load_ps(packet.caSq);
+
+    // Colisão dentro do triângulo (baricêntricas pré-calculadas)
+    {
+        Vec4x3 planeIntersectionPoint = Add(Sub(base, normal), Scale(velocity, t0));
+        Vec4x3 toPoint = Sub(planeIntersectionPoint, A);
+
+        __m128 dot01 = _mm_load_ps(packet.dot01);
+        __m128 invDenom = _mm_load_ps(packet.invDenom);
+        __m128 dot02 = Negate(Dot(edgeCA, toPoint));
+        __m128 dot12 = Dot(edgeAB, toPoint);
+
+        __m128 u = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(edgeABSq, dot02), _mm_mul_ps(dot01, dot12)), invDenom);
+        __m128 v = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(edgeCASq, dot12), _mm_mul_ps(dot01, dot02)), invDenom);
+
+        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)),
+                                   _mm_cmple_ps(_mm_add_ps(u, v), one));
+        inside = _mm_and_ps(inside, _mm_andnot_ps(embedded, active));
+
+        found = inside;
+        t = Select(inside, t0, t);
+        collisionPoint = Select(inside, planeIntersectionPoint, collisionPoint);
+    }
+
+    // Varrer a esfera contra vértices e arestas nas lanes sem colisão
+    __m128 sweep = _mm_andnot_ps(found, active);
+    if (_mm_movemask_ps(sweep) != 0)
+    {
+        Vec4x3 B = { _mm_load_ps(packet.bx), _mm_load_ps(packet.by), _mm_load_ps(packet.bz) };
+        Vec4x3 C = { _mm_load_ps(packet.cx), _mm_load_ps(packet.cy), _mm_load_ps(packet.cz) };
+        Vec4x3 edgeBC = { _mm_load_ps(packet.bcx), _mm_load_ps(packet.bcy), _mm_load_ps(packet.bcz) };
+        __m128 edgeBCSq = _mm_load_ps(packet.bcSq);
+        __m128 velocitySquaredLength = Dot(velocity, velocity);
+
+        SweepVertex4(A, base, velocity, velocitySquaredLength, sweep, t, found, collisionPoint);
+        SweepVertex4(B, base, velocity, velocitySquaredLength, sweep, t, found, collisionPoint);
+        SweepVertex4(C, base, velocity, velocitySquaredLength, sweep, t, found, collisionPoint);
+
+        SweepEdge4(A, edgeAB, edgeABSq, base, velocity, velocitySquaredLength, sweep, t, found, collisionPoint);
+        SweepEdge4(B, edgeBC, edgeBCSq, base, velocity, velocitySquaredLength, sweep, t, found, collisionPoint);
+        SweepEdge4(C, edgeCA, edgeCASq, base, velocity, velocitySquaredLength, sweep, t, found, collisionPoint);
+    }
+
+    s32 foundMask = _mm_movemask_ps(found);
+    if (foundMask == 0) return -1;
+
+    alignas(16) float tLanes[4], px[4], py[4], pz[4];
+    _mm_store_ps(tLanes, t);
+    _mm_store_ps(px, collisionPoint.x);
+    _mm_store_ps(py, collisionPoint.y);
+    _mm_store_ps(pz, collisionPoint.z);
+
+    float velocityLength = Vector3Length(colData->velocity);
+    s32 hitLane = -1;
+
+    for (s32 i = 0; i < packet.count; i++)
+    {
+        if (!(foundMask & (1 << i))) continue;
+
+        float distToCollision = tLanes[i] * velocityLength;
+        if (!colData->foundCollision || distToCollision < colData->nearestDistance)
+        {
+            colData->nearestDistance = distToCollision;
+            colData->intersectionPoint = { px[i], py[i], pz[i] };
+            colData->foundCollision = true;
+            colData->triangleHits++;
+            hitLane = i;
+        }
+    }
+
+    return hitLane;
+}
+
+// Slab test de 4 raios contra uma caixa. min/max são exatos, por isso o
+// resultado é o mesmo que eixo a eixo em escalar.
+s32 IntersectRayBox4(const RayPacket& rays, const BoundingBox& box,
+                     const float* maxDistance, float* entry)
+{
+    const __m128 zero = _mm_setzero_ps();
+
+    const float* origin[3] = { rays.ox, rays.oy, rays.oz };
+    const float* direction[3] = { rays.dx, rays.dy, rays.dz };
+    const float* invDirection[3] = { rays.ix, rays.iy, rays.iz };
+    const float boxMin[3] = { box.min.x, box.min.y, box.min.z };
+    const float boxMax[3] = { box.max.x, box.max.y, box.max.z };
+
+    __m128 tMin = zero;
+    __m128 tMax = _mm_set1_ps(FLT_MAX);
+    __m128 valid = _mm_cmpeq_ps(zero, zero);
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        __m128 o = _mm_load_ps(origin[axis]);
+        __m128 lo = _mm_set1_ps(boxMin[axis]);
+        __m128 hi = _mm_set1_ps(boxMax[axis]);
+
+        // Paralelo a este eixo: só passa se a origem estiver dentro da laje
+        __m128 parallel = _mm_cmpeq_ps(_mm_load_ps(direction[axis]), zero);
+        __m128 inside = _mm_and_ps(_mm_cmpge_ps(o, lo), _mm_cmple_ps(o, hi));
+        valid = _mm_andnot_ps(_mm_andnot_ps(inside, parallel), valid);
+
+        __m128 inv = _mm_load_ps(invDirection[axis]);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(lo, o), inv);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(hi, o), inv);
+
+        __m128 near = Select(parallel, tMin, _mm_min_ps(t0, t1));
+        __m128 far = Select(parallel, tMax, _mm_max_ps(t0, t1));
+        tMin = _mm_max_ps(tMin, near);
+        tMax = _mm_min_ps(tMax, far);
+    }
+
+    valid = _mm_and_ps(valid, _mm_cmple_ps(tMin, tMax));
+    valid = _mm_and_ps(valid, _mm_cmple_ps(tMin, _mm_loadu_ps(maxDistance)));
+
+    _mm_storeu_ps(entry, tMin);
+    return _mm_movemask_ps(valid);
+}
+
+// Möller-Trumbore para 4 raios contra um triângulo, pela mesma ordem de
+// operações que GetRayCollisionTriangle
+s32 IntersectRayTriangle4(const RayPacket& rays, const Triangle& tri, float* distance)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 epsilon = _mm_set1_ps(0.000001f);
+
+    Vec4x3 edge1 = Splat(tri.edgeAB);
+    Vec4x3 edge2 = Splat(Vector3Negate(tri.edgeCA));
+    Vec4x3 p1 = Splat(tri.pointA);
+
+    Vec4x3 origin = { _mm_load_ps(rays.ox), _mm_load_ps(rays.oy), _mm_load_ps(rays.oz) };
+    Vec4x3 direction = { _mm_load_ps(rays.dx), _mm_load_ps(rays.dy), _mm_load_ps(rays.dz) };
+
+    Vec4x3 p = Cross(direction, edge2);
+    __m128 det = Dot(edge1, p);
+    __m128 valid = _mm_or_ps(_mm_cmple_ps(det, Negate(epsilon)), _mm_cmpge_ps(det, epsilon));
+    if (_mm_movemask_ps(valid) == 0) return 0;
+
+    __m128 invDet = _mm_div_ps(one, det);
+    Vec4x3 tv = Sub(origin, p1);
+    __m128 u = _mm_mul_ps(Dot(tv, p), invDet);
+    valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+    if (_mm_movemask_ps(valid) == 0) return 0;
+
+    Vec4x3 q = Cross(tv, edge1);
+    __m128 v = _mm_mul_ps(Dot(direction, q), invDet);
+    valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero),
+                                         _mm_cmple_ps(_mm_add_ps(u, v), one)));
+
+    __m128 t = _mm_mul_ps(Dot(edge2, q), invDet);
+    valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, epsilon));
+
+    _mm_storeu_ps(distance, t);
+    return _mm_movemask_ps(valid);
+}
+
+#else
+
+// Sem SSE2 (ou com COLLISION_SCALAR): mesmo contrato, lane a lane
+s32 TestTriangleIntersection4(CollisionData* colData, const TrianglePacket& packet)
+{
+    return TestTriangleIntersection4Scalar(colData, packet);
+}
+
+s32 IntersectRayBox4(const RayPacket& rays, const BoundingBox& box,
+                     const float* maxDistance, float* entry)
+{
+    return IntersectRayBox4Scalar(rays, box, maxDistance, entry);
+}
+
+s32 IntersectRayTriangle4(const RayPacket& rays, const Triangle& tri, float* distance)
+{
+    return IntersectRayTriangle4Scalar(rays, tri, distance);
+}
+
+#endif
+
+
+// Versões escalares: referência para as SIMD, triângulo a triângulo e raio a raio
+s32 TestTriangleIntersection4Scalar(CollisionData* colData, const TrianglePacket& packet)
+{
+    s32 hitLane = -1;
+    for (s32 i = 0; i < packet.count; i++)
+    {
+        if (TestTriangleIntersection(colData, packet.getCollision(i)))
+        {
+            hitLane = i;
+        }
+    }
+    return hitLane;
+}
+
+s32 IntersectRayBox4Scalar(const RayPacket& rays, const BoundingBox& box,
+                           const float* maxDistance, float* entry)
+{
+    const float* origin[3] = { rays.ox, rays.oy, rays.oz };
+    const float* direction[3] = { rays.dx, rays.dy, rays.dz };
+    const float* invDirection[3] = { rays.ix, rays.iy, rays.iz };
+    const float boxMin[3] = { box.min.x, box.min.y, box.min.z };
+    const float boxMax[3] = { box.max.x, box.max.y, box.max.z };
+
+    s32 mask = 0;
+    for (s32 lane = 0; lane < 4; lane++)
+    {
+        float tMin = 0.0f;
+        float tMax = FLT_MAX;
+        bool valid = true;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float o = origin[axis][lane];
+            if (direction[axis][lane] == 0.0f)
+            {
+                if (o < boxMin[axis] || o > boxMax[axis]) valid = false;
+                continue;
+            }
+
+            float t0 = (boxMin[axis] - o) * invDirection[axis][lane];
+            float t1 = (boxMax[axis] - o) * invDirection[axis][lane];
+            tMin = fmaxf(tMin, fminf(t0, t1));
+            tMax = fminf(tMax, fmaxf(t0, t1));
+        }
+
+        entry[lane] = tMin;
+        if (valid && tMin <= tMax && tMin <= maxDistance[lane]) mask |= 1 << lane;
+    }
+    return mask;
+}
+
+s32 IntersectRayTriangle4Scalar(const RayPacket& rays, const Triangle& tri, float* distance)
+{
+    s32 mask = 0;
+    for (s32 lane = 0; lane < 4; lane++)
+    {
+        Ray ray = { { rays.ox[lane], rays.oy[lane], rays.oz[lane] },
+                    { rays.dx[lane], rays.dy[lane], rays.dz[lane] } };
+        RayCollision collision = GetRayCollisionTriangle(ray, tri.pointA, tri.pointB, tri.pointC);
+        distance[lane] = collision.distance;
+        if (collision.hit) mask |= 1 << lane;
+    }
+    return mask;
+}
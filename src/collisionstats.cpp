@@ -0,0 +1,103 @@
+#include "collisionstats.hpp"
+#include <mutex>
+#include <algorithm>
+
+
+void CollisionCounters::add(const CollisionCounters& other)
+{
+    queries += other.queries;
+    nodesVisited += other.nodesVisited;
+    candidates += other.candidates;
+    duplicates += other.duplicates;
+    triangleTests += other.triangleTests;
+    polygonTests += other.polygonTests;
+    moves += other.moves;
+    collideCalls += other.collideCalls;
+    maxRecursion = std::max(maxRecursion, other.maxRecursion);
+    cacheHits += other.cacheHits;
+    cacheMisses += other.cacheMisses;
+    groundProbes += other.groundProbes;
+    gravitySweeps += other.gravitySweeps;
+    queryTime += other.queryTime;
+    moveTime += other.moveTime;
+}
+
+// Contadores de todas as threads vivas; os de threads que acabaram (ex.:
+// um ThreadPool destruído) passam para retired e entram no próximo frame
+static std::mutex registryMutex;
+static std::vector<CollisionCounters*> registry;
+static CollisionCounters retired;
+
+static CollisionCounters lastFrame;
+static CollisionCounters total;
+static u64 frameCount = 0;
+
+struct ThreadCollisionCounters
+{
+    CollisionCounters counters;
+
+    ThreadCollisionCounters()
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(&counters);
+    }
+
+    ~ThreadCollisionCounters()
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        retired.add(counters);
+        registry.erase(std::find(registry.begin(), registry.end(), &counters));
+    }
+};
+
+CollisionCounters& GetCollisionCounters()
+{
+    static thread_local ThreadCollisionCounters threadCounters;
+    return threadCounters.counters;
+}
+
+void CollisionStatsEndFrame()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    CollisionCounters frame = retired;
+    retired = CollisionCounters();
+    for (CollisionCounters* counters : registry)
+    {
+        frame.add(*counters);
+        *counters = CollisionCounters();
+    }
+
+    lastFrame = frame;
+    total.add(frame);
+    frameCount++;
+}
+
+const CollisionCounters& GetCollisionFrameStats()
+{
+    return lastFrame;
+}
+
+const CollisionCounters& GetCollisionTotalStats()
+{
+    return total;
+}
+
+u64 GetCollisionFrameCount()
+{
+    return frameCount;
+}
+
+void ResetCollisionStats()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    for (CollisionCounters* counters : registry)
+    {
+        *counters = CollisionCounters();
+    }
+    retired = CollisionCounters();
+    lastFrame = CollisionCounters();
+    total = CollisionCounters();
+    frameCount = 0;
+}
@@ -0,0 +1,486 @@
+#include "Config.hpp"
+#include "collision.hpp"
+#include <algorithm>
+
+
+// Coordenadas de célula com 21 bits por eixo (±1M células), juntas numa chave
+#define HASHGRID_CELL_BITS 21
+#define HASHGRID_CELL_LIMIT ((1 << (HASHGRID_CELL_BITS - 1)) - 1)
+#define HASHGRID_CELL_MASK ((1ull << HASHGRID_CELL_BITS) - 1)
+
+static inline s32 CellCoord(float value, float invCellSize)
+{
+    float cell = floorf(value * invCellSize);
+    if (cell < (float)-HASHGRID_CELL_LIMIT) return -HASHGRID_CELL_LIMIT;
+    if (cell > (float)HASHGRID_CELL_LIMIT) return HASHGRID_CELL_LIMIT;
+    return (s32)cell;
+}
+
+static inline u64 CellKey(s32 x, s32 y, s32 z)
+{
+    return (((u64)x & HASHGRID_CELL_MASK) << (2 * HASHGRID_CELL_BITS)) |
+           (((u64)y & HASHGRID_CELL_MASK) << HASHGRID_CELL_BITS) |
+           ((u64)z & HASHGRID_CELL_MASK);
+}
+
+static inline s32 CellFromKey(u64 key, s32 shift)
+{
+    s32 value = (s32)((key >> shift) & HASHGRID_CELL_MASK);
+    return (value << (32 - HASHGRID_CELL_BITS)) >> (32 - HASHGRID_CELL_BITS);
+}
+
+// Mesmo critério que AcceptRayHit das árvores: empates ficam com o id mais baixo
+static inline void AcceptGridHit(const Ray& ray, RayHit& best, const Triangle* tri,
+                                 float distance, const RayFilter& filter)
+{
+    if (distance > best.distance) return;
+    if (distance == best.distance && best.triangle && best.triangle->id < tri->id) return;
+    if (filter && !filter(*tri)) return;
+
+    best.hit = true;
+    best.distance = distance;
+    best.point = Vector3Add(ray.position, Vector3Scale(ray.direction, distance));
+    best.normal = tri->normal;
+    best.triangle = tri;
+}
+
+
+HashGrid::HashGrid(float cellSize)
+{
+    this->cellSize = cellSize > 0.0f ? cellSize : 8.0f;
+    invCellSize = 1.0f / this->cellSize;
+    bounds = { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+}
+
+void HashGrid::setCellSize(float size)
+{
+    if (size <= 0.0f || size == cellSize) return;
+    cellSize = size;
+    invCellSize = 1.0f / size;
+    rebuild();
+}
+
+void HashGrid::cellRange(const BoundingBox& box, s32* lo, s32* hi) const
+{
+    lo[0] = CellCoord(box.min.x, invCellSize);
+    lo[1] = CellCoord(box.min.y, invCellSize);
+    lo[2] = CellCoord(box.min.z, invCellSize);
+    hi[0] = CellCoord(box.max.x, invCellSize);
+    hi[1] = CellCoord(box.max.y, invCellSize);
+    hi[2] = CellCoord(box.max.z, invCellSize);
+}
+
+void HashGrid::link(u32 id)
+{
+    const BoundingBox& box = triangleStorage[id].bounds;
+    u32 layers = triangleStorage[id].layers;
+    s32 lo[3], hi[3];
+    cellRange(box, lo, hi);
+    version++;
+
+    for (s32 x = lo[0]; x <= hi[0]; x++)
+        for (s32 y = lo[1]; y <= hi[1]; y++)
+            for (s32 z = lo[2]; z <= hi[2]; z++)
+            {
+                Cell& cell = cells[CellKey(x, y, z)];
+                cell.ids.push_back(id);
+                cell.layers |= layers;
+            }
+
+    bounds.min = Vector3Min(bounds.min, box.min);
+    bounds.max = Vector3Max(bounds.max, box.max);
+}
+
+void HashGrid::unlink(u32 id)
+{
+    s32 lo[3], hi[3];
+    cellRange(triangleStorage[id].bounds, lo, hi);
+    version++;
+
+    for (s32 x = lo[0]; x <= hi[0]; x++)
+        for (s32 y = lo[1]; y <= hi[1]; y++)
+            for (s32 z = lo[2]; z <= hi[2]; z++)
+            {
+                auto it = cells.find(CellKey(x, y, z));
+                if (it == cells.end()) continue;
+
+                // A ordem dentro da célula não importa: troca com o último.
+                // As camadas da célula ficam como estão (rebuild aperta-as).
+                std::vector<u32>& list = it->second.ids;
+                for (size_t k = 0; k < list.size(); k++)
+                {
+                    if (list[k] != id) continue;
+                    list[k] = list.back();
+                    list.pop_back();
+                    break;
+                }
+                if (list.empty()) cells.erase(it);
+            }
+}
+
+void HashGrid::addTriangle(const Vector3& a, const Vector3& b, const Vector3& c, u32 layers)
+{
+    insertTriangle(a, b, c, layers);
+}
+
+u32 HashGrid::insertTriangle(const Vector3& a, const Vector3& b, const Vector3& c, u32 layers)
+{
+    Triangle tri = { a, b, c };
+    tri.updateBounds();
+    tri.layers = layers;
+
+    u32 id;
+    if (!freeSlots.empty())
+    {
+        id = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else
+    {
+        id = (u32)triangleStorage.size();
+        triangleStorage.push_back(tri);
+        alive.push_back(0);
+    }
+
+    tri.id = id;
+    triangleStorage[id] = tri;
+    alive[id] = 1;
+    liveCount++;
+    link(id);
+    return id;
+}
+
+void HashGrid::removeTriangle(u32 handle)
+{
+    if (handle >= alive.size() || !alive[handle]) return;
+
+    unlink(handle);
+    alive[handle] = 0;
+    freeSlots.push_back(handle);
+    liveCount--;
+}
+
+void HashGrid::clear()
+{
+    version++;
+    triangleStorage.clear();
+    cells.clear();
+    alive.clear();
+    freeSlots.clear();
+    liveCount = 0;
+    bounds = { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+}
+
+void HashGrid::rebuild()
+{
+    cells.clear();
+    bounds = { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+    for (u32 id = 0; id < (u32)triangleStorage.size(); id++)
+    {
+        if (alive[id]) link(id);
+    }
+}
+
+
+// 3D-DDA (Amanatides & Woo): corta o raio pelos limites da grelha e visita as
+// células pela ordem em que o raio as atravessa. visit(cell, cellExit) recebe a
+// célula e o t de saída; devolve false para parar.
+template <typename Visit>
+void HashGrid::traverse(const Ray& ray, float maxDistance, const Visit& visit) const
+{
+    if (cells.empty()) return;
+
+    const float origin[3] = { ray.position.x, ray.position.y, ray.position.z };
+    const float dir[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+    // Folga para não perder por arredondamento triângulos encostados aos limites
+    const float margin = cellSize * 0.01f;
+    const float lower[3] = { bounds.min.x - margin, bounds.min.y - margin, bounds.min.z - margin };
+    const float upper[3] = { bounds.max.x + margin, bounds.max.y + margin, bounds.max.z + margin };
+
+    float tEnter = 0.0f;
+    float tExit = maxDistance;
+    for (s32 a = 0; a < 3; a++)
+    {
+        if (dir[a] == 0.0f)
+        {
+            if (origin[a] < lower[a] || origin[a] > upper[a]) return;
+            continue;
+        }
+        float inv = 1.0f / dir[a];
+        float t0 = (lower[a] - origin[a]) * inv;
+        float t1 = (upper[a] - origin[a]) * inv;
+        if (t0 > t1) std::swap(t0, t1);
+        tEnter = fmaxf(tEnter, t0);
+        tExit = fminf(tExit, t1);
+        if (tEnter > tExit) return;
+    }
+
+    s32 lo[3], hi[3];
+    cellRange(bounds, lo, hi);
+
+    s32 cell[3];
+    s32 step[3];
+    float tMax[3];
+    float tDelta[3];
+    for (s32 a = 0; a < 3; a++)
+    {
+        cell[a] = CellCoord(origin[a] + dir[a] * tEnter, invCellSize);
+        cell[a] = std::min(std::max(cell[a], lo[a]), hi[a]);
+
+        if (dir[a] > 0.0f)
+        {
+            step[a] = 1;
+            tMax[a] = ((float)(cell[a] + 1) * cellSize - origin[a]) / dir[a];
+            tDelta[a] = cellSize / dir[a];
+        }
+        else if (dir[a] < 0.0f)
+        {
+            step[a] = -1;
+            tMax[a] = ((float)cell[a] * cellSize - origin[a]) / dir[a];
+            tDelta[a] = -cellSize / dir[a];
+        }
+        else
+        {
+            step[a] = 0;
+            tMax[a] = FLT_MAX;
+            tDelta[a] = FLT_MAX;
+        }
+    }
+
+    for (;;)
+    {
+        s32 axis = 0;
+        if (tMax[1] < tMax[axis]) axis = 1;
+        if (tMax[2] < tMax[axis]) axis = 2;
+        float cellExit = tMax[axis];
+
+        COLLISION_STAT_ADD(nodesVisited, 1);
+        auto it = cells.find(CellKey(cell[0], cell[1], cell[2]));
+        if (it != cells.end() && !visit(it->second, cellExit)) return;
+
+        if (cellExit > maxDistance) return;
+        cell[axis] += step[axis];
+        if (cell[axis] < lo[axis] || cell[axis] > hi[axis]) return;
+        tMax[axis] += tDelta[axis];
+    }
+}
+
+
+std::vector<const Triangle*> HashGrid::getCandidates(const BoundingBox& area, u32 mask) const
+{
+    COLLISION_STAT_TIMER(queryTime);
+    COLLISION_STAT_ADD(queries, 1);
+
+    std::vector<const Triangle*> candidates;
+    if (cells.empty()) return candidates;
+    candidates.reserve(64);
+
+    QueryMarks& marks = GetQueryMarks();
+    marks.begin(triangleStorage.size());
+#ifdef COLLISION_STATS
+    u32 duplicates = marks.duplicates;
+#endif
+
+    auto collect = [&](const Cell& cell)
+    {
+        if (!(cell.layers & mask)) return;
+        for (u32 id : cell.ids)
+        {
+            const Triangle* tri = &triangleStorage[id];
+            if (!(tri->layers & mask) || !marks.visit(tri)) continue;
+            if (CheckCollisionBoxes(tri->bounds, area)) candidates.push_back(tri);
+        }
+    };
+
+    s32 lo[3], hi[3];
+    cellRange(area, lo, hi);
+    double range = (double)(hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) * (hi[2] - lo[2] + 1);
+
+    // Caixa maior que a grelha ocupada: mais barato percorrer as células que existem
+    if (range > (double)cells.size())
+    {
+        for (const auto& entry : cells)
+        {
+            COLLISION_STAT_ADD(nodesVisited, 1);
+            collect(entry.second);
+        }
+    }
+    else
+    {
+        for (s32 x = lo[0]; x <= hi[0]; x++)
+            for (s32 y = lo[1]; y <= hi[1]; y++)
+                for (s32 z = lo[2]; z <= hi[2]; z++)
+                {
+                    COLLISION_STAT_ADD(nodesVisited, 1);
+                    auto it = cells.find(CellKey(x, y, z));
+                    if (it != cells.end()) collect(it->second);
+                }
+    }
+
+    COLLISION_STAT_ADD(candidates, candidates.size());
+    COLLISION_STAT_ADD(duplicates, marks.duplicates - duplicates);
+    return candidates;
+}
+
+std::vector<const Triangle*> HashGrid::getCandidates(const Vector3& point, float radius, u32 mask) const
+{
+    COLLISION_STAT_TIMER(queryTime);
+    COLLISION_STAT_ADD(queries, 1);
+
+    std::vector<const Triangle*> candidates;
+    if (cells.empty()) return candidates;
+    candidates.reserve(32);
+
+    QueryMarks& marks = GetQueryMarks();
+    marks.begin(triangleStorage.size());
+#ifdef COLLISION_STATS
+    u32 duplicates = marks.duplicates;
+#endif
+
+    BoundingBox area = { Vector3Subtract(point, { radius, radius, radius }),
+                         Vector3Add(point, { radius, radius, radius }) };
+    s32 lo[3], hi[3];
+    cellRange(area, lo, hi);
+
+    for (s32 x = lo[0]; x <= hi[0]; x++)
+        for (s32 y = lo[1]; y <= hi[1]; y++)
+            for (s32 z = lo[2]; z <= hi[2]; z++)
+            {
+                COLLISION_STAT_ADD(nodesVisited, 1);
+                auto it = cells.find(CellKey(x, y, z));
+                if (it == cells.end() || !(it->second.layers & mask)) continue;
+
+                for (u32 id : it->second.ids)
+                {
+                    const Triangle* tri = &triangleStorage[id];
+                    if (!(tri->layers & mask) || !marks.visit(tri)) continue;
+                    if (CheckCollisionBoxSphere(tri->bounds, point, radius)) candidates.push_back(tri);
+                }
+            }
+
+    COLLISION_STAT_ADD(candidates, candidates.size());
+    COLLISION_STAT_ADD(duplicates, marks.duplicates - duplicates);
+    return candidates;
+}
+
+std::vector<const Triangle*> HashGrid::getCandidates(const Ray& ray, float maxDistance, u32 mask) const
+{
+    COLLISION_STAT_TIMER(queryTime);
+    COLLISION_STAT_ADD(queries, 1);
+
+    std::vector<const Triangle*> candidates;
+    candidates.reserve(16);
+
+    QueryMarks& marks = GetQueryMarks();
+    marks.begin(triangleStorage.size());
+#ifdef COLLISION_STATS
+    u32 duplicates = marks.duplicates;
+#endif
+
+    traverse(ray, maxDistance, [&](const Cell& cell, float cellExit)
+    {
+        if (!(cell.layers & mask)) return true;
+        for (u32 id : cell.ids)
+        {
+            const Triangle* tri = &triangleStorage[id];
+            if ((tri->layers & mask) && marks.visit(tri)) candidates.push_back(tri);
+        }
+        return true;
+    });
+
+    COLLISION_STAT_ADD(candidates, candidates.size());
+    COLLISION_STAT_ADD(duplicates, marks.duplicates - duplicates);
+    return candidates;
+}
+
+RayHit HashGrid::raycast(const Ray& ray, float maxDistance, const RayFilter& filter, u32 mask) const
+{
+    COLLISION_STAT_TIMER(queryTime);
+    COLLISION_STAT_ADD(queries, 1);
+
+    RayHit best;
+    best.distance = maxDistance;
+
+    QueryMarks& marks = GetQueryMarks();
+    marks.begin(triangleStorage.size());
+
+    // O mesmo kernel das árvores, para as distâncias baterem certo ao bit
+    RayPacket packet;
+    for (s32 lane = 0; lane < 4; lane++) packet.set(lane, ray);
+
+    traverse(ray, maxDistance, [&](const Cell& cell, float cellExit)
+    {
+        if (!(cell.layers & mask)) return true;
+        for (u32 id : cell.ids)
+        {
+            const Triangle* tri = &triangleStorage[id];
+            if (!(tri->layers & mask) || !marks.visit(tri)) continue;
+
+            alignas(16) float distance[4];
+            COLLISION_STAT_ADD(triangleTests, 1);
+            if (IntersectRayTriangle4(packet, *tri, distance) & 1)
+            {
+                AcceptGridHit(ray, best, tri, distance[0], filter);
+            }
+        }
+        // Um hit antes da saída desta célula não pode ser batido pelas seguintes
+        return !(best.hit && best.distance < cellExit);
+    });
+
+    if (!best.hit) return RayHit();
+    if (Vector3DotProduct(best.normal, ray.direction) > 0.0f)
+    {
+        best.normal = Vector3Negate(best.normal);
+    }
+    return best;
+}
+
+void HashGrid::raycast(const Ray* rays, s32 count, float maxDistance, RayHit* out,
+                       const RayFilter& filter, u32 mask, const float* maxDistances) const
+{
+    // Cada raio faz o seu percurso: na grelha não há nós para partilhar
+    for (s32 i = 0; i < count; i++)
+    {
+        out[i] = raycast(rays[i], maxDistances ? maxDistances[i] : maxDistance, filter, mask);
+    }
+}
+
+
+void HashGrid::debug() const
+{
+    for (const auto& entry : cells)
+    {
+        Vector3 min = { CellFromKey(entry.first, 2 * HASHGRID_CELL_BITS) * cellSize,
+                        CellFromKey(entry.first, HASHGRID_CELL_BITS) * cellSize,
+                        CellFromKey(entry.first, 0) * cellSize };
+        Vector3 max = Vector3Add(min, { cellSize, cellSize, cellSize });
+        DrawBoundingBox({ min, max }, entry.second.ids.size() > TreeNode::MAX_TRIANGLES ? RED : GREEN);
+    }
+}
+
+void HashGrid::stats() const
+{
+    size_t references = 0;
+    size_t largest = 0;
+    size_t memory = alive.capacity() + freeSlots.capacity() * sizeof(u32);
+    for (const auto& entry : cells)
+    {
+        references += entry.second.ids.size();
+        largest = std::max(largest, entry.second.ids.size());
+        memory += sizeof(entry) + entry.second.ids.capacity() * sizeof(u32);
+    }
+
+    LogInfo("HashGrid cell size: %.2f", cellSize);
+    LogInfo("HashGrid triangles: %u (%u free slots)", liveCount, (u32)freeSlots.size());
+    LogInfo("HashGrid cells: %u, references: %u, largest cell: %u",
+            (u32)cells.size(), (u32)references, (u32)largest);
+    if (!cells.empty())
+    {
+        LogInfo("HashGrid triangles per cell: %.2f", (float)references / (float)cells.size());
+    }
+    if (liveCount > 0)
+    {
+        LogInfo("HashGrid duplication factor: %.2f", (float)references / (float)liveCount);
+    }
+    LogInfo("HashGrid memory: %.1f KB", memory / 1024.0f);
+}
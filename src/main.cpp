@@ -14,6 +14,12 @@
 #include "emitter.hpp"
 #include "scene.hpp"
 #include "animation.hpp"
+#include "threadpool.hpp"
+#include "movetrace.hpp"
+#include "polygonmesh.hpp"
+#include "navmesh.hpp"
+#include "sight.hpp"
+#include "characters.hpp"
 #include "frustum.hpp"
 
 float bobbingTime = 0.0f;
@@ -70,6 +76,8 @@ class Player {
         this->active = active;
     }
 
+    bool IsActive() const { return active; }
+
     bool pick(Ray& ray)
     {
         if (!active)
@@ -95,6 +103,13 @@ class Player {
         upperAnimator->PlayAnimation("DEATH_BLOWBACK");
     }
 
+    void Respawn()
+    {
+        active = true;
+        lowerAnimator->PlayAnimation("IDLE");
+        upperAnimator->PlayAnimation("STAND_RIFLE");
+    }
+
     bool Load(const std::string& szFileName,
               const std::string& szWeaponFileName, float scale = 0.1f)
     {
@@ -227,11 +242,56 @@ ViewFrustum frustum;
 Collider world;
 Octree quad;
 BSP map;
+std::string mapFile;   // as caches (.oct, .nav, .trace) ficam ao lado
 Decal3D decals;
 ParticleSystem particleSystem;
 EffectEmitter muzzleFlash;
 EffectEmitter shockWave;
 Model barrel;
+MoveTrace moveTrace;
+NavMesh navMesh;
+bool showNavMesh = false;
+// Caminho do F10, só refeito quando liga ou quando uma ponta se afasta
+NavPath navPath;
+bool navPathFound = false;
+bool navPathDirty = true;
+Vector3 navPathStart = { 0.0f, 0.0f, 0.0f };
+Vector3 navPathGoal = { 0.0f, 0.0f, 0.0f };
+static const float NAV_PATH_REPATH = 1.0f;
+SightService sight;
+bool npcSeesPlayer = false;
+CharacterSet characters;
+u32 cameraCharacter = 0;
+u32 npcCharacter = 0;
+static const float NPC_RADIUS = 1.6f;
+static const float NPC_HALF_HEIGHT = 2.8f;   // a cápsula fica por cima da origem do modelo (pés)
+
+// Centro da cápsula do NPC a partir da posição do modelo
+static Vector3 NpcCapsuleCenter(const Node3D& transform)
+{
+    return Vector3Add(transform.GetWorldPosition(), { 0.0f, NPC_HALF_HEIGHT, 0.0f });
+}
+
+// Superfícies desenhadas e brushes de clip (LAYER_PLAYERCLIP)
+static void AddMapSurfaces(const BSP& bsp, PolygonMesh& polygonMesh)
+{
+    for (const std::vector<BSPSurface>* surfaces : { &bsp.getSurfaces(), &bsp.getClipSurfaces() })
+    {
+        for (const BSPSurface& surface : *surfaces)
+        {
+            const std::vector<Vector3>& verts = surface.vertices;
+            const std::vector<u16>& indices = surface.indices;
+            u32 layers = bsp.getCollisionLayers(surface.textureID);
+
+            for (size_t i = 0; i + 2 < indices.size(); i += 3)
+            {
+                polygonMesh.addTriangle(verts[indices[i + 0]], verts[indices[i + 1]],
+                                        verts[indices[i + 2]], layers);
+            }
+        }
+    }
+    polygonMesh.build();
+}
 
 struct MainScreen : public Screen
 {
@@ -277,34 +337,45 @@ struct MainScreen : public Screen
         int blendLoc = GetShaderLocation(mapShader, "lightmapBlend");
 
 
-        map.loadFromFile("maps/oa_rpg3dm2.bsp");
-        //     map.loadFromFile("maps/egyptians.bsp");
-
-
-        const std::vector<BSPSurface> surfaces = map.getSurfaces();
+        mapFile = "maps/oa_rpg3dm2.bsp";
+        //     mapFile = "maps/egyptians.bsp";
+        map.loadFromFile(mapFile.c_str());
 
 
         quad.setWorldBounds(map.getBounds());
 
+        // A octree construída fica ao lado do mapa; só se reconstrói se o
+        // .bsp ou os parâmetros da árvore mudarem
+        std::string treeCache = ChangeFileExtension(mapFile.c_str(), ".oct");
+        u64 treeKey = quad.getCacheKey(PolygonMesh::getCacheKey(map.getCollisionHash()));
 
-        for (u32 i = 0; i < surfaces.size(); i++)
+        // Os triângulos complanares juntos em polígonos; servem à octree e à
+        // malha de navegação, só se fazem se uma das caches falhar
+        PolygonMesh polygonMesh;
+        if (!quad.loadCache(treeCache.c_str(), treeKey))
         {
-            const BSPSurface& surface = surfaces[i];
-            const std::vector<Vector3>& verts = surface.vertices;
-            const std::vector<u16>& indices = surface.indices;
-
+            AddMapSurfaces(map, polygonMesh);
+            polygonMesh.stats();
+            polygonMesh.addTo(quad);
 
-            for (size_t i = 0; i + 2 < indices.size(); i += 3)
-            {
-                quad.addTriangle(verts[indices[i + 0]], verts[indices[i + 1]],
-                                 verts[indices[i + 2]]);
-            }
+            ThreadPool buildPool;
+            quad.rebuild(&buildPool);
+            quad.saveCache(treeCache.c_str(), treeKey);
         }
 
-        quad.rebuild();
+        std::string navCache = ChangeFileExtension(mapFile.c_str(), ".nav");
+        u64 navKey = navMesh.getCacheKey(PolygonMesh::getCacheKey(map.getCollisionHash()));
+        if (!navMesh.loadCache(navCache.c_str(), navKey))
+        {
+            if (polygonMesh.getPolygonCount() == 0) AddMapSurfaces(map, polygonMesh);
+            navMesh.build(polygonMesh, &quad);
+            navMesh.saveCache(navCache.c_str(), navKey);
+        }
+        navMesh.stats();
 
         world.setCollisionSelector(&quad);
         world.setScene(&scene);
+        sight.setWorld(&quad, &map);
 
 
         float blend = 0.5f;
@@ -384,6 +455,10 @@ struct MainScreen : public Screen
 
 
         player.transform.SetLocalScale(Vector3{ 0.6f, 0.6f, 0.6f });
+
+        // A câmara é empurrada pelo NPC, que está parado (massa 0)
+        cameraCharacter = characters.add(camera.GetPosition(), camera.ellipsoidRadius.x, camera.ellipsoidRadius.y);
+        npcCharacter = characters.add(NpcCapsuleCenter(player.transform), NPC_RADIUS, NPC_HALF_HEIGHT, 0.0f);
     }
     void OnEnter() override { LogInfo("Entrou em %s", name.c_str()); }
     void OnExit() override { LogInfo("Saiu de %s", name.c_str()); }
@@ -393,8 +468,65 @@ struct MainScreen : public Screen
         if (IsKeyDown(KEY_I)) blend -= 0.01f;
 
 
+        // F9 liga/desliga a gravação do movimento (bench/movement_replay)
+        if (IsKeyPressed(KEY_F9))
+        {
+            if (camera.GetTrace())
+            {
+                camera.SetTrace(nullptr);
+                moveTrace.save(ChangeFileExtension(mapFile.c_str(), ".trace").c_str(), map.getContentHash());
+            }
+            else
+            {
+                moveTrace.clear();
+                camera.SetTrace(&moveTrace);
+            }
+        }
+
+        // F10 mostra a malha de navegação e o caminho até ao NPC
+        if (IsKeyPressed(KEY_F10))
+        {
+            showNavMesh = !showNavMesh;
+            navPathDirty = true;
+        }
+
+        // F8 ressuscita o NPC; a cápsula saiu do CharacterSet no Kill
+        if (IsKeyPressed(KEY_F8) && !player.IsActive())
+        {
+            player.Respawn();
+            npcCharacter = characters.add(NpcCapsuleCenter(player.transform), NPC_RADIUS, NPC_HALF_HEIGHT, 0.0f);
+        }
+
         camera.Update(dt, world);
         player.Update(dt);
+
+        characters.setPosition(cameraCharacter, camera.GetPosition());
+        if (player.IsActive()) characters.setPosition(npcCharacter, NpcCapsuleCenter(player.transform));
+        characters.resolve(&world);
+        camera.SetPosition(characters.getPosition(cameraCharacter));
+
+        if (showNavMesh)
+        {
+            Vector3 start = camera.camera.position;
+            Vector3 goal = player.transform.GetWorldPosition();
+            if (navPathDirty ||
+                Vector3DistanceSqr(start, navPathStart) > NAV_PATH_REPATH * NAV_PATH_REPATH ||
+                Vector3DistanceSqr(goal, navPathGoal) > NAV_PATH_REPATH * NAV_PATH_REPATH)
+            {
+                navPathFound = navMesh.findPath(start, goal, navPath);
+                navPathStart = start;
+                navPathGoal = goal;
+                navPathDirty = false;
+            }
+        }
+
+        // Agente 0 é a câmara, 1 o NPC; o resultado pode ter uns frames
+        Vector3 eye = camera.camera.position;
+        sight.setAgent(0, eye, Vector3Normalize(Vector3Subtract(camera.camera.target, eye)));
+        sight.setAgent(1, Vector3Add(player.transform.GetWorldPosition(), { 0.0f, 2.0f, 0.0f }),
+                       player.transform.GetForward());
+        npcSeesPlayer = sight.query(1, 0).visible;
+        sight.update(dt);
         shockWave.Update(dt);
         muzzleFlash.Update(dt);
         particleSystem.Update(dt);
@@ -419,7 +551,13 @@ struct MainScreen : public Screen
         SetShaderValue(mapShader, blendLoc, &blend, SHADER_UNIFORM_FLOAT);
         map.render(frustum, mapShader);
 
-        scene.Render();
+        scene.Render(frustum);
+
+        if (showNavMesh)
+        {
+            navMesh.debug();
+            if (navPathFound) navMesh.debugPath(navPath);
+        }
 
 
         int w = GetScreenWidth() / 2;
@@ -448,19 +586,12 @@ struct MainScreen : public Screen
         if (IsKeyDown(KEY_M))
         {
             Ray pick = GetMouseRay(GetMousePosition(), camera.camera);
-            std::vector<const Triangle*> tris =
-                quad.getCandidates(pick, 1000.0f);
-
-            for (const Triangle* tri : tris)
+            RayHit status = quad.raycast(pick, 100.0f);
+            if (status.hit)
             {
-                RayCollision status = GetRayCollisionTriangle(
-                    ray, tri->pointA, tri->pointB, tri->pointC);
-                if (status.hit && status.distance < 100)
-                {
-                    DrawSphere(status.point, 0.1f, RED);
-                    LogInfo("Picked: %f %f %f", status.point.x, status.point.y,
-                            status.point.z);
-                }
+                DrawSphere(status.point, 0.1f, RED);
+                LogInfo("Picked: %f %f %f", status.point.x, status.point.y,
+                        status.point.z);
             }
         }
 
@@ -490,8 +621,9 @@ struct MainScreen : public Screen
 
             if (player.pick(ray))
             {
-               
+                // Morto já não bloqueia a câmara
                 player.Kill();
+                characters.remove(npcCharacter);
             }
 
 
@@ -522,33 +654,12 @@ struct MainScreen : public Screen
             }
 
 
-            float closestDistance = FLT_MAX;
-            const Triangle* closestTri = nullptr;
-            RayCollision closestHit = { 0 };
-            std::vector<const Triangle*> tris =quad.getCandidates(ray, 1000.0f);
+            // Os tiros passam grelhas, clips, água e nevoeiro
+            RayHit closestHit = quad.raycast(ray, 1000.0f, nullptr, MASK_SHOT);
 
-            // Encontra o triângulo mais próximo
-            for (const Triangle* tri : tris)
+            if (closestHit.hit)
             {
-                RayCollision status = GetRayCollisionTriangle(
-                    ray, tri->pointA, tri->pointB, tri->pointC);
-                if (status.hit && status.distance < closestDistance)
-                {
-                    closestDistance = status.distance;
-                    closestTri = tri;
-                    closestHit = status;
-                }
-            }
-
-            if (closestTri)
-            {
-                if (Vector3DotProduct(closestHit.normal, ray.direction) > 0)
-                {
-                    closestHit.normal = Vector3Negate(closestHit.normal);
-                }
-
-
-                decals.AddDecal(closestHit.point, closestHit.normal, closestTri,
+                decals.AddDecal(closestHit.point, closestHit.normal, closestHit.triangle,
                                 decal, 0.2f, WHITE);
 
                 particleSystem.EmitBulletImpact(closestHit.point,
@@ -622,6 +733,29 @@ struct MainScreen : public Screen
                  DARKGRAY);
         DrawText(TextFormat("Frame: %d", animator->GetFrame()), 10, 100, 16,
                  DARKGRAY);
+        DrawText(npcSeesPlayer ? "NPC: sees you" : "NPC: -", 160, 100, 16, DARKGRAY);
+
+#ifdef COLLISION_STATS
+        // Contadores de colisão do frame anterior
+        const CollisionCounters& stats = GetCollisionFrameStats();
+        DrawText(TextFormat("Moves: %u  slides: %u  depth: %u  %.2f ms", (u32)stats.moves,
+                            (u32)stats.collideCalls, stats.maxRecursion, stats.moveTime),
+                 10, 170, 16, DARKGRAY);
+        DrawText(TextFormat("Queries: %u  nodes: %u  candidates: %u  dup: %u  %.2f ms",
+                            (u32)stats.queries, (u32)stats.nodesVisited, (u32)stats.candidates,
+                            (u32)stats.duplicates, stats.queryTime),
+                 10, 190, 16, DARKGRAY);
+        DrawText(TextFormat("Triangle tests: %u  polygons: %u  cache hits: %u  misses: %u  ground: %u/%u",
+                            (u32)stats.triangleTests, (u32)stats.polygonTests,
+                            (u32)stats.cacheHits, (u32)stats.cacheMisses,
+                            (u32)stats.groundProbes, (u32)stats.gravitySweeps),
+                 10, 210, 16, DARKGRAY);
+        const CharacterStats& characterStats = characters.getStats();
+        DrawText(TextFormat("Characters: %u  pairs: %u  overlaps: %u  resolved: %u  %.3f ms",
+                            characterStats.characters, characterStats.pairs, characterStats.overlaps,
+                            characterStats.resolved, characterStats.time),
+                 10, 230, 16, DARKGRAY);
+#endif
 
 
         if (IsCursorHidden())
@@ -690,6 +824,8 @@ int main()
 
         DrawFPS(10, 10);
         EndDrawing();
+
+        CollisionStatsEndFrame();
     }
 
     scene.Clear();
@@ -0,0 +1,79 @@
+#include "movetrace.hpp"
+#include "binaryfile.hpp"
+
+// Layout: MoveTraceHeader e count MoveRecord tal como estão em memória
+
+#define MOVE_TRACE_MAGIC   0x5254564D  // "MVTR"
+#define MOVE_TRACE_VERSION 1
+
+struct MoveTraceHeader
+{
+    u32 magic;
+    u32 version;
+    u64 mapHash;
+    u32 count;
+    u32 recordSize;
+};
+
+void MoveTrace::add(const MoveRequest& request, const Vector3& position)
+{
+    records.push_back({ request, position });
+}
+
+bool MoveTrace::save(const char* filename, u64 mapHash) const
+{
+    MoveTraceHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MOVE_TRACE_MAGIC;
+    header.version = MOVE_TRACE_VERSION;
+    header.mapHash = mapHash;
+    header.count = (u32)records.size();
+    header.recordSize = (u32)sizeof(MoveRecord);
+
+    std::vector<u8> out(sizeof(header) + records.size() * sizeof(MoveRecord));
+    memcpy(out.data(), &header, sizeof(header));
+    if (!records.empty())
+    {
+        memcpy(out.data() + sizeof(header), records.data(), records.size() * sizeof(MoveRecord));
+    }
+
+    BinaryFile file;
+    if (!file.create(out.data(), (u32)out.size()) || !file.save(filename))
+    {
+        LogWarning("Move trace: could not write %s", filename);
+        return false;
+    }
+
+    LogInfo("Move trace saved: %s (%u moves)", filename, header.count);
+    return true;
+}
+
+bool MoveTrace::load(const char* filename, u64* mapHash)
+{
+    if (!FileExists(filename)) return false;
+
+    BinaryFile file;
+    if (!file.open(filename)) return false;
+
+    MoveTraceHeader header;
+    if (file.readBytes(&header, sizeof(header)) != sizeof(header) ||
+        header.magic != MOVE_TRACE_MAGIC || header.version != MOVE_TRACE_VERSION ||
+        header.recordSize != sizeof(MoveRecord) ||
+        (u64)header.count * sizeof(MoveRecord) != file.getFileSize() - sizeof(header))
+    {
+        LogWarning("Move trace: %s is not a valid trace", filename);
+        return false;
+    }
+
+    records.resize(header.count);
+    u32 bytes = header.count * (u32)sizeof(MoveRecord);
+    if (bytes && file.readBytes(records.data(), bytes) != bytes)
+    {
+        records.clear();
+        return false;
+    }
+
+    if (mapHash) *mapHash = header.mapHash;
+    LogInfo("Move trace loaded: %s (%u moves)", filename, header.count);
+    return true;
+}
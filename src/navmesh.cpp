@@ -0,0 +1,833 @@
+#include "navmesh.hpp"
+#include "polygonmesh.hpp"
+#include "binaryfile.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+
+#define NAVMESH_CACHE_MAGIC   0x4D56414E  // "NAVM"
+#define NAVMESH_CACHE_VERSION 1
+
+// Duas arestas formam um portal se em planta são paralelas (seno do ângulo),
+// estão na mesma reta (distância) e se sobrepõem pelo menos MIN_PORTAL_WIDTH
+static const float EDGE_PARALLEL_EPSILON = 1e-3f;
+static const float EDGE_DISTANCE_EPSILON = 0.05f;
+static const float MIN_PORTAL_WIDTH = 0.1f;
+// Células da grelha de arestas do build
+static const float EDGE_CELL_SIZE = 4.0f;
+
+namespace
+{
+    u64 CellKey(s32 x, s32 z)
+    {
+        return ((u64)(u32)x << 32) | (u32)z;
+    }
+
+    s32 CellCoord(float value, float cellSize)
+    {
+        return (s32)floorf(value / cellSize);
+    }
+
+    // Área (x2) com sinal em planta. Convenção dos portais: vistos de dentro
+    // do polígono de origem, TriArea2(origem, right, left) < 0
+    float TriArea2(const Vector3& a, const Vector3& b, const Vector3& c)
+    {
+        float abx = b.x - a.x, abz = b.z - a.z;
+        float acx = c.x - a.x, acz = c.z - a.z;
+        return acx * abz - abx * acz;
+    }
+
+    bool SameXZ(const Vector3& a, const Vector3& b)
+    {
+        float dx = a.x - b.x, dz = a.z - b.z;
+        return dx * dx + dz * dz < 1e-8f;
+    }
+
+    NavLink MakeLink(u32 target, const Vector3& from, const Vector3& a, const Vector3& b)
+    {
+        if (TriArea2(from, a, b) < 0.0f) return { target, b, a };
+        return { target, a, b };
+    }
+
+    // Scratch de um A* por thread: as marcas de geração evitam limpar os
+    // arrays entre queries (como QueryMarks)
+    struct NavSearch
+    {
+        std::vector<u32> stamps;    // == generation: nó já aberto nesta query
+        std::vector<u32> closed;    // == generation: nó já expandido
+        std::vector<float> cost;
+        std::vector<u32> parent;
+        std::vector<Vector3> position;
+        std::vector<std::pair<float, u32>> heap;
+        u32 generation{0};
+
+        void begin(size_t count)
+        {
+            if (stamps.size() < count)
+            {
+                stamps.resize(count, 0);
+                closed.resize(count, 0);
+                cost.resize(count);
+                parent.resize(count);
+                position.resize(count);
+            }
+            generation++;
+            if (generation == 0)
+            {
+                std::fill(stamps.begin(), stamps.end(), 0);
+                std::fill(closed.begin(), closed.end(), 0);
+                generation = 1;
+            }
+            heap.clear();
+        }
+
+        void push(u32 node, float f)
+        {
+            heap.push_back({ -f, node });
+            std::push_heap(heap.begin(), heap.end());
+        }
+
+        u32 pop()
+        {
+            std::pop_heap(heap.begin(), heap.end());
+            u32 node = heap.back().second;
+            heap.pop_back();
+            return node;
+        }
+
+        // Caminho de from até node pelos pais (from primeiro)
+        void trace(u32 from, u32 node, std::vector<u32>& out) const
+        {
+            out.clear();
+            for (;;)
+            {
+                out.push_back(node);
+                if (node == from) break;
+                node = parent[node];
+            }
+            std::reverse(out.begin(), out.end());
+        }
+    };
+
+    struct NavSearchContext
+    {
+        NavSearch regions;
+        NavSearch polygons;
+        std::vector<u32> corridor;
+        std::vector<u32> allowed;   // == allowedGeneration: região do corredor
+        u32 allowedGeneration{0};
+    };
+
+    NavSearchContext& GetNavSearch()
+    {
+        static thread_local NavSearchContext context;
+        return context;
+    }
+}
+
+
+static bool HasClearance(const Selector& world, const CollisionPolygon& polygon, const Vector3* points,
+                         const Vector3& center, float height)
+{
+    for (u32 i = 0; i <= polygon.pointCount; i++)
+    {
+        Vector3 origin = i == 0 ? center : Vector3Lerp(center, points[i - 1], 0.75f);
+        Ray up = { { origin.x, origin.y + 0.01f, origin.z }, { 0.0f, 1.0f, 0.0f } };
+        if (!world.raycast(up, height, nullptr, MASK_MOVEMENT).hit) return true;
+    }
+    return false;
+}
+
+
+void NavMesh::clear()
+{
+    polygons.clear();
+    vertices.clear();
+    links.clear();
+    regions.clear();
+    regionLinks.clear();
+    cells.clear();
+}
+
+void NavMesh::build(const PolygonMesh& mesh, const Selector* world, const NavMeshConfig& config)
+{
+    clear();
+    this->config = config;
+    const float minNormalY = cosf(config.maxSlope * DEG2RAD);
+
+    for (const CollisionPolygon& polygon : mesh.getPolygons())
+    {
+        if (!(polygon.layers & config.walkableLayers)) continue;
+        if (polygon.normal.y < minNormalY) continue;
+
+        const Vector3* points = mesh.getPoints(polygon);
+        Vector3 center = { 0.0f, 0.0f, 0.0f };
+        for (u32 i = 0; i < polygon.pointCount; i++) center = Vector3Add(center, points[i]);
+        center = Vector3Scale(center, 1.0f / (float)polygon.pointCount);
+
+        // Tem de caber um agente de pé em algum sítio do polígono: testa o
+        // centro e pontos a caminho de cada vértice (um chão grande meio
+        // tapado por uma ponte continua a ligar as duas pontas)
+        if (world && !HasClearance(*world, polygon, points, center, config.agentHeight)) continue;
+
+        NavPolygon nav;
+        nav.firstVertex = (u32)vertices.size();
+        nav.vertexCount = polygon.pointCount;
+        nav.firstLink = 0;
+        nav.linkCount = 0;
+        nav.region = 0;
+        nav.center = center;
+        nav.normal = polygon.normal;
+        nav.planeD = polygon.planeD;
+        nav.bounds = polygon.bounds;
+        vertices.insert(vertices.end(), points, points + polygon.pointCount);
+        polygons.push_back(nav);
+    }
+
+    // Arestas por célula em planta; só as que partilham uma célula são comparadas
+    std::vector<u32> owner(vertices.size());
+    std::unordered_map<u64, std::vector<u32>> edgeCells;
+    for (u32 p = 0; p < (u32)polygons.size(); p++)
+    {
+        const NavPolygon& polygon = polygons[p];
+        for (u32 k = 0; k < polygon.vertexCount; k++)
+        {
+            u32 edge = polygon.firstVertex + k;
+            owner[edge] = p;
+            const Vector3& a = vertices[edge];
+            const Vector3& b = vertices[polygon.firstVertex + (k + 1) % polygon.vertexCount];
+            s32 x0 = CellCoord(fminf(a.x, b.x), EDGE_CELL_SIZE), x1 = CellCoord(fmaxf(a.x, b.x), EDGE_CELL_SIZE);
+            s32 z0 = CellCoord(fminf(a.z, b.z), EDGE_CELL_SIZE), z1 = CellCoord(fmaxf(a.z, b.z), EDGE_CELL_SIZE);
+            for (s32 x = x0; x <= x1; x++)
+                for (s32 z = z0; z <= z1; z++)
+                {
+                    edgeCells[CellKey(x, z)].push_back(edge);
+                }
+        }
+    }
+
+    std::vector<u64> pairs;
+    for (const auto& entry : edgeCells)
+    {
+        const std::vector<u32>& list = entry.second;
+        for (size_t i = 0; i < list.size(); i++)
+            for (size_t j = i + 1; j < list.size(); j++)
+            {
+                if (owner[list[i]] == owner[list[j]]) continue;
+                u32 lo = std::min(list[i], list[j]), hi = std::max(list[i], list[j]);
+                pairs.push_back(((u64)lo << 32) | hi);
+            }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+    auto edgeEnd = [&](u32 edge)
+    {
+        const NavPolygon& polygon = polygons[owner[edge]];
+        return vertices[polygon.firstVertex + (edge - polygon.firstVertex + 1) % polygon.vertexCount];
+    };
+
+    std::vector<std::vector<NavLink>> polygonLinks(polygons.size());
+    auto addLink = [&](u32 from, const NavLink& link)
+    {
+        // Um portal por par: fica o mais largo
+        for (NavLink& existing : polygonLinks[from])
+        {
+            if (existing.target != link.target) continue;
+            if (Vector3Distance(link.left, link.right) > Vector3Distance(existing.left, existing.right)) existing = link;
+            return;
+        }
+        polygonLinks[from].push_back(link);
+    };
+
+    for (u64 pair : pairs)
+    {
+        u32 e1 = (u32)(pair >> 32), e2 = (u32)pair;
+        u32 p = owner[e1], q = owner[e2];
+        const Vector3 a = vertices[e1], b = edgeEnd(e1);
+        const Vector3 c = vertices[e2], d = edgeEnd(e2);
+
+        float dx = b.x - a.x, dz = b.z - a.z;
+        float length = sqrtf(dx * dx + dz * dz);
+        float ex = d.x - c.x, ez = d.z - c.z;
+        float otherLength = sqrtf(ex * ex + ez * ez);
+        if (length < MIN_PORTAL_WIDTH || otherLength < MIN_PORTAL_WIDTH) continue;
+
+        float ux = dx / length, uz = dz / length;
+        if (fabsf(ux * ez - uz * ex) > EDGE_PARALLEL_EPSILON * otherLength) continue;
+        if (fabsf((c.x - a.x) * -uz + (c.z - a.z) * ux) > EDGE_DISTANCE_EPSILON) continue;
+        if (fabsf((d.x - a.x) * -uz + (d.z - a.z) * ux) > EDGE_DISTANCE_EPSILON) continue;
+
+        // Sobreposição ao longo de a-b
+        float tc = (c.x - a.x) * ux + (c.z - a.z) * uz;
+        float td = (d.x - a.x) * ux + (d.z - a.z) * uz;
+        float lo = fmaxf(0.0f, fminf(tc, td));
+        float hi = fminf(length, fmaxf(tc, td));
+        if (hi - lo < MIN_PORTAL_WIDTH) continue;
+
+        // Um de cada lado da aresta (e não dois andares um por cima do outro)
+        const Vector3& pc = polygons[p].center;
+        const Vector3& qc = polygons[q].center;
+        float sideP = (pc.x - a.x) * -uz + (pc.z - a.z) * ux;
+        float sideQ = (qc.x - a.x) * -uz + (qc.z - a.z) * ux;
+        if (sideP * sideQ >= 0.0f) continue;
+
+        auto onFirst = [&](float t) { return Vector3Lerp(a, b, t / length); };
+        auto onSecond = [&](float t) { return Vector3Lerp(c, d, (t - tc) / (td - tc)); };
+        Vector3 p0 = onFirst(lo), p1 = onFirst(hi);
+        Vector3 q0 = onSecond(lo), q1 = onSecond(hi);
+        if (fabsf(p0.y - q0.y) > config.stepHeight || fabsf(p1.y - q1.y) > config.stepHeight) continue;
+
+        addLink(p, MakeLink(q, pc, p0, p1));
+        addLink(q, MakeLink(p, qc, q0, q1));
+    }
+
+    for (u32 p = 0; p < (u32)polygons.size(); p++)
+    {
+        polygons[p].firstLink = (u32)links.size();
+        polygons[p].linkCount = (u32)polygonLinks[p].size();
+        links.insert(links.end(), polygonLinks[p].begin(), polygonLinks[p].end());
+    }
+
+    buildRegions();
+    buildCells();
+}
+
+void NavMesh::buildRegions()
+{
+    const u32 NONE = 0xFFFFFFFF;
+    regions.clear();
+    regionLinks.clear();
+    for (NavPolygon& polygon : polygons) polygon.region = NONE;
+
+    // Flood fill em largura a partir de cada polígono ainda sem região, até
+    // regionSize polígonos: regiões ligadas por dentro e mais ou menos redondas
+    std::vector<u32> queue;
+    for (u32 seed = 0; seed < (u32)polygons.size(); seed++)
+    {
+        if (polygons[seed].region != NONE) continue;
+
+        u32 id = (u32)regions.size();
+        queue.clear();
+        queue.push_back(seed);
+        polygons[seed].region = id;
+        for (size_t head = 0; head < queue.size(); head++)
+        {
+            const NavPolygon& polygon = polygons[queue[head]];
+            for (u32 k = 0; k < polygon.linkCount && queue.size() < config.regionSize; k++)
+            {
+                u32 target = links[polygon.firstLink + k].target;
+                if (polygons[target].region != NONE) continue;
+                polygons[target].region = id;
+                queue.push_back(target);
+            }
+        }
+
+        Vector3 center = { 0.0f, 0.0f, 0.0f };
+        for (u32 p : queue) center = Vector3Add(center, polygons[p].center);
+        regions.push_back({ Vector3Scale(center, 1.0f / (float)queue.size()), 0, 0 });
+    }
+
+    std::vector<std::vector<NavRegionLink>> perRegion(regions.size());
+    for (const NavPolygon& polygon : polygons)
+    {
+        for (u32 k = 0; k < polygon.linkCount; k++)
+        {
+            u32 from = polygon.region;
+            u32 to = polygons[links[polygon.firstLink + k].target].region;
+            if (from == to) continue;
+
+            std::vector<NavRegionLink>& list = perRegion[from];
+            bool known = false;
+            for (const NavRegionLink& link : list) known = known || link.target == to;
+            if (!known) list.push_back({ to, Vector3Distance(regions[from].center, regions[to].center) });
+        }
+    }
+
+    for (u32 r = 0; r < (u32)regions.size(); r++)
+    {
+        regions[r].firstLink = (u32)regionLinks.size();
+        regions[r].linkCount = (u32)perRegion[r].size();
+        regionLinks.insert(regionLinks.end(), perRegion[r].begin(), perRegion[r].end());
+    }
+}
+
+void NavMesh::buildCells()
+{
+    cells.clear();
+    for (u32 p = 0; p < (u32)polygons.size(); p++)
+    {
+        const BoundingBox& bounds = polygons[p].bounds;
+        s32 x0 = CellCoord(bounds.min.x, cellSize), x1 = CellCoord(bounds.max.x, cellSize);
+        s32 z0 = CellCoord(bounds.min.z, cellSize), z1 = CellCoord(bounds.max.z, cellSize);
+        for (s32 x = x0; x <= x1; x++)
+            for (s32 z = z0; z <= z1; z++)
+            {
+                cells[CellKey(x, z)].push_back(p);
+            }
+    }
+}
+
+
+s32 NavMesh::findPolygon(const Vector3& point, float maxDrop) const
+{
+    if (maxDrop < 0.0f) maxDrop = config.agentHeight;
+
+    auto it = cells.find(CellKey(CellCoord(point.x, cellSize), CellCoord(point.z, cellSize)));
+    if (it == cells.end()) return -1;
+
+    // O mais alto dos que estão por baixo (ou até um degrau acima)
+    s32 best = -1;
+    float bestY = -FLT_MAX;
+    for (u32 p : it->second)
+    {
+        const NavPolygon& polygon = polygons[p];
+        if (point.x < polygon.bounds.min.x - 0.01f || point.x > polygon.bounds.max.x + 0.01f ||
+            point.z < polygon.bounds.min.z - 0.01f || point.z > polygon.bounds.max.z + 0.01f)
+        {
+            continue;
+        }
+
+        // Dentro em planta: o ponto fica do mesmo lado de todas as arestas
+        bool negative = false, positive = false;
+        for (u32 k = 0; k < polygon.vertexCount; k++)
+        {
+            const Vector3& a = vertices[polygon.firstVertex + k];
+            const Vector3& b = vertices[polygon.firstVertex + (k + 1) % polygon.vertexCount];
+            float area = TriArea2(a, b, point);
+            negative = negative || area < -1e-4f;
+            positive = positive || area > 1e-4f;
+        }
+        if (negative && positive) continue;
+
+        float y = -(polygon.normal.x * point.x + polygon.normal.z * point.z + polygon.planeD) / polygon.normal.y;
+        if (y > point.y + config.stepHeight || y < point.y - maxDrop) continue;
+        if (y > bestY)
+        {
+            bestY = y;
+            best = (s32)p;
+        }
+    }
+    return best;
+}
+
+const NavLink* NavMesh::findLink(u32 from, u32 to) const
+{
+    const NavPolygon& polygon = polygons[from];
+    for (u32 k = 0; k < polygon.linkCount; k++)
+    {
+        if (links[polygon.firstLink + k].target == to) return &links[polygon.firstLink + k];
+    }
+    return nullptr;
+}
+
+bool NavMesh::searchRegions(u32 from, u32 to, std::vector<u32>& corridor, u32& expanded) const
+{
+    NavSearch& search = GetNavSearch().regions;
+    search.begin(regions.size());
+
+    const Vector3& goal = regions[to].center;
+    search.stamps[from] = search.generation;
+    search.cost[from] = 0.0f;
+    search.parent[from] = from;
+    search.push(from, Vector3Distance(regions[from].center, goal));
+
+    while (!search.heap.empty())
+    {
+        u32 node = search.pop();
+        if (search.closed[node] == search.generation) continue;
+        search.closed[node] = search.generation;
+        expanded++;
+
+        if (node == to)
+        {
+            search.trace(from, to, corridor);
+            return true;
+        }
+
+        const NavRegion& region = regions[node];
+        for (u32 k = 0; k < region.linkCount; k++)
+        {
+            const NavRegionLink& link = regionLinks[region.firstLink + k];
+            if (search.closed[link.target] == search.generation) continue;
+
+            float cost = search.cost[node] + link.cost;
+            if (search.stamps[link.target] == search.generation && cost >= search.cost[link.target]) continue;
+
+            search.stamps[link.target] = search.generation;
+            search.cost[link.target] = cost;
+            search.parent[link.target] = node;
+            search.push(link.target, cost + Vector3Distance(regions[link.target].center, goal));
+        }
+    }
+    return false;
+}
+
+bool NavMesh::searchPolygons(u32 from, u32 to, const Vector3& start, const Vector3& goal,
+                             const std::vector<u32>* regionsAllowed, std::vector<u32>& out, u32& expanded) const
+{
+    NavSearchContext& context = GetNavSearch();
+    NavSearch& search = context.polygons;
+    search.begin(polygons.size());
+
+    // Cada nó fica no meio do portal por onde se entrou (o de partida em start)
+    search.stamps[from] = search.generation;
+    search.cost[from] = 0.0f;
+    search.parent[from] = from;
+    search.position[from] = start;
+    search.push(from, Vector3Distance(start, goal));
+
+    while (!search.heap.empty())
+    {
+        u32 node = search.pop();
+        if (search.closed[node] == search.generation) continue;
+        search.closed[node] = search.generation;
+        expanded++;
+
+        if (node == to)
+        {
+            search.trace(from, to, out);
+            return true;
+        }
+
+        const NavPolygon& polygon = polygons[node];
+        for (u32 k = 0; k < polygon.linkCount; k++)
+        {
+            const NavLink& link = links[polygon.firstLink + k];
+            u32 target = link.target;
+            if (search.closed[target] == search.generation) continue;
+            if (regionsAllowed && (*regionsAllowed)[polygons[target].region] != context.allowedGeneration) continue;
+
+            Vector3 entry = Vector3Scale(Vector3Add(link.left, link.right), 0.5f);
+            float cost = search.cost[node] + Vector3Distance(search.position[node], entry);
+            float remaining = Vector3Distance(entry, goal);
+            if (target == to) cost += remaining;
+            if (search.stamps[target] == search.generation && cost >= search.cost[target]) continue;
+
+            search.stamps[target] = search.generation;
+            search.cost[target] = cost;
+            search.parent[target] = node;
+            search.position[target] = entry;
+            search.push(target, target == to ? cost : cost + remaining);
+        }
+    }
+    return false;
+}
+
+// Funil (Simple Stupid Funnel): o caminho só dobra nos cantos dos portais
+void NavMesh::pullString(const Vector3& start, const Vector3& goal, const std::vector<u32>& corridor,
+                         std::vector<Vector3>& out) const
+{
+    out.clear();
+    out.push_back(start);
+
+    std::vector<NavLink> portals;
+    portals.reserve(corridor.size() + 1);
+    portals.push_back({ 0, start, start });
+    for (size_t i = 0; i + 1 < corridor.size(); i++)
+    {
+        const NavLink* link = findLink(corridor[i], corridor[i + 1]);
+        if (link) portals.push_back(*link);
+    }
+    portals.push_back({ 0, goal, goal });
+
+    Vector3 apex = start, portalLeft = start, portalRight = start;
+    size_t apexIndex = 0, leftIndex = 0, rightIndex = 0;
+    for (size_t i = 1; i < portals.size(); i++)
+    {
+        const Vector3& left = portals[i].left;
+        const Vector3& right = portals[i].right;
+
+        // Aperta o lado direito, ou o esquerdo passa a ser um canto
+        if (TriArea2(apex, portalRight, right) <= 0.0f)
+        {
+            if (SameXZ(apex, portalRight) || TriArea2(apex, portalLeft, right) > 0.0f)
+            {
+                portalRight = right;
+                rightIndex = i;
+            }
+            else
+            {
+                out.push_back(portalLeft);
+                apex = portalLeft;
+                apexIndex = leftIndex;
+                portalLeft = portalRight = apex;
+                leftIndex = rightIndex = apexIndex;
+                i = apexIndex;
+                continue;
+            }
+        }
+
+        if (TriArea2(apex, portalLeft, left) >= 0.0f)
+        {
+            if (SameXZ(apex, portalLeft) || TriArea2(apex, portalRight, left) < 0.0f)
+            {
+                portalLeft = left;
+                leftIndex = i;
+            }
+            else
+            {
+                out.push_back(portalRight);
+                apex = portalRight;
+                apexIndex = rightIndex;
+                portalLeft = portalRight = apex;
+                leftIndex = rightIndex = apexIndex;
+                i = apexIndex;
+                continue;
+            }
+        }
+    }
+
+    if (!SameXZ(out.back(), goal) || out.back().y != goal.y) out.push_back(goal);
+}
+
+bool NavMesh::findPath(const Vector3& start, const Vector3& goal, NavPath& out, bool hierarchical) const
+{
+    out.points.clear();
+    out.polygons.clear();
+    out.expanded = 0;
+
+    s32 from = findPolygon(start);
+    s32 to = findPolygon(goal);
+    if (from < 0 || to < 0) return false;
+
+    NavSearchContext& context = GetNavSearch();
+    const std::vector<u32>* allowed = nullptr;
+    if (hierarchical)
+    {
+        u32 regionFrom = polygons[from].region;
+        u32 regionTo = polygons[to].region;
+        context.corridor.assign(1, regionFrom);
+        if (regionFrom != regionTo && !searchRegions(regionFrom, regionTo, context.corridor, out.expanded))
+        {
+            return false;
+        }
+
+        // Só os polígonos das regiões do corredor
+        if (context.allowed.size() < regions.size()) context.allowed.resize(regions.size(), 0);
+        if (++context.allowedGeneration == 0)
+        {
+            std::fill(context.allowed.begin(), context.allowed.end(), 0);
+            context.allowedGeneration = 1;
+        }
+        for (u32 region : context.corridor) context.allowed[region] = context.allowedGeneration;
+        allowed = &context.allowed;
+    }
+
+    if (!searchPolygons((u32)from, (u32)to, start, goal, allowed, out.polygons, out.expanded))
+    {
+        // As regiões são ligadas por dentro, por isso isto não devia falhar
+        if (!allowed || !searchPolygons((u32)from, (u32)to, start, goal, nullptr, out.polygons, out.expanded))
+        {
+            return false;
+        }
+    }
+
+    pullString(start, goal, out.polygons, out.points);
+    return true;
+}
+
+void NavMesh::findPaths(const NavPathRequest* requests, NavPath* results, bool* found, u32 count,
+                        ThreadPool* pool) const
+{
+    auto run = [&](u32 begin, u32 end)
+    {
+        for (u32 i = begin; i < end; i++)
+        {
+            bool ok = findPath(requests[i].start, requests[i].goal, results[i]);
+            if (found) found[i] = ok;
+        }
+    };
+
+    if (pool)
+    {
+        pool->parallelFor(count, 4, run);
+    }
+    else
+    {
+        run(0, count);
+    }
+}
+
+
+// Cache em disco
+//
+// Layout: NavMeshCacheHeader e os arrays tal como estão em memória
+// (polígonos, vértices, portais, regiões, ligações entre regiões).
+
+struct NavMeshCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u64 key;
+    u32 polygonCount;
+    u32 vertexCount;
+    u32 linkCount;
+    u32 regionCount;
+    u32 regionLinkCount;
+    NavMeshConfig config;
+};
+
+template <typename T>
+static void PutArray(std::vector<u8>& out, const std::vector<T>& values)
+{
+    const u8* bytes = (const u8*)values.data();
+    out.insert(out.end(), bytes, bytes + values.size() * sizeof(T));
+}
+
+template <typename T>
+static bool ReadArray(BinaryFile& file, std::vector<T>& values, u32 count)
+{
+    values.resize(count);
+    u32 bytes = count * (u32)sizeof(T);
+    return bytes == 0 || file.readBytes(values.data(), bytes) == bytes;
+}
+
+u64 NavMesh::getCacheKey(u64 sourceHash, const NavMeshConfig& config) const
+{
+    const s32 version = NAVMESH_CACHE_VERSION;
+    const float params[] = { config.agentRadius, config.agentHeight, config.maxSlope, config.stepHeight,
+                             EDGE_PARALLEL_EPSILON, EDGE_DISTANCE_EPSILON, MIN_PORTAL_WIDTH };
+    const u32 flags[] = { config.walkableLayers, config.regionSize };
+
+    u64 hash = HashFNV1a(&sourceHash, sizeof(sourceHash));
+    hash = HashFNV1a(&version, sizeof(version), hash);
+    hash = HashFNV1a(params, sizeof(params), hash);
+    return HashFNV1a(flags, sizeof(flags), hash);
+}
+
+bool NavMesh::saveCache(const char* filename, u64 key) const
+{
+    NavMeshCacheHeader header;
+    memset((void*)&header, 0, sizeof(header));
+    header.magic = NAVMESH_CACHE_MAGIC;
+    header.version = NAVMESH_CACHE_VERSION;
+    header.key = key;
+    header.polygonCount = (u32)polygons.size();
+    header.vertexCount = (u32)vertices.size();
+    header.linkCount = (u32)links.size();
+    header.regionCount = (u32)regions.size();
+    header.regionLinkCount = (u32)regionLinks.size();
+    header.config = config;
+
+    std::vector<u8> out((const u8*)&header, (const u8*)&header + sizeof(header));
+    PutArray(out, polygons);
+    PutArray(out, vertices);
+    PutArray(out, links);
+    PutArray(out, regions);
+    PutArray(out, regionLinks);
+
+    BinaryFile file;
+    if (!file.create(out.data(), (u32)out.size()) || !file.save(filename))
+    {
+        LogWarning("Nav mesh cache: could not write %s", filename);
+        return false;
+    }
+
+    LogInfo("Nav mesh cache saved: %s (%u polygons, %u regions, %u bytes)",
+            filename, header.polygonCount, header.regionCount, (u32)out.size());
+    return true;
+}
+
+bool NavMesh::loadCache(const char* filename, u64 key)
+{
+    if (!FileExists(filename)) return false;
+
+    BinaryFile file;
+    if (!file.open(filename)) return false;
+
+    NavMeshCacheHeader header;
+    if (file.readBytes(&header, sizeof(header)) != sizeof(header)) return false;
+    if (header.magic != NAVMESH_CACHE_MAGIC || header.version != NAVMESH_CACHE_VERSION || header.key != key)
+    {
+        LogWarning("Nav mesh cache: %s is stale, rebuilding", filename);
+        return false;
+    }
+
+    u64 expected = sizeof(header) + (u64)header.polygonCount * sizeof(NavPolygon)
+                 + (u64)header.vertexCount * sizeof(Vector3) + (u64)header.linkCount * sizeof(NavLink)
+                 + (u64)header.regionCount * sizeof(NavRegion) + (u64)header.regionLinkCount * sizeof(NavRegionLink);
+    if (expected != file.getFileSize())
+    {
+        LogWarning("Nav mesh cache: %s is corrupt, rebuilding", filename);
+        return false;
+    }
+
+    // Lê para temporários e só troca no fim, depois de validar os índices
+    std::vector<NavPolygon> loadedPolygons;
+    std::vector<Vector3> loadedVertices;
+    std::vector<NavLink> loadedLinks;
+    std::vector<NavRegion> loadedRegions;
+    std::vector<NavRegionLink> loadedRegionLinks;
+    bool valid = ReadArray(file, loadedPolygons, header.polygonCount) &&
+                 ReadArray(file, loadedVertices, header.vertexCount) &&
+                 ReadArray(file, loadedLinks, header.linkCount) &&
+                 ReadArray(file, loadedRegions, header.regionCount) &&
+                 ReadArray(file, loadedRegionLinks, header.regionLinkCount);
+
+    for (const NavPolygon& polygon : loadedPolygons)
+    {
+        valid = valid && polygon.vertexCount >= 3 &&
+                (u64)polygon.firstVertex + polygon.vertexCount <= header.vertexCount &&
+                (u64)polygon.firstLink + polygon.linkCount <= header.linkCount &&
+                polygon.region < header.regionCount && polygon.normal.y > 0.0f;
+    }
+    for (const NavLink& link : loadedLinks) valid = valid && link.target < header.polygonCount;
+    for (const NavRegion& region : loadedRegions)
+    {
+        valid = valid && (u64)region.firstLink + region.linkCount <= header.regionLinkCount;
+    }
+    for (const NavRegionLink& link : loadedRegionLinks) valid = valid && link.target < header.regionCount;
+    if (!valid)
+    {
+        LogWarning("Nav mesh cache: %s is corrupt, rebuilding", filename);
+        return false;
+    }
+
+    config = header.config;
+    polygons.swap(loadedPolygons);
+    vertices.swap(loadedVertices);
+    links.swap(loadedLinks);
+    regions.swap(loadedRegions);
+    regionLinks.swap(loadedRegionLinks);
+    buildCells();
+
+    LogInfo("Nav mesh cache loaded: %s (%u polygons, %u regions)", filename, header.polygonCount, header.regionCount);
+    return true;
+}
+
+
+void NavMesh::debug() const
+{
+    const Color regionColors[6] = { GREEN, YELLOW, ORANGE, PURPLE, SKYBLUE, PINK };
+    for (const NavPolygon& polygon : polygons)
+    {
+        Color color = regionColors[polygon.region % 6];
+        for (u32 k = 0; k < polygon.vertexCount; k++)
+        {
+            Vector3 a = vertices[polygon.firstVertex + k];
+            Vector3 b = vertices[polygon.firstVertex + (k + 1) % polygon.vertexCount];
+            a.y += 0.05f;
+            b.y += 0.05f;
+            DrawLine3D(a, b, color);
+        }
+    }
+}
+
+void NavMesh::debugPath(const NavPath& path) const
+{
+    for (size_t i = 0; i + 1 < path.points.size(); i++)
+    {
+        DrawLine3D(path.points[i], path.points[i + 1], RED);
+        DrawSphere(path.points[i + 1], 0.15f, RED);
+    }
+}
+
+void NavMesh::stats() const
+{
+    size_t memory = polygons.capacity() * sizeof(NavPolygon) + vertices.capacity() * sizeof(Vector3) +
+                    links.capacity() * sizeof(NavLink) + regions.capacity() * sizeof(NavRegion) +
+                    regionLinks.capacity() * sizeof(NavRegionLink);
+    LogInfo("Nav mesh: %u polygons, %u vertices, %u portals, %u regions, %u region links, %.1f KB",
+            (u32)polygons.size(), (u32)vertices.size(), (u32)links.size() / 2, (u32)regions.size(),
+            (u32)regionLinks.size() / 2, memory / 1024.0f);
+}
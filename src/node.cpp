@@ -1,5 +1,6 @@
  
 #include "node.hpp"
+#include "scene.hpp"
  
 
 
@@ -220,6 +221,7 @@ void Node3D::UpdateWorldTransform()
     rot = MatrixMultiply(rot, MatrixScale(1.0f / worldScale.x, 1.0f / worldScale.y, 1.0f / worldScale.z));
     worldRotation = QuaternionFromMatrix(rot);
 
+    OnTransformChanged();
     UpdateChildrenWorldTransform();
 }
 
@@ -232,10 +234,62 @@ void Node3D::UpdateChildrenWorldTransform()
 }
 
 
+CollisionMesh::CollisionMesh(const Model& model)
+{
+    // Não usa GetModelBoundingBox: aplica model.transform, que o Render
+    // deixa com a matriz da última instância desenhada
+    bounds = GetMeshBoundingBox(model.meshes[0]);
+    for (int i = 1; i < model.meshCount; i++)
+    {
+        BoundingBox b = GetMeshBoundingBox(model.meshes[i]);
+        bounds.min = Vector3Min(bounds.min, b.min);
+        bounds.max = Vector3Max(bounds.max, b.max);
+    }
+    tree.setWorldBounds(bounds);
+
+    for (int i = 0; i < model.meshCount; i++)
+    {
+        const Mesh& mesh = model.meshes[i];
+
+        for (int j = 0; j < mesh.triangleCount * 3; j += 3)
+        {
+            int i0 = mesh.indices[j + 0];
+            int i1 = mesh.indices[j + 1];
+            int i2 = mesh.indices[j + 2];
+
+            tree.addTriangle(
+                { mesh.vertices[i0 * 3 + 0], mesh.vertices[i0 * 3 + 1], mesh.vertices[i0 * 3 + 2] },
+                { mesh.vertices[i1 * 3 + 0], mesh.vertices[i1 * 3 + 1], mesh.vertices[i1 * 3 + 2] },
+                { mesh.vertices[i2 * 3 + 0], mesh.vertices[i2 * 3 + 1], mesh.vertices[i2 * 3 + 2] });
+        }
+    }
+
+    tree.rebuild();
+}
+
+std::shared_ptr<CollisionMesh> CollisionMesh::Get(const Model* model)
+{
+    static std::map<const Model*, std::weak_ptr<CollisionMesh>> meshes;
+
+    std::weak_ptr<CollisionMesh>& slot = meshes[model];
+    std::shared_ptr<CollisionMesh> mesh = slot.lock();
+    if (!mesh)
+    {
+        mesh = std::make_shared<CollisionMesh>(*model);
+        slot = mesh;
+    }
+    return mesh;
+}
+
+
 Model3D::Model3D(Model* model) : model(model)
 {
     color = WHITE;
-    bounds = GetMeshBoundingBox(model->meshes[0]); 
+    mesh = CollisionMesh::Get(model);
+    bounds = mesh->getBounds();
+    worldMatrix = GetWorldMatrix();
+    inverseWorldMatrix = MatrixInvert(worldMatrix);
+    updateWorldBounds();
 }
 
 Model3D::~Model3D() 
@@ -249,10 +303,6 @@ void Model3D::Render()
     if (!m_visible) return;
     this->model->transform = this->GetWorldMatrix();
 
-    world.min = Vector3Transform(this->bounds.min, this->model->transform);
-    world.max = Vector3Transform(this->bounds.max, this->model->transform);
-    
-
     for (int i = 0; i < model->meshCount; i++)
     {
         Color c = model->materials[model->meshMaterial[i]].maps[MATERIAL_MAP_DIFFUSE].color;
@@ -270,6 +320,51 @@ void Model3D::Render()
    // DrawBoundingBox(world, RED);
 }
 
+void Model3D::updateWorldBounds()
+{
+    // Caixa mundial pelos 8 cantos (a rotação pode trocar min/max)
+    Matrix mat = GetWorldMatrix();
+    world.min = { FLT_MAX, FLT_MAX, FLT_MAX };
+    world.max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (int i = 0; i < 8; i++)
+    {
+        Vector3 corner = {
+            (i & 1) ? bounds.max.x : bounds.min.x,
+            (i & 2) ? bounds.max.y : bounds.min.y,
+            (i & 4) ? bounds.max.z : bounds.min.z
+        };
+        corner = Vector3Transform(corner, mat);
+        world.min = Vector3Min(world.min, corner);
+        world.max = Vector3Max(world.max, corner);
+    }
+}
+
+void Model3D::OnTransformChanged()
+{
+    // Update() passa aqui todos os frames; só conta se a matriz mudou
+    Matrix mat = GetWorldMatrix();
+    if (worldMatrixValid && memcmp(&mat, &worldMatrix, sizeof(Matrix)) == 0) return;
+    bool moved = worldMatrixValid;
+    Vector3 oldCenter = Vector3Scale(Vector3Add(world.min, world.max), 0.5f);
+    worldMatrix = mat;
+    inverseWorldMatrix = MatrixInvert(mat);
+    worldMatrixValid = true;
+
+    updateWorldBounds();
+    if (scene)
+    {
+        Vector3 center = Vector3Scale(Vector3Add(world.min, world.max), 0.5f);
+        scene->UpdateNode(this, moved ? Vector3Subtract(center, oldCenter) : Vector3Zero());
+    }
+}
+
+void Model3D::SetVisible(bool visible)
+{
+    if (m_visible == visible) return;
+    m_visible = visible;
+    if (scene) scene->UpdateNode(this);
+}
+
 void Model3D::SetTexture(u32 index , Texture2D texture)
 {
     if (!model) return;
@@ -285,154 +380,83 @@ bool CheckCollisionPointBox(const Vector3& point, const BoundingBox& box)
             point.z >= box.min.z && point.z <= box.max.z);
 }
 
+// Triângulo local da malha partilhada para espaço mundo
+static Triangle TransformTriangle(const Triangle& local, const Matrix& mat)
+{
+    Triangle triangle = local;
+    triangle.pointA = Vector3Transform(local.pointA, mat);
+    triangle.pointB = Vector3Transform(local.pointB, mat);
+    triangle.pointC = Vector3Transform(local.pointC, mat);
+    triangle.updateBounds();
+    return triangle;
+}
+
+// Caixa mundo para espaço local (caixa dos 8 cantos transformados)
+static BoundingBox TransformBox(const BoundingBox& box, const Matrix& mat)
+{
+    BoundingBox out = { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+    for (int i = 0; i < 8; i++)
+    {
+        Vector3 corner = {
+            (i & 1) ? box.max.x : box.min.x,
+            (i & 2) ? box.max.y : box.min.y,
+            (i & 4) ? box.max.z : box.min.z
+        };
+        corner = Vector3Transform(corner, mat);
+        out.min = Vector3Min(out.min, corner);
+        out.max = Vector3Max(out.max, corner);
+    }
+    return out;
+}
+
 bool Model3D::collide(const Ray& ray, float maxDistance, PickData *data) 
 {
     if (!m_visible) return false;
-    PickData pickData;
-    pickData.collide = false;
-    pickData.node=nullptr;
-    
-    Matrix worldMat = GetWorldMatrix();
-    RayCollision collision = GetRayCollisionBox(ray, world);
 
-    
-    if (collision.hit && collision.distance <= maxDistance)
+    // Raio para espaço local; a escala muda o comprimento da direção,
+    // por isso as distâncias são convertidas à entrada e à saída
+    const Matrix& inv = inverseWorldMatrix;
+    Vector3 direction = {
+        inv.m0 * ray.direction.x + inv.m4 * ray.direction.y + inv.m8 * ray.direction.z,
+        inv.m1 * ray.direction.x + inv.m5 * ray.direction.y + inv.m9 * ray.direction.z,
+        inv.m2 * ray.direction.x + inv.m6 * ray.direction.y + inv.m10 * ray.direction.z
+    };
+    float scale = Vector3Length(direction);
+    if (scale <= 0.0f) return false;
+
+    Ray localRay = { Vector3Transform(ray.position, inv), Vector3Scale(direction, 1.0f / scale) };
+    RayHit hit = mesh->getTree().raycast(localRay, maxDistance * scale);
+    if (!hit.hit) return false;
+
+    if (data != nullptr)
     {
-        float closestDistance = maxDistance;
-        bool foundHit = false;
-        
-        for (int i = 0; i < model->meshCount; i++)
-        {
-            Mesh mesh = model->meshes[i];
-            
-            for (int j = 0; j < mesh.triangleCount * 3; j += 3)
-            {
-                int i0 = mesh.indices[j + 0];
-                int i1 = mesh.indices[j + 1];
-                int i2 = mesh.indices[j + 2];
-                
-                Triangle triangle;
-                triangle.pointA = {
-                    mesh.vertices[i0 * 3 + 0],
-                    mesh.vertices[i0 * 3 + 1],
-                    mesh.vertices[i0 * 3 + 2]
-                };
-                triangle.pointB = {
-                    mesh.vertices[i1 * 3 + 0],
-                    mesh.vertices[i1 * 3 + 1],
-                    mesh.vertices[i1 * 3 + 2]
-                };
-                triangle.pointC = {
-                    mesh.vertices[i2 * 3 + 0],
-                    mesh.vertices[i2 * 3 + 1],
-                    mesh.vertices[i2 * 3 + 2]
-                };
-                
-                // Transform triangle vertices to world space
-                triangle.pointA = Vector3Transform(triangle.pointA, worldMat);
-                triangle.pointB = Vector3Transform(triangle.pointB, worldMat);
-                triangle.pointC = Vector3Transform(triangle.pointC, worldMat);
-                triangle.updateBounds();
-                
-                // Test ray-triangle intersection
-                RayCollision triangleCollision = GetRayCollisionTriangle(ray, triangle.pointA, triangle.pointB, triangle.pointC);
-                
-                if (triangleCollision.hit && triangleCollision.distance <= closestDistance)
-                {
-                    closestDistance = triangleCollision.distance;
-                    foundHit = true;
-                    
-                
-                    pickData.intersectionPoint = triangleCollision.point;
-                    pickData.intersectionTriangle = triangle;
-                    pickData.triangleIndex = j / 3; // Convert back to triangle index
-                    pickData.triangleHits++;
-                    pickData.node = this;
-                }
-            }
-        }
-        
-        if (foundHit && data != nullptr)
-        {
-            data->collide = true;
-            data->intersectionPoint = pickData.intersectionPoint;
-            data->intersectionTriangle = pickData.intersectionTriangle;
-            data->triangleIndex = pickData.triangleIndex;
-            data->triangleHits = pickData.triangleHits;
-            data->node = pickData.node;
-        }
-        
-        return foundHit;
+        data->collide = true;
+        data->intersectionPoint = Vector3Add(ray.position, Vector3Scale(ray.direction, hit.distance / scale));
+        data->intersectionTriangle = TransformTriangle(*hit.triangle, worldMatrix);
+        data->triangleIndex = (s32)hit.triangle->id;
+        data->triangleHits = 1;
+        data->node = this;
     }
-    
-    return false;
-}
 
- void Model3D::buildTriangleCache() const
- {
-        cachedTriangles.clear();
-        Matrix worldMat = GetWorldMatrix();
-        
-        for (int i = 0; i < model->meshCount; i++)
-        {
-            Mesh mesh = model->meshes[i];
-            
-            for (int j = 0; j < mesh.triangleCount * 3; j += 3)
-            {
-                int i0 = mesh.indices[j + 0];
-                int i1 = mesh.indices[j + 1];
-                int i2 = mesh.indices[j + 2];
-                
-                Triangle triangle;
-                triangle.pointA = {
-                    mesh.vertices[i0 * 3 + 0],
-                    mesh.vertices[i0 * 3 + 1],
-                    mesh.vertices[i0 * 3 + 2]
-                };
-                triangle.pointB = {
-                    mesh.vertices[i1 * 3 + 0],
-                    mesh.vertices[i1 * 3 + 1],
-                    mesh.vertices[i1 * 3 + 2]
-                };
-                triangle.pointC = {
-                    mesh.vertices[i2 * 3 + 0],
-                    mesh.vertices[i2 * 3 + 1],
-                    mesh.vertices[i2 * 3 + 2]
-                };
-                
-                // Transform triangle vertices to world space
-                triangle.pointA = Vector3Transform(triangle.pointA, worldMat);
-                triangle.pointB = Vector3Transform(triangle.pointB, worldMat);
-                triangle.pointC = Vector3Transform(triangle.pointC, worldMat);
-                triangle.updateBounds();
-                
-                cachedTriangles.push_back(triangle);   
-            }
-        }
- }
+    return true;
+}
 
-bool Model3D::collectTriangles(const BoundingBox& area, std::vector<const Triangle*>& out) const
+bool Model3D::collectTriangles(const BoundingBox& area, std::vector<Triangle>& out) const
 {
-     if (!m_visible) return false;
-     if (!CheckCollisionBoxes(world, area)) return false;
-    
+    if (!m_visible) return false;
+    if (!CheckCollisionBoxes(world, area)) return false;
 
-        if (!trianglesCacheValid) 
-        {
-            buildTriangleCache();
-            trianglesCacheValid = true;
-        }
-        
-        
-        for (const Triangle& triangle : cachedTriangles) 
+    size_t start = out.size();
+    for (const Triangle* local : mesh->getTree().getCandidates(TransformBox(area, inverseWorldMatrix)))
+    {
+        Triangle triangle = TransformTriangle(*local, worldMatrix);
+        if (CheckCollisionBoxes(triangle.bounds, area))
         {
-            if (CheckCollisionBoxes(triangle.bounds, area)) 
-            {
-                out.push_back(&triangle);
-            }
+            out.push_back(triangle);
         }
-        
-        return !out.empty();
+    }
+
+    return out.size() > start;
 }
 
 bool Model3D::collide(const BoundingBox& area, PickData* data)
@@ -441,88 +465,42 @@ bool Model3D::collide(const BoundingBox& area, PickData* data)
     // First check if model's bounding box intersects with the area
     if (!CheckCollisionBoxes(world, area))
         return false;
-    
+
     PickData pickData;
+    pickData.collide = false;
+    pickData.triangleHits = 0;
     bool foundHit = false;
-    
-    for (int i = 0; i < model->meshCount; i++)
+
+    for (const Triangle* local : mesh->getTree().getCandidates(TransformBox(area, inverseWorldMatrix)))
     {
-        Mesh mesh = model->meshes[i];
-        
-        for (int j = 0; j < mesh.triangleCount * 3; j += 3)
+        Triangle triangle = TransformTriangle(*local, worldMatrix);
+        if (!CheckCollisionBoxes(triangle.bounds, area)) continue;
+
+        foundHit = true;
+        pickData.triangleHits++;
+
+        // Store first hit
+        if (!pickData.collide)
         {
-            int i0 = mesh.indices[j + 0];
-            int i1 = mesh.indices[j + 1];
-            int i2 = mesh.indices[j + 2];
-            
-            Triangle triangle;
-            triangle.pointA = {
-                mesh.vertices[i0 * 3 + 0],
-                mesh.vertices[i0 * 3 + 1],
-                mesh.vertices[i0 * 3 + 2]
+            Vector3 triangleCenter = {
+                (triangle.pointA.x + triangle.pointB.x + triangle.pointC.x) / 3.0f,
+                (triangle.pointA.y + triangle.pointB.y + triangle.pointC.y) / 3.0f,
+                (triangle.pointA.z + triangle.pointB.z + triangle.pointC.z) / 3.0f
             };
-            triangle.pointB = {
-                mesh.vertices[i1 * 3 + 0],
-                mesh.vertices[i1 * 3 + 1],
-                mesh.vertices[i1 * 3 + 2]
-            };
-            triangle.pointC = {
-                mesh.vertices[i2 * 3 + 0],
-                mesh.vertices[i2 * 3 + 1],
-                mesh.vertices[i2 * 3 + 2]
-            };
-            
-            // Transform triangle vertices to world space
-            triangle.pointA = Vector3Transform(triangle.pointA, this->GetWorldMatrix());
-            triangle.pointB = Vector3Transform(triangle.pointB, this->GetWorldMatrix());
-            triangle.pointC = Vector3Transform(triangle.pointC, this->GetWorldMatrix());
-            triangle.updateBounds();
-            
-            
-            // Check if any vertex of the triangle is inside the bounding box
-            // or if the triangle intersects with the bounding box
-            bool vertexInside = CheckCollisionPointBox(triangle.pointA, area) ||
-                               CheckCollisionPointBox(triangle.pointB, area) ||
-                               CheckCollisionPointBox(triangle.pointC, area);
-            
-            if (vertexInside || CheckCollisionBoxes(triangle.bounds, area))
-            {
-                foundHit = true;
-                pickData.triangleHits++;
-                
-                if (data != nullptr)
-                {
-                    // Store first hit or closest to center of area
-                    if (!pickData.collide)
-                    {
-                        // Vector3 areaCenter = {
-                        //     (area.min.x + area.max.x) * 0.5f,
-                        //     (area.min.y + area.max.y) * 0.5f,
-                        //     (area.min.z + area.max.z) * 0.5f
-                        // };
-                        
-                        Vector3 triangleCenter = {
-                            (triangle.pointA.x + triangle.pointB.x + triangle.pointC.x) / 3.0f,
-                            (triangle.pointA.y + triangle.pointB.y + triangle.pointC.y) / 3.0f,
-                            (triangle.pointA.z + triangle.pointB.z + triangle.pointC.z) / 3.0f
-                        };
-                        
-                        pickData.intersectionPoint = triangleCenter;
-                        pickData.intersectionTriangle = triangle;
-                        pickData.triangleIndex = j / 3;
-                        pickData.collide = true;
-                        pickData.node = this;
-                    }
-                }
-            }
+
+            pickData.intersectionPoint = triangleCenter;
+            pickData.intersectionTriangle = triangle;
+            pickData.triangleIndex = (s32)local->id;
+            pickData.collide = true;
+            pickData.node = this;
         }
     }
-    
+
     if (foundHit && data != nullptr)
     {
         *data = pickData;
     }
-    
+
     return foundHit;
 }
 
@@ -591,60 +569,32 @@ bool Model3D::collide(const Vector3& point, float radius, PickData *data)
     // First check if model's bounding box intersects with the sphere bounds
     if (!CheckCollisionBoxes(world, sphereBounds))
         return false;
-    
+
     PickData pickData;
+    pickData.triangleHits = 0;
     bool foundHit = false;
     float closestDistance = radius;
-    
-    for (int i = 0; i < model->meshCount; i++)
+
+    for (const Triangle* local : mesh->getTree().getCandidates(TransformBox(sphereBounds, inverseWorldMatrix)))
     {
-        Mesh mesh = model->meshes[i];
-        
-        for (int j = 0; j < mesh.triangleCount * 3; j += 3)
+        Triangle triangle = TransformTriangle(*local, worldMatrix);
+        if (!CheckCollisionBoxes(triangle.bounds, sphereBounds)) continue;
+
+        // Calculate closest point on triangle to the sphere center
+        Vector3 closestPoint = GetClosestPointOnTriangle(point, triangle.pointA, triangle.pointB, triangle.pointC);
+        float distance = Vector3Distance(point, closestPoint);
+
+        if (distance <= radius && distance < closestDistance)
         {
-            int i0 = mesh.indices[j + 0];
-            int i1 = mesh.indices[j + 1];
-            int i2 = mesh.indices[j + 2];
-            
-            Triangle triangle;
-            triangle.pointA = {
-                mesh.vertices[i0 * 3 + 0],
-                mesh.vertices[i0 * 3 + 1],
-                mesh.vertices[i0 * 3 + 2]
-            };
-            triangle.pointB = {
-                mesh.vertices[i1 * 3 + 0],
-                mesh.vertices[i1 * 3 + 1],
-                mesh.vertices[i1 * 3 + 2]
-            };
-            triangle.pointC = {
-                mesh.vertices[i2 * 3 + 0],
-                mesh.vertices[i2 * 3 + 1],
-                mesh.vertices[i2 * 3 + 2]
-            };
-            
-            // Transform triangle vertices to world space
-            triangle.pointA = Vector3Transform(triangle.pointA, this->GetWorldMatrix());
-            triangle.pointB = Vector3Transform(triangle.pointB, this->GetWorldMatrix());
-            triangle.pointC = Vector3Transform(triangle.pointC, this->GetWorldMatrix());
-            triangle.updateBounds();
-            
-            // Calculate closest point on triangle to the sphere center
-            Vector3 closestPoint = GetClosestPointOnTriangle(point, triangle.pointA, triangle.pointB, triangle.pointC);
-            float distance = Vector3Distance(point, closestPoint);
-            
-            if (distance <= radius && distance < closestDistance)
-            {
-                closestDistance = distance;
-                foundHit = true;
-                
-                pickData.intersectionPoint = closestPoint;
-                pickData.intersectionTriangle = triangle;
-                pickData.triangleIndex = j / 3;
-                pickData.triangleHits++;
-                pickData.collide = true;
-                pickData.node = this;
-            }
+            closestDistance = distance;
+            foundHit = true;
+
+            pickData.intersectionPoint = closestPoint;
+            pickData.intersectionTriangle = triangle;
+            pickData.triangleIndex = (s32)local->id;
+            pickData.triangleHits++;
+            pickData.collide = true;
+            pickData.node = this;
         }
     }
     
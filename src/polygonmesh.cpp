@@ -0,0 +1,289 @@
+#include "polygonmesh.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+#define POLYGON_MESH_VERSION 2
+
+// Dois triângulos estão no mesmo plano se as normais quase coincidem e os
+// vértices de um ficam a menos de PLANE_EPSILON do plano do outro
+static const float NORMAL_EPSILON = 1e-5f;
+static const float PLANE_EPSILON = 1e-3f;
+// Seno do ângulo abaixo do qual um canto conta como reto
+static const float STRAIGHT_EPSILON = 1e-5f;
+
+namespace
+{
+    struct Loop
+    {
+        std::vector<u32> vertices;
+        Vector3 normal;
+        float planeD;
+        u32 sourceTriangles;
+        u32 layers;
+        bool alive;
+    };
+
+    u64 EdgeKey(u32 from, u32 to)
+    {
+        return ((u64)from << 32) | to;
+    }
+
+    // Seno (com sinal, pela normal) da volta em b no caminho a -> b -> c
+    float Turn(const Vector3& a, const Vector3& b, const Vector3& c, const Vector3& normal)
+    {
+        Vector3 e1 = Vector3Subtract(b, a);
+        Vector3 e2 = Vector3Subtract(c, b);
+        float lengths = Vector3Length(e1) * Vector3Length(e2);
+        if (lengths <= 0.0f) return 0.0f;
+        return Vector3DotProduct(Vector3CrossProduct(e1, e2), normal) / lengths;
+    }
+}
+
+void PolygonMesh::addTriangle(const Vector3& a, const Vector3& b, const Vector3& c, u32 layers)
+{
+    input.push_back(a);
+    input.push_back(b);
+    input.push_back(c);
+    inputLayers.push_back(layers);
+}
+
+void PolygonMesh::clear()
+{
+    input.clear();
+    inputLayers.clear();
+    polygons.clear();
+    points.clear();
+    edgePlanes.clear();
+    firstTriangle.clear();
+    triangleCount = 0;
+}
+
+void PolygonMesh::build()
+{
+    polygons.clear();
+    points.clear();
+    edgePlanes.clear();
+    firstTriangle.clear();
+    triangleCount = 0;
+
+    // Solda os vértices pelos bits da posição (como CompactTriangles): só se
+    // juntam triângulos que partilham mesmo os dois pontos da aresta
+    struct Corner
+    {
+        u32 bits[3];
+        u32 slot;
+    };
+    std::vector<Corner> list(input.size());
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        memcpy(list[i].bits, &input[i], sizeof(list[i].bits));
+        list[i].slot = (u32)i;
+    }
+    std::sort(list.begin(), list.end(), [](const Corner& a, const Corner& b)
+    {
+        if (a.bits[0] != b.bits[0]) return a.bits[0] < b.bits[0];
+        if (a.bits[1] != b.bits[1]) return a.bits[1] < b.bits[1];
+        if (a.bits[2] != b.bits[2]) return a.bits[2] < b.bits[2];
+        return a.slot < b.slot;
+    });
+
+    std::vector<Vector3> positions;
+    std::vector<u32> corner(input.size());
+    for (size_t j = 0; j < list.size(); j++)
+    {
+        if (j == 0 || memcmp(list[j].bits, list[j - 1].bits, sizeof(list[j].bits)) != 0)
+        {
+            positions.push_back(input[list[j].slot]);
+        }
+        corner[list[j].slot] = (u32)positions.size() - 1;
+    }
+
+    // Um contorno por triângulo (sem os degenerados)
+    std::vector<Loop> loops;
+    loops.reserve(input.size() / 3);
+    for (size_t i = 0; i + 2 < input.size(); i += 3)
+    {
+        u32 a = corner[i], b = corner[i + 1], c = corner[i + 2];
+        if (a == b || b == c || c == a) continue;
+
+        Vector3 cross = Vector3CrossProduct(Vector3Subtract(positions[b], positions[a]),
+                                            Vector3Subtract(positions[c], positions[a]));
+        float length = Vector3Length(cross);
+        if (length <= 1e-12f) continue;
+
+        Loop loop;
+        loop.vertices = { a, b, c };
+        loop.normal = Vector3Scale(cross, 1.0f / length);
+        loop.planeD = -Vector3DotProduct(loop.normal, positions[a]);
+        loop.sourceTriangles = 1;
+        loop.layers = inputLayers[i / 3];
+        loop.alive = true;
+        loops.push_back(loop);
+    }
+
+    // Aresta orientada -> contorno. Vizinhos no mesmo sentido de rotação
+    // partilham a aresta ao contrário (b, a)
+    std::unordered_map<u64, u32> edges;
+    edges.reserve(loops.size() * 3);
+    for (u32 i = 0; i < (u32)loops.size(); i++)
+    {
+        const std::vector<u32>& v = loops[i].vertices;
+        for (size_t k = 0; k < v.size(); k++)
+        {
+            edges.emplace(EdgeKey(v[k], v[(k + 1) % v.size()]), i);
+        }
+    }
+
+    auto coplanar = [&](const Loop& p, const Loop& q)
+    {
+        if (Vector3DotProduct(p.normal, q.normal) < 1.0f - NORMAL_EPSILON) return false;
+        for (u32 index : q.vertices)
+        {
+            if (fabsf(Vector3DotProduct(p.normal, positions[index]) + p.planeD) > PLANE_EPSILON) return false;
+        }
+        return true;
+    };
+
+    auto convex = [&](const std::vector<u32>& v, const Vector3& normal)
+    {
+        size_t n = v.size();
+        for (size_t k = 0; k < n; k++)
+        {
+            float turn = Turn(positions[v[(k + n - 1) % n]], positions[v[k]], positions[v[(k + 1) % n]], normal);
+            if (turn < -STRAIGHT_EPSILON) return false;
+        }
+        return true;
+    };
+
+    // Junta cada contorno com os vizinhos enquanto o resultado for convexo
+    std::vector<u32> merged;
+    std::vector<u32> sorted;
+    for (u32 p = 0; p < (u32)loops.size(); p++)
+    {
+        bool grew = true;
+        while (loops[p].alive && grew)
+        {
+            grew = false;
+            const std::vector<u32>& pv = loops[p].vertices;
+            for (size_t k = 0; k < pv.size() && !grew; k++)
+            {
+                u32 from = pv[k], to = pv[(k + 1) % pv.size()];
+                auto twin = edges.find(EdgeKey(to, from));
+                if (twin == edges.end()) continue;
+
+                u32 q = twin->second;
+                if (q == p || !loops[q].alive || loops[q].layers != loops[p].layers) continue;
+                if (!coplanar(loops[p], loops[q])) continue;
+                const std::vector<u32>& qv = loops[q].vertices;
+
+                // p a começar em to e a acabar em from, depois q de from a to (sem os extremos)
+                size_t qk = std::find(qv.begin(), qv.end(), from) - qv.begin();
+                merged.clear();
+                for (size_t j = 0; j < pv.size(); j++) merged.push_back(pv[(k + 1 + j) % pv.size()]);
+                for (size_t j = 1; j + 1 < qv.size(); j++) merged.push_back(qv[(qk + j) % qv.size()]);
+
+                // Partilham mais que uma aresta: o contorno passava duas vezes no mesmo ponto
+                sorted = merged;
+                std::sort(sorted.begin(), sorted.end());
+                if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) continue;
+                if (!convex(merged, loops[p].normal)) continue;
+
+                // Só as arestas destes dois (numa malha não-manifold outro pode ter a mesma)
+                auto forget = [&](const std::vector<u32>& v, u32 owner)
+                {
+                    for (size_t j = 0; j < v.size(); j++)
+                    {
+                        auto edge = edges.find(EdgeKey(v[j], v[(j + 1) % v.size()]));
+                        if (edge != edges.end() && edge->second == owner) edges.erase(edge);
+                    }
+                };
+                forget(pv, p);
+                forget(qv, q);
+
+                loops[p].vertices = merged;
+                loops[p].sourceTriangles += loops[q].sourceTriangles;
+                loops[q].alive = false;
+                loops[q].vertices.clear();
+
+                for (size_t j = 0; j < merged.size(); j++)
+                {
+                    edges[EdgeKey(merged[j], merged[(j + 1) % merged.size()])] = p;
+                }
+                grew = true;
+            }
+        }
+    }
+
+    // Tira os pontos a meio de arestas retas e guarda os polígonos
+    for (Loop& loop : loops)
+    {
+        if (!loop.alive) continue;
+
+        std::vector<u32>& v = loop.vertices;
+        bool removed = true;
+        while (removed && v.size() > 3)
+        {
+            removed = false;
+            size_t n = v.size();
+            for (size_t k = 0; k < n; k++)
+            {
+                const Vector3& a = positions[v[(k + n - 1) % n]];
+                const Vector3& b = positions[v[k]];
+                const Vector3& c = positions[v[(k + 1) % n]];
+                bool straight = fabsf(Turn(a, b, c, loop.normal)) <= STRAIGHT_EPSILON &&
+                                Vector3DotProduct(Vector3Subtract(b, a), Vector3Subtract(c, b)) > 0.0f;
+                if (straight)
+                {
+                    v.erase(v.begin() + k);
+                    removed = true;
+                    break;
+                }
+            }
+        }
+
+        CollisionPolygon polygon;
+        polygon.normal = loop.normal;
+        polygon.planeD = loop.planeD;
+        polygon.sourceTriangles = loop.sourceTriangles;
+        polygon.layers = loop.layers;
+        polygon.firstPoint = (u32)points.size();
+        polygon.pointCount = (u32)v.size();
+        for (u32 index : v)
+        {
+            points.push_back(positions[index]);
+        }
+        edgePlanes.resize(points.size());
+        BuildPolygonPlanes(polygon, &points[polygon.firstPoint], &edgePlanes[polygon.firstPoint]);
+
+        polygon.firstTriangle = triangleCount;
+        firstTriangle.push_back(triangleCount);
+        triangleCount += (u32)v.size() - 2;
+        polygons.push_back(std::move(polygon));
+    }
+}
+
+void PolygonMesh::addTo(Selector& selector) const
+{
+    for (const CollisionPolygon& polygon : polygons)
+    {
+        selector.addPolygon(polygon, &points[polygon.firstPoint]);
+    }
+}
+
+u64 PolygonMesh::getCacheKey(u64 sourceHash)
+{
+    const s32 version = POLYGON_MESH_VERSION;
+    const float params[] = { NORMAL_EPSILON, PLANE_EPSILON, STRAIGHT_EPSILON };
+
+    u64 hash = HashFNV1a(&sourceHash, sizeof(sourceHash));
+    hash = HashFNV1a(&version, sizeof(version), hash);
+    return HashFNV1a(params, sizeof(params), hash);
+}
+
+void PolygonMesh::stats() const
+{
+    u32 inputCount = getInputCount();
+    LogInfo("Polygon mesh: %u triangles -> %u polygons -> %u triangles (%.1f%% fewer)",
+            inputCount, getPolygonCount(), triangleCount,
+            inputCount ? (1.0f - (float)triangleCount / (float)inputCount) * 100.0f : 0.0f);
+}
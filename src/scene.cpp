@@ -2,6 +2,7 @@
 #include "scene.hpp"
 #include "collision.hpp"
 #include "node.hpp"
+#include "frustum.hpp"
 
 
 static u32 IDS = 0;
@@ -20,6 +21,8 @@ Model3D* Scene::AddNode(Model* model)
 {
      Model3D* newNode = new Model3D(model);
      newNode->ID = IDS++;
+     newNode->scene = this;
+     newNode->UpdateWorldTransform();
      this->nodes.push_back(newNode);
      return newNode;
 }
@@ -29,7 +32,8 @@ Model3D* Scene::AddNode(Model* model, Vector3 position)
     Model3D *newNode = new Model3D(model);
     newNode->ID = IDS++;
     newNode->localPosition = position;
-    newNode->GetWorldMatrix();
+    newNode->scene = this;
+    newNode->UpdateWorldTransform();
     this->nodes.push_back(newNode);
     return newNode;
 }
@@ -40,7 +44,8 @@ Model3D* Scene::AddNode(Model* model, Vector3 position, Vector3 scale)
     newNode->ID = IDS++;
     newNode->localPosition = position;
     newNode->localScale = scale;
-    newNode->GetWorldMatrix();
+    newNode->scene = this;
+    newNode->UpdateWorldTransform();
     this->nodes.push_back(newNode);
     return newNode;
 }
@@ -51,7 +56,14 @@ void Scene::RemoveNode(Model3D* node)
     auto it = std::find(nodes.begin(), nodes.end(), node);
     if (it != nodes.end())
     {
+        version++;
         nodes.erase(it);
+        if (node->proxy != AABBTree::NULL_NODE)
+        {
+            tree.remove(node->proxy);
+            node->proxy = AABBTree::NULL_NODE;
+        }
+        node->scene = nullptr;
     }
 }
 
@@ -62,64 +74,89 @@ void Scene::Clear()
         delete node;
     }
     nodes.clear();
+    tree.clear();
+    version++;
 }
 
+void Scene::UpdateNode(Model3D* node, const Vector3& displacement)
+{
+    version++;
+    if (!node->IsVisible())
+    {
+        if (node->proxy != AABBTree::NULL_NODE)
+        {
+            tree.remove(node->proxy);
+            node->proxy = AABBTree::NULL_NODE;
+        }
+        return;
+    }
 
+    if (node->proxy == AABBTree::NULL_NODE)
+    {
+        node->proxy = tree.insert(node->GetWorldBounds(), node);
+        return;
+    }
 
+    tree.move(node->proxy, node->GetWorldBounds(), displacement);
+}
 
 
 bool Scene::collide(const Ray& ray, float maxDistance, PickData* data)  
 {
-    if (nodes.empty()) return false;
-
-    for (auto& node : nodes)
+    // Frente para trás: cada acerto encurta o raio para os nós seguintes
+    bool found = false;
+    tree.raycast(ray, maxDistance, [&](s32 proxy, float distance)
     {
-        if (node->collide(ray, maxDistance, data)) return true;
-    }
-   
-    return false;
-   
+        Model3D* node = (Model3D*)tree.getUserData(proxy);
+        PickData pick;
+        if (node->collide(ray, distance, &pick))
+        {
+            found = true;
+            distance = Vector3Distance(ray.position, pick.intersectionPoint);
+            if (data) *data = pick;
+        }
+        return distance;
+    });
+    return found;
 }
 
 
 
 bool Scene::collide(const Vector3& point, float radius, PickData *data) 
 {
-    if (nodes.empty()) return false;
-
-    for (auto& node : nodes)
+    bool found = false;
+    tree.query(point, radius, [&](s32 proxy)
     {
-        if (node->collide(point, radius, data)) return true;
-    }
-   
-    return false;
+        Model3D* node = (Model3D*)tree.getUserData(proxy);
+        found = node->collide(point, radius, data);
+        return !found;
+    });
+    return found;
 }
  
 bool Scene::collide(const BoundingBox& area, PickData* data) 
 {
-    if (nodes.empty()) return false;
-
-    for (auto& node : nodes)
+    bool found = false;
+    tree.query(area, [&](s32 proxy)
     {
-        if (node->collide(area, data)) return true;
-    }
-   
-    return false;
+        Model3D* node = (Model3D*)tree.getUserData(proxy);
+        found = node->collide(area, data);
+        return !found;
+    });
+    return found;
 }
 
-std::vector<const Triangle*> Scene::collectTriangles(const BoundingBox& area) const
+void Scene::collectTriangles(const BoundingBox& area, std::vector<Triangle>& out) const
 {
-    std::vector<const Triangle*> triangles;
-    for (auto& node : nodes)
+    tree.query(area, [&](s32 proxy)
     {
-        node->collectTriangles(area, triangles);
-    }
-    return triangles;
+        const Model3D* node = (const Model3D*)tree.getUserData(proxy);
+        node->collectTriangles(area, out);
+        return true;
+    });
 }
 
 
-
-
 void Scene::Update(float dt) 
 {
     for (auto& node : nodes)
@@ -142,4 +179,15 @@ void Scene::Render()
     {
         node->Render();
     }
+}
+
+void Scene::Render(ViewFrustum& frustum)
+{
+    // Só os nós cuja caixa (gorda) toca o frustum
+    tree.query([&](const BoundingBox& box) { return frustum.isBoxInside(box); },
+               [&](s32 proxy)
+    {
+        ((Model3D*)tree.getUserData(proxy))->Render();
+        return true;
+    });
 }
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include "sight.hpp"
+#include "bsp.hpp"
+#include <chrono>
+
+// Raios por chamada ao raycast em lote; o orçamento é visto entre lotes
+static const s32 SIGHT_BATCH = 16;
+
+static u64 PairKey(u32 observer, u32 target)
+{
+    return ((u64)observer << 32) | target;
+}
+
+void SightService::setWorld(const Selector* world, const BSP* map)
+{
+    this->world = world;
+    this->map = map;
+    for (Agent& agent : agents)
+    {
+        agent.cluster = map ? map->findCluster(agent.eye) : -1;
+    }
+}
+
+void SightService::setAgent(u32 id, const Vector3& eye, const Vector3& forward)
+{
+    if (id >= agents.size()) agents.resize(id + 1, { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, -1, false });
+
+    Agent& agent = agents[id];
+    agent.eye = eye;
+    agent.forward = forward;
+    agent.cluster = map ? map->findCluster(eye) : -1;
+    agent.active = true;
+}
+
+void SightService::removeAgent(u32 id)
+{
+    if (id >= agents.size()) return;
+    agents[id].active = false;
+
+    for (u32 i = (u32)pairs.size(); i-- > 0;)
+    {
+        if (pairs[i].observer == id || pairs[i].target == id) removePair(i);
+    }
+}
+
+SightResult SightService::query(u32 observer, u32 target)
+{
+    u64 key = PairKey(observer, target);
+    auto it = pairIndex.find(key);
+    if (it == pairIndex.end())
+    {
+        // Par novo: ainda sem resultado até um update lhe chegar
+        pairIndex[key] = (u32)pairs.size();
+        pairs.push_back({ observer, target, false, FLT_MAX, 0.0f });
+        return { false, FLT_MAX };
+    }
+
+    Pair& pair = pairs[it->second];
+    pair.idle = 0.0f;
+    return { pair.visible, pair.age };
+}
+
+void SightService::clear()
+{
+    agents.clear();
+    pairs.clear();
+    pairIndex.clear();
+    stats = SightStats();
+}
+
+void SightService::removePair(u32 index)
+{
+    pairIndex.erase(PairKey(pairs[index].observer, pairs[index].target));
+    if (index + 1 != pairs.size())
+    {
+        pairs[index] = pairs.back();
+        pairIndex[PairKey(pairs[index].observer, pairs[index].target)] = index;
+    }
+    pairs.pop_back();
+}
+
+bool SightService::needsRay(Pair& pair, Ray& ray, float& distance)
+{
+    pair.visible = false;
+    pair.age = 0.0f;
+
+    if (pair.observer >= agents.size() || pair.target >= agents.size()) return false;
+    const Agent& observer = agents[pair.observer];
+    const Agent& target = agents[pair.target];
+    if (!observer.active || !target.active) return false;
+
+    Vector3 delta = Vector3Subtract(target.eye, observer.eye);
+    distance = Vector3Length(delta);
+    if (distance > config.maxDistance)
+    {
+        stats.rejectedDistance++;
+        return false;
+    }
+    if (distance < 1e-4f)
+    {
+        pair.visible = true;
+        return false;
+    }
+
+    Vector3 direction = Vector3Scale(delta, 1.0f / distance);
+    if (config.fieldOfView > 0.0f &&
+        Vector3DotProduct(direction, observer.forward) < cosf(config.fieldOfView * 0.5f * DEG2RAD))
+    {
+        stats.rejectedView++;
+        return false;
+    }
+
+    if (map && !map->isClusterVisible(observer.cluster, target.cluster))
+    {
+        stats.rejectedPVS++;
+        return false;
+    }
+
+    if (!world)
+    {
+        pair.visible = true;
+        return false;
+    }
+
+    ray = { observer.eye, direction };
+    return true;
+}
+
+void SightService::update(float dt)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&start]()
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    stats = SightStats();
+
+    // Envelhece tudo e tira da cache os pares que ninguém pediu
+    for (u32 i = (u32)pairs.size(); i-- > 0;)
+    {
+        Pair& pair = pairs[i];
+        pair.idle += dt;
+        if (pair.idle > config.dropAfter)
+        {
+            removePair(i);
+            continue;
+        }
+        if (pair.age < FLT_MAX) pair.age += dt;
+        stats.stale += pair.age >= config.maxAge ? 1 : 0;
+    }
+    stats.pairs = (u32)pairs.size();
+
+    // Volta aos pares a partir de onde o update anterior parou: o que ficar
+    // de fora hoje vai à frente amanhã, sem ordenar a cache toda
+    u32 count = (u32)pairs.size();
+    if (cursor >= count) cursor = 0;
+    u32 visited = 0;
+    while (visited < count)
+    {
+        // Lote: testes baratos até juntar SIGHT_BATCH raios
+        pending.clear();
+        rays.clear();
+        distances.clear();
+        for (; visited < count && (s32)rays.size() < SIGHT_BATCH; visited++)
+        {
+            u32 index = cursor;
+            cursor = cursor + 1 < count ? cursor + 1 : 0;
+
+            Pair& pair = pairs[index];
+            if (pair.age < config.maxAge) continue;
+
+            float age = pair.age;
+            Ray ray;
+            float distance = 0.0f;
+            if (!needsRay(pair, ray, distance)) continue;
+
+            // Só conta como testado depois do raio
+            pair.age = age;
+            // O raio só vai até ao alvo: qualquer hit pelo caminho tapa-o
+            pending.push_back(index);
+            rays.push_back(ray);
+            distances.push_back(fmaxf(distance - 0.01f, 0.0f));
+        }
+
+        if (!rays.empty())
+        {
+            hits.resize(rays.size());
+            world->raycast(rays.data(), (s32)rays.size(), config.maxDistance, hits.data(), nullptr, config.mask,
+                           distances.data());
+            for (size_t i = 0; i < pending.size(); i++)
+            {
+                Pair& pair = pairs[pending[i]];
+                pair.visible = !hits[i].hit;
+                pair.age = 0.0f;
+            }
+            stats.rays += (u32)rays.size();
+        }
+
+        if (elapsed() >= config.budget) break;
+    }
+
+    // Os que ainda estão velhos
+    for (const Pair& pair : pairs) stats.deferred += pair.age >= config.maxAge ? 1 : 0;
+    stats.time = elapsed();
+}
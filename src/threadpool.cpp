@@ -0,0 +1,95 @@
+#include "threadpool.hpp"
+
+
+ThreadPool::ThreadPool(u32 threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0) threadCount = 1;
+    }
+
+    // A thread que chama parallelFor conta como uma
+    for (u32 i = 1; i < threadCount; i++)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::runChunks()
+{
+    for (;;)
+    {
+        u32 begin = next.fetch_add(grain);
+        if (begin >= count) break;
+
+        u32 end = begin + grain < count ? begin + grain : count;
+        (*job)(begin, end);
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    u32 seen = 0;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+
+        runChunks();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0) done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(u32 count, u32 grain, const Job& job)
+{
+    if (count == 0) return;
+    if (grain == 0) grain = 1;
+
+    // Pouco trabalho ou sem workers: corre aqui mesmo
+    if (workers.empty() || count <= grain)
+    {
+        job(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = &job;
+        this->count = count;
+        this->grain = grain;
+        next.store(0);
+        busy = (u32)workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    runChunks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return busy == 0; });
+    this->job = nullptr;
+}
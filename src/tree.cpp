@@ -2,562 +2,1488 @@
 #include "Config.hpp"
 #include "collision.hpp"
 #include "bsp.hpp"
+#include "binaryfile.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
 
 
-QuadtreeNode::QuadtreeNode(const BoundingBox& bounds)
-    : bounds(bounds), divided(false)
+void QueryMarks::begin(size_t count)
 {
-    triangles.reserve(MAX_TRIANGLES);
-    for (int i = 0; i < 4; i++) children[i] = nullptr;
+    if (stamps.size() < count)
+    {
+        stamps.resize(count, 0);
+    }
+
+    generation++;
+    if (generation == 0)
+    {
+        // Deu a volta: limpa as marcas antigas para não haver falsos duplicados
+        std::fill(stamps.begin(), stamps.end(), 0);
+        generation = 1;
+    }
 }
 
-QuadtreeNode::~QuadtreeNode()
+void QueryMarks::beginRays(size_t count)
 {
-    for (int i = 0; i < 4; i++)
+    begin(count);
+    if (rayMasks.size() < count)
     {
-        delete children[i];
+        rayMasks.resize(count, 0);
     }
 }
 
-void QuadtreeNode::insert(const Triangle* tri, int maxDepth, int depth)
+QueryMarks& GetQueryMarks()
+{
+    static thread_local QueryMarks marks;
+    return marks;
+}
+
+
+// Raycast: um só percurso da árvore por grupo de até 64 raios, com a
+// fronteira de raios ativos em cada nó numa máscara de bits. Os testes
+// raio-caixa e raio-triângulo são feitos 4 raios de cada vez
+// (IntersectRayBox4 / IntersectRayTriangle4). Um raycast simples é um grupo
+// de 1, por isso o lote dá exatamente os mesmos hits que N raycasts.
+#define RAY_GROUP_SIZE 64
+#define RAY_GROUP_CELL_SHIFT 18 // octante + 3 níveis de Morton
+
+struct RayGroup
+{
+    Ray rays[RAY_GROUP_SIZE];
+    RayHit best[RAY_GROUP_SIZE];
+    Triangle decoded[RAY_GROUP_SIZE]; // triângulo de best[i] numa árvore compacta
+    alignas(16) float bestDistance[RAY_GROUP_SIZE];
+    float maxDistance[RAY_GROUP_SIZE];  // alcance de cada raio
+    RayPacket packets[RAY_GROUP_SIZE / 4];
+    s32 packetCount;
+};
+
+// Guarda o hit se for o mais perto deste raio. Empates na distância ficam
+// com o id mais baixo, para o resultado não depender da ordem de visita.
+static inline bool AcceptRayHit(RayGroup& group, s32 i, const Triangle* tri,
+                                float distance, const RayFilter& filter)
+{
+    RayHit& best = group.best[i];
+    if (distance > best.distance) return false;
+    if (distance == best.distance && best.triangle && best.triangle->id < tri->id) return false;
+    if (filter && !filter(*tri)) return false;
+
+    const Ray& ray = group.rays[i];
+    best.hit = true;
+    best.distance = distance;
+    best.point = Vector3Add(ray.position, Vector3Scale(ray.direction, distance));
+    best.normal = tri->normal;
+    best.triangle = tri;
+    group.bestDistance[i] = distance;
+    return true;
+}
+
+// Hit final: normal virada contra o raio, nada encontrado devolve RayHit vazio
+static RayHit FinishRaycast(const Ray& ray, const RayHit& best)
 {
-    if (!CheckCollisionBoxes(bounds, tri->bounds)) return;
+    if (!best.hit) return RayHit();
 
-    // Se chegou ao máximo de profundidade ou não está dividido
-    if (depth >= maxDepth || !divided)
+    RayHit result = best;
+    if (Vector3DotProduct(result.normal, ray.direction) > 0.0f)
     {
-        triangles.push_back(tri);
+        result.normal = Vector3Negate(result.normal);
+    }
+    return result;
+}
 
-        // Subdividir apenas se necessário e possível
-        if (triangles.size() > MAX_TRIANGLES && depth < maxDepth)
+
+// Chave de coerência: octante da direção nos bits altos (a ordem dos filhos
+// frente-trás só é partilhada por raios do mesmo octante), depois Morton da
+// origem dentro do mundo para raios vizinhos ficarem no mesmo grupo
+static u32 RayCoherenceKey(const Ray& ray, const BoundingBox& world)
+{
+    u32 octant = (ray.direction.x < 0.0f ? 1u : 0u) | (ray.direction.y < 0.0f ? 2u : 0u)
+        | (ray.direction.z < 0.0f ? 4u : 0u);
+
+    const float p[3] = { ray.position.x, ray.position.y, ray.position.z };
+    const float lo[3] = { world.min.x, world.min.y, world.min.z };
+    const float hi[3] = { world.max.x, world.max.y, world.max.z };
+
+    u32 morton = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float size = hi[axis] - lo[axis];
+        float f = size > 0.0f ? (p[axis] - lo[axis]) / size : 0.0f;
+        u32 cell = (u32)Clamp(f * 1023.0f, 0.0f, 1023.0f);
+
+        for (int bit = 0; bit < 9; bit++)
         {
-            Vector3 size = Vector3Subtract(bounds.max, bounds.min);
-            if (size.x > MIN_SIZE && size.z > MIN_SIZE)
-            {
-                subdivide();
+            morton |= ((cell >> (bit + 1)) & 1u) << (bit * 3 + axis);
+        }
+    }
+
+    return (octant << 27) | morton;
+}
+
+// Vista só de leitura de uma árvore (NodePool + triangleStorage) para as queries
+struct TreeView
+{
+    const TreeNode* nodes;      // nullptr se a árvore não tem raiz ou os nós são compactos
+    const u32* indices;
+    const u16* shortIndices;    // não nulo: os índices são estes (CompactNodes)
+    const CompactNodes* compactNodes; // não nulo: os nós vêm daqui
+    const Triangle* triangles;
+    size_t triangleCount;
+    const CompactTriangles* compact; // não nulo: triangles não existe, descodifica-se
+
+    bool hasRoot() const { return nodes || compactNodes; }
+    TreeNode node(u32 i) const { return nodes ? nodes[i] : compactNodes->get(i); }
+
+    // Filhos, índices e camadas; a caixa só em node() (evita dequantizar)
+    TreeNode links(u32 i) const
+    {
+        if (nodes) return nodes[i];
+        const CompactNode& compact = compactNodes->nodes[i];
+        TreeNode out;
+        out.firstChild = compact.firstChild;
+        out.firstIndex = compact.firstIndex;
+        out.indexCount = compact.indexCount;
+        out.layers = compact.layers;
+        return out;
+    }
+    u32 nodeLayers(u32 i) const { return nodes ? nodes[i].layers : compactNodes->nodes[i].layers; }
+    u32 index(u32 position) const { return shortIndices ? shortIndices[position] : indices[position]; }
+    u32 layersOf(u32 id) const { return compact ? compact->layers[id] : triangles[id].layers; }
+};
+
+static TreeView MakeTreeView(const NodePool& pool, const std::vector<Triangle>& storage,
+                             const CompactTriangles* compact = nullptr,
+                             const CompactNodes* compactNodes = nullptr)
+{
+    TreeView view;
+    view.nodes = pool.nodes.empty() ? nullptr : pool.nodes.data();
+    view.indices = pool.indices.data();
+    view.shortIndices = nullptr;
+    view.compactNodes = nullptr;
+    if (!view.nodes && compactNodes && !compactNodes->empty())
+    {
+        view.compactNodes = compactNodes;
+        view.indices = compactNodes->indices.data();
+        if (compactNodes->indices.empty()) view.shortIndices = compactNodes->shortIndices.data();
+    }
+    if (compact && !compact->empty())
+    {
+        view.triangles = nullptr;
+        view.triangleCount = compact->getCount();
+        view.compact = compact;
+    }
+    else
+    {
+        view.triangles = storage.data();
+        view.triangleCount = storage.size();
+        view.compact = nullptr;
+    }
+    return view;
+}
+
+// Triângulos descodificados de árvores compactas, por thread: os ponteiros
+// devolvidos ficam válidos até à query seguinte do mesmo tipo
+struct DecodeBuffer
+{
+    std::vector<u32> ids;
+    std::vector<Triangle> candidates;
+    std::vector<Triangle> hits;
+    std::vector<Vector3> outline;       // contorno e planos de um CompactPolygon
+    std::vector<Vector4> edgePlanes;
+};
+
+static DecodeBuffer& GetDecodeBuffer()
+{
+    static thread_local DecodeBuffer buffer;
+    return buffer;
+}
 
-          
-                auto oldTriangles = std::move(triangles);
-                triangles.clear();
-                triangles.reserve(MAX_TRIANGLES); // Reserve espaço
+template <s32 CHILD_COUNT>
+static void RaycastGroupNode(const TreeView& tree, u32 index, RayGroup& group, u64 active,
+                             const RayFilter& filter, u32 mask, QueryMarks& marks)
+{
+    const TreeNode node = tree.links(index);
+    COLLISION_STAT_ADD(nodesVisited, 1);
 
-                for (const auto& triangle : oldTriangles)
+    // Cada triângulo só é testado uma vez por raio (QueryMarks::visitRays).
+    // Se a máscara cobre todas as camadas do nó não é preciso ver uma a uma.
+    bool matchAll = (node.layers & ~mask) == 0;
+    for (u32 k = 0; k < node.indexCount; k++)
+    {
+        u32 id = tree.index(node.firstIndex + k);
+        if (!matchAll && !(tree.layersOf(id) & mask)) continue;
+        u64 pending = marks.visitRays(id, active);
+        if (!pending) continue;
+
+        // Árvore compacta: só os pontos para o teste, o resto quando há hit
+        Triangle decoded;
+        bool complete = false;
+        if (tree.compact) tree.compact->decodeEdges(id, decoded);
+        const Triangle* tri = tree.compact ? &decoded : tree.triangles + id;
+
+        while (pending)
+        {
+            s32 packet = __builtin_ctzll(pending) >> 2;
+            s32 lanes = (s32)((pending >> (packet * 4)) & 0xF);
+            pending &= ~((u64)0xF << (packet * 4));
+
+            alignas(16) float distance[4];
+            s32 hits = IntersectRayTriangle4(group.packets[packet], *tri, distance) & lanes;
+            COLLISION_STAT_ADD(triangleTests, __builtin_popcount(lanes));
+            if (hits && tree.compact && !complete)
+            {
+                tree.compact->decode(id, decoded);
+                complete = true;
+            }
+            while (hits)
+            {
+                s32 lane = __builtin_ctz(hits);
+                hits &= hits - 1;
+                s32 i = packet * 4 + lane;
+                if (AcceptRayHit(group, i, tri, distance[lane], filter) && tree.compact)
                 {
-                    bool inserted = false;
-                    
-            
-                    for (int i = 0; i < 4; i++)
-                    {
-                        if (CheckCollisionBoxes(children[i]->bounds, triangle->bounds))
-                        {
-                            children[i]->insert(triangle, maxDepth, depth + 1);
-                            inserted = true;
-              
-                        }
-                    }
-                    
-             
-                    if (!inserted)
-                    {
-                        triangles.push_back(triangle);
-                    }
+                    group.decoded[i] = decoded;
+                    group.best[i].triangle = &group.decoded[i];
                 }
             }
         }
     }
-    else
+
+    if (!node.isDivided()) return;
+
+    u64 childMask[CHILD_COUNT];
+    float childNearest[CHILD_COUNT];
+    alignas(16) float entries[CHILD_COUNT][RAY_GROUP_SIZE];
+    s32 order[CHILD_COUNT];
+    s32 ordered = 0;
+
+    for (s32 c = 0; c < CHILD_COUNT; c++)
     {
-         
-        bool inserted = false;
-        for (int i = 0; i < 4; i++)
+        if (!(tree.nodeLayers(node.firstChild + c) & mask)) continue;
+
+        const BoundingBox bounds = tree.node(node.firstChild + c).bounds;
+        u64 rays = 0;
+
+        for (s32 packet = 0; packet < group.packetCount; packet++)
         {
-            if (CheckCollisionBoxes(children[i]->bounds, tri->bounds))
-            {
-                children[i]->insert(tri, maxDepth, depth + 1);
-                inserted = true;
-          
-            }
+            s32 lanes = (s32)((active >> (packet * 4)) & 0xF);
+            if (!lanes) continue;
+
+            s32 hits = IntersectRayBox4(group.packets[packet], bounds,
+                                        &group.bestDistance[packet * 4],
+                                        &entries[c][packet * 4]) & lanes;
+            rays |= (u64)hits << (packet * 4);
         }
-        
- 
-        if (!inserted)
+
+        if (!rays) continue;
+        childMask[c] = rays;
+
+        float nearest = FLT_MAX;
+        for (u64 left = rays; left; left &= left - 1)
+        {
+            nearest = fminf(nearest, entries[c][__builtin_ctzll(left)]);
+        }
+
+        // Filhos ordenados pela entrada mais perto de qualquer raio do grupo
+        s32 j = ordered++;
+        while (j > 0 && childNearest[order[j - 1]] > nearest)
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        childNearest[c] = nearest;
+        order[j] = c;
+    }
+
+    for (s32 n = 0; n < ordered; n++)
+    {
+        s32 c = order[n];
+
+        // Volta a cortar: os hits dos irmãos anteriores podem ter encolhido best
+        u64 rays = childMask[c];
+        for (u64 left = rays; left; left &= left - 1)
         {
-            triangles.push_back(tri);
+            s32 i = __builtin_ctzll(left);
+            if (entries[c][i] > group.bestDistance[i]) rays &= ~((u64)1 << i);
         }
+
+        if (rays) RaycastGroupNode<CHILD_COUNT>(tree, node.firstChild + c, group, rays, filter, mask, marks);
     }
 }
 
-void QuadtreeNode::subdivide()
+template <s32 CHILD_COUNT>
+static void RaycastGroup(const TreeView& tree, RayGroup& group, s32 size,
+                         const RayFilter& filter, u32 mask)
 {
-    Vector3 min = bounds.min;
-    Vector3 max = bounds.max;
-    Vector3 center = { (min.x + max.x) * 0.5f, min.y, (min.z + max.z) * 0.5f };
-
-    BoundingBox quads[4] = {
-        { { min.x, min.y, min.z }, { center.x, max.y, center.z } }, // SW
-        { { center.x, min.y, min.z }, { max.x, max.y, center.z } }, // SE
-        { { min.x, min.y, center.z }, { center.x, max.y, max.z } }, // NW
-        { { center.x, min.y, center.z }, { max.x, max.y, max.z } } // NE
-    };
+    group.packetCount = (size + 3) / 4;
 
-    for (int i = 0; i < 4; i++)
+    for (s32 i = 0; i < group.packetCount * 4; i++)
     {
-        children[i] = new QuadtreeNode(quads[i]);
+        // Lanes a mais no último pacote repetem o primeiro raio (nunca ficam ativas)
+        group.packets[i / 4].set(i % 4, group.rays[i < size ? i : 0]);
+        group.bestDistance[i] = group.maxDistance[i < size ? i : 0];
     }
-    divided = true;
-}
 
-// QUERIES ULTRA-RÁPIDAS - apenas coletam, sem testes complexos
+    u64 active = 0;
+    for (s32 i = 0; i < size; i++)
+    {
+        group.best[i] = RayHit();
+        group.best[i].distance = group.maxDistance[i];
+    }
 
-void QuadtreeNode::collectTriangles(const BoundingBox& area,
-                                    std::vector<const Triangle*>& out) const
-{
-    if (!CheckCollisionBoxes(bounds, area)) return;
+    if (tree.hasRoot() && (tree.nodeLayers(0) & mask))
+    {
+        const BoundingBox root = tree.node(0).bounds;
+        alignas(16) float entry[RAY_GROUP_SIZE];
+        for (s32 packet = 0; packet < group.packetCount; packet++)
+        {
+            s32 hits = IntersectRayBox4(group.packets[packet], root,
+                                        &group.bestDistance[packet * 4], &entry[packet * 4]);
+            active |= (u64)hits << (packet * 4);
+        }
+        active &= size < RAY_GROUP_SIZE ? (((u64)1 << size) - 1) : ~(u64)0;
+    }
 
-    // Adicionar todos os triângulos deste nó
-    out.insert(out.end(), triangles.begin(), triangles.end());
+    if (active)
+    {
+        QueryMarks& marks = GetQueryMarks();
+        marks.beginRays(tree.triangleCount);
+        RaycastGroupNode<CHILD_COUNT>(tree, 0, group, active, filter, mask, marks);
+    }
 
-    // Recursão nos filhos
-    if (divided)
+    for (s32 i = 0; i < size; i++)
     {
-        children[0]->collectTriangles(area, out);
-        children[1]->collectTriangles(area, out);
-        children[2]->collectTriangles(area, out);
-        children[3]->collectTriangles(area, out);
+        group.best[i] = FinishRaycast(group.rays[i], group.best[i]);
     }
 }
 
-void QuadtreeNode::collectTriangles(const Vector3& point, float radius,
-                                    std::vector<const Triangle*>& out) const
+template <s32 CHILD_COUNT>
+static void RaycastBatch(const TreeView& tree, const Ray* rays, s32 count, float maxDistance,
+                         const float* maxDistances, RayHit* out, const RayFilter& filter, u32 mask)
 {
-    if (!CheckCollisionBoxSphere(bounds, point, radius)) return;
+    COLLISION_STAT_TIMER(queryTime);
+    COLLISION_STAT_ADD(queries, count);
 
-    out.insert(out.end(), triangles.begin(), triangles.end());
+    RayGroup group;
 
-    if (divided)
+    // Os hits de uma árvore compacta apontam para group.decoded: copia-os
+    // para a área da thread antes de o grupo ser reutilizado
+    std::vector<Triangle>* decodedHits = nullptr;
+    if (tree.compact)
     {
-        children[0]->collectTriangles(point, radius, out);
-        children[1]->collectTriangles(point, radius, out);
-        children[2]->collectTriangles(point, radius, out);
-        children[3]->collectTriangles(point, radius, out);
+        decodedHits = &GetDecodeBuffer().hits;
+        decodedHits->resize(count);
     }
-}
+    auto store = [&](s32 index, const RayHit& hit)
+    {
+        out[index] = hit;
+        if (decodedHits && hit.hit)
+        {
+            (*decodedHits)[index] = *hit.triangle;
+            out[index].triangle = &(*decodedHits)[index];
+        }
+    };
 
-void QuadtreeNode::collectTriangles(const Ray& ray, float maxDistance,
-                                    std::vector<const Triangle*>& out) const
-{
-    RayCollision collision = GetRayCollisionBox(ray, bounds);
-    if (!collision.hit || collision.distance > maxDistance) return;
+    if (count == 1 || !tree.hasRoot())
+    {
+        for (s32 i = 0; i < count; i++)
+        {
+            group.rays[0] = rays[i];
+            group.maxDistance[0] = maxDistances ? maxDistances[i] : maxDistance;
+            RaycastGroup<CHILD_COUNT>(tree, group, 1, filter, mask);
+            store(i, group.best[0]);
+        }
+        return;
+    }
 
-    out.insert(out.end(), triangles.begin(), triangles.end());
+    // Agrupa raios coerentes pela chave ordenada
+    const BoundingBox root = tree.node(0).bounds;
+    std::vector<std::pair<u32, s32>> order(count);
+    for (s32 i = 0; i < count; i++)
+    {
+        order[i] = { RayCoherenceKey(rays[i], root), i };
+    }
+    std::sort(order.begin(), order.end());
 
-    if (divided)
+    s32 start = 0;
+    while (start < count)
     {
-        children[0]->collectTriangles(ray, maxDistance, out);
-        children[1]->collectTriangles(ray, maxDistance, out);
-        children[2]->collectTriangles(ray, maxDistance, out);
-        children[3]->collectTriangles(ray, maxDistance, out);
+        // Mesmo octante e origem na mesma célula 8x8x8 do mundo; raios soltos
+        // ficam em grupos pequenos e custam o mesmo que raycasts separados
+        u32 cell = order[start].first >> RAY_GROUP_CELL_SHIFT;
+        s32 size = 0;
+        while (start + size < count && size < RAY_GROUP_SIZE
+               && (order[start + size].first >> RAY_GROUP_CELL_SHIFT) == cell)
+        {
+            s32 index = order[start + size].second;
+            group.rays[size] = rays[index];
+            group.maxDistance[size] = maxDistances ? maxDistances[index] : maxDistance;
+            size++;
+        }
+
+        RaycastGroup<CHILD_COUNT>(tree, group, size, filter, mask);
+
+        for (s32 i = 0; i < size; i++)
+        {
+            store(order[start + i].second, group.best[i]);
+        }
+        start += size;
     }
 }
 
-inline void QuadtreeNode::collectAll(std::vector<const Triangle*>& out) const
+
+// QUERIES ULTRA-RÁPIDAS - apenas coletam, sem testes complexos.
+// test(bounds) decide se desce ao nó; emit(id) recebe cada triângulo novo
+// com alguma camada em mask. Subárvores sem nenhuma ficam de fora.
+
+// Caixa contra nós normais e compactos. Nos CompactNode compara em unidades
+// da grelha: como dequantize só cresce com o valor, dá os mesmos nós que
+// comparar com a caixa dequantizada, sem converter nenhum para float.
+struct BoxTest
 {
-    out.insert(out.end(), triangles.begin(), triangles.end());
+    BoundingBox area;
+    s32 first[3];   // menor valor com posição >= area.min
+    s32 last[3];    // maior valor com posição <= area.max
 
-    if (divided)
+    BoxTest(const BoundingBox& area, const CompactNodes* nodes) : area(area)
     {
-        children[0]->collectAll(out);
-        children[1]->collectAll(out);
-        children[2]->collectAll(out);
-        children[3]->collectAll(out);
+        if (!nodes) return;
+        for (s32 axis = 0; axis < 3; axis++)
+        {
+            first[axis] = nodes->firstAtOrAbove((&area.min.x)[axis], axis);
+            last[axis] = nodes->lastAtOrBelow((&area.max.x)[axis], axis);
+        }
     }
+
+    bool operator()(const BoundingBox& bounds) const { return CheckCollisionBoxes(bounds, area); }
+
+    bool operator()(const CompactNode& node) const
+    {
+        return node.max[0] >= first[0] && node.min[0] <= last[0] &&
+               node.max[1] >= first[1] && node.min[1] <= last[1] &&
+               node.max[2] >= first[2] && node.min[2] <= last[2];
+    }
+};
+
+template <typename Test>
+static bool TestNode(const Test& test, const TreeView& tree, u32 index)
+{
+    return test(tree.node(index).bounds);
 }
 
-void QuadtreeNode::clear()
+static bool TestNode(const BoxTest& test, const TreeView& tree, u32 index)
 {
-    triangles.clear();
-    for (int i = 0; i < 4; i++)
+    return tree.nodes ? test(tree.nodes[index].bounds) : test(tree.compactNodes->nodes[index]);
+}
+
+template <s32 CHILD_COUNT, typename Test, typename Emit>
+static void CollectTriangles(const TreeView& tree, u32 index, const Test& test,
+                             const Emit& emit, u32 mask, QueryMarks& marks)
+{
+    COLLISION_STAT_ADD(nodesVisited, 1);
+    if (!TestNode(test, tree, index)) return;
+    const TreeNode node = tree.links(index);
+
+    // Adicionar os triângulos deste nó que ainda não foram emitidos
+    bool matchAll = (node.layers & ~mask) == 0;
+    for (u32 k = 0; k < node.indexCount; k++)
     {
-        delete children[i];
-        children[i] = nullptr;
+        u32 id = tree.index(node.firstIndex + k);
+        if (!matchAll && !(tree.layersOf(id) & mask)) continue;
+        if (marks.visit(id)) emit(id);
+    }
+
+    if (!node.isDivided()) return;
+    for (s32 c = 0; c < CHILD_COUNT; c++)
+    {
+        u32 child = node.firstChild + c;
+        if (tree.nodeLayers(child) & mask)
+        {
+            CollectTriangles<CHILD_COUNT>(tree, child, test, emit, mask, marks);
+        }
     }
-    divided = false;
 }
 
-void QuadtreeNode::debug(Color color) const
+template <s32 CHILD_COUNT, typename Test>
+static std::vector<const Triangle*> QueryTree(const TreeView& tree, size_t reserve, u32 mask, const Test& test)
 {
-    DrawBoundingBox(bounds, color);
+    COLLISION_STAT_TIMER(queryTime);
+    COLLISION_STAT_ADD(queries, 1);
 
-    if (divided)
+    if (!tree.hasRoot() || !(tree.nodeLayers(0) & mask)) return {};
+    std::vector<const Triangle*> candidates;
+    candidates.reserve(reserve);
+    QueryMarks& marks = GetQueryMarks();
+    marks.begin(tree.triangleCount);
+#ifdef COLLISION_STATS
+    u32 duplicates = marks.duplicates;
+#endif
+
+    if (tree.compact)
+    {
+        // Junta os ids e só depois descodifica: o vector não muda de sítio
+        DecodeBuffer& buffer = GetDecodeBuffer();
+        buffer.ids.clear();
+        CollectTriangles<CHILD_COUNT>(tree, 0, test, [&](u32 id) { buffer.ids.push_back(id); }, mask, marks);
+
+        buffer.candidates.resize(buffer.ids.size());
+        for (size_t i = 0; i < buffer.ids.size(); i++)
+        {
+            tree.compact->decode(buffer.ids[i], buffer.candidates[i]);
+            candidates.push_back(&buffer.candidates[i]);
+        }
+    }
+    else
     {
-        children[0]->debug(GREEN);
-        children[1]->debug(YELLOW);
-        children[2]->debug(ORANGE);
-        children[3]->debug(PURPLE);
+        CollectTriangles<CHILD_COUNT>(tree, 0, test, [&](u32 id) { candidates.push_back(tree.triangles + id); }, mask, marks);
     }
+    COLLISION_STAT_ADD(candidates, candidates.size());
+    COLLISION_STAT_ADD(duplicates, marks.duplicates - duplicates);
+    return candidates;
 }
 
-Quadtree::Quadtree(const BoundingBox& worldBounds)
+template <s32 CHILD_COUNT>
+static std::vector<const Triangle*> QueryTree(const TreeView& tree, const BoundingBox& area, u32 mask)
 {
-    root = new QuadtreeNode(worldBounds);
+    return QueryTree<CHILD_COUNT>(tree, 64, mask, BoxTest(area, tree.compactNodes));
 }
 
-Quadtree::~Quadtree() { delete root; }
+template <s32 CHILD_COUNT>
+static std::vector<const Triangle*> QueryTree(const TreeView& tree, const Vector3& point, float radius,
+                                              u32 mask)
+{
+    return QueryTree<CHILD_COUNT>(tree, 32, mask, [&](const BoundingBox& bounds)
+    {
+        return CheckCollisionBoxSphere(bounds, point, radius);
+    });
+}
 
-void Quadtree::setWorldBounds(const BoundingBox& bounds) 
+template <s32 CHILD_COUNT>
+static std::vector<const Triangle*> QueryTree(const TreeView& tree, const Ray& ray, float maxDistance,
+                                              u32 mask)
 {
-    if (root) delete root;
-    root = new QuadtreeNode(bounds);
+    return QueryTree<CHILD_COUNT>(tree, 16, mask, [&](const BoundingBox& bounds)
+    {
+        RayCollision collision = GetRayCollisionBox(ray, bounds);
+        return collision.hit && collision.distance <= maxDistance;
+    });
 }
 
 
+// NodePool
 
-void Quadtree::addTriangle(const Vector3& a, const Vector3& b, const Vector3& c)
+u32 NodePool::allocate(u32 count, const BoundingBox* bounds)
 {
-    if (!root) return;
-    Triangle tri = { a, b, c };
-    tri.updateBounds();
-    triangleStorage.push_back(tri);
+    u32 first = (u32)nodes.size();
+    for (u32 i = 0; i < count; i++)
+    {
+        nodes.push_back({ bounds[i], 0, 0, 0, 0 });
+    }
+    return first;
 }
 
-void Quadtree::rebuild()
+// CompactTriangles
+
+void CompactTriangles::build(const std::vector<Triangle>& triangles)
 {
-    if (!root) return;
-    root->clear();
-    for (const auto& tri : triangleStorage)
+    // Cantos ordenados pelos bits da posição: pontos iguais ficam seguidos.
+    // Compara bits e não floats para 0.0 e -0.0 não se juntarem.
+    struct Corner
+    {
+        u32 bits[3];
+        u32 slot;
+    };
+    std::vector<Corner> list(triangles.size() * 3);
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+        const Vector3* points[3] = { &triangles[i].pointA, &triangles[i].pointB, &triangles[i].pointC };
+        for (s32 k = 0; k < 3; k++)
+        {
+            Corner& corner = list[i * 3 + k];
+            memcpy(corner.bits, points[k], sizeof(corner.bits));
+            corner.slot = (u32)(i * 3 + k);
+        }
+    }
+    std::sort(list.begin(), list.end(), [](const Corner& a, const Corner& b)
+    {
+        if (a.bits[0] != b.bits[0]) return a.bits[0] < b.bits[0];
+        if (a.bits[1] != b.bits[1]) return a.bits[1] < b.bits[1];
+        if (a.bits[2] != b.bits[2]) return a.bits[2] < b.bits[2];
+        return a.slot < b.slot;
+    });
+
+    // Grupo de cada canto, depois renumerado pela primeira vez que aparece:
+    // triângulos seguidos usam posições seguidas
+    std::vector<u32> group(list.size());
+    u32 groups = 0;
+    for (size_t j = 0; j < list.size(); j++)
+    {
+        if (j > 0 && memcmp(list[j].bits, list[j - 1].bits, sizeof(list[j].bits)) != 0) groups++;
+        group[list[j].slot] = groups;
+    }
+
+    std::vector<u32> remap(list.empty() ? 0 : groups + 1, 0xFFFFFFFF);
+    positions.clear();
+    positions.reserve(remap.size());
+    corners.resize(list.size());
+    for (size_t slot = 0; slot < corners.size(); slot++)
     {
-        root->insert(&tri);
+        u32& index = remap[group[slot]];
+        if (index == 0xFFFFFFFF)
+        {
+            index = (u32)positions.size();
+            const Triangle& tri = triangles[slot / 3];
+            positions.push_back(slot % 3 == 0 ? tri.pointA : (slot % 3 == 1 ? tri.pointB : tri.pointC));
+        }
+        corners[slot] = index;
+    }
+    positions.shrink_to_fit();
+
+    layers.resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+        layers[i] = (u8)triangles[i].layers;
     }
 }
 
-std::vector<const Triangle*>
-Quadtree::getCandidates(const BoundingBox& area) const
+
+// CompactNodes
+
+// Estimativa pela divisão, acertada com dequantize (que é o que conta)
+s32 CompactNodes::firstAtOrAbove(float value, s32 axis) const
 {
-    if (!root) return {};
-    std::vector<const Triangle*> candidates;
-    candidates.reserve(64); // Pre-aloca
-    root->collectTriangles(area, candidates);
-    return candidates;
+    float unit = (&step.x)[axis];
+    if (unit <= 0.0f) return dequantize(0, axis) >= value ? 0 : 0x10000;
+
+    float units = ceilf((value - (&bounds.min.x)[axis]) / unit);
+    s32 q = units < 0.0f ? 0 : (units > 65536.0f ? 0x10000 : (s32)units);
+    while (q > 0 && dequantize((u16)(q - 1), axis) >= value) q--;
+    while (q <= 0xFFFF && dequantize((u16)q, axis) < value) q++;
+    return q;
 }
 
-std::vector<const Triangle*> Quadtree::getCandidates(const Vector3& point,
-                                                     float radius) const
+s32 CompactNodes::lastAtOrBelow(float value, s32 axis) const
 {
-    if (!root) return {};
-    std::vector<const Triangle*> candidates;
-    candidates.reserve(32);
-    root->collectTriangles(point, radius, candidates);
-    return candidates;
+    float unit = (&step.x)[axis];
+    if (unit <= 0.0f) return dequantize(0, axis) <= value ? 0xFFFF : -1;
+
+    float units = floorf((value - (&bounds.min.x)[axis]) / unit);
+    s32 q = units < -1.0f ? -1 : (units > 65535.0f ? 0xFFFF : (s32)units);
+    while (q < 0xFFFF && dequantize((u16)(q + 1), axis) <= value) q++;
+    while (q >= 0 && dequantize((u16)q, axis) > value) q--;
+    return q;
 }
 
-std::vector<const Triangle*> Quadtree::getCandidates(const Ray& ray,
-                                                     float maxDistance) const
+bool CompactNodes::build(const NodePool& pool, u32 triangleCount)
 {
-    if (!root) return {};
-    std::vector<const Triangle*> candidates;
-    candidates.reserve(16);
-    root->collectTriangles(ray, maxDistance, candidates);
-    return candidates;
+    clear();
+    if (pool.nodes.empty()) return false;
+
+    // 0xFFFF unidades cobrem a raiz toda: o passo sobe até o último valor passar max
+    bounds = pool.nodes[0].bounds;
+    for (s32 axis = 0; axis < 3; axis++)
+    {
+        float min = (&bounds.min.x)[axis];
+        float max = (&bounds.max.x)[axis];
+        float& unit = (&step.x)[axis];
+        unit = max > min ? (max - min) / 65535.0f : 0.0f;
+        while (unit > 0.0f && min + 65535.0f * unit < max) unit = nextafterf(unit, FLT_MAX);
+    }
+
+    nodes.resize(pool.nodes.size());
+    for (size_t i = 0; i < pool.nodes.size(); i++)
+    {
+        const TreeNode& node = pool.nodes[i];
+        if (node.indexCount >= (1u << 24) || node.layers > 0xFF)
+        {
+            clear();
+            return false;
+        }
+
+        CompactNode& out = nodes[i];
+        for (s32 axis = 0; axis < 3; axis++)
+        {
+            // Arredonda para fora: a caixa quantizada contém sempre a real
+            s32 min = lastAtOrBelow((&node.bounds.min.x)[axis], axis);
+            s32 max = firstAtOrAbove((&node.bounds.max.x)[axis], axis);
+            out.min[axis] = (u16)(min < 0 ? 0 : min);
+            out.max[axis] = (u16)(max > 0xFFFF ? 0xFFFF : max);
+        }
+        out.firstChild = node.firstChild;
+        out.firstIndex = node.firstIndex;
+        out.indexCount = node.indexCount;
+        out.layers = node.layers;
+    }
+
+    if (triangleCount <= 0x10000)
+    {
+        shortIndices.assign(pool.indices.begin(), pool.indices.end());
+    }
+    else
+    {
+        indices = pool.indices;
+    }
+    return true;
 }
 
-void Quadtree::debug() const
+void CompactNodes::expand(NodePool& pool) const
 {
-    if (!root) return;
-    root->debug();
-}
+    pool.nodes.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        pool.nodes[i] = get((u32)i);
+    }
+    if (!pool.nodes.empty()) pool.nodes[0].bounds = bounds;
 
+    if (indices.empty())
+    {
+        pool.indices.assign(shortIndices.begin(), shortIndices.end());
+    }
+    else
+    {
+        pool.indices = indices;
+    }
+}
 
-OctreeNode::OctreeNode(const BoundingBox& bounds)
-    : bounds(bounds), divided(false)
+bool CompactPolygons::build(const std::vector<CollisionPolygon>& source, const CompactTriangles& triangles)
 {
-    triangles.reserve(MAX_TRIANGLES);
-    for (int i = 0; i < 8; i++) children[i] = nullptr;
+    clear();
+    u32 pointCount = 0;
+    for (const CollisionPolygon& polygon : source)
+    {
+        if (polygon.pointCount > 0xFFFF || polygon.layers > 0xFF) return false;
+        pointCount += polygon.pointCount;
+    }
+
+    bool wide = triangles.positions.size() > 0x10000;
+    if (wide) points.resize(pointCount);
+    else shortPoints.resize(pointCount);
+    auto setPoint = [&](u32 position, u32 index)
+    {
+        if (wide) points[position] = index;
+        else shortPoints[position] = (u16)index;
+    };
+
+    polygons.resize(source.size());
+    u32 next = 0;
+    for (size_t i = 0; i < source.size(); i++)
+    {
+        const CollisionPolygon& polygon = source[i];
+        CompactPolygon& out = polygons[i];
+        out.normal = polygon.normal;
+        out.planeD = polygon.planeD;
+        out.firstPoint = next;
+        out.firstTriangle = polygon.firstTriangle;
+        out.sourceTriangles = polygon.sourceTriangles;
+        out.pointCount = (u16)polygon.pointCount;
+        out.layers = (u8)polygon.layers;
+
+        // Leque (0, k, k + 1): os dois primeiros cantos do primeiro triângulo
+        // e depois o terceiro de cada um
+        const u32* corner = &triangles.corners[polygon.firstTriangle * 3];
+        setPoint(next, corner[0]);
+        setPoint(next + 1, corner[1]);
+        for (u32 k = 0; k + 2 < polygon.pointCount; k++)
+        {
+            setPoint(next + 2 + k, corner[k * 3 + 2]);
+        }
+        next += polygon.pointCount;
+    }
+    return true;
 }
 
-OctreeNode::~OctreeNode()
+void CompactPolygons::decode(u32 i, const CompactTriangles& triangles, CollisionPolygon& out,
+                             Vector3* outline, Vector4* edgePlanes) const
 {
-    for (int i = 0; i < 8; i++)
+    const CompactPolygon& polygon = polygons[i];
+    out.normal = polygon.normal;
+    out.planeD = polygon.planeD;
+    out.firstPoint = 0;
+    out.pointCount = polygon.pointCount;
+    out.sourceTriangles = polygon.sourceTriangles;
+    out.layers = polygon.layers;
+    out.firstTriangle = polygon.firstTriangle;
+    for (u32 k = 0; k < polygon.pointCount; k++)
     {
-        delete children[i];
+        outline[k] = triangles.positions[pointIndex(polygon.firstPoint + k)];
     }
+    BuildPolygonPlanes(out, outline, edgePlanes);
 }
-void OctreeNode::insert(const Triangle* tri, int maxDepth, int depth)
+
+
+void NodePool::stats(s32 childCount) const
 {
-    // Teste rápido de bounds
-    if (!CheckCollisionBoxes(bounds, tri->bounds)) return;
+    if (nodes.empty()) return;
 
-    if (depth >= maxDepth || !divided)
+    // Os filhos vêm sempre depois do pai: uma passagem chega para as profundidades
+    std::vector<u8> depth(nodes.size(), 0);
+    std::vector<u32> histogram;
+    u32 leaves = 0;
+    for (size_t i = 0; i < nodes.size(); i++)
     {
-        triangles.push_back(tri);
+        const TreeNode& node = nodes[i];
+        if (histogram.size() <= depth[i]) histogram.resize(depth[i] + 1, 0);
+        histogram[depth[i]]++;
 
-        // Subdividir apenas se necessário e possível
-        if (triangles.size() > MAX_TRIANGLES && depth < maxDepth)
+        if (!node.isDivided())
         {
-            Vector3 size = Vector3Subtract(bounds.max, bounds.min);
-            if (size.x > MIN_SIZE && size.y > MIN_SIZE && size.z > MIN_SIZE)
-            {
-                subdivide();
+            leaves++;
+            continue;
+        }
+        for (s32 c = 0; c < childCount; c++)
+        {
+            depth[node.firstChild + c] = depth[i] + 1;
+        }
+    }
 
-                // Redistribuir triângulos
-                auto oldTriangles = std::move(triangles);
-                triangles.clear();
+    size_t used = nodes.size() * sizeof(TreeNode) + indices.size() * sizeof(u32);
+    LogInfo("Nodes: %u (%u leaves), %u bytes per node", (u32)nodes.size(), leaves, (u32)sizeof(TreeNode));
+    LogInfo("Node memory: %u bytes used, %u reserved, %.1f bytes per node with indices",
+            (u32)used, (u32)getMemory(), (float)used / (float)nodes.size());
+    for (size_t d = 0; d < histogram.size(); d++)
+    {
+        LogInfo("  depth %u: %u nodes", (u32)d, histogram[d]);
+    }
+}
 
-                for (const auto& triangle : oldTriangles)
-                {
-                    bool inserted = false;
-                    for (int i = 0; i < 8; i++)
-                    {
-                        if (CheckCollisionBoxes(children[i]->bounds, triangle->bounds))
-                        {
-                            children[i]->insert(triangle, maxDepth, depth + 1);
-                            inserted = true;
-                        }
-                    }
-
-                    if (!inserted)
-                    {
-                        triangles.push_back(triangle);
-                    }
-                }
-            }
-        }
+
+// Construção de cima para baixo, comum às duas árvores. Split diz quantos
+// filhos tem um nó, quando pode dividir e as caixas dos filhos.
+
+struct QuadtreeSplit
+{
+    static constexpr s32 CHILD_COUNT = 4;
+
+    static bool canSplit(const Vector3& size)
+    {
+        return size.x > TreeNode::MIN_SIZE && size.z > TreeNode::MIN_SIZE;
     }
-    else
+
+    // Divide só em x/z, os filhos ficam com a altura toda
+    static void split(const BoundingBox& bounds, BoundingBox* out)
+    {
+        Vector3 min = bounds.min;
+        Vector3 max = bounds.max;
+        Vector3 center = { (min.x + max.x) * 0.5f, min.y, (min.z + max.z) * 0.5f };
+
+        out[0] = { { min.x, min.y, min.z }, { center.x, max.y, center.z } }; // SW
+        out[1] = { { center.x, min.y, min.z }, { max.x, max.y, center.z } }; // SE
+        out[2] = { { min.x, min.y, center.z }, { center.x, max.y, max.z } }; // NW
+        out[3] = { { center.x, min.y, center.z }, { max.x, max.y, max.z } }; // NE
+    }
+};
+
+struct OctreeSplit
+{
+    static constexpr s32 CHILD_COUNT = 8;
+
+    static bool canSplit(const Vector3& size)
+    {
+        return size.x > TreeNode::MIN_SIZE && size.y > TreeNode::MIN_SIZE && size.z > TreeNode::MIN_SIZE;
+    }
+
+    static void split(const BoundingBox& bounds, BoundingBox* out)
+    {
+        Vector3 min = bounds.min;
+        Vector3 max = bounds.max;
+        Vector3 center = { (min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f,
+                           (min.z + max.z) * 0.5f };
+
+        // 8 octantes: Bottom 4 + Top 4
+        out[0] = { { min.x, min.y, min.z }, { center.x, center.y, center.z } }; // Back-Left-Bottom
+        out[1] = { { center.x, min.y, min.z }, { max.x, center.y, center.z } }; // Back-Right-Bottom
+        out[2] = { { min.x, min.y, center.z }, { center.x, center.y, max.z } }; // Front-Left-Bottom
+        out[3] = { { center.x, min.y, center.z }, { max.x, center.y, max.z } }; // Front-Right-Bottom
+        out[4] = { { min.x, center.y, min.z }, { center.x, max.y, center.z } }; // Back-Left-Top
+        out[5] = { { center.x, center.y, min.z }, { max.x, max.y, center.z } }; // Back-Right-Top
+        out[6] = { { min.x, center.y, center.z }, { center.x, max.y, max.z } }; // Front-Left-Top
+        out[7] = { { center.x, center.y, center.z }, { max.x, max.y, max.z } }; // Front-Right-Top
+    }
+};
+
+static void SetNodeTriangles(NodePool& pool, u32 index, const std::vector<u32>& list)
+{
+    TreeNode& node = pool.nodes[index];
+    node.firstIndex = (u32)pool.indices.size();
+    node.indexCount = (u32)list.size();
+    pool.indices.insert(pool.indices.end(), list.begin(), list.end());
+}
+
+// Um nível: se o nó divide, reparte list (índices em base) pelos filhos e
+// devolve true; senão list fica como triângulos do nó. As condições são as
+// de inserir um a um: mais de MAX_TRIANGLES a chegar ao nó.
+template <typename Split>
+static bool DistributeNode(NodePool& pool, const Triangle* base, u32 index, std::vector<u32>& list,
+                           int depth, std::vector<u32>* childLists)
+{
+    BoundingBox bounds = pool.nodes[index].bounds;
+    Vector3 size = Vector3Subtract(bounds.max, bounds.min);
+    if (list.size() <= TreeNode::MAX_TRIANGLES || depth >= TreeNode::MAX_DEPTH || !Split::canSplit(size))
+    {
+        SetNodeTriangles(pool, index, list);
+        return false;
+    }
+
+    // Os filhos num bloco seguido do pool
+    BoundingBox children[Split::CHILD_COUNT];
+    Split::split(bounds, children);
+    u32 first = pool.allocate(Split::CHILD_COUNT, children);
+    pool.nodes[index].firstChild = first;
+
+    std::vector<u32> leftovers;
+    for (u32 tri : list)
     {
         bool inserted = false;
-        for (int i = 0; i < 8; i++)
+        for (s32 i = 0; i < Split::CHILD_COUNT; i++)
         {
-            if (CheckCollisionBoxes(children[i]->bounds, tri->bounds))
+            if (CheckCollisionBoxes(children[i], base[tri].bounds))
             {
-                children[i]->insert(tri, maxDepth, depth + 1);
+                childLists[i].push_back(tri);
                 inserted = true;
             }
         }
 
         if (!inserted)
         {
-            triangles.push_back(tri);
+            leftovers.push_back(tri);
         }
     }
-}
+    SetNodeTriangles(pool, index, leftovers);
 
+    list.clear();
+    list.shrink_to_fit();
+    return true;
+}
 
-void OctreeNode::subdivide()
+template <typename Split>
+static void BuildNode(NodePool& pool, const Triangle* base, u32 index, std::vector<u32>& list, int depth)
 {
-    Vector3 min = bounds.min;
-    Vector3 max = bounds.max;
-    Vector3 center = { (min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f,
-                       (min.z + max.z) * 0.5f };
-
-    // 8 octantes: Bottom 4 + Top 4
-    BoundingBox octants[8] = {
-        // Bottom level (Y = min to center)
-        { { min.x, min.y, min.z },
-          { center.x, center.y, center.z } }, // 0: Back-Left-Bottom
-        { { center.x, min.y, min.z },
-          { max.x, center.y, center.z } }, // 1: Back-Right-Bottom
-        { { min.x, min.y, center.z },
-          { center.x, center.y, max.z } }, // 2: Front-Left-Bottom
-        { { center.x, min.y, center.z },
-          { max.x, center.y, max.z } }, // 3: Front-Right-Bottom
+    std::vector<u32> childLists[Split::CHILD_COUNT];
+    if (!DistributeNode<Split>(pool, base, index, list, depth, childLists)) return;
 
-        // Top level (Y = center to max)
-        { { min.x, center.y, min.z },
-          { center.x, max.y, center.z } }, // 4: Back-Left-Top
-        { { center.x, center.y, min.z },
-          { max.x, max.y, center.z } }, // 5: Back-Right-Top
-        { { min.x, center.y, center.z },
-          { center.x, max.y, max.z } }, // 6: Front-Left-Top
-        { { center.x, center.y, center.z },
-          { max.x, max.y, max.z } } // 7: Front-Right-Top
-    };
-
-    for (int i = 0; i < 8; i++)
+    u32 first = pool.nodes[index].firstChild;
+    for (s32 i = 0; i < Split::CHILD_COUNT; i++)
     {
-        children[i] = new OctreeNode(octants[i]);
+        BuildNode<Split>(pool, base, first + i, childLists[i], depth + 1);
     }
-    divided = true;
 }
 
-// QUERIES ULTRA-RÁPIDAS - apenas coletam, sem testes complexos
-
-void OctreeNode::collectTriangles(const BoundingBox& area,
-                                  std::vector<const Triangle*>& out) const
+// Subárvore ainda por construir (build com pool de threads). Cada uma é
+// construída num NodePool próprio e copiada no fim para o da árvore.
+struct TreeBuildTask
+{
+    u32 node;
+    std::vector<u32> triangles;
+    int depth;
+    NodePool pool;
+};
+
+// Copia a subárvore de local (raiz no nó 0) para o nó index de pool
+static void MergeSubtree(NodePool& pool, u32 index, const NodePool& local)
 {
-    if (!CheckCollisionBoxes(bounds, area)) return;
+    // O nó 1 de local passa a ser o primeiro nó novo de pool
+    u32 nodeBase = (u32)pool.nodes.size() - 1;
+    u32 indexBase = (u32)pool.indices.size();
 
-    // Adicionar todos os triângulos deste nó
-    out.insert(out.end(), triangles.begin(), triangles.end());
+    auto relocate = [&](TreeNode node)
+    {
+        if (node.isDivided()) node.firstChild += nodeBase;
+        node.firstIndex += indexBase;
+        return node;
+    };
 
-    // Recursão nos 8 filhos
-    if (divided)
+    pool.nodes[index] = relocate(local.nodes[0]);
+    for (size_t i = 1; i < local.nodes.size(); i++)
     {
-        for (int i = 0; i < 8; i++)
-        {
-            children[i]->collectTriangles(area, out);
-        }
+        pool.nodes.push_back(relocate(local.nodes[i]));
     }
+    pool.indices.insert(pool.indices.end(), local.indices.begin(), local.indices.end());
 }
 
-void OctreeNode::collectTriangles(const Vector3& point, float radius,
-                                  std::vector<const Triangle*>& out) const
+// Camadas de cada nó: as dos seus triângulos mais as dos filhos. Os filhos
+// vêm sempre depois do pai, por isso chega uma passagem de trás para a frente.
+static void UpdateNodeLayers(NodePool& pool, const std::vector<Triangle>& storage, s32 childCount)
 {
-    if (!CheckCollisionBoxSphere(bounds, point, radius)) return;
-
-    out.insert(out.end(), triangles.begin(), triangles.end());
-
-    if (divided)
+    for (size_t i = pool.nodes.size(); i-- > 0;)
     {
-        for (int i = 0; i < 8; i++)
+        TreeNode& node = pool.nodes[i];
+        u32 layers = 0;
+        for (u32 k = 0; k < node.indexCount; k++)
         {
-            children[i]->collectTriangles(point, radius, out);
+            layers |= storage[pool.indices[node.firstIndex + k]].layers;
         }
+        if (node.isDivided())
+        {
+            for (s32 c = 0; c < childCount; c++)
+            {
+                layers |= pool.nodes[node.firstChild + c].layers;
+            }
+        }
+        node.layers = layers;
     }
 }
 
-void OctreeNode::collectTriangles(const Ray& ray, float maxDistance,
-                                  std::vector<const Triangle*>& out) const
+// Reconstrói pool (a raiz guarda as bounds do mundo) com storage
+template <typename Split>
+static void BuildTree(NodePool& pool, const std::vector<Triangle>& storage, ThreadPool* threads)
 {
-    RayCollision collision = GetRayCollisionBox(ray, bounds);
-    if (!collision.hit || collision.distance > maxDistance) return;
+    BoundingBox bounds = pool.nodes[0].bounds;
+    pool.clear();
+    pool.allocate(1, &bounds);
+    pool.indices.reserve(storage.size());
+
+    std::vector<u32> list;
+    list.reserve(storage.size());
+    for (const Triangle& tri : storage)
+    {
+        if (CheckCollisionBoxes(bounds, tri.bounds)) list.push_back(tri.id);
+    }
 
-   // DrawBoundingBox(bounds, RED);
+    const Triangle* base = storage.data();
+    u32 threadCount = threads ? threads->getThreadCount() : 1;
+    if (threadCount <= 1)
+    {
+        BuildNode<Split>(pool, base, 0, list, 0);
+        UpdateNodeLayers(pool, storage, Split::CHILD_COUNT);
+        return;
+    }
 
-    out.insert(out.end(), triangles.begin(), triangles.end());
+    // Abre os primeiros níveis nesta thread até haver subárvores que
+    // cheguem para equilibrar as threads; cada uma constrói-se sozinha
+    std::vector<TreeBuildTask> tasks;
+    tasks.push_back({ 0, std::move(list), 0, NodePool() });
 
-    if (divided)
+    while (tasks.size() < threadCount * 8)
     {
-        for (int i = 0; i < 8; i++)
+        std::vector<TreeBuildTask> next;
+        bool split = false;
+        for (TreeBuildTask& task : tasks)
         {
-            children[i]->collectTriangles(ray, maxDistance, out);
+            std::vector<u32> childLists[Split::CHILD_COUNT];
+            if (!DistributeNode<Split>(pool, base, task.node, task.triangles, task.depth, childLists)) continue;
+
+            split = true;
+            u32 first = pool.nodes[task.node].firstChild;
+            for (s32 i = 0; i < Split::CHILD_COUNT; i++)
+            {
+                next.push_back({ first + i, std::move(childLists[i]), task.depth + 1, NodePool() });
+            }
         }
+        tasks.swap(next);
+        if (!split) break;
     }
-}
-
-inline void OctreeNode::collectAll(std::vector<const Triangle*>& out) const
-{
-    out.insert(out.end(), triangles.begin(), triangles.end());
 
-    if (divided)
+    // As folhas que não dividiram já ficaram com os triângulos no pool
+    threads->parallelFor((u32)tasks.size(), 1, [&](u32 begin, u32 end)
     {
-        for (int i = 0; i < 8; i++)
+        for (u32 i = begin; i < end; i++)
         {
-            children[i]->collectAll(out);
+            TreeBuildTask& task = tasks[i];
+            task.pool.allocate(1, &pool.nodes[task.node].bounds);
+            BuildNode<Split>(task.pool, base, 0, task.triangles, task.depth);
         }
+    });
+
+    // Pela ordem das tarefas: a árvore não depende de que thread acabou primeiro
+    for (TreeBuildTask& task : tasks)
+    {
+        MergeSubtree(pool, task.node, task.pool);
     }
+    UpdateNodeLayers(pool, storage, Split::CHILD_COUNT);
 }
 
-void OctreeNode::clear()
+static void DebugNode(const TreeView& tree, u32 index, s32 childCount, Color color, const Color* childColors)
 {
-    triangles.clear();
-    for (int i = 0; i < 8; i++)
+    const TreeNode node = tree.node(index);
+    DrawBoundingBox(node.bounds, color);
+
+    if (!node.isDivided()) return;
+    for (s32 i = 0; i < childCount; i++)
     {
-        delete children[i];
-        children[i] = nullptr;
+        DebugNode(tree, node.firstChild + i, childCount, childColors[i], childColors);
     }
-    divided = false;
 }
 
-void OctreeNode::debug(Color color) const
+
+Quadtree::Quadtree(const BoundingBox& worldBounds)
 {
-    DrawBoundingBox(bounds, color);
+    setWorldBounds(worldBounds);
+}
 
-    if (divided)
-    {
-        // Cores diferentes para cada octante
-        Color octantColors[8] = {
-            RED, // 0: Back-Left-Bottom
-            GREEN, // 1: Back-Right-Bottom
-            BLUE, // 2: Front-Left-Bottom
-            YELLOW, // 3: Front-Right-Bottom
-            ORANGE, // 4: Back-Left-Top
-            PURPLE, // 5: Back-Right-Top
-            PINK, // 6: Front-Left-Top
-            GRAY // 7: Front-Right-Top
-        };
+void Quadtree::setWorldBounds(const BoundingBox& bounds) 
+{
+    version++;
+    pool.clear();
+    pool.allocate(1, &bounds);
+}
 
-        for (int i = 0; i < 8; i++)
-        {
-            children[i]->debug(octantColors[i]);
-        }
-    }
+
+
+void Quadtree::addTriangle(const Vector3& a, const Vector3& b, const Vector3& c, u32 layers)
+{
+    if (pool.nodes.empty()) return;
+    version++;
+    Triangle tri = { a, b, c };
+    tri.updateBounds();
+    tri.id = (u32)triangleStorage.size();
+    tri.layers = layers;
+    triangleStorage.push_back(tri);
+}
+
+void Quadtree::rebuild()
+{
+    if (pool.nodes.empty()) return;
+    version++;
+    BuildTree<QuadtreeSplit>(pool, triangleStorage, nullptr);
+}
+
+std::vector<const Triangle*>
+Quadtree::getCandidates(const BoundingBox& area, u32 mask) const
+{
+    return QueryTree<QuadtreeSplit::CHILD_COUNT>(MakeTreeView(pool, triangleStorage), area, mask);
+}
+
+std::vector<const Triangle*> Quadtree::getCandidates(const Vector3& point,
+                                                     float radius, u32 mask) const
+{
+    return QueryTree<QuadtreeSplit::CHILD_COUNT>(MakeTreeView(pool, triangleStorage), point, radius, mask);
+}
+
+std::vector<const Triangle*> Quadtree::getCandidates(const Ray& ray,
+                                                     float maxDistance, u32 mask) const
+{
+    return QueryTree<QuadtreeSplit::CHILD_COUNT>(MakeTreeView(pool, triangleStorage), ray, maxDistance, mask);
+}
+
+RayHit Quadtree::raycast(const Ray& ray, float maxDistance,
+                         const RayFilter& filter, u32 mask) const
+{
+    RayHit hit;
+    RaycastBatch<QuadtreeSplit::CHILD_COUNT>(MakeTreeView(pool, triangleStorage), &ray, 1,
+                                             maxDistance, nullptr, &hit, filter, mask);
+    return hit;
 }
 
-int OctreeNode::getTriangleCount() const
+void Quadtree::raycast(const Ray* rays, s32 count, float maxDistance, RayHit* out,
+                       const RayFilter& filter, u32 mask, const float* maxDistances) const
 {
-    int count = triangles.size();
-    if (divided)
+    RaycastBatch<QuadtreeSplit::CHILD_COUNT>(MakeTreeView(pool, triangleStorage), rays, count,
+                                             maxDistance, maxDistances, out, filter, mask);
+}
+
+void Quadtree::debug() const
+{
+    if (pool.nodes.empty()) return;
+    const Color quadColors[4] = { GREEN, YELLOW, ORANGE, PURPLE };
+    DebugNode(MakeTreeView(pool, triangleStorage), 0, QuadtreeSplit::CHILD_COUNT, BLUE, quadColors);
+}
+
+void Quadtree::stats() const
+{
+    if (pool.nodes.empty()) return;
+    int unique = getTriangleCount();
+    int references = (int)pool.indices.size();
+    LogInfo("Total Triangles: %d\n", unique);
+    LogInfo("Quadtree Triangles: %d\n", references);
+    if (unique > 0)
     {
-        for (int i = 0; i < 8; i++)
-        {
-            count += children[i]->getTriangleCount();
-        }
+        LogInfo("Duplication factor: %.2f\n", (float)references / (float)unique);
     }
-    return count;
+    pool.stats(QuadtreeSplit::CHILD_COUNT);
 }
 
 
 Octree::Octree(const BoundingBox& worldBounds) 
 {
-    root = new OctreeNode(worldBounds);
+    setWorldBounds(worldBounds);
 }
 
-Octree::~Octree() { delete root; }
-
 void Octree::setWorldBounds(const BoundingBox& bounds) 
 {
-    if (root) delete root;
-    root = new OctreeNode(bounds);
+    version++;
+    pool.clear();
+    compactNodes = CompactNodes();
+    pool.allocate(1, &bounds);
 }
 
 
-void Octree::addTriangle(const Vector3& a, const Vector3& b, const Vector3& c)
+void Octree::addTriangle(const Vector3& a, const Vector3& b, const Vector3& c, u32 layers)
 {
-    if (!root) return;
+    if (!hasRoot()) return;
+    if (!compactStorage.empty()) expand();
+    version++;
     Triangle tri = { a, b, c };
     tri.updateBounds();
+    tri.id = (u32)triangleStorage.size();
+    tri.layers = layers;
     triangleStorage.push_back(tri);
+    if (!polygonOf.empty()) polygonOf.push_back(NO_POLYGON);
    
+}
+
+// O leque vai para triangleStorage como qualquer triângulo (raycasts, árvore,
+// getCandidates); polygonOf liga cada um ao polígono, que é o que o Collider testa
+void Octree::addPolygon(const CollisionPolygon& polygon, const Vector3* points)
+{
+    if (!hasRoot() || polygon.pointCount < 3) return;
+    if (!compactStorage.empty()) expand();
+
+    u32 index = (u32)polygonStorage.size();
+    u32 first = (u32)triangleStorage.size();
+    Selector::addPolygon(polygon, points);
+
+    // Os triângulos de antes do primeiro polígono também ficam com NO_POLYGON
+    polygonOf.resize(triangleStorage.size(), NO_POLYGON);
+    polygonStorage.push_back(polygon);
+    CollisionPolygon& stored = polygonStorage.back();
+    stored.firstTriangle = first;
+    stored.firstPoint = (u32)polygonPoints.size();
+    polygonPoints.insert(polygonPoints.end(), points, points + polygon.pointCount);
+    edgePlanes.resize(polygonPoints.size());
+    BuildPolygonPlanes(stored, &polygonPoints[stored.firstPoint], &edgePlanes[stored.firstPoint]);
+    for (u32 id = first; id < (u32)triangleStorage.size(); id++)
+    {
+        polygonOf[id] = index;
+    }
 }
     
     void Octree::rebuild() 
     {
-        if (!root) return;
-        root->clear();
-        for (const auto& tri : triangleStorage) 
+        rebuild(nullptr);
+    }
+
+    void Octree::rebuild(ThreadPool* threads)
+    {
+        if (!hasRoot()) return;
+        if (!compactStorage.empty()) expand();
+        version++;
+        // Os polígonos cresceram um a um (addPolygon): sem a folga dos vectors
+        polygonStorage.shrink_to_fit();
+        polygonPoints.shrink_to_fit();
+        edgePlanes.shrink_to_fit();
+        polygonOf.shrink_to_fit();
+        BuildTree<OctreeSplit>(pool, triangleStorage, threads);
+        if (compact) compress();
+    }
+
+    void Octree::setCompact(bool enable)
+    {
+        compact = enable;
+        if (compact && !triangleStorage.empty() && !pool.nodes.empty()) compress();
+        if (!compact && !compactStorage.empty()) expand();
+    }
+
+    // Os triângulos passam para CompactTriangles e os nós para CompactNodes;
+    // triangleStorage e o pool ficam sem memória reservada
+    void Octree::compress()
+    {
+        compactStorage.build(triangleStorage);
+        std::vector<Triangle>().swap(triangleStorage);
+        if (compactNodes.build(pool, compactStorage.getCount()))
+        {
+            pool = NodePool();
+        }
+        else
+        {
+            LogWarning("Octree: nodes too large to compact, keeping the full node pool");
+        }
+
+        if (polygonStorage.empty()) return;
+        if (compactPolygons.build(polygonStorage, compactStorage))
         {
-            root->insert(&tri);
+            std::vector<CollisionPolygon>().swap(polygonStorage);
+            std::vector<Vector3>().swap(polygonPoints);
+            std::vector<Vector4>().swap(edgePlanes);
+        }
+        else
+        {
+            LogWarning("Octree: polygons too large to compact, keeping them as they are");
         }
-        triangleStorage.clear();
+    }
+
+    void Octree::expandPolygons(std::vector<CollisionPolygon>& polygons, std::vector<Vector3>& points,
+                                std::vector<Vector4>& planes) const
+    {
+        u32 count = compactPolygons.getCount();
+        u32 pointCount = (u32)(compactPolygons.points.size() + compactPolygons.shortPoints.size());
+        polygons.resize(count);
+        points.resize(pointCount);
+        planes.resize(pointCount);
+        u32 first = 0;
+        for (u32 i = 0; i < count; i++)
+        {
+            compactPolygons.decode(i, compactStorage, polygons[i], &points[first], &planes[first]);
+            polygons[i].firstPoint = first;
+            first += polygons[i].pointCount;
+        }
+    }
+
+    void Octree::expand()
+    {
+        // Antes dos triângulos: os contornos são índices na pool de posições
+        if (!compactPolygons.empty())
+        {
+            expandPolygons(polygonStorage, polygonPoints, edgePlanes);
+            compactPolygons = CompactPolygons();
+        }
+
+        u32 count = compactStorage.getCount();
+        triangleStorage.resize(count);
+        for (u32 i = 0; i < count; i++)
+        {
+            compactStorage.decode(i, triangleStorage[i]);
+        }
+        compactStorage = CompactTriangles();
+        if (!compactNodes.empty())
+        {
+            compactNodes.expand(pool);
+            compactNodes = CompactNodes();
+        }
+    }
+
+    int Octree::getTriangleCount() const
+    {
+        return compactStorage.empty() ? (int)triangleStorage.size() : (int)compactStorage.getCount();
+    }
+
+    Triangle Octree::getTriangleCopy(u32 id) const
+    {
+        if (compactStorage.empty()) return triangleStorage[id];
+        Triangle tri;
+        compactStorage.decode(id, tri);
+        return tri;
+    }
+
+    size_t Octree::getMemory() const
+    {
+        size_t polygons = polygonStorage.capacity() * sizeof(CollisionPolygon) + polygonOf.capacity() * sizeof(u32)
+                        + polygonPoints.capacity() * sizeof(Vector3) + edgePlanes.capacity() * sizeof(Vector4);
+        return triangleStorage.capacity() * sizeof(Triangle) + compactStorage.getMemory()
+             + pool.getMemory() + compactNodes.getMemory() + polygons + compactPolygons.getMemory();
     }
     
    
-    std::vector<const Triangle*> Octree::getCandidates(const BoundingBox& area) const {
-        if (!root) return {};
-        std::vector<const Triangle*> candidates;
-        candidates.reserve(64);
-        root->collectTriangles(area, candidates);
-        return candidates;
+    std::vector<const Triangle*> Octree::getCandidates(const BoundingBox& area, u32 mask) const {
+        return QueryTree<OctreeSplit::CHILD_COUNT>(MakeTreeView(pool, triangleStorage, &compactStorage, &compactNodes), area, mask);
+    }
+    
+    std::vector<const Triangle*> Octree::getCandidates(const Vector3& point, float radius, u32 mask) const 
+    {
+        return QueryTree<OctreeSplit::CHILD_COUNT>(MakeTreeView(pool, triangleStorage, &compactStorage, &compactNodes), point, radius, mask);
     }
     
-    std::vector<const Triangle*> Octree::getCandidates(const Vector3& point, float radius) const 
+    std::vector<const Triangle*> Octree::getCandidates(const Ray& ray, float maxDistance, u32 mask) const 
+    {
+        return QueryTree<OctreeSplit::CHILD_COUNT>(MakeTreeView(pool, triangleStorage, &compactStorage, &compactNodes), ray, maxDistance, mask);
+    }
+
+    // Ordena os ids: os leques de um polígono são seguidos, por isso cada
+    // polígono entra uma vez (out.polygons) no lugar dos seus triângulos. Na
+    // compacta descodifica só o que BuildCollisionTriangle lê (decodeShape),
+    // sem passar por um Triangle completo por candidato
+    void Octree::getCollisionCandidates(const BoundingBox& area, const Vector3& eRadius, u32 mask,
+                                        CollisionCandidates& out) const
     {
-        if (!root) return {};
-        std::vector<const Triangle*> candidates;
-        candidates.reserve(32);
-        root->collectTriangles(point, radius, candidates);
-        return candidates;
+        if (compactStorage.empty() && polygonOf.empty())
+        {
+            Selector::getCollisionCandidates(area, eRadius, mask, out);
+            return;
+        }
+
+        COLLISION_STAT_TIMER(queryTime);
+        COLLISION_STAT_ADD(queries, 1);
+
+        TreeView tree = MakeTreeView(pool, triangleStorage, &compactStorage, &compactNodes);
+        if (!tree.hasRoot() || !(tree.nodeLayers(0) & mask)) return;
+        QueryMarks& marks = GetQueryMarks();
+        marks.begin(tree.triangleCount);
+#ifdef COLLISION_STATS
+        u32 duplicates = marks.duplicates;
+#endif
+
+        DecodeBuffer& buffer = GetDecodeBuffer();
+        buffer.ids.clear();
+        CollectTriangles<OctreeSplit::CHILD_COUNT>(tree, 0, BoxTest(area, tree.compactNodes),
+                                                   [&](u32 id) { buffer.ids.push_back(id); }, mask, marks);
+        std::sort(buffer.ids.begin(), buffer.ids.end());
+
+        // Reservado antes: os ponteiros para buffer.candidates não mudam de sítio
+        if (tree.compact) buffer.candidates.resize(buffer.ids.size());
+
+        u32 lastPolygon = NO_POLYGON;
+        size_t decoded = 0;
+        size_t firstTriangle = out.triangles.size();
+        size_t firstPolygon = out.polygons.size();
+        for (u32 id : buffer.ids)
+        {
+            u32 polygon = polygonOf.empty() ? NO_POLYGON : polygonOf[id];
+            if (polygon != NO_POLYGON)
+            {
+                if (polygon == lastPolygon) continue;
+                lastPolygon = polygon;
+
+                // Compacta: o contorno sai da pool de posições e os planos refazem-se
+                CollisionPolygon decoded;
+                const CollisionPolygon* source = &decoded;
+                const Vector3* points;
+                const Vector4* planes;
+                if (compactPolygons.empty())
+                {
+                    source = &polygonStorage[polygon];
+                    points = &polygonPoints[source->firstPoint];
+                    planes = &edgePlanes[source->firstPoint];
+                }
+                else
+                {
+                    u32 count = compactPolygons.polygons[polygon].pointCount;
+                    if (buffer.outline.size() < count) buffer.outline.resize(count);
+                    if (buffer.edgePlanes.size() < count) buffer.edgePlanes.resize(count);
+                    compactPolygons.decode(polygon, compactStorage, decoded,
+                                           buffer.outline.data(), buffer.edgePlanes.data());
+                    points = buffer.outline.data();
+                    planes = buffer.edgePlanes.data();
+                }
+
+                out.polygons.push_back({ source->bounds, source->firstTriangle });
+                out.ePolygons.emplace_back();
+                BuildEllipsoidPolygon(*source, points, planes, eRadius, out.ePolygons.back(), out.corners);
+            }
+            else if (tree.compact)
+            {
+                compactStorage.decodeShape(id, buffer.candidates[decoded]);
+                out.triangles.push_back(&buffer.candidates[decoded++]);
+            }
+            else
+            {
+                out.triangles.push_back(tree.triangles + id);
+            }
+        }
+
+        out.eSpace.resize(out.triangles.size());
+        for (size_t i = firstTriangle; i < out.triangles.size(); i++)
+        {
+            BuildCollisionTriangle(*out.triangles[i], eRadius, out.eSpace[i]);
+        }
+        COLLISION_STAT_ADD(candidates, out.triangles.size() - firstTriangle + out.polygons.size() - firstPolygon);
+        COLLISION_STAT_ADD(duplicates, marks.duplicates - duplicates);
     }
     
-    std::vector<const Triangle*> Octree::getCandidates(const Ray& ray, float maxDistance  ) const 
+    RayHit Octree::raycast(const Ray& ray, float maxDistance,
+                           const RayFilter& filter, u32 mask) const
     {
-        if (!root) return {};
-        std::vector<const Triangle*> candidates;
-        candidates.reserve(16);
-        root->collectTriangles(ray, maxDistance, candidates);
-        return candidates;
+        RayHit hit;
+        RaycastBatch<OctreeSplit::CHILD_COUNT>(MakeTreeView(pool, triangleStorage, &compactStorage, &compactNodes), &ray, 1,
+                                               maxDistance, nullptr, &hit, filter, mask);
+        return hit;
     }
     
+    void Octree::raycast(const Ray* rays, s32 count, float maxDistance, RayHit* out,
+                         const RayFilter& filter, u32 mask, const float* maxDistances) const
+    {
+        RaycastBatch<OctreeSplit::CHILD_COUNT>(MakeTreeView(pool, triangleStorage, &compactStorage, &compactNodes), rays, count,
+                                               maxDistance, maxDistances, out, filter, mask);
+    }
+
     // Query por bounding box do player/objeto
     std::vector<const Triangle*> Octree::getCandidatesForObject(const Vector3& position, const Vector3& size) const 
     {
@@ -571,8 +1497,20 @@ void Octree::addTriangle(const Vector3& a, const Vector3& b, const Vector3& c)
     
     void Octree::debug() const 
     {
-        if (!root) return;
-        root->debug();
+        if (!hasRoot()) return;
+
+        // Cores diferentes para cada octante
+        const Color octantColors[8] = {
+            RED, // 0: Back-Left-Bottom
+            GREEN, // 1: Back-Right-Bottom
+            BLUE, // 2: Front-Left-Bottom
+            YELLOW, // 3: Front-Right-Bottom
+            ORANGE, // 4: Back-Left-Top
+            PURPLE, // 5: Back-Right-Top
+            PINK, // 6: Front-Left-Top
+            GRAY // 7: Front-Right-Top
+        };
+        DebugNode(MakeTreeView(pool, triangleStorage, &compactStorage, &compactNodes), 0, OctreeSplit::CHILD_COUNT, BLUE, octantColors);
     }
  
  
@@ -580,11 +1518,343 @@ void Octree::addTriangle(const Vector3& a, const Vector3& b, const Vector3& c)
     // Helper para estatísticas
     void Octree::stats() const 
     {
-        if (!root) return;
-        LogInfo("Total Triangles: %d\n", getTriangleCount());
-        LogInfo("Octree Triangles: %d\n", root->getTriangleCount());
-        LogInfo("Memory efficiency: %.1f%%\n", (float)getTriangleCount() / (float)root->getTriangleCount() * 100.0f);
+        if (!hasRoot()) return;
+
+        // Nós compactos: as contas são feitas sobre uma cópia em TreeNode
+        NodePool expanded;
+        if (!compactNodes.empty()) compactNodes.expand(expanded);
+        const NodePool& nodes = compactNodes.empty() ? pool : expanded;
+
+        int unique = getTriangleCount();
+        int references = (int)nodes.indices.size();
+        LogInfo("Total Triangles: %d\n", unique);
+        LogInfo("Octree Triangles: %d\n", references);
+        if (unique > 0)
+        {
+            LogInfo("Memory efficiency: %.1f%%\n", (float)unique / (float)references * 100.0f);
+            // Quantas vezes, em média, um triângulo aparece em nós diferentes
+            LogInfo("Duplication factor: %.2f\n", (float)references / (float)unique);
+            LogInfo("Duplicates skipped: %u\n", GetQueryMarks().duplicates);
+        }
+        if (getPolygonCount() > 0)
+        {
+            u32 fans = 0;
+            for (u32 polygon : polygonOf) fans += polygon != NO_POLYGON;
+            LogInfo("Polygons: %u (%u triangles in fans)", (u32)getPolygonCount(), fans);
+        }
+        LogInfo("Memory: %.1f KB%s", getMemory() / 1024.0f, compactStorage.empty() ? "" : " (compact)");
+        nodes.stats(OctreeSplit::CHILD_COUNT);
+        if (!compactNodes.empty())
+        {
+            LogInfo("Compact nodes: %u bytes (%u per node, %u-bit indices, triangles %u bytes)",
+                    (u32)compactNodes.getMemory(), (u32)sizeof(CompactNode),
+                    compactNodes.indices.empty() ? 16 : 32, (u32)compactStorage.getMemory());
+        }
+        if (!compactPolygons.empty())
+        {
+            LogInfo("Compact polygons: %u bytes (%u per polygon, %u-bit points)",
+                    (u32)compactPolygons.getMemory(), (u32)sizeof(CompactPolygon),
+                    compactPolygons.points.empty() ? 16 : 32);
+        }
     }
 
 
-    
\ No newline at end of file
+// Cache em disco da octree
+//
+// Layout: OctreeCacheHeader, triangleCount * (9 floats A, B, C + u32 layers;
+// o resto do Triangle recalcula-se com updateBounds), e o NodePool tal como
+// está em memória: nodeCount TreeNode e indexCount índices (u32). Tudo é lido de uma
+// vez por BinaryFile::open e os dois arrays copiados sem percorrer a árvore.
+// No fim os polígonos (addPolygon): polygonCount OctreeCachePolygon e os
+// polygonPointCount pontos de todos, seguidos.
+
+#define OCTREE_CACHE_MAGIC   0x43544F42  // "BOTC"
+#define OCTREE_CACHE_VERSION 4
+#define OCTREE_CACHE_MAX_DEPTH 32
+
+struct OctreeCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u64 key;
+    u32 triangleCount;
+    u32 nodeCount;
+    u32 indexCount;
+    u32 polygonCount;
+    u32 polygonPointCount;
+    BoundingBox bounds;
+};
+
+// Os planos das arestas e bounds recalculam-se com BuildPolygonPlanes
+struct OctreeCachePolygon
+{
+    Vector3 normal;
+    float planeD;
+    u32 layers;
+    u32 sourceTriangles;
+    u32 firstTriangle;
+    u32 pointCount;
+};
+
+template <typename T>
+static void Put(std::vector<u8>& out, const T& value)
+{
+    const u8* bytes = (const u8*)&value;
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+u64 Octree::getCacheKey(u64 sourceHash) const
+{
+    // Mudar o formato ou um parâmetro de construção invalida as caches antigas
+    const s32 params[] = { OCTREE_CACHE_VERSION, TreeNode::MAX_TRIANGLES, TreeNode::MAX_DEPTH };
+    const float minSize = TreeNode::MIN_SIZE;
+
+    u64 hash = HashFNV1a(&sourceHash, sizeof(sourceHash));
+    hash = HashFNV1a(params, sizeof(params), hash);
+    hash = HashFNV1a(&minSize, sizeof(minSize), hash);
+    if (!pool.nodes.empty()) hash = HashFNV1a(&pool.nodes[0].bounds, sizeof(BoundingBox), hash);
+    else if (!compactNodes.empty()) hash = HashFNV1a(&compactNodes.bounds, sizeof(BoundingBox), hash);
+    return hash;
+}
+
+// Um ficheiro válido tem de dar uma árvore que se pode percorrer: filhos
+// sempre depois do pai e dentro do array, intervalos de índices dentro do
+// array e índices de triângulos que existem
+static bool ValidateCachePool(const NodePool& pool, u32 triangleCount)
+{
+    const u32 nodeCount = (u32)pool.nodes.size();
+    const u64 indexCount = pool.indices.size();
+
+    for (u32 index : pool.indices)
+    {
+        if (index >= triangleCount) return false;
+    }
+
+    std::vector<u8> depth(nodeCount, 0);
+    for (u32 i = 0; i < nodeCount; i++)
+    {
+        const TreeNode& node = pool.nodes[i];
+        if ((u64)node.firstIndex + node.indexCount > indexCount) return false;
+        if (!node.isDivided()) continue;
+
+        if (node.firstChild <= i || (u64)node.firstChild + OctreeSplit::CHILD_COUNT > nodeCount) return false;
+        if (depth[i] >= OCTREE_CACHE_MAX_DEPTH) return false;
+        for (s32 c = 0; c < OctreeSplit::CHILD_COUNT; c++)
+        {
+            depth[node.firstChild + c] = depth[i] + 1;
+        }
+    }
+    return true;
+}
+
+bool Octree::saveCache(const char* filename, u64 key) const
+{
+    if (!hasRoot()) return false;
+
+    // O ficheiro tem sempre TreeNode: os nós compactos são expandidos
+    NodePool expanded;
+    if (!compactNodes.empty()) compactNodes.expand(expanded);
+    const NodePool& pool = compactNodes.empty() ? this->pool : expanded;
+
+    // Os polígonos compactos também: o ficheiro guarda sempre os pontos
+    std::vector<CollisionPolygon> expandedPolygons;
+    std::vector<Vector3> expandedPoints;
+    std::vector<Vector4> expandedPlanes;
+    if (!compactPolygons.empty()) expandPolygons(expandedPolygons, expandedPoints, expandedPlanes);
+    const std::vector<CollisionPolygon>& polygonStorage = compactPolygons.empty() ? this->polygonStorage : expandedPolygons;
+    const std::vector<Vector3>& polygonPoints = compactPolygons.empty() ? this->polygonPoints : expandedPoints;
+
+    OctreeCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = OCTREE_CACHE_MAGIC;
+    header.version = OCTREE_CACHE_VERSION;
+    header.key = key;
+    header.triangleCount = (u32)getTriangleCount();
+    header.nodeCount = (u32)pool.nodes.size();
+    header.indexCount = (u32)pool.indices.size();
+    header.polygonCount = (u32)polygonStorage.size();
+    header.polygonPointCount = (u32)polygonPoints.size();
+    header.bounds = pool.nodes[0].bounds;
+
+    const u8* nodeBytes = (const u8*)pool.nodes.data();
+    const u8* indexBytes = (const u8*)pool.indices.data();
+
+    std::vector<u8> out;
+    out.reserve(sizeof(header) + header.triangleCount * (3 * sizeof(Vector3) + sizeof(u32))
+                + pool.nodes.size() * sizeof(TreeNode) + pool.indices.size() * sizeof(u32)
+                + header.polygonCount * sizeof(OctreeCachePolygon) + header.polygonPointCount * sizeof(Vector3));
+    Put(out, header);
+    if (compactStorage.empty())
+    {
+        for (const Triangle& tri : triangleStorage)
+        {
+            Put(out, tri.pointA);
+            Put(out, tri.pointB);
+            Put(out, tri.pointC);
+            Put(out, tri.layers);
+        }
+    }
+    else
+    {
+        for (u32 i = 0; i < compactStorage.getCount(); i++)
+        {
+            const u32* corner = &compactStorage.corners[i * 3];
+            Put(out, compactStorage.positions[corner[0]]);
+            Put(out, compactStorage.positions[corner[1]]);
+            Put(out, compactStorage.positions[corner[2]]);
+            Put(out, (u32)compactStorage.layers[i]);
+        }
+    }
+    out.insert(out.end(), nodeBytes, nodeBytes + pool.nodes.size() * sizeof(TreeNode));
+    out.insert(out.end(), indexBytes, indexBytes + pool.indices.size() * sizeof(u32));
+    for (const CollisionPolygon& polygon : polygonStorage)
+    {
+        OctreeCachePolygon record;
+        record.normal = polygon.normal;
+        record.planeD = polygon.planeD;
+        record.layers = polygon.layers;
+        record.sourceTriangles = polygon.sourceTriangles;
+        record.firstTriangle = polygon.firstTriangle;
+        record.pointCount = polygon.pointCount;
+        Put(out, record);
+    }
+    const u8* pointBytes = (const u8*)polygonPoints.data();
+    out.insert(out.end(), pointBytes, pointBytes + polygonPoints.size() * sizeof(Vector3));
+
+    BinaryFile file;
+    if (!file.create(out.data(), (u32)out.size()) || !file.save(filename))
+    {
+        LogWarning("Octree cache: could not write %s", filename);
+        return false;
+    }
+
+    LogInfo("Octree cache saved: %s (%u triangles, %u polygons, %u nodes, %u bytes)",
+            filename, header.triangleCount, header.polygonCount, header.nodeCount, (u32)out.size());
+    return true;
+}
+
+bool Octree::loadCache(const char* filename, u64 key)
+{
+    if (!FileExists(filename)) return false;
+
+    BinaryFile file;
+    if (!file.open(filename)) return false;
+
+    OctreeCacheHeader header;
+    if (file.readBytes(&header, sizeof(header)) != sizeof(header)) return false;
+    if (header.magic != OCTREE_CACHE_MAGIC || header.version != OCTREE_CACHE_VERSION || header.key != key)
+    {
+        LogWarning("Octree cache: %s is stale, rebuilding", filename);
+        return false;
+    }
+
+    // O tamanho tem de bater certo antes de alocar o que o header pede
+    u64 expected = sizeof(header) + (u64)header.triangleCount * (3 * sizeof(Vector3) + sizeof(u32))
+                 + (u64)header.nodeCount * sizeof(TreeNode) + (u64)header.indexCount * sizeof(u32)
+                 + (u64)header.polygonCount * sizeof(OctreeCachePolygon)
+                 + (u64)header.polygonPointCount * sizeof(Vector3);
+    if (header.nodeCount == 0 || expected != file.getFileSize())
+    {
+        LogWarning("Octree cache: %s is corrupt, rebuilding", filename);
+        return false;
+    }
+
+    // Lê para temporários e só troca no fim: se falhar, a octree fica intacta
+    std::vector<Triangle> storage(header.triangleCount);
+    for (u32 i = 0; i < header.triangleCount; i++)
+    {
+        Vector3 points[3];
+        u32 layers;
+        if (file.readBytes(points, sizeof(points)) != sizeof(points)) return false;
+        if (file.readBytes(&layers, sizeof(layers)) != sizeof(layers)) return false;
+
+        Triangle& tri = storage[i];
+        tri.pointA = points[0];
+        tri.pointB = points[1];
+        tri.pointC = points[2];
+        tri.updateBounds();
+        tri.id = i;
+        tri.layers = layers;
+    }
+
+    NodePool loaded;
+    loaded.nodes.resize(header.nodeCount);
+    loaded.indices.resize(header.indexCount);
+    u32 nodeBytes = header.nodeCount * (u32)sizeof(TreeNode);
+    u32 indexBytes = header.indexCount * (u32)sizeof(u32);
+    if (file.readBytes(loaded.nodes.data(), nodeBytes) != nodeBytes ||
+        (indexBytes && file.readBytes(loaded.indices.data(), indexBytes) != indexBytes) ||
+        !ValidateCachePool(loaded, header.triangleCount))
+    {
+        LogWarning("Octree cache: %s is corrupt, rebuilding", filename);
+        return false;
+    }
+    // Não confia nas camadas dos nós do ficheiro: refaz a partir dos triângulos
+    UpdateNodeLayers(loaded, storage, OctreeSplit::CHILD_COUNT);
+
+    // Cada polígono tem de ter o seu leque inteiro dentro dos triângulos, sem
+    // partilhar nenhum com outro, e os pontos têm de somar polygonPointCount
+    std::vector<CollisionPolygon> polygons(header.polygonCount);
+    std::vector<u32> owner;
+    if (header.polygonCount > 0) owner.assign(header.triangleCount, NO_POLYGON);
+    u64 pointCount = 0;
+    for (u32 i = 0; i < header.polygonCount; i++)
+    {
+        OctreeCachePolygon record;
+        if (file.readBytes(&record, sizeof(record)) != sizeof(record)) return false;
+        pointCount += record.pointCount;
+        if (record.pointCount < 3 || pointCount > header.polygonPointCount ||
+            (u64)record.firstTriangle + record.pointCount - 2 > header.triangleCount)
+        {
+            LogWarning("Octree cache: %s is corrupt, rebuilding", filename);
+            return false;
+        }
+
+        CollisionPolygon& polygon = polygons[i];
+        polygon.normal = record.normal;
+        polygon.planeD = record.planeD;
+        polygon.layers = record.layers;
+        polygon.sourceTriangles = record.sourceTriangles;
+        polygon.firstTriangle = record.firstTriangle;
+        polygon.firstPoint = (u32)(pointCount - record.pointCount);
+        polygon.pointCount = record.pointCount;
+        for (u32 id = record.firstTriangle; id < record.firstTriangle + record.pointCount - 2; id++)
+        {
+            if (owner[id] != NO_POLYGON)
+            {
+                LogWarning("Octree cache: %s is corrupt, rebuilding", filename);
+                return false;
+            }
+            owner[id] = i;
+        }
+    }
+    if (pointCount != header.polygonPointCount)
+    {
+        LogWarning("Octree cache: %s is corrupt, rebuilding", filename);
+        return false;
+    }
+    std::vector<Vector3> points(header.polygonPointCount);
+    std::vector<Vector4> planes(header.polygonPointCount);
+    u32 pointBytes = header.polygonPointCount * (u32)sizeof(Vector3);
+    if (pointBytes && file.readBytes(points.data(), pointBytes) != pointBytes) return false;
+    for (CollisionPolygon& polygon : polygons)
+    {
+        BuildPolygonPlanes(polygon, &points[polygon.firstPoint], &planes[polygon.firstPoint]);
+    }
+
+    triangleStorage.swap(storage);
+    pool.nodes.swap(loaded.nodes);
+    pool.indices.swap(loaded.indices);
+    polygonStorage.swap(polygons);
+    polygonPoints.swap(points);
+    edgePlanes.swap(planes);
+    polygonOf.swap(owner);
+    compactStorage.clear();
+    compactPolygons.clear();
+    version++;
+    if (compact) compress();
+
+    LogInfo("Octree cache loaded: %s (%u triangles, %u polygons, %u nodes)", filename,
+            header.triangleCount, header.polygonCount, header.nodeCount);
+    return true;
+}
@@ -85,4 +85,27 @@ void LogInfo( const char *msg, ... )
 	va_start( args, msg );
 	LogMessage( 0, msg, args );
 	va_end( args );
-}
\ No newline at end of file
+}
+
+
+u64 HashFNV1a( const void *data, size_t size, u64 hash )
+{
+	const u8* bytes = (const u8*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+
+std::string ChangeFileExtension( const char *fileName, const char *extension )
+{
+	std::string result = fileName;
+	size_t dot = result.find_last_of( '.' );
+	size_t slash = result.find_last_of( "/\\" );
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+		result.erase( dot );
+	return result + extension;
+}